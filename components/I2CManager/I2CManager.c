@@ -1,64 +1,283 @@
 #include "I2CManager.h"
 #include <esp_log.h>
-#include <driver/i2c.h>
+#include <esp_timer.h>
 
-#define SDA_IO 25         /*!< gpio number for I2C master data  */
-#define SCL_IO 26         /*!< gpio number for I2C master clock */
+static const char *TAG = "I2C Manager";
 
-#define FREQ_HZ 100000    /*!< I2C master clock frequency */
-#define TX_BUF_DISABLE 0  /*!< I2C master doesn't need buffer */
-#define RX_BUF_DISABLE 0  /*!< I2C master doesn't need buffer */
+SemaphoreHandle_t xI2CBinary[I2CMANAGER_NUM_PORTS];
 
-static const char *TAG = "I2C Manager";
+static const i2cmanager_backend_t *backends[I2CMANAGER_NUM_PORTS];
+static void *backend_ctx[I2CMANAGER_NUM_PORTS];
+static uint32_t bus_timeout_ms[I2CMANAGER_NUM_PORTS] = {I2CMANAGER_DEF_TIMEOUT_MS, I2CMANAGER_DEF_TIMEOUT_MS};
+static i2cmanager_dev_t devices[I2CMANAGER_MAX_DEVICES];                                        /*!< Attached at setup, looked up by the engine */
+
+static esp_err_t I2CMANAGERInitiateSempahores(uint8_t port);
+static bool I2CMANAGERSdaLow(uint8_t port);
+static esp_err_t I2CMANAGERTransfer(const i2cmanager_dev_t *dev, i2cmanager_op_t op, uint8_t reg, uint8_t *buff, size_t len, int64_t deadline_us);
+
+esp_err_t I2CMANAGER_dev_write(const i2cmanager_dev_t *dev, uint8_t reg, const uint8_t *buff, size_t len)
+{
+  return I2CMANAGERTransfer(dev, I2CMANAGER_OP_WRITE, reg, (uint8_t *)buff, len, 0);
+}
+
+esp_err_t I2CMANAGER_dev_read(const i2cmanager_dev_t *dev, uint8_t reg, uint8_t *buff, size_t len)
+{
+  return I2CMANAGERTransfer(dev, I2CMANAGER_OP_READ, reg, buff, len, 0);
+}
+
+esp_err_t I2CMANAGER_dev_write_until(const i2cmanager_dev_t *dev, uint8_t reg, const uint8_t *buff, size_t len, int64_t deadline_us)
+{
+  return I2CMANAGERTransfer(dev, I2CMANAGER_OP_WRITE, reg, (uint8_t *)buff, len, deadline_us);
+}
+
+esp_err_t I2CMANAGER_dev_read_until(const i2cmanager_dev_t *dev, uint8_t reg, uint8_t *buff, size_t len, int64_t deadline_us)
+{
+  return I2CMANAGERTransfer(dev, I2CMANAGER_OP_READ, reg, buff, len, deadline_us);
+}
+
+TickType_t I2CMANAGER_ticks_until(int64_t deadline_us)
+{
+  int64_t left_us = deadline_us - esp_timer_get_time();
+  int64_t tick_us = (int64_t)portTICK_PERIOD_MS * 1000;
+
+  return left_us > 0 ? (TickType_t)((left_us + tick_us - 1) / tick_us) : 0;
+}
+
+esp_err_t I2CMANAGER_take_until(uint8_t port, int64_t deadline_us)
+{
+  if(!deadline_us)
+    return I2CMANAGER_take(port, pdMS_TO_TICKS(I2CMANAGER_LOCK_MS));
+
+  TickType_t left = I2CMANAGER_ticks_until(deadline_us);
+
+  if(!left)
+    return I2CMANAGER_ERR_DEADLINE;
+
+  return I2CMANAGER_take(port, left) == ESP_OK ? ESP_OK : I2CMANAGER_ERR_DEADLINE;
+}
+
+esp_err_t I2CMANAGER_recover(uint8_t port)
+{
+  if(port >= I2CMANAGER_NUM_PORTS)
+    return ESP_ERR_INVALID_ARG;
+
+  if(!backends[port])
+    return ESP_ERR_INVALID_STATE;
+
+  if(!backends[port]->recover)
+    return ESP_ERR_NOT_SUPPORTED;
+
+  ESP_LOGD(TAG, "Recovering Bus. Port: %d", port);
+
+  return backends[port]->recover(backend_ctx[port], port);
+}
+
+esp_err_t I2CMANAGER_set_backend(uint8_t port, const i2cmanager_backend_t *backend, void *ctx)
+{
+  ESP_LOGD(TAG, "Setting Backend. Port: %d", port);
+
+  if(port >= I2CMANAGER_NUM_PORTS || !backend || !backend->write || !backend->read)
+    return ESP_ERR_INVALID_ARG;
+
+  backends[port] = backend;
+  backend_ctx[port] = ctx;
+
+  return I2CMANAGERInitiateSempahores(port);
+}
+
+esp_err_t I2CMANAGER_set_timeout(uint8_t port, uint32_t timeout_ms)
+{
+  if(port >= I2CMANAGER_NUM_PORTS || !timeout_ms)
+    return ESP_ERR_INVALID_ARG;
+
+  bus_timeout_ms[port] = timeout_ms;
+
+  return ESP_OK;
+}
+
+esp_err_t I2CMANAGER_attach(const i2cmanager_dev_config_t *cfg, i2cmanager_dev_t **dev)
+{
+  i2cmanager_dev_t *slot = NULL;
+
+  ESP_LOGD(TAG, "Attaching Device. Port: %d Adr: 0x%02x", cfg->port, cfg->adr);
 
-SemaphoreHandle_t xI2CBinary;
+  if(cfg->port >= I2CMANAGER_NUM_PORTS || cfg->adr > 0x7F || !dev)
+    return ESP_ERR_INVALID_ARG;
 
-static esp_err_t I2CMANAGERInstallDrivers();
-static esp_err_t I2CMANAGERInitiateSempahores();
+  if(!backends[cfg->port])
+    return ESP_ERR_INVALID_STATE;
 
-esp_err_t I2CMANAGER_initiate()
+  for(uint8_t x = 0; x < I2CMANAGER_MAX_DEVICES; x++)
+  {
+    if(devices[x].attached && devices[x].cfg.port == cfg->port && devices[x].cfg.adr == cfg->adr)
+      return ESP_ERR_INVALID_STATE;
+
+    if(!devices[x].attached && !slot)
+      slot = &devices[x];
+  }
+
+  if(!slot)
+    return ESP_ERR_NO_MEM;
+
+  slot->cfg = *cfg;
+  slot->timeout = pdMS_TO_TICKS(cfg->timeout_ms ? cfg->timeout_ms : bus_timeout_ms[cfg->port]);
+  slot->attached = true;
+  *dev = slot;
+
+  return ESP_OK;
+}
+
+esp_err_t I2CMANAGER_detach(i2cmanager_dev_t *dev)
+{
+  if(!dev || !dev->attached)
+    return ESP_ERR_INVALID_ARG;
+
+  dev->attached = false;
+
+  return ESP_OK;
+}
+
+TickType_t I2CMANAGER_timeout(uint8_t port, uint8_t adr)
+{
+  if(port >= I2CMANAGER_NUM_PORTS)
+    return 0;
+
+  for(uint8_t x = 0; x < I2CMANAGER_MAX_DEVICES; x++)
+    if(devices[x].attached && devices[x].cfg.port == port && devices[x].cfg.adr == adr)
+      return devices[x].timeout;
+
+  return pdMS_TO_TICKS(bus_timeout_ms[port]);
+}
+
+void I2CMANAGER_lookup(uint8_t port, uint8_t adr, i2cmanager_dev_t *dev)
+{
+  for(uint8_t x = 0; x < I2CMANAGER_MAX_DEVICES; x++)
+  {
+    if(devices[x].attached && devices[x].cfg.port == port && devices[x].cfg.adr == adr)
+    {
+      *dev = devices[x];
+      return;
+    }
+  }
+
+  *dev = (i2cmanager_dev_t){.cfg = {.port = port, .adr = adr}, .timeout = I2CMANAGER_timeout(port, adr)};
+}
+
+esp_err_t I2CMANAGER_write(uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout)
+{
+  if(port >= I2CMANAGER_NUM_PORTS)
+    return ESP_ERR_INVALID_ARG;
+
+  if(!backends[port])
+    return ESP_ERR_INVALID_STATE;
+
+#if CONFIG_I2CMANAGER_STATS
+  int64_t start = esp_timer_get_time();
+  esp_err_t rslt = backends[port]->write(backend_ctx[port], port, adr, reg, buff, len, timeout);
+
+  I2CMANAGER_stats_op(port, I2CMANAGER_OP_WRITE, len, esp_timer_get_time() - start, rslt);
+
+  return rslt;
+#else
+  return backends[port]->write(backend_ctx[port], port, adr, reg, buff, len, timeout);
+#endif
+}
+
+esp_err_t I2CMANAGER_read(uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout)
 {
-  esp_err_t rslt = 0;   
-  esp_log_level_set(TAG, ESP_LOG_DEBUG);
-  
-  ESP_LOGD(TAG, "Initiating I2C Manager. Core: %d Pri: %d", xPortGetCoreID(), uxTaskPriorityGet(NULL));
+  if(port >= I2CMANAGER_NUM_PORTS || !len)
+    return ESP_ERR_INVALID_ARG;
+
+  if(!backends[port])
+    return ESP_ERR_INVALID_STATE;
 
-  rslt += I2CMANAGERInstallDrivers(); 
-  rslt += I2CMANAGERInitiateSempahores();
+#if CONFIG_I2CMANAGER_STATS
+  int64_t start = esp_timer_get_time();
+  esp_err_t rslt = backends[port]->read(backend_ctx[port], port, adr, reg, buff, len, timeout);
 
-  ESP_LOGD(TAG, "Initiating I2C Manager Finished");
+  I2CMANAGER_stats_op(port, I2CMANAGER_OP_READ, len, esp_timer_get_time() - start, rslt);
 
   return rslt;
+#else
+  return backends[port]->read(backend_ctx[port], port, adr, reg, buff, len, timeout);
+#endif
 }
 
-static esp_err_t I2CMANAGERInstallDrivers()
+const char *I2CMANAGER_err_to_name(esp_err_t rslt)
 {
-  ESP_LOGD(TAG, "Installing Drivers. Core: %d Pri: %d", xPortGetCoreID(), uxTaskPriorityGet(NULL));
+  switch(rslt)
+  {
+    case I2CMANAGER_ERR_NACK:       return "I2CMANAGER_ERR_NACK";
+    case I2CMANAGER_ERR_BUS_STUCK:  return "I2CMANAGER_ERR_BUS_STUCK";
+    case I2CMANAGER_ERR_DEADLINE:   return "I2CMANAGER_ERR_DEADLINE";
+    case I2CMANAGER_ERR_LOCK:       return "I2CMANAGER_ERR_LOCK";
+    default:                        return esp_err_to_name(rslt);
+  }
+}
 
-  esp_err_t rslt = 0;                                                                          // Holder for I2C error result
+static esp_err_t I2CMANAGERTransfer(const i2cmanager_dev_t *dev, i2cmanager_op_t op, uint8_t reg, uint8_t *buff, size_t len, int64_t deadline_us)
+{
+  uint32_t backoff_ms = dev->cfg.backoff_ms;
+  esp_err_t rslt = ESP_OK;
 
-  i2c_config_t i2c_config =                                                                    // Config profile for I2C
+  for(uint8_t attempt = 0; ; attempt++)
   {
-    .mode = I2C_MODE_MASTER,
-    .sda_io_num = SDA_IO,
-    .scl_io_num = SCL_IO,
-    .sda_pullup_en = GPIO_PULLUP_DISABLE,
-    .scl_pullup_en = GPIO_PULLUP_DISABLE,
-    .master.clk_speed = FREQ_HZ
-  };
-  
-  rslt += i2c_param_config(I2C_NUM_0, &i2c_config);                                             // Push config profile
-  rslt += i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER, RX_BUF_DISABLE, TX_BUF_DISABLE, 0);    // Install I2C Drivers
+    TickType_t timeout = dev->timeout;
+
+    if(deadline_us)                                                                             // Never let one attempt outlive the caller
+    {
+      TickType_t left = I2CMANAGER_ticks_until(deadline_us);
 
-  return rslt;     
+      if(!left)
+        return attempt ? rslt : I2CMANAGER_ERR_DEADLINE;                                        // Report what the last attempt saw
+      if(left < timeout)
+        timeout = left;
+    }
+
+    if(op == I2CMANAGER_OP_WRITE)
+      rslt = I2CMANAGER_write(dev->cfg.port, dev->cfg.adr, reg, buff, len, timeout);
+    else
+      rslt = I2CMANAGER_read(dev->cfg.port, dev->cfg.adr, reg, buff, len, timeout);
+
+    if(rslt == ESP_ERR_TIMEOUT && I2CMANAGERSdaLow(dev->cfg.port) &&                            // Stretching or a clipped deadline leave SDA alone, only a held line is recovered
+       I2CMANAGER_recover(dev->cfg.port) == I2CMANAGER_ERR_BUS_STUCK)                            // A held SDA times out every retry too
+      return I2CMANAGER_ERR_BUS_STUCK;
+
+    if((rslt != I2CMANAGER_ERR_NACK && rslt != ESP_ERR_TIMEOUT) || attempt >= dev->cfg.retries)
+      return rslt;
+
+    if(backoff_ms)
+    {
+      if(deadline_us && esp_timer_get_time() + (int64_t)backoff_ms * 1000 >= deadline_us)
+        return rslt;
+
+      I2CMUTEX_GIVE_PORT(dev->cfg.port);                                                          // Other devices on the port use the bus meanwhile
+      vTaskDelay(pdMS_TO_TICKS(backoff_ms) ? pdMS_TO_TICKS(backoff_ms) : 1);
+      backoff_ms *= 2;
+
+      if(I2CMANAGER_take(dev->cfg.port, deadline_us ? I2CMANAGER_ticks_until(deadline_us) : pdMS_TO_TICKS(I2CMANAGER_LOCK_MS)) != ESP_OK)
+        return I2CMANAGER_ERR_LOCK;                                                               // Token not held, the caller must not give it
+    }
+  }
 }
 
-static esp_err_t I2CMANAGERInitiateSempahores()
+static bool I2CMANAGERSdaLow(uint8_t port)
+{
+  if(!backends[port]->sda_low)                                                                  // Cannot tell, a recovery could reset a healthy bus
+    return false;
+
+  return backends[port]->sda_low(backend_ctx[port], port);
+}
+
+static esp_err_t I2CMANAGERInitiateSempahores(uint8_t port)
 {
   ESP_LOGD(TAG, "Initiating Semaphores. Core: %d Pri: %d", xPortGetCoreID(), uxTaskPriorityGet(NULL));
 
-  xI2CBinary = xSemaphoreCreateBinary();                                                        // Setup binary semaphore
-  xSemaphoreGive(xI2CBinary);                                                                   // Allocate token
+  if(!xI2CBinary[port])
+  {
+    xI2CBinary[port] = xSemaphoreCreateBinary();                                                // Setup binary semaphore
+    xSemaphoreGive(xI2CBinary[port]);                                                           // Allocate token
+  }
 
-  return !xI2CBinary ? ESP_ERR_INVALID_STATE : ESP_OK;
+  return !xI2CBinary[port] ? ESP_ERR_INVALID_STATE : ESP_OK;
 }
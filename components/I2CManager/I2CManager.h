@@ -3,16 +3,223 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include <esp_err.h>
+#include "sdkconfig.h"
 
 #include "freertos/FreeRTOS.h"
 #include <freertos/task.h> 
 #include <freertos/semphr.h>
 
-extern SemaphoreHandle_t xI2CBinary;
+#if CONFIG_I2CMANAGER_STATS
+#include <esp_timer.h>
+#endif
+
+#define I2CMANAGER_NUM_PORTS 2                                      /*!< I2C_NUM_0 and I2C_NUM_1 */
+
+#define I2CMANAGER_ASYNC_MAX_LEN 32                                 /*!< Largest single queued transfer */
+#define I2CMANAGER_ASYNC_BATCH 8                                    /*!< Requests the engine drains and coalesces per pass */
+
+extern SemaphoreHandle_t xI2CBinary[I2CMANAGER_NUM_PORTS];         /*!< One token per port, devices on different ports never contend */
+
+#define I2CMANAGER_LOCK_MS 1000                                     /*!< Wait for the port token before giving up */
+#define I2CMANAGER_DEF_TIMEOUT_MS 500                               /*!< Transaction deadline for a bus or device that sets none */
+#define I2CMANAGER_MAX_DEVICES 16                                   /*!< Registry slots across all ports */
+
+#define I2CMANAGER_ERR_BASE 0x7100                                  /*!< Distinct from any ESP_ERR_* the driver returns */
+#define I2CMANAGER_ERR_NACK (I2CMANAGER_ERR_BASE + 1)               /*!< Address or data byte not acknowledged */
+#define I2CMANAGER_ERR_BUS_STUCK (I2CMANAGER_ERR_BASE + 2)          /*!< SDA still low after recovery */
+#define I2CMANAGER_ERR_DEADLINE (I2CMANAGER_ERR_BASE + 3)           /*!< Caller deadline passed before the transfer could start */
+#define I2CMANAGER_ERR_LOCK (I2CMANAGER_ERR_BASE + 4)               /*!< Port token not obtained in time, the caller does not hold it */
+
+#define I2CMANAGER_RECOVER_CLOCKS 9                                 /*!< SCL pulses that free any slave stuck mid byte */
+
+#define I2CMUTEX_TAKE_PORT(P) do { esp_err_t lock_rslt = I2CMANAGER_take((P), pdMS_TO_TICKS(I2CMANAGER_LOCK_MS)); \
+                                   if(lock_rslt != ESP_OK) return lock_rslt; } while(0)
+#define I2CMUTEX_GIVE_PORT(P) do { xSemaphoreGive(xI2CBinary[(P)]); } while(0)
+
+#define I2CMUTEX_TAKE I2CMUTEX_TAKE_PORT(0)
+#define I2CMUTEX_GIVE I2CMUTEX_GIVE_PORT(0)
+
+/* Statistics, CONFIG_I2CMANAGER_STATS ------------------------------------------------- */
+#define I2CMANAGER_STATS_BUCKETS 20                                 /*!< log2 microseconds: [0] < 1 us, [n] < 2^n us, last is open ended */
+#define I2CMANAGER_STATS_DUMP_SIZE (8 + 2 * (4 + 4 * I2CMANAGER_ERR_CLASSES + 8 + 8 + 4 + 4 * I2CMANAGER_STATS_BUCKETS) + (4 + 4 + 8 + 4 + 4 * I2CMANAGER_STATS_BUCKETS))
+
+typedef enum                                                        /*!< esp_err_t folded into fixed counters */
+{
+  I2CMANAGER_ERR_OK = 0,
+  I2CMANAGER_ERR_FAIL,                                              /*!< NACK or bus error */
+  I2CMANAGER_ERR_TIMEOUT,
+  I2CMANAGER_ERR_INVALID_STATE,
+  I2CMANAGER_ERR_INVALID_ARG,
+  I2CMANAGER_ERR_OTHER,                                             /*!< Includes I2CMANAGER_ERR_BUS_STUCK */
+  I2CMANAGER_ERR_CLASSES
+} i2cmanager_err_class_t;
+
+typedef struct
+{
+  uint32_t calls;
+  uint32_t errors[I2CMANAGER_ERR_CLASSES];                          /*!< [I2CMANAGER_ERR_OK] counts successes */
+  uint64_t bytes;                                                   /*!< Payload bytes of successful transfers */
+  uint64_t bus_us_total;
+  uint32_t bus_us_max;
+  uint32_t bus_hist[I2CMANAGER_STATS_BUCKETS];
+} i2cmanager_op_stats_t;
+
+typedef struct
+{
+  i2cmanager_op_stats_t op[2];                                      /*!< Indexed by i2cmanager_op_t */
+  uint32_t lock_takes;
+  uint32_t lock_timeouts;
+  uint64_t lock_us_total;
+  uint32_t lock_us_max;
+  uint32_t lock_hist[I2CMANAGER_STATS_BUCKETS];                     /*!< Wait for the port token, successful takes only */
+} i2cmanager_stats_t;
+
+/* Configuration ------------------------------------------------------------------------- */
+typedef struct
+{
+  uint8_t port;                                                     /*!< I2C_NUM_0 or I2C_NUM_1 */
+  int sda_io;
+  int scl_io;
+  uint32_t clk_hz;                                                  /*!< 100000 standard, 400000 fast mode, 0 takes 100 kHz */
+  bool pullup_en;                                                   /*!< Internal pull-ups, weak, short buses only */
+  uint8_t glitch_cycles;                                            /*!< APB cycles of the SCL/SDA filter 1 - 7, 0 leaves it off */
+  uint32_t timeout_ms;                                              /*!< Default transaction deadline, 0 takes I2CMANAGER_DEF_TIMEOUT_MS */
+} i2cmanager_bus_config_t;
+
+typedef struct
+{
+  const i2cmanager_bus_config_t *buses;
+  uint8_t num_buses;
+} i2cmanager_config_t;
+
+typedef struct
+{
+  uint8_t port;
+  uint8_t adr;                                                      /*!< 7 bit */
+  uint32_t timeout_ms;                                              /*!< Transaction deadline, 0 takes the bus default */
+  uint8_t retries;                                                  /*!< Extra attempts after a NACK or timeout, within the caller deadline */
+  uint32_t backoff_ms;                                              /*!< Wait before the first retry, doubles per retry, 0 retries at once */
+} i2cmanager_dev_config_t;
+
+typedef struct
+{
+  i2cmanager_dev_config_t cfg;
+  TickType_t timeout;                                               /*!< Resolved deadline */
+  bool attached;
+} i2cmanager_dev_t;
+
+/* Backend ------------------------------------------------------------------------------- */
+typedef struct                                                      /*!< Register block transfers, caller holds the port token */
+{
+  esp_err_t (*write)(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout);
+  esp_err_t (*read)(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout);
+  esp_err_t (*recover)(void *ctx, uint8_t port);                    /*!< Optional, clock out a stuck slave, STOP, reset the controller */
+  bool (*sda_low)(void *ctx, uint8_t port);                         /*!< Optional, samples SDA, recovery only runs while it reads low */
+} i2cmanager_backend_t;
+
+extern const i2cmanager_backend_t i2cmanager_idf_backend;          /*!< Legacy ESP-IDF driver, installed by I2CMANAGER_initiate() */
+
+/* Async --------------------------------------------------------------------------------- */
+typedef enum
+{
+  I2CMANAGER_OP_WRITE = 0,
+  I2CMANAGER_OP_READ
+} i2cmanager_op_t;
+
+typedef enum
+{
+  I2CMANAGER_PRIO_NORMAL = 0,
+  I2CMANAGER_PRIO_HIGH                                              /*!< Served before any queued normal request */
+} i2cmanager_prio_t;
+
+typedef struct                                                      /*!< Waitable completion, reusable once waited on */
+{
+  SemaphoreHandle_t done;
+  esp_err_t rslt;
+} i2cmanager_token_t;
+
+typedef void (*i2cmanager_cb_t)(esp_err_t rslt, void *arg);         /*!< Runs on the engine task */
+
+typedef struct i2cmanager_req i2cmanager_req_t;
+typedef void (*i2cmanager_settle_t)(const i2cmanager_req_t *req, esp_err_t rslt);   /*!< Engine task, before token and cb. Port token held unless rslt is I2CMANAGER_ERR_LOCK */
+
+struct i2cmanager_req
+{
+  i2cmanager_op_t op;
+  i2cmanager_prio_t prio;
+  uint8_t adr;
+  uint8_t reg;
+  uint8_t len;
+  uint8_t data[I2CMANAGER_ASYNC_MAX_LEN];                           /*!< Write payload, copied on submit */
+  uint8_t *r_buff;                                                  /*!< Read destination, must stay valid until completion */
+  i2cmanager_token_t *token;                                        /*!< Optional */
+  i2cmanager_cb_t cb;                                               /*!< Optional */
+  void *arg;
+  i2cmanager_settle_t settle;                                       /*!< Optional, the device driver's own completion, e.g. its register cache */
+  void *owner;
+  int64_t deadline_us;                                              /*!< esp_timer time, 0: none. A coalesced transfer keeps the earliest */
+};
+
+/* Setup --------------------------------------------------------------------------------- */
+esp_err_t I2CMANAGER_initiate(const i2cmanager_config_t *cfg);     /*!< ESP-IDF only, NULL: one 100 kHz bus on port 0, SDA 25, SCL 26 */
+esp_err_t I2CMANAGER_initiate_bus(const i2cmanager_bus_config_t *bus);   /*!< ESP-IDF only */
+esp_err_t I2CMANAGER_set_backend(uint8_t port, const i2cmanager_backend_t *backend, void *ctx);
+esp_err_t I2CMANAGER_set_timeout(uint8_t port, uint32_t timeout_ms);   /*!< Bus default deadline, applies to devices attached after */
+
+/* Device registry ----------------------------------------------------------------------- */
+esp_err_t I2CMANAGER_attach(const i2cmanager_dev_config_t *cfg, i2cmanager_dev_t **dev);   /*!< Port must have a backend, one slot per port and address */
+esp_err_t I2CMANAGER_detach(i2cmanager_dev_t *dev);
+TickType_t I2CMANAGER_timeout(uint8_t port, uint8_t adr);          /*!< Deadline of an attached device, else the bus default */
+void I2CMANAGER_lookup(uint8_t port, uint8_t adr, i2cmanager_dev_t *dev);   /*!< Copy of an attached device, else one with the bus default and no retries */
+
+/* Sync, caller holds I2CMUTEX_TAKE_PORT(port) ------------------------------------------- */
+esp_err_t I2CMANAGER_write(uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout);
+esp_err_t I2CMANAGER_read(uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout);
+esp_err_t I2CMANAGER_dev_write(const i2cmanager_dev_t *dev, uint8_t reg, const uint8_t *buff, size_t len);   /*!< With the device deadline. Token dropped over retry backoffs, not held on I2CMANAGER_ERR_LOCK */
+esp_err_t I2CMANAGER_dev_read(const i2cmanager_dev_t *dev, uint8_t reg, uint8_t *buff, size_t len);
+esp_err_t I2CMANAGER_dev_write_until(const i2cmanager_dev_t *dev, uint8_t reg, const uint8_t *buff, size_t len, int64_t deadline_us);   /*!< esp_timer time, 0: none */
+esp_err_t I2CMANAGER_dev_read_until(const i2cmanager_dev_t *dev, uint8_t reg, uint8_t *buff, size_t len, int64_t deadline_us);
+esp_err_t I2CMANAGER_recover(uint8_t port);                       /*!< ESP_ERR_NOT_SUPPORTED when the backend has no recovery */
+const char *I2CMANAGER_err_to_name(esp_err_t rslt);                /*!< esp_err_to_name() that knows I2CMANAGER_ERR_* */
+
+/* Port token, prefer I2CMUTEX_TAKE_PORT() / I2CMUTEX_GIVE_PORT() ------------------------- */
+#if CONFIG_I2CMANAGER_STATS
+void I2CMANAGER_stats_lock(uint8_t port, int64_t wait_us, bool taken);
+void I2CMANAGER_stats_op(uint8_t port, i2cmanager_op_t op, size_t len, int64_t bus_us, esp_err_t rslt);   /*!< Caller holds the port token */
+#endif
+
+static inline esp_err_t I2CMANAGER_take(uint8_t port, TickType_t timeout)
+{
+  if(port >= I2CMANAGER_NUM_PORTS || !xI2CBinary[port])
+    return ESP_ERR_INVALID_STATE;
+
+#if CONFIG_I2CMANAGER_STATS
+  int64_t start = esp_timer_get_time();
+  bool taken = xSemaphoreTake(xI2CBinary[port], timeout);
+
+  I2CMANAGER_stats_lock(port, esp_timer_get_time() - start, taken);
+
+  return taken ? ESP_OK : I2CMANAGER_ERR_LOCK;
+#else
+  return xSemaphoreTake(xI2CBinary[port], timeout) ? ESP_OK : I2CMANAGER_ERR_LOCK;
+#endif
+}
+
+esp_err_t I2CMANAGER_take_until(uint8_t port, int64_t deadline_us);   /*!< I2CMANAGER_ERR_DEADLINE once passed, 0 waits I2CMANAGER_LOCK_MS for I2CMANAGER_ERR_LOCK */
+TickType_t I2CMANAGER_ticks_until(int64_t deadline_us);            /*!< Whole ticks left rounded up, 0 once passed */
 
-#define I2CMUTEX_TAKE do { if(!xSemaphoreTake(xI2CBinary, pdMS_TO_TICKS(1000))) return ESP_ERR_TIMEOUT; } while(0)
-#define I2CMUTEX_GIVE do { xSemaphoreGive(xI2CBinary); } while(0)
+/* Statistics, ESP_ERR_NOT_SUPPORTED when compiled out ----------------------------------- */
+esp_err_t I2CMANAGER_stats_get(uint8_t port, i2cmanager_stats_t *stats);   /*!< Consistent copy, taken under the port token */
+esp_err_t I2CMANAGER_stats_reset(uint8_t port);
+esp_err_t I2CMANAGER_stats_dump(uint8_t port, uint8_t *buff, size_t len);  /*!< Packed little endian, I2CMANAGER_STATS_DUMP_SIZE bytes */
 
-esp_err_t I2CMANAGER_initiate();
+/* Async engine, one task per port ------------------------------------------------------- */
+esp_err_t I2CMANAGER_engine_start(uint8_t port, uint8_t depth, UBaseType_t priority);
+esp_err_t I2CMANAGER_submit(uint8_t port, const i2cmanager_req_t *req, TickType_t wait);
+esp_err_t I2CMANAGER_token_init(i2cmanager_token_t *token);
+esp_err_t I2CMANAGER_token_wait(i2cmanager_token_t *token, TickType_t timeout);
 
-#endif 
\ No newline at end of file
+#endif 
@@ -0,0 +1,242 @@
+#include "I2CManager.h"
+#include <esp_log.h>
+#include <string.h>
+#include <freertos/queue.h>
+
+#define ENGINE_STACK 3072
+#define ENGINE_MERGE_MAX 64     /*!< Largest coalesced transfer */
+
+static const char *TAG = "I2C Engine";
+
+typedef struct
+{
+  QueueHandle_t queue[2];                                                                       // Indexed by i2cmanager_prio_t
+  SemaphoreHandle_t work;                                                                       // One count per queued request
+  TaskHandle_t task;
+  uint8_t port;
+} i2cmanager_engine_t;
+
+typedef struct                                                                                  // Run of adjacent requests served by one transfer
+{
+  i2cmanager_op_t op;
+  uint8_t adr;
+  uint8_t reg;
+  uint8_t len;
+  uint8_t members;                                                                              // Bit per batch index
+} i2cmanager_xfer_t;
+
+static i2cmanager_engine_t engines[I2CMANAGER_NUM_PORTS];
+
+static void I2CMANAGERTaskEngine(void *arg);
+static uint8_t I2CMANAGERDrain(i2cmanager_engine_t *engine, i2cmanager_req_t *batch);
+static uint8_t I2CMANAGERCoalesce(const i2cmanager_req_t *batch, uint8_t count, i2cmanager_xfer_t *xfers);
+static void I2CMANAGERExecute(i2cmanager_engine_t *engine, const i2cmanager_xfer_t *xfer, i2cmanager_req_t *batch);
+static void I2CMANAGERComplete(i2cmanager_req_t *req, esp_err_t rslt);
+
+esp_err_t I2CMANAGER_engine_start(uint8_t port, uint8_t depth, UBaseType_t priority)
+{
+  ESP_LOGD(TAG, "Starting Engine. Port: %d Depth: %d Pri: %d", port, depth, priority);
+
+  if(port >= I2CMANAGER_NUM_PORTS || !depth)
+    return ESP_ERR_INVALID_ARG;
+
+  i2cmanager_engine_t *engine = &engines[port];
+
+  if(engine->task || !xI2CBinary[port])                                                         // Port must be initiated first
+    return ESP_ERR_INVALID_STATE;
+
+  engine->port = port;
+  engine->queue[I2CMANAGER_PRIO_NORMAL] = xQueueCreate(depth, sizeof(i2cmanager_req_t));
+  engine->queue[I2CMANAGER_PRIO_HIGH] = xQueueCreate(depth, sizeof(i2cmanager_req_t));
+  engine->work = xSemaphoreCreateCounting(2 * depth, 0);
+
+  if(!engine->queue[I2CMANAGER_PRIO_NORMAL] || !engine->queue[I2CMANAGER_PRIO_HIGH] || !engine->work)
+    return ESP_ERR_NO_MEM;
+
+  if(xTaskCreate(I2CMANAGERTaskEngine, "i2c_engine", ENGINE_STACK, engine, priority, &engine->task) != pdPASS)
+    return ESP_ERR_NO_MEM;
+
+  return ESP_OK;
+}
+
+esp_err_t I2CMANAGER_submit(uint8_t port, const i2cmanager_req_t *req, TickType_t wait)
+{
+  if(port >= I2CMANAGER_NUM_PORTS || !req || !req->len || req->len > I2CMANAGER_ASYNC_MAX_LEN || req->prio > I2CMANAGER_PRIO_HIGH)
+    return ESP_ERR_INVALID_ARG;
+
+  if(req->op == I2CMANAGER_OP_READ && !req->r_buff)
+    return ESP_ERR_INVALID_ARG;
+
+  i2cmanager_engine_t *engine = &engines[port];
+
+  if(!engine->task)
+    return ESP_ERR_INVALID_STATE;
+
+  if(xQueueSend(engine->queue[req->prio], req, wait) != pdTRUE)                                 // Bounded, a full queue pushes back on the caller
+    return ESP_ERR_TIMEOUT;
+
+  xSemaphoreGive(engine->work);
+
+  return ESP_OK;
+}
+
+esp_err_t I2CMANAGER_token_init(i2cmanager_token_t *token)
+{
+  if(!token->done)
+    token->done = xSemaphoreCreateBinary();
+
+  token->rslt = ESP_ERR_NOT_FINISHED;
+
+  return !token->done ? ESP_ERR_NO_MEM : ESP_OK;
+}
+
+esp_err_t I2CMANAGER_token_wait(i2cmanager_token_t *token, TickType_t timeout)
+{
+  if(!xSemaphoreTake(token->done, timeout))
+    return ESP_ERR_TIMEOUT;
+
+  return token->rslt;
+}
+
+static void I2CMANAGERTaskEngine(void *arg)
+{
+  i2cmanager_engine_t *engine = (i2cmanager_engine_t *)arg;
+  i2cmanager_req_t batch[I2CMANAGER_ASYNC_BATCH];
+  i2cmanager_xfer_t xfers[I2CMANAGER_ASYNC_BATCH];
+
+  for(;;)
+  {
+    xSemaphoreTake(engine->work, portMAX_DELAY);
+
+    uint8_t count = I2CMANAGERDrain(engine, batch);
+    uint8_t n_xfer = I2CMANAGERCoalesce(batch, count, xfers);
+
+    for(uint8_t x = 0; x < n_xfer; x++)
+      I2CMANAGERExecute(engine, &xfers[x], batch);
+  }
+}
+
+static uint8_t I2CMANAGERDrain(i2cmanager_engine_t *engine, i2cmanager_req_t *batch)
+{
+  uint8_t count = 0;
+
+  for(int8_t prio = I2CMANAGER_PRIO_HIGH; prio >= I2CMANAGER_PRIO_NORMAL; prio--)               // High priority requests always lead the batch
+  {
+    while(count < I2CMANAGER_ASYNC_BATCH && xQueueReceive(engine->queue[prio], &batch[count], 0) == pdTRUE)
+    {
+      if(count++)                                                                               // The first count was taken by the wait in the task loop
+        xSemaphoreTake(engine->work, 0);
+    }
+  }
+
+  return count;
+}
+
+static uint8_t I2CMANAGERCoalesce(const i2cmanager_req_t *batch, uint8_t count, i2cmanager_xfer_t *xfers)
+{
+  uint8_t n_xfer = 0;
+
+  for(uint8_t x = 0; x < count; x++)
+  {
+    const i2cmanager_req_t *req = &batch[x];
+    i2cmanager_xfer_t *last = NULL;
+
+    for(int8_t y = n_xfer - 1; y >= 0 && !last; y--)                                             // Only the latest transfer to a device may grow, keeps per-device order
+      if(xfers[y].adr == req->adr)
+        last = &xfers[y];
+
+    if(last && last->op == req->op && last->len + req->len <= ENGINE_MERGE_MAX)
+    {
+      if(req->reg == last->reg + last->len)
+      {
+        last->len += req->len;
+        last->members |= (0x01 << x);
+        continue;
+      }
+
+      if(req->reg + req->len == last->reg)
+      {
+        last->reg = req->reg;
+        last->len += req->len;
+        last->members |= (0x01 << x);
+        continue;
+      }
+    }
+
+    xfers[n_xfer].op = req->op;
+    xfers[n_xfer].adr = req->adr;
+    xfers[n_xfer].reg = req->reg;
+    xfers[n_xfer].len = req->len;
+    xfers[n_xfer].members = (0x01 << x);
+    n_xfer++;
+  }
+
+  return n_xfer;
+}
+
+static void I2CMANAGERExecute(i2cmanager_engine_t *engine, const i2cmanager_xfer_t *xfer, i2cmanager_req_t *batch)
+{
+  uint8_t buff[ENGINE_MERGE_MAX] = {0};
+  i2cmanager_dev_t dev;
+  int64_t deadline_us = 0;
+  esp_err_t rslt = ESP_OK;
+  bool held = false;
+
+  for(uint8_t x = 0; x < I2CMANAGER_ASYNC_BATCH; x++)
+  {
+    if(!(xfer->members & (0x01 << x)))
+      continue;
+
+    if(xfer->op == I2CMANAGER_OP_WRITE)
+      memcpy(buff + (batch[x].reg - xfer->reg), batch[x].data, batch[x].len);
+
+    if(batch[x].deadline_us && (!deadline_us || batch[x].deadline_us < deadline_us))
+      deadline_us = batch[x].deadline_us;
+  }
+
+  I2CMANAGER_lookup(engine->port, xfer->adr, &dev);                                             // Retries, backoff and deadline from the registry, as the sync calls
+
+  held = I2CMANAGER_take_until(engine->port, deadline_us) == ESP_OK;
+  rslt = held ? ESP_OK : I2CMANAGER_ERR_LOCK;                                                   // Settle callbacks tell a missing token by this
+
+  if(held)
+  {
+    if(xfer->op == I2CMANAGER_OP_WRITE)
+      rslt = I2CMANAGER_dev_write_until(&dev, xfer->reg, buff, xfer->len, deadline_us);
+    else
+      rslt = I2CMANAGER_dev_read_until(&dev, xfer->reg, buff, xfer->len, deadline_us);
+
+    held = rslt != I2CMANAGER_ERR_LOCK;                                                         // Lost over a retry backoff
+  }
+
+  for(uint8_t x = 0; x < I2CMANAGER_ASYNC_BATCH; x++)
+  {
+    if(!(xfer->members & (0x01 << x)))
+      continue;
+
+    if(xfer->op == I2CMANAGER_OP_READ && rslt == ESP_OK)
+      memcpy(batch[x].r_buff, buff + (batch[x].reg - xfer->reg), batch[x].len);
+
+    if(batch[x].settle)                                                                         // Still under the token, no other transfer in between
+      batch[x].settle(&batch[x], rslt);
+  }
+
+  if(held)
+    xSemaphoreGive(xI2CBinary[engine->port]);
+
+  for(uint8_t x = 0; x < I2CMANAGER_ASYNC_BATCH; x++)
+    if(xfer->members & (0x01 << x))
+      I2CMANAGERComplete(&batch[x], rslt);
+}
+
+static void I2CMANAGERComplete(i2cmanager_req_t *req, esp_err_t rslt)
+{
+  if(req->token)
+  {
+    req->token->rslt = rslt;
+    xSemaphoreGive(req->token->done);
+  }
+
+  if(req->cb)
+    req->cb(rslt, req->arg);
+}
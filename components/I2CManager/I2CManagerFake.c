@@ -0,0 +1,96 @@
+#include "I2CManagerFake.h"
+#include <string.h>
+
+static esp_err_t I2CMANAGERFakeWrite(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout);
+static esp_err_t I2CMANAGERFakeRead(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout);
+static i2cmanager_fake_dev_t *I2CMANAGERFakeFind(i2cmanager_fake_t *fake, uint8_t adr);
+
+const i2cmanager_backend_t i2cmanager_fake_backend =
+{
+  .write = I2CMANAGERFakeWrite,
+  .read = I2CMANAGERFakeRead
+};
+
+uint8_t *I2CMANAGER_fake_attach(i2cmanager_fake_t *fake, uint8_t adr)
+{
+  i2cmanager_fake_dev_t *dev = I2CMANAGERFakeFind(fake, adr);
+
+  for(uint8_t x = 0; x < I2CMANAGER_FAKE_MAX_DEV && !dev; x++)
+  {
+    if(fake->dev[x].used)
+      continue;
+
+    dev = &fake->dev[x];
+    memset(dev, 0, sizeof(*dev));
+    dev->used = true;
+    dev->adr = adr;
+  }
+
+  return dev ? dev->regs : NULL;
+}
+
+void I2CMANAGER_fake_reset_counters(i2cmanager_fake_t *fake)
+{
+  fake->transactions = 0;
+  fake->bytes = 0;
+  fake->nacks = 0;
+}
+
+static esp_err_t I2CMANAGERFakeWrite(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout)
+{
+  i2cmanager_fake_t *fake = (i2cmanager_fake_t *)ctx;
+  i2cmanager_fake_dev_t *dev = I2CMANAGERFakeFind(fake, adr);
+
+  fake->transactions++;
+
+  if(!dev || fake->nak_next)
+  {
+    if(dev)                                                                                     // Injected, the device ignores its address this once
+      fake->nak_next--;
+
+    fake->bytes += 1;                                                                           // Address byte, then NACK
+    fake->nacks++;
+    return I2CMANAGER_ERR_NACK;
+  }
+
+  for(size_t x = 0; x < len; x++)
+    dev->regs[(uint8_t)(reg + x)] = buff[x];
+
+  fake->bytes += 2 + len;
+
+  return ESP_OK;
+}
+
+static esp_err_t I2CMANAGERFakeRead(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout)
+{
+  i2cmanager_fake_t *fake = (i2cmanager_fake_t *)ctx;
+  i2cmanager_fake_dev_t *dev = I2CMANAGERFakeFind(fake, adr);
+
+  fake->transactions++;
+
+  if(!dev || fake->nak_next)
+  {
+    if(dev)                                                                                     // Injected, the device ignores its address this once
+      fake->nak_next--;
+
+    fake->bytes += 1;
+    fake->nacks++;
+    return I2CMANAGER_ERR_NACK;
+  }
+
+  for(size_t x = 0; x < len; x++)
+    buff[x] = dev->regs[(uint8_t)(reg + x)];
+
+  fake->bytes += 3 + len;                                                                       // Address, register, repeated start address
+
+  return ESP_OK;
+}
+
+static i2cmanager_fake_dev_t *I2CMANAGERFakeFind(i2cmanager_fake_t *fake, uint8_t adr)
+{
+  for(uint8_t x = 0; x < I2CMANAGER_FAKE_MAX_DEV; x++)
+    if(fake->dev[x].used && fake->dev[x].adr == adr)
+      return &fake->dev[x];
+
+  return NULL;
+}
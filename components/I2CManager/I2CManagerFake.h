@@ -0,0 +1,30 @@
+#ifndef _I2CMANAGER_FAKE_H
+#define _I2CMANAGER_FAKE_H
+
+#include "I2CManager.h"
+
+#define I2CMANAGER_FAKE_MAX_DEV 8                                   /*!< Devices per fake bus */
+#define I2CMANAGER_FAKE_REG_SPACE 256
+
+typedef struct
+{
+  bool used;
+  uint8_t adr;
+  uint8_t regs[I2CMANAGER_FAKE_REG_SPACE];                          /*!< Plain memory, auto-increment wraps at 0xFF */
+} i2cmanager_fake_dev_t;
+
+typedef struct                                                      /*!< In-memory bus for host checks, pass as the backend ctx */
+{
+  i2cmanager_fake_dev_t dev[I2CMANAGER_FAKE_MAX_DEV];
+  uint32_t transactions;
+  uint32_t bytes;                                                   /*!< Address, register and data bytes on the wire */
+  uint32_t nacks;
+  uint32_t nak_next;                                                /*!< Transfers NACKed before the devices answer again, counts down */
+} i2cmanager_fake_t;
+
+extern const i2cmanager_backend_t i2cmanager_fake_backend;
+
+uint8_t *I2CMANAGER_fake_attach(i2cmanager_fake_t *fake, uint8_t adr);  /*!< Returns the device register file, NULL when full */
+void I2CMANAGER_fake_reset_counters(i2cmanager_fake_t *fake);
+
+#endif
@@ -0,0 +1,230 @@
+#include "I2CManager.h"
+#include <esp_log.h>
+#include <driver/i2c.h>
+#include <driver/gpio.h>
+#include <esp_rom_sys.h>
+
+#define SDA_IO 25         /*!< Default gpio number for I2C master data  */
+#define SCL_IO 26         /*!< Default gpio number for I2C master clock */
+
+#define FREQ_HZ 100000    /*!< Default I2C master clock frequency */
+#define FREQ_HZ_MAX 400000  /*!< Fast mode, the fastest the MAX31790 supports */
+#define GLITCH_MAX 7      /*!< Largest filter the controller takes, in APB cycles */
+#define TX_BUF_DISABLE 0  /*!< I2C master doesn't need buffer */
+#define RX_BUF_DISABLE 0  /*!< I2C master doesn't need buffer */
+#define CMD_LINK_OPS 8    /*!< Longest sequence: START, adr, reg, START, adr, read, read last, STOP */
+#define RECOVER_HALF_US 5 /*!< Half SCL period while clocking out, 100 kHz */
+
+static const char *TAG = "I2C Manager";
+
+static const i2cmanager_bus_config_t default_bus =
+{
+  .port = I2C_NUM_0,
+  .sda_io = SDA_IO,
+  .scl_io = SCL_IO,
+  .clk_hz = FREQ_HZ
+};
+
+static uint8_t cmd_link_buff[I2CMANAGER_NUM_PORTS][I2C_LINK_RECOMMENDED_SIZE(CMD_LINK_OPS)];   /*!< Per port, the port token guards it */
+static i2cmanager_bus_config_t bus_cfg[I2CMANAGER_NUM_PORTS];                                   /*!< Kept to reinstall the driver after recovery */
+
+static esp_err_t I2CMANAGERInstallDrivers(const i2cmanager_bus_config_t *bus);
+static esp_err_t I2CMANAGERIdfWrite(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout);
+static esp_err_t I2CMANAGERIdfRead(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout);
+static esp_err_t I2CMANAGERIdfRecover(void *ctx, uint8_t port);
+static bool I2CMANAGERIdfSdaLow(void *ctx, uint8_t port);
+static esp_err_t I2CMANAGERIdfBegin(uint8_t port, i2c_cmd_handle_t cmd, TickType_t timeout);
+
+const i2cmanager_backend_t i2cmanager_idf_backend =
+{
+  .write = I2CMANAGERIdfWrite,
+  .read = I2CMANAGERIdfRead,
+  .recover = I2CMANAGERIdfRecover,
+  .sda_low = I2CMANAGERIdfSdaLow
+};
+
+esp_err_t I2CMANAGER_initiate(const i2cmanager_config_t *cfg)
+{
+  esp_err_t rslt = ESP_OK;
+
+  if(!cfg)
+    return I2CMANAGER_initiate_bus(&default_bus);
+
+  if(!cfg->buses || !cfg->num_buses || cfg->num_buses > I2CMANAGER_NUM_PORTS)
+    return ESP_ERR_INVALID_ARG;
+
+  for(uint8_t x = 0; x < cfg->num_buses && rslt == ESP_OK; x++)
+    rslt = I2CMANAGER_initiate_bus(&cfg->buses[x]);
+
+  return rslt;
+}
+
+esp_err_t I2CMANAGER_initiate_bus(const i2cmanager_bus_config_t *bus)
+{
+  esp_err_t rslt = ESP_OK;   
+  esp_log_level_set(TAG, ESP_LOG_DEBUG);
+  
+  ESP_LOGD(TAG, "Initiating I2C Manager. Port: %d Clk: %d Core: %d Pri: %d", bus->port, bus->clk_hz, xPortGetCoreID(), uxTaskPriorityGet(NULL));
+
+  if(bus->port >= I2CMANAGER_NUM_PORTS || bus->clk_hz > FREQ_HZ_MAX || bus->glitch_cycles > GLITCH_MAX)
+    return ESP_ERR_INVALID_ARG;
+
+  bus_cfg[bus->port] = *bus;
+
+  rslt = I2CMANAGERInstallDrivers(bus); 
+  if(rslt == ESP_OK)
+    rslt = I2CMANAGER_set_backend(bus->port, &i2cmanager_idf_backend, NULL);
+  if(rslt == ESP_OK && bus->timeout_ms)
+    rslt = I2CMANAGER_set_timeout(bus->port, bus->timeout_ms);
+
+  ESP_LOGD(TAG, "Initiating I2C Manager Finished");
+
+  return rslt;
+}
+
+static esp_err_t I2CMANAGERInstallDrivers(const i2cmanager_bus_config_t *bus)
+{
+  ESP_LOGD(TAG, "Installing Drivers. Core: %d Pri: %d", xPortGetCoreID(), uxTaskPriorityGet(NULL));
+
+  esp_err_t rslt = ESP_OK;                                                                     // Holder for I2C error result
+
+  i2c_config_t i2c_config =                                                                    // Config profile for I2C
+  {
+    .mode = I2C_MODE_MASTER,
+    .sda_io_num = bus->sda_io,
+    .scl_io_num = bus->scl_io,
+    .sda_pullup_en = bus->pullup_en ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+    .scl_pullup_en = bus->pullup_en ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+    .master.clk_speed = bus->clk_hz ? bus->clk_hz : FREQ_HZ
+  };
+  
+  rslt = i2c_param_config(bus->port, &i2c_config);                                             // Push config profile
+  if(rslt == ESP_OK)
+    rslt = i2c_driver_install(bus->port, I2C_MODE_MASTER, RX_BUF_DISABLE, TX_BUF_DISABLE, 0);  // Install I2C Drivers
+  if(rslt == ESP_OK && bus->glitch_cycles)
+    rslt = i2c_filter_enable(bus->port, bus->glitch_cycles);                                    // Reject spikes on long or noisy runs
+
+  return rslt;     
+}
+
+static esp_err_t I2CMANAGERIdfWrite(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout)
+{
+  esp_err_t ret_err = ESP_OK;
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(cmd_link_buff[port], sizeof(cmd_link_buff[port]));
+
+  if(!cmd)
+    return ESP_ERR_NO_MEM;
+
+  ret_err = i2c_master_start(cmd);                                                              // Link building only fails on a short buffer, first error wins
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_write_byte(cmd, (adr << 1) | I2C_MASTER_WRITE, true);
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_write_byte(cmd, reg, true);
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_write(cmd, buff, len, true);
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_stop(cmd);
+  if(ret_err == ESP_OK)
+    ret_err = I2CMANAGERIdfBegin(port, cmd, timeout);
+
+  i2c_cmd_link_delete_static(cmd);
+
+  return ret_err;
+}
+
+static esp_err_t I2CMANAGERIdfRead(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout)
+{
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(cmd_link_buff[port], sizeof(cmd_link_buff[port]));
+  esp_err_t ret_err = ESP_OK;
+
+  if(!cmd)
+    return ESP_ERR_NO_MEM;
+
+  ret_err = i2c_master_start(cmd);
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_write_byte(cmd, (adr << 1) | I2C_MASTER_WRITE, true);
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_write_byte(cmd, reg, true);
+
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_start(cmd);
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_write_byte(cmd, (adr << 1) | I2C_MASTER_READ, true);
+
+  if(ret_err == ESP_OK && len > 1)
+    ret_err = i2c_master_read(cmd, buff, len-1, I2C_MASTER_ACK);
+
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_read_byte(cmd, buff + len-1, I2C_MASTER_NACK);
+  if(ret_err == ESP_OK)
+    ret_err = i2c_master_stop(cmd);
+
+  if(ret_err == ESP_OK)
+    ret_err = I2CMANAGERIdfBegin(port, cmd, timeout);
+
+  i2c_cmd_link_delete_static(cmd);
+
+  return ret_err;
+}
+
+static esp_err_t I2CMANAGERIdfBegin(uint8_t port, i2c_cmd_handle_t cmd, TickType_t timeout)
+{
+  esp_err_t rslt = i2c_master_cmd_begin(port, cmd, timeout);
+
+  return rslt == ESP_FAIL ? I2CMANAGER_ERR_NACK : rslt;                                         // The driver reports a missing ACK as ESP_FAIL
+}
+
+static esp_err_t I2CMANAGERIdfRecover(void *ctx, uint8_t port)
+{
+  const i2cmanager_bus_config_t *bus = &bus_cfg[port];
+  esp_err_t rslt = ESP_OK;
+  bool released = false;
+
+  i2c_driver_delete(port);                                                                      // Frees the pins and the stuck controller state
+
+  gpio_set_direction(bus->sda_io, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_direction(bus->scl_io, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_level(bus->sda_io, 1);
+  gpio_set_level(bus->scl_io, 1);
+  esp_rom_delay_us(RECOVER_HALF_US);
+
+  for(uint8_t x = 0; x < I2CMANAGER_RECOVER_CLOCKS && !gpio_get_level(bus->sda_io); x++)     // Slave shifts out the rest of its byte and lets go
+  {
+    gpio_set_level(bus->scl_io, 0);
+    esp_rom_delay_us(RECOVER_HALF_US);
+    gpio_set_level(bus->scl_io, 1);
+    esp_rom_delay_us(RECOVER_HALF_US);
+  }
+
+  gpio_set_level(bus->scl_io, 0);                                                               // STOP, SDA rises while SCL is high
+  esp_rom_delay_us(RECOVER_HALF_US);
+  gpio_set_level(bus->sda_io, 0);
+  esp_rom_delay_us(RECOVER_HALF_US);
+  gpio_set_level(bus->scl_io, 1);
+  esp_rom_delay_us(RECOVER_HALF_US);
+  gpio_set_level(bus->sda_io, 1);
+  esp_rom_delay_us(RECOVER_HALF_US);
+
+  released = gpio_get_level(bus->sda_io);
+
+  ESP_LOGW(TAG, "Bus Recovery. Port: %d SDA: %s", port, released ? "released" : "held low");
+
+  rslt = I2CMANAGERInstallDrivers(bus);
+
+  if(rslt != ESP_OK)
+    return rslt;
+
+  return released ? ESP_OK : I2CMANAGER_ERR_BUS_STUCK;
+}
+
+static bool I2CMANAGERIdfSdaLow(void *ctx, uint8_t port)
+{
+  const i2cmanager_bus_config_t *bus = &bus_cfg[port];
+
+  if(gpio_get_level(bus->sda_io))                                                               // The driver leaves the pad input enabled
+    return false;
+
+  esp_rom_delay_us(2 * RECOVER_HALF_US);                                                        // Low for a whole bit time, not a data edge
+
+  return !gpio_get_level(bus->sda_io);
+}
@@ -0,0 +1,122 @@
+#include "I2CManagerLinux.h"
+#include <esp_log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define LINUX_WRITE_MAX 64      /*!< Register byte plus payload, larger than any MAX31790 burst */
+#define LINUX_TIMEOUT_10MS 50   /*!< Adapter timeout in 10 ms units, for calls without a deadline */
+
+static const char *TAG = "I2C Linux";
+
+static esp_err_t I2CMANAGERLinuxWrite(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout);
+static esp_err_t I2CMANAGERLinuxRead(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout);
+static esp_err_t I2CMANAGERLinuxTimeout(i2cmanager_linux_t *bus, TickType_t timeout);
+static esp_err_t I2CMANAGERLinuxErr(int err);
+
+const i2cmanager_backend_t i2cmanager_linux_backend =
+{
+  .write = I2CMANAGERLinuxWrite,
+  .read = I2CMANAGERLinuxRead
+};
+
+esp_err_t I2CMANAGER_linux_open(i2cmanager_linux_t *bus, const char *path)
+{
+  ESP_LOGD(TAG, "Opening %s", path);
+
+  bus->fd = open(path, O_RDWR | O_CLOEXEC);
+
+  if(bus->fd < 0)
+    return ESP_ERR_NOT_FOUND;
+
+  bus->timeout_10ms = 0;                                                                        // Set by the first transfer
+
+  return ESP_OK;
+}
+
+void I2CMANAGER_linux_close(i2cmanager_linux_t *bus)
+{
+  if(bus->fd >= 0)
+    close(bus->fd);
+
+  bus->fd = -1;
+}
+
+static esp_err_t I2CMANAGERLinuxWrite(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout)
+{
+  i2cmanager_linux_t *bus = (i2cmanager_linux_t *)ctx;
+  uint8_t w_buff[LINUX_WRITE_MAX];
+
+  if(len + 1 > sizeof(w_buff))
+    return ESP_ERR_INVALID_SIZE;
+
+  esp_err_t rslt = I2CMANAGERLinuxTimeout(bus, timeout);
+  if(rslt != ESP_OK)
+    return rslt;
+
+  w_buff[0] = reg;
+  memcpy(w_buff + 1, buff, len);
+
+  struct i2c_msg msg = { .addr = adr, .flags = 0, .len = len + 1, .buf = w_buff };
+  struct i2c_rdwr_ioctl_data data = { .msgs = &msg, .nmsgs = 1 };
+
+  return (ioctl(bus->fd, I2C_RDWR, &data) < 0) ? I2CMANAGERLinuxErr(errno) : ESP_OK;
+}
+
+static esp_err_t I2CMANAGERLinuxRead(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout)
+{
+  i2cmanager_linux_t *bus = (i2cmanager_linux_t *)ctx;
+
+  esp_err_t rslt = I2CMANAGERLinuxTimeout(bus, timeout);
+  if(rslt != ESP_OK)
+    return rslt;
+
+  struct i2c_msg msgs[2] =                                                                      // Repeated start between the two
+  {
+    { .addr = adr, .flags = 0, .len = 1, .buf = &reg },
+    { .addr = adr, .flags = I2C_M_RD, .len = len, .buf = buff }
+  };
+  struct i2c_rdwr_ioctl_data data = { .msgs = msgs, .nmsgs = 2 };
+
+  return (ioctl(bus->fd, I2C_RDWR, &data) < 0) ? I2CMANAGERLinuxErr(errno) : ESP_OK;
+}
+
+static esp_err_t I2CMANAGERLinuxTimeout(i2cmanager_linux_t *bus, TickType_t timeout)
+{
+  uint32_t timeout_10ms = LINUX_TIMEOUT_10MS;
+
+  if(!timeout)                                                                                  // No budget left, the adapter cannot go below one 10 ms unit
+    return ESP_ERR_TIMEOUT;
+
+  if(timeout != portMAX_DELAY)
+    timeout_10ms = (pdTICKS_TO_MS(timeout) + 9) / 10;                                           // Rounded up, a short deadline still gets one unit
+
+  if(timeout_10ms == bus->timeout_10ms)                                                         // Unchanged since the last transfer, skip the ioctl
+    return ESP_OK;
+
+  if(ioctl(bus->fd, I2C_TIMEOUT, (unsigned long)timeout_10ms) < 0)
+    return I2CMANAGERLinuxErr(errno);
+
+  bus->timeout_10ms = timeout_10ms;
+
+  return ESP_OK;
+}
+
+static esp_err_t I2CMANAGERLinuxErr(int err)
+{
+  switch(err)
+  {
+    case ENXIO:
+    case EREMOTEIO:
+      return I2CMANAGER_ERR_NACK;
+    case ETIMEDOUT:
+      return ESP_ERR_TIMEOUT;
+    default:
+      return ESP_ERR_INVALID_STATE;
+  }
+}
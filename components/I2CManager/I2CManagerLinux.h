@@ -0,0 +1,21 @@
+#ifndef _I2CMANAGER_LINUX_H
+#define _I2CMANAGER_LINUX_H
+
+#include "I2CManager.h"
+
+typedef struct                                                      /*!< One /dev/i2c-N adapter, pass as the backend ctx */
+{
+  int fd;
+  uint32_t timeout_10ms;                                            /*!< Adapter timeout last set, 0 none yet */
+} i2cmanager_linux_t;
+
+extern const i2cmanager_backend_t i2cmanager_linux_backend;        /*!< I2C_RDWR, reads are one combined write/read message pair.
+                                                                         Each transfer sets I2C_TIMEOUT from its own timeout, rounded up
+                                                                         to 10 ms so it can overrun by that much. A zero budget fails with
+                                                                         ESP_ERR_TIMEOUT off the bus, portMAX_DELAY takes 500 ms. The
+                                                                         timeout is per adapter, not per fd, and drivers may ignore it. */
+
+esp_err_t I2CMANAGER_linux_open(i2cmanager_linux_t *bus, const char *path);
+void I2CMANAGER_linux_close(i2cmanager_linux_t *bus);
+
+#endif
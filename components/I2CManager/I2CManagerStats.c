@@ -0,0 +1,180 @@
+#include "I2CManager.h"
+#include <string.h>
+
+#define STATS_DUMP_MAGIC "I2CS"
+#define STATS_DUMP_VERSION 1
+
+#if CONFIG_I2CMANAGER_STATS
+
+static i2cmanager_stats_t stats[I2CMANAGER_NUM_PORTS];
+
+static uint8_t I2CMANAGERBucket(int64_t us);
+static i2cmanager_err_class_t I2CMANAGERErrClass(esp_err_t rslt);
+static uint8_t *I2CMANAGERPut32(uint8_t *buff, uint32_t val);
+static uint8_t *I2CMANAGERPut64(uint8_t *buff, uint64_t val);
+static uint8_t *I2CMANAGERPutHist(uint8_t *buff, const uint32_t *hist);
+
+void I2CMANAGER_stats_lock(uint8_t port, int64_t wait_us, bool taken)
+{
+  i2cmanager_stats_t *s = &stats[port];
+
+  if(!taken)                                                                                    // Token not held, the counter is shared
+  {
+    __atomic_add_fetch(&s->lock_timeouts, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  s->lock_takes++;
+  s->lock_us_total += wait_us;
+  s->lock_hist[I2CMANAGERBucket(wait_us)]++;
+
+  if(wait_us > s->lock_us_max)
+    s->lock_us_max = wait_us;
+}
+
+void I2CMANAGER_stats_op(uint8_t port, i2cmanager_op_t op, size_t len, int64_t bus_us, esp_err_t rslt)
+{
+  i2cmanager_op_stats_t *s = &stats[port].op[op];                                               // Caller holds the port token
+
+  s->calls++;
+  s->errors[I2CMANAGERErrClass(rslt)]++;
+  s->bus_us_total += bus_us;
+  s->bus_hist[I2CMANAGERBucket(bus_us)]++;
+
+  if(rslt == ESP_OK)
+    s->bytes += len;
+
+  if(bus_us > s->bus_us_max)
+    s->bus_us_max = bus_us;
+}
+
+esp_err_t I2CMANAGER_stats_get(uint8_t port, i2cmanager_stats_t *out)
+{
+  if(port >= I2CMANAGER_NUM_PORTS || !out)
+    return ESP_ERR_INVALID_ARG;
+
+  esp_err_t rslt = I2CMANAGER_take(port, pdMS_TO_TICKS(I2CMANAGER_LOCK_MS));
+
+  if(rslt != ESP_OK)
+    return rslt;
+
+  memcpy(out, &stats[port], sizeof(*out));
+  out->lock_timeouts = __atomic_load_n(&stats[port].lock_timeouts, __ATOMIC_RELAXED);
+
+  I2CMUTEX_GIVE_PORT(port);
+
+  return ESP_OK;
+}
+
+esp_err_t I2CMANAGER_stats_reset(uint8_t port)
+{
+  if(port >= I2CMANAGER_NUM_PORTS)
+    return ESP_ERR_INVALID_ARG;
+
+  esp_err_t rslt = I2CMANAGER_take(port, pdMS_TO_TICKS(I2CMANAGER_LOCK_MS));
+
+  if(rslt != ESP_OK)
+    return rslt;
+
+  memset(&stats[port], 0, sizeof(stats[port]));                                                 // The take above is counted against the old figures
+
+  I2CMUTEX_GIVE_PORT(port);
+
+  return ESP_OK;
+}
+
+esp_err_t I2CMANAGER_stats_dump(uint8_t port, uint8_t *buff, size_t len)
+{
+  i2cmanager_stats_t s;
+
+  if(!buff || len < I2CMANAGER_STATS_DUMP_SIZE)
+    return ESP_ERR_INVALID_SIZE;
+
+  esp_err_t rslt = I2CMANAGER_stats_get(port, &s);
+
+  if(rslt != ESP_OK)
+    return rslt;
+
+  memcpy(buff, STATS_DUMP_MAGIC, 4);
+  buff[4] = STATS_DUMP_VERSION;
+  buff[5] = port;
+  buff[6] = I2CMANAGER_STATS_BUCKETS;
+  buff[7] = I2CMANAGER_ERR_CLASSES;
+  buff += 8;
+
+  for(uint8_t op = I2CMANAGER_OP_WRITE; op <= I2CMANAGER_OP_READ; op++)
+  {
+    buff = I2CMANAGERPut32(buff, s.op[op].calls);
+    for(uint8_t x = 0; x < I2CMANAGER_ERR_CLASSES; x++)
+      buff = I2CMANAGERPut32(buff, s.op[op].errors[x]);
+    buff = I2CMANAGERPut64(buff, s.op[op].bytes);
+    buff = I2CMANAGERPut64(buff, s.op[op].bus_us_total);
+    buff = I2CMANAGERPut32(buff, s.op[op].bus_us_max);
+    buff = I2CMANAGERPutHist(buff, s.op[op].bus_hist);
+  }
+
+  buff = I2CMANAGERPut32(buff, s.lock_takes);
+  buff = I2CMANAGERPut32(buff, s.lock_timeouts);
+  buff = I2CMANAGERPut64(buff, s.lock_us_total);
+  buff = I2CMANAGERPut32(buff, s.lock_us_max);
+  I2CMANAGERPutHist(buff, s.lock_hist);
+
+  return ESP_OK;
+}
+
+static uint8_t I2CMANAGERBucket(int64_t us)
+{
+  uint8_t bucket = 0;
+
+  for(; us > 0 && bucket < I2CMANAGER_STATS_BUCKETS - 1; us >>= 1)
+    bucket++;
+
+  return bucket;
+}
+
+static i2cmanager_err_class_t I2CMANAGERErrClass(esp_err_t rslt)
+{
+  switch(rslt)
+  {
+    case ESP_OK:                  return I2CMANAGER_ERR_OK;
+    case ESP_FAIL:
+    case I2CMANAGER_ERR_NACK:     return I2CMANAGER_ERR_FAIL;
+    case ESP_ERR_TIMEOUT:
+    case I2CMANAGER_ERR_DEADLINE:
+    case I2CMANAGER_ERR_LOCK:     return I2CMANAGER_ERR_TIMEOUT;
+    case ESP_ERR_INVALID_STATE:   return I2CMANAGER_ERR_INVALID_STATE;
+    case ESP_ERR_INVALID_ARG:     return I2CMANAGER_ERR_INVALID_ARG;
+    default:                      return I2CMANAGER_ERR_OTHER;
+  }
+}
+
+static uint8_t *I2CMANAGERPut32(uint8_t *buff, uint32_t val)
+{
+  for(uint8_t x = 0; x < 4; x++)
+    *buff++ = val >> (8 * x);
+
+  return buff;
+}
+
+static uint8_t *I2CMANAGERPut64(uint8_t *buff, uint64_t val)
+{
+  buff = I2CMANAGERPut32(buff, (uint32_t)val);
+
+  return I2CMANAGERPut32(buff, (uint32_t)(val >> 32));
+}
+
+static uint8_t *I2CMANAGERPutHist(uint8_t *buff, const uint32_t *hist)
+{
+  for(uint8_t x = 0; x < I2CMANAGER_STATS_BUCKETS; x++)
+    buff = I2CMANAGERPut32(buff, hist[x]);
+
+  return buff;
+}
+
+#else
+
+esp_err_t I2CMANAGER_stats_get(uint8_t port, i2cmanager_stats_t *out) { return ESP_ERR_NOT_SUPPORTED; }
+esp_err_t I2CMANAGER_stats_reset(uint8_t port) { return ESP_ERR_NOT_SUPPORTED; }
+esp_err_t I2CMANAGER_stats_dump(uint8_t port, uint8_t *buff, size_t len) { return ESP_ERR_NOT_SUPPORTED; }
+
+#endif
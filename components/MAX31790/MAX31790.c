@@ -8,300 +8,935 @@
 #include "MAX31790.h"
 #include "I2CManager.h"
 
-#include <driver/i2c.h>
-#include <math.h>
+#include <string.h>
 #include <esp_log.h>
 
-static max31790_master_config_t *max31790_config;
+#define CRC8_POLY 0x07
+#define CRC8_INIT 0xFF                                                                              // A blank, all zero page does not check
+#define BATCH_BRIDGE_MAX 2                                                                          // Cached registers rewritten to join two runs, cheaper than a new START/address/register
 
 static const char *TAG = "MAX31790";
 static const uint8_t sr_map[6] = {1, 2, 4, 8, 16, 32};
 
-static esp_err_t MAX31790_write(uint8_t w_adr, uint8_t w_len);
-static esp_err_t MAX31790_read(uint8_t r_adr, uint8_t r_len);
-static inline esp_err_t MAX31790_read8(uint8_t r_adr, uint8_t *ret_val);
-
-esp_err_t MAX31790_initiate(max31790_master_config_t *cfg)
+static esp_err_t MAX31790_write(max31790_handle_t dev, uint8_t w_adr, const uint8_t *w_buff, uint8_t w_len);
+static esp_err_t MAX31790_write_locked(max31790_handle_t dev, uint8_t w_adr, const uint8_t *w_buff, uint8_t w_len);
+static esp_err_t MAX31790_read(max31790_handle_t dev, uint8_t r_adr, uint8_t *r_buff, uint8_t r_len);
+static esp_err_t MAX31790_write_async(max31790_handle_t dev, uint8_t w_adr, const uint8_t *w_buff, uint8_t w_len, i2cmanager_token_t *token, i2cmanager_cb_t cb, void *arg);
+static inline esp_err_t MAX31790_write8(max31790_handle_t dev, uint8_t w_adr, uint8_t val);
+static inline esp_err_t MAX31790_read8(max31790_handle_t dev, uint8_t r_adr, uint8_t *ret_val);
+static void MAX31790_update_tach_k(max31790_handle_t dev, uint8_t channel);
+static uint32_t MAX31790_range_k(uint8_t fan_dyn);
+static uint16_t MAX31790_rpm_to_count_k(max31790_handle_t dev, uint8_t channel, uint32_t rpm, uint32_t k);
+static void MAX31790_range_settle(max31790_handle_t dev, uint8_t reg, const uint8_t *buff, uint8_t len);
+static inline bool MAX31790_bit_get(const uint8_t *map, uint8_t reg);
+static inline void MAX31790_bit_set(uint8_t *map, uint8_t reg, bool val);
+static bool MAX31790_shadow_covers(max31790_handle_t dev, uint8_t reg, uint8_t len);
+static void MAX31790_shadow_update(max31790_handle_t dev, uint8_t reg, const uint8_t *buff, uint8_t len, bool reached_hw);
+static void MAX31790_write_settle(const i2cmanager_req_t *req, esp_err_t rslt);
+static esp_err_t MAX31790_attach(max31790_handle_t dev);
+static void MAX31790_stage_master_config(max31790_handle_t dev, max31790_batch_t *batch);
+static void MAX31790_batch_plan(max31790_batch_t *batch, uint8_t pending[REG_MAP_SIZE / 8], bool from_shadow);
+
+esp_err_t MAX31790_initiate(max31790_handle_t dev)
 {
+    esp_err_t err_ret = ESP_OK;
+
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
-    ESP_LOGD(TAG, "Initiate");
+    ESP_LOGD(TAG, "Initiate. Adr: 0x%02X Port: %d", dev->adr, dev->port);
+
+    err_ret = MAX31790_attach(dev);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    MAX31790_invalidate_cache(dev);
 
-    return MAX31790_set_master_config(cfg);
+    return MAX31790_set_master_config(dev);
 }  
 
-/* Set --------------------------------------------------------------------------------------- */
-esp_err_t MAX31790_set_master_config(max31790_master_config_t *cfg)
+esp_err_t MAX31790_initiate_warm(max31790_handle_t dev, bool *resumed, uint8_t *rewritten)
+{
+    uint8_t live[MAX31790_REG_SEQ_START_CONFIG + 1] = {0};
+    uint8_t targets[MAX31790_REG_TARGET_COUNT(NUM_CHANNEL) - MAX31790_REG_TARGET_DUTY(0)] = {0};
+    max31790_batch_t batch;
+    esp_err_t err_ret = ESP_OK;
+    uint8_t changed = 0;
+    bool running = false;
+
+    esp_log_level_set(TAG, ESP_LOG_DEBUG);
+    ESP_LOGD(TAG, "Warm initiate. Adr: 0x%02X Port: %d", dev->adr, dev->port);
+
+    if(resumed)
+        *resumed = false;
+    if(rewritten)
+        *rewritten = 0;
+
+    err_ret = MAX31790_attach(dev);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    MAX31790_invalidate_cache(dev);
+
+    err_ret = MAX31790_read(dev, MAX31790_REG_GLOBAL_CONFIG, live, sizeof(live));                    // 0x00 - 0x14, the shadow learns what the chip holds
+    if(err_ret == ESP_OK)
+        err_ret = MAX31790_read(dev, MAX31790_REG_TARGET_DUTY(0), targets, sizeof(targets));         // 0x40 - 0x5B, setpoints carry on as they are
+
+    if(err_ret != ESP_OK)
+    {
+        MAX31790_invalidate_cache(dev);
+        return err_ret;
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)                                                        // Anything off the power-on values was set by an earlier run
+        running |= live[MAX31790_REG_FAN_CONFIG(x)] != MAX31790_POR_FAN_CONFIG || live[MAX31790_REG_FAN_DYNAMIC(x)] != MAX31790_POR_FAN_DYNAMIC;
+
+    if(live[MAX31790_REG_GLOBAL_CONFIG] & MAX31790_GLO_I2C_WD_STATUS)
+        ESP_LOGW(TAG, "I2C watchdog expired while the host was away. Adr: 0x%02X", dev->adr);
+
+    MAX31790_stage_master_config(dev, &batch);
+
+    if(!((live[MAX31790_REG_GLOBAL_CONFIG] ^ dev->global_cfg) & ~(MAX31790_GLO_I2C_WD_STATUS | MAX31790_GLO_RESET_RESET)))   // Volatile only for its status bit
+        MAX31790_bit_set(batch.staged, MAX31790_REG_GLOBAL_CONFIG, false);
+
+    for(uint8_t x = 0; x < sizeof(live); x++)
+        changed += MAX31790_bit_get(batch.staged, x) && batch.data[x] != live[x];
+
+    ESP_LOGD(TAG, "Warm initiate. %s, rewriting %d registers", running ? "Resumed" : "Power-on state", changed);
+
+    if(resumed)
+        *resumed = running;
+    if(rewritten)
+        *rewritten = changed;
+
+    return MAX31790_batch_commit(&batch);                                                           // Equal registers are dropped against the shadow
+}
+
+void MAX31790_set_deadline(max31790_handle_t dev, int64_t deadline_us)
 {
-    max31790_config = cfg;
+    dev->deadline_us = deadline_us;
+}
 
+/* Cache ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_resync(max31790_handle_t dev)
+{
     esp_err_t err_ret = ESP_OK;
 
-    err_ret += MAX31790_set_global_config(max31790_config->global_cfg);
-    err_ret += MAX31790_set_failed_fan_seq_start(max31790_config->fan_failed_seq_start_cfg);
+    MAX31790_invalidate_cache(dev);
 
-    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    err_ret = MAX31790_read(dev, MAX31790_REG_GLOBAL_CONFIG, dev->shadow, MAX31790_REG_PWM_DUTY(NUM_CHANNEL));   // 0x00 - 0x3B
+    if(err_ret == ESP_OK)
+        err_ret = MAX31790_read(dev, MAX31790_REG_TARGET_DUTY(0), dev->shadow + MAX31790_REG_TARGET_DUTY(0), REG_MAP_SIZE - MAX31790_REG_TARGET_DUTY(0));
+
+    if(err_ret != ESP_OK)
+        MAX31790_invalidate_cache(dev);
+
+    return err_ret;
+}
+
+esp_err_t MAX31790_flush(max31790_handle_t dev)
+{
+    esp_err_t err_ret = ESP_OK;
+    uint8_t end = 0;
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x = end)
     {
-        err_ret += MAX31790_set_fan_config(max31790_config->fan_cfg[x], x);
-        err_ret += MAX31790_set_fan_dynamic(max31790_config->fan_dyn[x], x);
+        end = x + 1;
+
+        if(!MAX31790_bit_get(dev->shadow_dirty, x))
+            continue;
+
+        while(end < REG_MAP_SIZE && MAX31790_bit_get(dev->shadow_dirty, end))                          // Extend across adjacent dirty registers
+            end++;
+
+        esp_err_t rslt = MAX31790_write(dev, x, dev->shadow + x, end - x);
+
+        if(rslt != ESP_OK && err_ret == ESP_OK)                                                     // First failure, keeps NACK and timeout apart
+            err_ret = rslt;
     }
 
-    max31790_config->write_buff[0] = max31790_config->fault_mask_1;
-    err_ret += MAX31790_write(MAX31790_REG_FAN_FAULT_MASK_1, 1);
-    max31790_config->write_buff[0] = max31790_config->fault_mask_2;
-    err_ret += MAX31790_write(MAX31790_REG_FAN_FAULT_MASK_2, 1);
-    
     return err_ret;
 }
 
-esp_err_t MAX31790_set_target_rpm(uint8_t channel, uint32_t RPM)
+void MAX31790_invalidate_cache(max31790_handle_t dev)
+{
+    memset(dev->shadow_valid, 0, sizeof(dev->shadow_valid));
+    memset(dev->shadow_dirty, 0, sizeof(dev->shadow_dirty));
+}
+
+/* Batch ------------------------------------------------------------------------------------- */
+void MAX31790_batch_begin(max31790_batch_t *batch, max31790_handle_t dev)
+{
+    batch->dev = dev;
+    memset(batch->staged, 0, sizeof(batch->staged));
+}
+
+esp_err_t MAX31790_batch_stage(max31790_batch_t *batch, uint8_t reg, const uint8_t *buff, uint8_t len)
+{
+    if(reg + len > REG_MAP_SIZE)
+        return ESP_ERR_INVALID_ARG;
+
+    for(uint8_t x = 0; x < len; x++)
+    {
+        batch->data[reg + x] = buff[x];
+        MAX31790_bit_set(batch->staged, reg + x, true);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_batch_stage_dutybits(max31790_batch_t *batch, uint8_t channel, uint16_t dutybits)
+{
+    uint8_t w_buff[2] = {0};
+
+    CHCK_CHAN(channel);
+
+    dutybits = CONSTRAIN(dutybits, 0, 511);
+
+    w_buff[0] = LFTJST_TO_MSB(dutybits, 9);
+    w_buff[1] = LFTJST_TO_LSB(dutybits, 9);
+
+    return MAX31790_batch_stage(batch, MAX31790_REG_TARGET_DUTY(channel), w_buff, 2);
+}
+
+esp_err_t MAX31790_batch_stage_target_rpm(max31790_batch_t *batch, uint8_t channel, uint32_t rpm)
+{
+    uint16_t calc = 0;
+    uint8_t w_buff[2] = {0};
+
+    CHCK_CHAN(channel);
+
+    if(MAX31790_bit_get(batch->staged, MAX31790_REG_FAN_DYNAMIC(channel)))                          // Speed range as staged, stage FAN_DYN first
+        calc = MAX31790_rpm_to_count_k(batch->dev, channel, rpm, MAX31790_range_k(batch->data[MAX31790_REG_FAN_DYNAMIC(channel)]));
+    else
+        calc = MAX31790_rpm_to_count(batch->dev, channel, rpm);
+
+    w_buff[0] = LFTJST_TO_MSB(calc, 11);
+    w_buff[1] = LFTJST_TO_LSB(calc, 11);
+
+    return MAX31790_batch_stage(batch, MAX31790_REG_TARGET_COUNT(channel), w_buff, 2);
+}
+
+esp_err_t MAX31790_batch_stage_fan_dynamic(max31790_batch_t *batch, uint8_t channel, uint8_t fan_dyn)
+{
+    CHCK_CHAN(channel);
+
+    return MAX31790_batch_stage(batch, MAX31790_REG_FAN_DYNAMIC(channel), &fan_dyn, 1);
+}
+
+esp_err_t MAX31790_batch_commit(max31790_batch_t *batch)
+{
+    max31790_handle_t dev = batch->dev;
+    uint8_t pending[REG_MAP_SIZE / 8] = {0};
+    esp_err_t err_ret = ESP_OK;
+    esp_err_t rslt = I2CMANAGER_take_until(dev->port, dev->deadline_us);
+    uint8_t end = 0;
+
+    if(rslt != ESP_OK)
+        return rslt;
+
+    MAX31790_batch_plan(batch, pending, true);                                                      // Token held to the last run, no other writer between a bridged copy and its write
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE && rslt != I2CMANAGER_ERR_LOCK; x = end)                     // One auto-increment write per run
+    {
+        end = x + 1;
+
+        if(!MAX31790_bit_get(pending, x))
+            continue;
+
+        while(end < REG_MAP_SIZE && MAX31790_bit_get(pending, end))
+            end++;
+
+        for(uint8_t y = x; y < end; y++)                                                            // A retry backoff lets others in, bridge with what they left
+            if(!MAX31790_bit_get(batch->staged, y))
+                batch->data[y] = dev->shadow[y];
+
+        rslt = MAX31790_write_locked(dev, x, batch->data + x, end - x);
+        if(rslt != ESP_OK && err_ret == ESP_OK)
+            err_ret = rslt;
+    }
+
+    if(rslt != I2CMANAGER_ERR_LOCK)                                                                 // Lost over a backoff, not ours to give
+        I2CMUTEX_GIVE_PORT(dev->port);
+    else
+        err_ret = rslt;
+
+    memset(batch->staged, 0, sizeof(batch->staged));
+
+    return err_ret;
+}
+
+esp_err_t MAX31790_batch_commit_async(max31790_batch_t *batch, i2cmanager_cb_t cb, void *arg, uint8_t *submitted)
+{
+    max31790_handle_t dev = batch->dev;
+    uint8_t pending[REG_MAP_SIZE / 8] = {0};
+    esp_err_t err_ret = ESP_OK;
+    uint8_t end = 0;
+
+    *submitted = 0;
+
+    I2CMUTEX_TAKE_PORT(dev->port);
+    MAX31790_batch_plan(batch, pending, false);                                                     // The engine writes after the token is given, bridge only with staged values
+    I2CMUTEX_GIVE_PORT(dev->port);
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE && err_ret == ESP_OK; x = end)                               // One queued write per run, split at the engine limit
+    {
+        end = x + 1;
+
+        if(!MAX31790_bit_get(pending, x))
+            continue;
+
+        while(end < REG_MAP_SIZE && end - x < I2CMANAGER_ASYNC_MAX_LEN && MAX31790_bit_get(pending, end))
+            end++;
+
+        err_ret = MAX31790_write_async(dev, x, batch->data + x, end - x, NULL, cb, arg);
+        *submitted += (err_ret == ESP_OK);
+    }
+
+    memset(batch->staged, 0, sizeof(batch->staged));
+
+    return err_ret;
+}
+
+/* Set --------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_set_master_config(max31790_handle_t dev)
+{
+    max31790_batch_t batch;
+
+    MAX31790_stage_master_config(dev, &batch);
+    
+    return MAX31790_batch_commit(&batch);
+}
+
+esp_err_t MAX31790_set_all_target_dutybits(max31790_handle_t dev, const uint16_t dutybits[NUM_CHANNEL])
+{
+    max31790_batch_t batch;
+
+    MAX31790_batch_begin(&batch, dev);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_batch_stage_dutybits(&batch, x, dutybits[x]);
+
+    return MAX31790_batch_commit(&batch);
+}
+
+esp_err_t MAX31790_set_target_rpm(max31790_handle_t dev, uint8_t channel, uint32_t RPM)
 {
     uint16_t calc = 0;
+    uint8_t w_buff[2] = {0};
+
+    CHCK_CHAN(channel);
+
+    calc = MAX31790_rpm_to_count(dev, channel, RPM);
+
+    w_buff[0] = LFTJST_TO_MSB(calc, 11);
+    w_buff[1] = LFTJST_TO_LSB(calc, 11);
+
+    return MAX31790_write(dev, MAX31790_REG_TARGET_COUNT(channel), w_buff, 2);
+}
+
+esp_err_t MAX31790_set_target_dutybits(max31790_handle_t dev, uint8_t channel, uint16_t dutybits)
+{
+    uint8_t w_buff[2] = {0};
 
     CHCK_CHAN(channel);
 
-    RPM = CONSTRAIN(RPM, RPM_MIN, RPM_MAX);
-    calc = CALC_RPM_OR_BIT(RPM, sr_map[(MAX31790_FAN_DYN_SR_MASK & max31790_config->fan_dyn[channel]) >> 5], max31790_config->fan_hallcount[channel]);
+    dutybits = CONSTRAIN(dutybits, 0, 511);
 
-    max31790_config->write_buff[0] = LFTJST_TO_MSB(calc, 11);
-    max31790_config->write_buff[1] = LFTJST_TO_LSB(calc, 11);
+    w_buff[0] = LFTJST_TO_MSB(dutybits, 9);
+    w_buff[1] = LFTJST_TO_LSB(dutybits, 9);
 
-    return MAX31790_write(MAX31790_REG_TARGET_COUNT(channel), 2);
+    return MAX31790_write(dev, MAX31790_REG_TARGET_DUTY(channel), w_buff, 2); 
 }
 
-esp_err_t MAX31790_set_target_dutybits(uint8_t channel, uint16_t dutybits)
+esp_err_t MAX31790_set_target_dutybits_async(max31790_handle_t dev, uint8_t channel, uint16_t dutybits, i2cmanager_token_t *token)
 {
+    uint8_t w_buff[2] = {0};
+
     CHCK_CHAN(channel);
 
     dutybits = CONSTRAIN(dutybits, 0, 511);
 
-    max31790_config->write_buff[0] = LFTJST_TO_MSB(dutybits, 9);
-    max31790_config->write_buff[1] = LFTJST_TO_LSB(dutybits, 9);
+    w_buff[0] = LFTJST_TO_MSB(dutybits, 9);
+    w_buff[1] = LFTJST_TO_LSB(dutybits, 9);
 
-    return MAX31790_write(MAX31790_REG_TARGET_DUTY(channel), 2); 
+    return MAX31790_write_async(dev, MAX31790_REG_TARGET_DUTY(channel), w_buff, 2, token, NULL, NULL);
 }
 
-esp_err_t MAX31790_set_fault_mask(uint8_t fan_number)
+esp_err_t MAX31790_set_fault_mask(max31790_handle_t dev, uint8_t fan_number)
 { 
     CHCK_TACH_CHAN(fan_number);
 
     if(fan_number > 5)
     {
-        max31790_config->fault_mask_2 |= (0x01 << (6 - fan_number));
-        max31790_config->write_buff[0] = max31790_config->fault_mask_2;
+        dev->fault_mask_2 |= (0x01 << FAN_TO_CHAN(fan_number));
+        return MAX31790_write8(dev, MAX31790_REG_FAN_FAULT_MASK_2, dev->fault_mask_2);
     }
-    else
-    {
-        max31790_config->fault_mask_1 |= (0x01 << (6 - fan_number));
-        max31790_config->write_buff[0] = max31790_config->fault_mask_1;
-    } 
 
-    return MAX31790_write((fan_number > 5) ? MAX31790_REG_FAN_FAULT_MASK_2 : MAX31790_REG_FAN_FAULT_MASK_1, 1);
+    dev->fault_mask_1 |= (0x01 << fan_number);
+    return MAX31790_write8(dev, MAX31790_REG_FAN_FAULT_MASK_1, dev->fault_mask_1);
 }
 
-esp_err_t MAX31790_set_window(uint8_t cfg, uint8_t channel)
+esp_err_t MAX31790_set_window(max31790_handle_t dev, uint8_t cfg, uint8_t channel)
 {
     CHCK_CHAN(channel);
-    max31790_config->write_buff[0] = cfg;
-    return MAX31790_write(MAX31790_REG_WINDOW(channel), 1);  
+    return MAX31790_write8(dev, MAX31790_REG_WINDOW(channel), cfg);  
 }
 
-esp_err_t MAX31790_set_failed_fan_seq_start(uint8_t ff_ss)
+esp_err_t MAX31790_set_failed_fan_seq_start(max31790_handle_t dev, uint8_t ff_ss)
 {
-    max31790_config->write_buff[0] = ff_ss;
-    return MAX31790_write(MAX31790_REG_SEQ_START_CONFIG, 1);
+    return MAX31790_write8(dev, MAX31790_REG_SEQ_START_CONFIG, ff_ss);
 }
 
-esp_err_t MAX31790_set_global_config(uint8_t cfg)
+esp_err_t MAX31790_set_global_config(max31790_handle_t dev, uint8_t cfg)
 {
-    max31790_config->write_buff[0] = cfg;
-    return MAX31790_write(MAX31790_REG_GLOBAL_CONFIG, 1);
+    return MAX31790_write8(dev, MAX31790_REG_GLOBAL_CONFIG, cfg);
 }
 
-esp_err_t MAX31790_set_pwm_feq(uint8_t bit_freq)
+esp_err_t MAX31790_set_pwm_feq(max31790_handle_t dev, uint8_t bit_freq)
 {
-    max31790_config->write_buff[0] = bit_freq;
-    return MAX31790_write(MAX31790_REG_FREQ_START, 1);
+    return MAX31790_write8(dev, MAX31790_REG_FREQ_START, bit_freq);
 }
 
-esp_err_t MAX31790_set_fan_config(uint8_t fan_cfg, uint8_t channel)
+esp_err_t MAX31790_set_fan_config(max31790_handle_t dev, uint8_t fan_cfg, uint8_t channel)
 {
     CHCK_CHAN(channel);
-    max31790_config->write_buff[0] = fan_cfg;
-    return MAX31790_write(MAX31790_REG_FAN_CONFIG(channel), 1);
+    return MAX31790_write8(dev, MAX31790_REG_FAN_CONFIG(channel), fan_cfg);
 }
 
-esp_err_t MAX31790_set_fan_dynamic(uint8_t fan_dyn, uint8_t channel)
+esp_err_t MAX31790_set_fan_dynamic(max31790_handle_t dev, uint8_t fan_dyn, uint8_t channel)
 {
     CHCK_CHAN(channel);
-    max31790_config->write_buff[0] = fan_dyn;
-    return MAX31790_write(MAX31790_REG_FAN_DYNAMIC(channel), 1);
+
+    return MAX31790_write8(dev, MAX31790_REG_FAN_DYNAMIC(channel), fan_dyn);                        // Conversions follow once the chip has it
+}
+
+esp_err_t MAX31790_set_mode_bumpless(max31790_handle_t dev, uint8_t channel, uint8_t mode)
+{
+    esp_err_t err_ret = ESP_OK;
+    uint8_t fan_cfg = 0;
+    uint8_t live[2] = {0};
+
+    CHCK_CHAN(channel);
+
+    if(mode != MAX31790_FAN_CFG_MODE_PWM && mode != MAX31790_FAN_CFG_MODE_RPM)
+        return ESP_ERR_INVALID_ARG;
+
+    err_ret = MAX31790_read8(dev, MAX31790_REG_FAN_CONFIG(channel), &fan_cfg);                      // Normally served by the shadow
+
+    if(err_ret != ESP_OK || (fan_cfg & MAX31790_FAN_CFG_MODE_RPM) == mode)                          // Already there, seeding now would only disturb it
+        return err_ret;
+
+    if(mode == MAX31790_FAN_CFG_MODE_RPM)                                                           // Target the speed the fan runs at, same range and NP, no conversion
+    {
+        err_ret = MAX31790_read(dev, MAX31790_REG_TACH_COUNT(channel), live, 2);
+        if(err_ret == ESP_OK)
+            err_ret = MAX31790_write(dev, MAX31790_REG_TARGET_COUNT(channel), live, 2);
+    }
+    else                                                                                            // Hold the duty the speed loop settled on
+    {
+        err_ret = MAX31790_read(dev, MAX31790_REG_PWM_DUTY(channel), live, 2);
+        if(err_ret == ESP_OK)
+            err_ret = MAX31790_write(dev, MAX31790_REG_TARGET_DUTY(channel), live, 2);
+    }
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    return MAX31790_write8(dev, MAX31790_REG_FAN_CONFIG(channel), (fan_cfg & ~MAX31790_FAN_CFG_MODE_RPM) | mode);
+}
+
+esp_err_t MAX31790_set_regs(max31790_handle_t dev, uint8_t reg, const uint8_t *buff, uint8_t len)
+{
+    if(!len || reg + len > REG_MAP_SIZE)
+        return ESP_ERR_INVALID_ARG;
+
+    return MAX31790_write(dev, reg, buff, len);                                                     // Conversions follow a range once written
 }
 
 /* Get --------------------------------------------------------------------------------------- */
-esp_err_t MAX31790_get_rpm(uint8_t fan_number, bool isTarget, uint32_t *rpm)
+esp_err_t MAX31790_get_rpm(max31790_handle_t dev, uint8_t fan_number, bool isTarget, uint32_t *rpm)
 {
     esp_err_t err_ret = ESP_OK;
+    uint8_t r_buff[2] = {0};
 
     CHCK_TACH_CHAN(fan_number);
 
-    err_ret = MAX31790_read((isTarget ? MAX31790_REG_TARGET_COUNT(FAN_TO_CHAN(fan_number)) : MAX31790_REG_TACH_COUNT(fan_number)), 2);
-    *rpm = REG_TO_LFTJST(11, max31790_config->read_buff[0], max31790_config->read_buff[1]);    
-    *rpm = CALC_RPM_OR_BIT(*rpm, sr_map[(MAX31790_FAN_DYN_SR_MASK & max31790_config->fan_dyn[FAN_TO_CHAN(fan_number)]) >> 5], max31790_config->fan_hallcount[fan_number]); 
+    err_ret = MAX31790_read(dev, (isTarget ? MAX31790_REG_TARGET_COUNT(FAN_TO_CHAN(fan_number)) : MAX31790_REG_TACH_COUNT(fan_number)), r_buff, 2);
+    *rpm = MAX31790_count_to_rpm(dev, fan_number, REG_TO_LFTJST(11, r_buff[0], r_buff[1]));
+
+    return err_ret;
+}
+
+esp_err_t MAX31790_get_all_rpm(max31790_handle_t dev, uint32_t rpm[NUM_TACH_CHANNEL])
+{
+    esp_err_t err_ret = ESP_OK;
+    uint8_t burst[TACH_COUNT_BURST] = {0};
+
+    uint16_t counts[NUM_TACH_CHANNEL] = {0};
+
+    err_ret = MAX31790_read(dev, MAX31790_REG_TACH_COUNT(0), burst, TACH_COUNT_BURST);
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+        counts[x] = REG_TO_LFTJST(11, burst[x * 2], burst[(x * 2) + 1]);
+
+    MAX31790_counts_to_rpm(dev, counts, rpm);
 
     return err_ret;
 }
 
-esp_err_t MAX31790_get_dutybits(uint8_t channel, bool isTarget, uint16_t *dutybits)
+esp_err_t MAX31790_get_dutybits(max31790_handle_t dev, uint8_t channel, bool isTarget, uint16_t *dutybits)
 {
     esp_err_t err_ret = ESP_OK;
+    uint8_t r_buff[2] = {0};
 
     CHCK_CHAN(channel);
 
-    MAX31790_read((isTarget ? MAX31790_REG_TARGET_DUTY(channel) : MAX31790_REG_PWM_DUTY(channel)), 2);
-    *dutybits = REG_TO_LFTJST(9, max31790_config->read_buff[0], max31790_config->read_buff[1]);
+    err_ret = MAX31790_read(dev, (isTarget ? MAX31790_REG_TARGET_DUTY(channel) : MAX31790_REG_PWM_DUTY(channel)), r_buff, 2);
+    *dutybits = REG_TO_LFTJST(9, r_buff[0], r_buff[1]);
 
     return err_ret;
 }
 
-esp_err_t MAX31790_get_duty(uint8_t channel, bool isTarget, float *fl_duty)
+esp_err_t MAX31790_get_duty(max31790_handle_t dev, uint8_t channel, bool isTarget, float *fl_duty)
 {    
     uint16_t u16buff = 0;
 
     CHCK_CHAN(channel);
     esp_err_t err_ret = ESP_OK;
-    err_ret = MAX31790_get_dutybits(channel, isTarget, &u16buff);
+    err_ret = MAX31790_get_dutybits(dev, channel, isTarget, &u16buff);
     *fl_duty = MAX31790_bits_to_fduty(u16buff);
     return err_ret;
 }
 
-esp_err_t MAX31790_get_target_duty(uint8_t channel, float *tar_duty)
+esp_err_t MAX31790_get_target_duty(max31790_handle_t dev, uint8_t channel, float *tar_duty)
 {    
-    CHCK_CHAN(channel);
-    esp_err_t err_ret = ESP_OK;
-    err_ret = MAX31790_get_dutybits(channel, true, (uint16_t*)tar_duty);
-    *tar_duty = MAX31790_bits_to_fduty((uint16_t)*tar_duty);
-    return err_ret;
+    return MAX31790_get_duty(dev, channel, true, tar_duty);
+}
+
+esp_err_t MAX31790_get_regs(max31790_handle_t dev, uint8_t reg, uint8_t *buff, uint8_t len)
+{
+    if(!len || reg + len > REG_MAP_SIZE)
+        return ESP_ERR_INVALID_ARG;
+
+    return MAX31790_read(dev, reg, buff, len);
+}
+
+esp_err_t MAX31790_get_regs_async(max31790_handle_t dev, uint8_t reg, uint8_t *buff, uint8_t len, i2cmanager_cb_t cb, void *arg)
+{
+    i2cmanager_req_t req =
+    {
+        .op = I2CMANAGER_OP_READ,
+        .prio = I2CMANAGER_PRIO_NORMAL,
+        .adr = dev->adr,
+        .reg = reg,
+        .len = len,
+        .r_buff = buff,
+        .cb = cb,
+        .arg = arg,
+        .deadline_us = dev->deadline_us
+    };
+
+    if(!len || reg + len > REG_MAP_SIZE)
+        return ESP_ERR_INVALID_ARG;
+
+    return I2CMANAGER_submit(dev->port, &req, 0);                                                   // Never block the caller, a full queue is reported
 }
 
-esp_err_t MAX31790_get_global_config(uint8_t *gl_cfg)
+esp_err_t MAX31790_get_global_config(max31790_handle_t dev, uint8_t *gl_cfg)
 {
-    return MAX31790_read8(MAX31790_REG_GLOBAL_CONFIG, gl_cfg);
+    return MAX31790_read8(dev, MAX31790_REG_GLOBAL_CONFIG, gl_cfg);
 }
 
-esp_err_t MAX31790_get_pwm_freq(uint8_t *pwm_freq)
+esp_err_t MAX31790_get_pwm_freq(max31790_handle_t dev, uint8_t *pwm_freq)
 {    
-    return MAX31790_read8(MAX31790_REG_FREQ_START, pwm_freq);
+    return MAX31790_read8(dev, MAX31790_REG_FREQ_START, pwm_freq);
 }
 
-esp_err_t MAX31790_get_failed_fan_seq_opt(uint8_t *ff_seq_opt)
+esp_err_t MAX31790_get_failed_fan_seq_opt(max31790_handle_t dev, uint8_t *ff_seq_opt)
 {
-    return MAX31790_read8(MAX31790_REG_SEQ_START_CONFIG, ff_seq_opt);
+    return MAX31790_read8(dev, MAX31790_REG_SEQ_START_CONFIG, ff_seq_opt);
 }
 
-esp_err_t MAX31790_get_fan_config(uint8_t channel, uint8_t *fan_cfg)
+esp_err_t MAX31790_get_fan_config(max31790_handle_t dev, uint8_t channel, uint8_t *fan_cfg)
 {
     CHCK_CHAN(channel);
-    return MAX31790_read8(MAX31790_REG_FAN_CONFIG(channel), fan_cfg);
+    return MAX31790_read8(dev, MAX31790_REG_FAN_CONFIG(channel), fan_cfg);
 }
 
-esp_err_t MAX31790_get_fan_dynamic(uint8_t channel, uint8_t *fan_dyn)
+esp_err_t MAX31790_get_fan_dynamic(max31790_handle_t dev, uint8_t channel, uint8_t *fan_dyn)
 {
     CHCK_CHAN(channel);
-    return MAX31790_read8(MAX31790_REG_FAN_DYNAMIC(channel), fan_dyn);
+    return MAX31790_read8(dev, MAX31790_REG_FAN_DYNAMIC(channel), fan_dyn);
 }
 
-esp_err_t MAX31790_get_fault_mask(uint8_t num, uint8_t *f_mask)
+esp_err_t MAX31790_get_fault_mask(max31790_handle_t dev, uint8_t num, uint8_t *f_mask)
 { 
     CHCK_TACH_CHAN(num);
-    return ((num < 5) ? MAX31790_read8(MAX31790_REG_FAN_FAULT_MASK_1, f_mask) : MAX31790_read8(MAX31790_REG_FAN_FAULT_MASK_2, f_mask));
+    return ((num > 5) ? MAX31790_read8(dev, MAX31790_REG_FAN_FAULT_MASK_2, f_mask) : MAX31790_read8(dev, MAX31790_REG_FAN_FAULT_MASK_1, f_mask));
 }
 
-esp_err_t MAX31790_get_fault_status(uint8_t num, uint8_t *f_status)
+esp_err_t MAX31790_get_fault_status(max31790_handle_t dev, uint8_t num, uint8_t *f_status)
 { 
     CHCK_TACH_CHAN(num);
-    return ((num < 5) ? MAX31790_read8(MAX31790_REG_FAN_FAULT_STATUS_1, f_status) : MAX31790_read8(MAX31790_REG_FAN_FAULT_STATUS_2, f_status));
+    return ((num > 5) ? MAX31790_read8(dev, MAX31790_REG_FAN_FAULT_STATUS_2, f_status) : MAX31790_read8(dev, MAX31790_REG_FAN_FAULT_STATUS_1, f_status));
+}
+
+esp_err_t MAX31790_get_fault_status_all(max31790_handle_t dev, uint16_t *fans)
+{
+    uint8_t r_buff[2] = {0};
+    esp_err_t err_ret = MAX31790_read(dev, MAX31790_REG_FAN_FAULT_STATUS_2, r_buff, 2);          // 0x10 - 0x11
+
+    *fans = (err_ret == ESP_OK) ? (((r_buff[0] & 0x3F) << NUM_CHANNEL) | (r_buff[1] & 0x3F)) : 0;
+
+    return err_ret;
+}
+
+esp_err_t MAX31790_clear_fault_status(max31790_handle_t dev, uint16_t fans)
+{
+    uint8_t w_buff[2] = {0};
+
+    w_buff[0] = 0x3F & ~(fans >> NUM_CHANNEL);                                                      // Write 0 to clear, 1 leaves the bit alone
+    w_buff[1] = 0x3F & ~fans;
+
+    return MAX31790_write(dev, MAX31790_REG_FAN_FAULT_STATUS_2, w_buff, 2);
 }
 
-esp_err_t MAX31790_get_window(uint8_t cfg, uint8_t channel, uint8_t *window)
+esp_err_t MAX31790_get_window(max31790_handle_t dev, uint8_t cfg, uint8_t channel, uint8_t *window)
 {
     CHCK_CHAN(channel);
-    return MAX31790_read8(MAX31790_REG_WINDOW(channel), window);
+    return MAX31790_read8(dev, MAX31790_REG_WINDOW(channel), window);
 }
 
 /* Utility -------------------------------------------------------------------------------------------- */
-static esp_err_t MAX31790_write(uint8_t w_adr, uint8_t w_len)
+static void MAX31790_batch_plan(max31790_batch_t *batch, uint8_t pending[REG_MAP_SIZE / 8], bool from_shadow)   // Caller holds the port token
+{
+    max31790_handle_t dev = batch->dev;
+    uint8_t end = 0;
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x++)                                                        // Drop what the chip already holds
+        if(MAX31790_bit_get(batch->staged, x) && !(MAX31790_shadow_covers(dev, x, 1) && dev->shadow[x] == batch->data[x]))
+            MAX31790_bit_set(pending, x, true);
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x++)                                                        // Bridge short gaps of known registers
+    {
+        if(MAX31790_bit_get(pending, x) || !MAX31790_shadow_covers(dev, x, 1) || !(from_shadow || MAX31790_bit_get(batch->staged, x)))
+            continue;
+
+        for(end = x; end < REG_MAP_SIZE && !MAX31790_bit_get(pending, end) && end - x < BATCH_BRIDGE_MAX; end++)
+            if(!MAX31790_shadow_covers(dev, end, 1) || !(from_shadow || MAX31790_bit_get(batch->staged, end)))
+                break;
+
+        if(x > 0 && MAX31790_bit_get(pending, x - 1) && end < REG_MAP_SIZE && MAX31790_bit_get(pending, end))
+        {
+            for(; x < end; x++)
+            {
+                if(!MAX31790_bit_get(batch->staged, x))
+                    batch->data[x] = dev->shadow[x];
+
+                MAX31790_bit_set(pending, x, true);
+            }
+        }
+    }
+}
+
+static esp_err_t MAX31790_attach(max31790_handle_t dev)
 {
-    I2CMUTEX_TAKE;
+    i2cmanager_dev_config_t i2c_cfg = {.port = dev->port, .adr = dev->adr, .timeout_ms = dev->timeout_ms, .retries = dev->retries, .backoff_ms = dev->backoff_ms};
 
+    if(dev->i2c)                                                                                    // Once, a re-initiate keeps its registry slot
+        return ESP_OK;
+
+    return I2CMANAGER_attach(&i2c_cfg, &dev->i2c);
+}
+
+static void MAX31790_stage_master_config(max31790_handle_t dev, max31790_batch_t *batch)
+{
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_update_tach_k(dev, x);
+
+    MAX31790_batch_begin(batch, dev);
+
+    MAX31790_batch_stage(batch, MAX31790_REG_GLOBAL_CONFIG, &dev->global_cfg, 1);
+    MAX31790_batch_stage(batch, MAX31790_REG_FAN_CONFIG(0), dev->fan_cfg, NUM_CHANNEL);             // 0x02 - 0x07
+    MAX31790_batch_stage(batch, MAX31790_REG_FAN_DYNAMIC(0), dev->fan_dyn, NUM_CHANNEL);            // 0x08 - 0x0D, joins the fan config run
+    MAX31790_batch_stage(batch, MAX31790_REG_FAN_FAULT_MASK_2, &dev->fault_mask_2, 1);
+    MAX31790_batch_stage(batch, MAX31790_REG_FAN_FAULT_MASK_1, &dev->fault_mask_1, 1);
+    MAX31790_batch_stage(batch, MAX31790_REG_SEQ_START_CONFIG, &dev->fan_failed_seq_start_cfg, 1);
+}
+
+static esp_err_t MAX31790_write(max31790_handle_t dev, uint8_t w_adr, const uint8_t *w_buff, uint8_t w_len)
+{
+    esp_err_t ret_err = I2CMANAGER_take_until(dev->port, dev->deadline_us);
+
+    if(ret_err != ESP_OK)
+        return ret_err;
+
+    ret_err = MAX31790_write_locked(dev, w_adr, w_buff, w_len);
+
+    if(ret_err != I2CMANAGER_ERR_LOCK)
+        I2CMUTEX_GIVE_PORT(dev->port);
+
+    return ret_err;
+}
+
+static esp_err_t MAX31790_write_locked(max31790_handle_t dev, uint8_t w_adr, const uint8_t *w_buff, uint8_t w_len)   // Caller holds the port token, not held on I2CMANAGER_ERR_LOCK
+{
     esp_err_t ret_err = ESP_OK;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);    
 
-    ret_err += i2c_master_write_byte(cmd, (max31790_config->adr << 1) | I2C_MASTER_WRITE, true);
-    ret_err += i2c_master_write_byte(cmd, w_adr, true);
+    if(MAX31790_shadow_covers(dev, w_adr, w_len) && !memcmp(dev->shadow + w_adr, w_buff, w_len))    // Unchanged, skip the bus
+    {
+        MAX31790_range_settle(dev, w_adr, w_buff, w_len);
+        return ESP_OK;
+    }
 
-    ret_err += i2c_master_write(cmd, max31790_config->write_buff, w_len, true);
+    ret_err = dev->i2c ? I2CMANAGER_dev_write_until(dev->i2c, w_adr, w_buff, w_len, dev->deadline_us) : ESP_ERR_INVALID_STATE;
 
-    ret_err += i2c_master_stop(cmd);
-    ret_err += i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(500));
+    if(ret_err == I2CMANAGER_ERR_LOCK)                                                              // Lost the token over a retry backoff, the shadow is not ours to touch
+        return ret_err;
 
-    i2c_cmd_link_delete(cmd);
-    
-    max31790_config->write_buff[0] = 0; max31790_config->write_buff[1] = 0;
+    if(ret_err == ESP_OK)
+        MAX31790_range_settle(dev, w_adr, w_buff, w_len);
 
-    I2CMUTEX_GIVE;
+    MAX31790_shadow_update(dev, w_adr, w_buff, w_len, ret_err == ESP_OK);
+    for(uint8_t x = w_adr; x < w_adr + w_len && x < REG_MAP_SIZE; x++)
+        MAX31790_bit_set(dev->shadow_dirty, x, ret_err != ESP_OK);
 
     return ret_err;
 }
 
-static esp_err_t MAX31790_read(uint8_t r_adr, uint8_t r_len)
+static esp_err_t MAX31790_read(max31790_handle_t dev, uint8_t r_adr, uint8_t *r_buff, uint8_t r_len)
 {
-    I2CMUTEX_TAKE;
+    esp_err_t ret_err = I2CMANAGER_take_until(dev->port, dev->deadline_us);
+
+    if(ret_err != ESP_OK)
+        return ret_err;
+
+    if(MAX31790_shadow_covers(dev, r_adr, r_len))                                                    // Configuration the driver already knows
+    {
+        memmove(r_buff, dev->shadow + r_adr, r_len);
+        I2CMUTEX_GIVE_PORT(dev->port);
+        return ESP_OK;
+    }
 
-    max31790_config->read_buff[0] = 0; max31790_config->read_buff[1] = 0;
+    ret_err = dev->i2c ? I2CMANAGER_dev_read_until(dev->i2c, r_adr, r_buff, r_len, dev->deadline_us) : ESP_ERR_INVALID_STATE;
 
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if(ret_err == I2CMANAGER_ERR_LOCK)
+        return ret_err;
+
+    for(uint8_t x = 0; ret_err == ESP_OK && x < r_len && r_adr + x < REG_MAP_SIZE; x++)
+        if(!MAX31790_bit_get(dev->shadow_dirty, r_adr + x))                                        // A failed write's value is kept for MAX31790_flush()
+            MAX31790_shadow_update(dev, r_adr + x, r_buff + x, 1, true);
+
+    I2CMUTEX_GIVE_PORT(dev->port);
+
+    return ret_err; 
+}
+
+static esp_err_t MAX31790_write_async(max31790_handle_t dev, uint8_t w_adr, const uint8_t *w_buff, uint8_t w_len, i2cmanager_token_t *token, i2cmanager_cb_t cb, void *arg)
+{
     esp_err_t ret_err = ESP_OK;
+    i2cmanager_req_t req =
+    {
+        .op = I2CMANAGER_OP_WRITE,
+        .prio = I2CMANAGER_PRIO_HIGH,
+        .adr = dev->adr,
+        .reg = w_adr,
+        .len = w_len,
+        .token = token,
+        .cb = cb,
+        .arg = arg,
+        .settle = MAX31790_write_settle,
+        .owner = dev,
+        .deadline_us = dev->deadline_us
+    };
 
-    ret_err += i2c_master_start(cmd);
-    ret_err += i2c_master_write_byte(cmd, (max31790_config->adr << 1) | I2C_MASTER_WRITE, true);
-    ret_err += i2c_master_write_byte(cmd, r_adr, true);
+    if(w_len > I2CMANAGER_ASYNC_MAX_LEN || w_adr + w_len > REG_MAP_SIZE)
+        return ESP_ERR_INVALID_SIZE;
 
-    ret_err += i2c_master_start(cmd);
-    ret_err += i2c_master_write_byte(cmd, (max31790_config->adr << 1) | I2C_MASTER_READ, true);
+    memcpy(req.data, w_buff, w_len);
 
-    if (r_len > 1)
-        ret_err += i2c_master_read(cmd, max31790_config->read_buff, r_len-1, I2C_MASTER_ACK);
+    for(uint8_t x = w_adr; x < w_adr + w_len; x++)                                                  // No token here, a telemetry transfer never delays the caller
+        __atomic_add_fetch(&dev->shadow_queued[x], 1, __ATOMIC_ACQ_REL);
 
-    ret_err += i2c_master_read_byte(cmd, max31790_config->read_buff + r_len-1, I2C_MASTER_NACK);
-    ret_err += i2c_master_stop(cmd);
+    ret_err = I2CMANAGER_submit(dev->port, &req, 0);                                                // Never block the caller, a full queue is reported
 
-    ret_err += i2c_master_cmd_begin(I2C_NUM_0, cmd, pdMS_TO_TICKS(500));
+    if(ret_err != ESP_OK)
+        for(uint8_t x = w_adr; x < w_adr + w_len; x++)
+            __atomic_sub_fetch(&dev->shadow_queued[x], 1, __ATOMIC_ACQ_REL);
 
-    i2c_cmd_link_delete(cmd);
-    
-    I2CMUTEX_GIVE;
+    return ret_err;
+}
 
-    return ret_err; 
+static void MAX31790_write_settle(const i2cmanager_req_t *req, esp_err_t rslt)                     // Engine task, port token held unless the take failed
+{
+    max31790_handle_t dev = req->owner;
+
+    if(rslt != I2CMANAGER_ERR_LOCK)                                                                 // As MAX31790_write(), a failed value is kept dirty for MAX31790_flush()
+    {
+        MAX31790_shadow_update(dev, req->reg, req->data, req->len, rslt == ESP_OK);
+        for(uint8_t x = req->reg; x < req->reg + req->len; x++)
+            MAX31790_bit_set(dev->shadow_dirty, x, rslt != ESP_OK);
+
+        if(rslt == ESP_OK)
+            MAX31790_range_settle(dev, req->reg, req->data, req->len);
+    }
+
+    for(uint8_t x = req->reg; x < req->reg + req->len; x++)
+        __atomic_sub_fetch(&dev->shadow_queued[x], 1, __ATOMIC_ACQ_REL);
 }
 
-static inline esp_err_t MAX31790_read8(uint8_t r_adr, uint8_t *ret_val)
+static inline esp_err_t MAX31790_write8(max31790_handle_t dev, uint8_t w_adr, uint8_t val)
 {
-    esp_err_t err_ret = ESP_OK;
-    err_ret = MAX31790_read(r_adr, 1);
-    *ret_val = max31790_config->read_buff[0];
-    return err_ret;
+    return MAX31790_write(dev, w_adr, &val, 1);
+}
+
+static inline esp_err_t MAX31790_read8(max31790_handle_t dev, uint8_t r_adr, uint8_t *ret_val)
+{
+    *ret_val = 0;
+    return MAX31790_read(dev, r_adr, ret_val, 1);
+}
+
+static inline bool MAX31790_bit_get(const uint8_t *map, uint8_t reg)
+{
+    return map[reg >> 3] & (0x01 << (reg & 0x07));
+}
+
+static inline void MAX31790_bit_set(uint8_t *map, uint8_t reg, bool val)
+{
+    if(val)
+        map[reg >> 3] |= (0x01 << (reg & 0x07));
+    else
+        map[reg >> 3] &= ~(0x01 << (reg & 0x07));
+}
+
+static bool MAX31790_shadow_covers(max31790_handle_t dev, uint8_t reg, uint8_t len)
+{
+    if(reg + len > REG_MAP_SIZE)
+        return false;
+
+    for(uint8_t x = reg; x < reg + len; x++)
+        if(REG_IS_VOLATILE(x) || !MAX31790_bit_get(dev->shadow_valid, x) || __atomic_load_n(&dev->shadow_queued[x], __ATOMIC_ACQUIRE))
+            return false;
+
+    return true;
+}
+
+static void MAX31790_shadow_update(max31790_handle_t dev, uint8_t reg, const uint8_t *buff, uint8_t len, bool reached_hw)
+{
+    for(uint8_t x = 0; x < len && reg + x < REG_MAP_SIZE; x++)
+    {
+        if(dev->shadow + reg + x != buff + x)
+            dev->shadow[reg + x] = buff[x];
+
+        MAX31790_bit_set(dev->shadow_valid, reg + x, reached_hw && !REG_IS_VOLATILE(reg + x));
+    }
+}
+
+static void MAX31790_update_tach_k(max31790_handle_t dev, uint8_t channel)
+{
+    uint32_t k = MAX31790_range_k(dev->fan_dyn[channel]);
+
+    dev->tach_k[channel] = k;
+    dev->tach_k[channel + NUM_CHANNEL] = k;                                                         // Inputs 7 - 12 share the range of their PWM channel
+}
+
+static uint32_t MAX31790_range_k(uint8_t fan_dyn)
+{
+    uint8_t sr = (MAX31790_FAN_DYN_SR_MASK & fan_dyn) >> 5;
+
+    return TACH_K(sr_map[sr < sizeof(sr_map) ? sr : sizeof(sr_map) - 1]);
+}
+
+static void MAX31790_range_settle(max31790_handle_t dev, uint8_t reg, const uint8_t *buff, uint8_t len)   // Port token held, the chip holds buff
+{
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        if(MAX31790_REG_FAN_DYNAMIC(x) < reg || MAX31790_REG_FAN_DYNAMIC(x) >= reg + len)
+            continue;
+
+        dev->fan_dyn[x] = buff[MAX31790_REG_FAN_DYNAMIC(x) - reg];
+        MAX31790_update_tach_k(dev, x);
+    }
+}
+
+uint32_t MAX31790_count_to_rpm(max31790_handle_t dev, uint8_t fan_number, uint16_t count)
+{
+    uint32_t div = (uint32_t)count * dev->fan_hallcount[fan_number];                               // At most 2047 * 255, no 64 bit division needed
+
+    if(!div)                                                                                        // Avoid a divide by zero on an unpopulated input
+        return 0;
+
+    return (dev->tach_k[fan_number] + (div >> 1)) / div;
+}
+
+uint16_t MAX31790_rpm_to_count(max31790_handle_t dev, uint8_t channel, uint32_t rpm)
+{
+    return MAX31790_rpm_to_count_k(dev, channel, rpm, dev->tach_k[channel]);
+}
+
+static uint16_t MAX31790_rpm_to_count_k(max31790_handle_t dev, uint8_t channel, uint32_t rpm, uint32_t k)
+{
+    uint32_t div = 0;
+    uint32_t count = 0;
+
+    rpm = CONSTRAIN(rpm, RPM_MIN, RPM_MAX);
+    div = rpm * dev->fan_hallcount[channel];                                                        // At most 7864320 * 255, fits 32 bits
+
+    if(!div)
+        return TACH_COUNT_MAX;
+
+    count = (k + (div >> 1)) / div;
+
+    return CONSTRAIN(count, 1, TACH_COUNT_MAX);
+}
+
+void MAX31790_counts_to_rpm(max31790_handle_t dev, const uint16_t counts[NUM_TACH_CHANNEL], uint32_t rpm[NUM_TACH_CHANNEL])
+{
+    const uint32_t *k = dev->tach_k;
+    const uint8_t *np = dev->fan_hallcount;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)                                                   // Branch free so the loop stays flat in the snapshot path
+    {
+        uint32_t div = (uint32_t)counts[x] * np[x];
+        uint32_t safe = div | !div;
+
+        rpm[x] = ((k[x] + (div >> 1)) / safe) & -(uint32_t)(div != 0);
+    }
+}
+
+uint16_t MAX31790_bits_to_permille(uint16_t bits)
+{
+    bits = CONSTRAIN(bits, 0, DUTYBITS_MAX);
+    return ((uint32_t)bits * PERMILLE_MAX + (DUTYBITS_MAX / 2)) / DUTYBITS_MAX;
+}
+
+uint16_t MAX31790_permille_to_bits(uint16_t permille)
+{
+    permille = CONSTRAIN(permille, 0, PERMILLE_MAX);
+    return ((uint32_t)permille * DUTYBITS_MAX + (PERMILLE_MAX / 2)) / PERMILLE_MAX;
 }
 
 float MAX31790_bits_to_fduty(uint16_t bits)
 {
-    float calc = bits;   
-    calc = round(MAP((calc*10), 0, 511,0, 100));
-    return calc / 10;
+    return MAX31790_bits_to_permille(bits) / 10.0f;
 }
 
 uint16_t MAX31790_fduty_to_bits(float duty)
 {
-    float calc = duty;   
-    return round(MAP(calc, 0, 100, 0, 511)); 
+    duty = CONSTRAIN(duty, 0.0f, 100.0f);
+    return (uint16_t)(duty * (DUTYBITS_MAX / 100.0f) + 0.5f);                                      // Same rounding as round(), no libm
+}
+
+uint8_t MAX31790_crc8(const uint8_t *buff, size_t len)
+{
+    uint8_t crc = CRC8_INIT;
+
+    for(size_t x = 0; x < len; x++)
+    {
+        crc ^= buff[x];
+
+        for(uint8_t b = 0; b < 8; b++)
+            crc = (crc & 0x80) ? (crc << 1) ^ CRC8_POLY : crc << 1;
+    }
+
+    return crc;
 }
@@ -13,6 +13,8 @@
 #include <stdbool.h>
 #include <esp_err.h>
 
+#include "I2CManager.h"
+
 /* MAX31790 Addresses ---------------------- */
 #define MAX31790_DEF_ADDR                   0x20     // 0x40 >> 1  ADD0: GND ADD1: GND
 
@@ -26,14 +28,16 @@
 #define MAX31790_GLO_OSC_INT                0x00
 #define MAX31790_GLO_OSC_EXT                0x08
 #define MAX31790_GLO_I2C_WD                 0x04
+#define MAX31790_GLO_I2C_WD_MASK            0x06
 #define MAX31790_GLO_I2C_WD_STATUS          0x01
 
 // Fan Config Bits //
 #define MAX31790_FAN_CFG_MODE_PWM           0x00
 #define MAX31790_FAN_CFG_MODE_RPM           0x80
 #define MAX31790_FAN_CFG_SPIN_UP_0_5        0x20
-#define MAX31790_FAN_CFG_SPIN_UP_1          0x30
-#define MAX31790_FAN_CFG_SPIN_UP_2          0x40
+#define MAX31790_FAN_CFG_SPIN_UP_1          0x40
+#define MAX31790_FAN_CFG_SPIN_UP_2          0x60
+#define MAX31790_FAN_CFG_SPIN_UP_MASK       0x60
 #define MAX31790_FAN_CFG_CON_MON_CON        0x00
 #define MAX31790_FAN_CFG_CON_MON_MON        0x10
 #define MAX31790_FAN_CFG_TACH_INPUT         0x08
@@ -46,7 +50,7 @@
 #define MAX31790_FAN_DYN_SR_1               0x00
 #define MAX31790_FAN_DYN_SR_2               0x20
 #define MAX31790_FAN_DYN_SR_4               0x40
-#define MAX31790_FAN_DYN_SR_8               0xC0
+#define MAX31790_FAN_DYN_SR_8               0x60
 #define MAX31790_FAN_DYN_SR_16              0x80
 #define MAX31790_FAN_DYN_SR_32              0xA0
 #define MAX31790_FAN_DYN_SR_MASK            0xE0
@@ -67,12 +71,12 @@
 #define MAX31790_FAN_FAILED_SEQ_SSD_0       0x00
 #define MAX31790_FAN_FAILED_SEQ_SSD_250     0x20
 #define MAX31790_FAN_FAILED_SEQ_SSD_500     0x40
-#define MAX31790_FAN_FAILED_SEQ_SSD_1000    0xC0
+#define MAX31790_FAN_FAILED_SEQ_SSD_1000    0x60
 #define MAX31790_FAN_FAILED_SEQ_SSD_2000    0x80
 #define MAX31790_FAN_FAILED_SEQ_SSD_4000    0xA0
 #define MAX31790_FAN_FAILED_SEQ_SSD_MASK    0xE0
 
-#define MAX31790_FAN_FAILED_SEQ_FFO_0       0xE0
+#define MAX31790_FAN_FAILED_SEQ_FFO_0       0x00
 #define MAX31790_FAN_FAILED_SEQ_FFO_CON     0x04
 #define MAX31790_FAN_FAILED_SEQ_FFO_100     0x08
 #define MAX31790_FAN_FAILED_SEQ_FFO_A100    0x0C
@@ -81,8 +85,8 @@
 #define MAX31790_FAN_FAILED_SEQ_FFQ_1       0x00
 #define MAX31790_FAN_FAILED_SEQ_FFQ_2       0x01
 #define MAX31790_FAN_FAILED_SEQ_FFQ_4       0x02
-#define MAX31790_FAN_FAILED_SEQ_FFQ_6       0x04
-#define MAX31790_FAN_FAILED_SEQ_FFQ_MASK    0x04
+#define MAX31790_FAN_FAILED_SEQ_FFQ_6       0x03
+#define MAX31790_FAN_FAILED_SEQ_FFQ_MASK    0x03
 
 // PWM Freq Bits // 
 #define MAX31790_PWM_FREQ_25                0x00
@@ -97,6 +101,7 @@
 #define MAX31790_PWM_FREQ_5K                0x09
 #define MAX31790_PWM_FREQ_12_5K             0x0A
 #define MAX31790_PWM_FREQ_25K               0x0B
+#define MAX31790_PWM_FREQ_MASK              0x0F                                  // Channels 1 - 3, 4 - 6 in the high nibble
 
 /* MAX31790 Register -------------------------------- */
 // Core Bits //
@@ -137,25 +142,47 @@
 #define MAX31790_REG_USER_BYTE_13           0x66
 #define MAX31790_REG_USER_BYTE_14           0x67
 
+// Power-on Values //
+#define MAX31790_POR_FAN_CONFIG             0x00
+#define MAX31790_POR_FAN_DYNAMIC            0x4C
+
 #define NUM_CHANNEL         6
 #define NUM_TACH_CHANNEL    12
 #define RPM_MIN             120
 #define RPM_MAX             7864320
-
-#define CALC_RPM_OR_BIT(X,SR,NP)              ((60 * (SR) * 8192) / (uint64_t)((X) * (NP)))
+#define DUTYBITS_MAX        511
+#define PERMILLE_MAX        1000                                                  // Duty in 0.1 % units
+#define TACH_COUNT_MAX      0x7FF
+#define TACH_COUNT_BURST    (NUM_TACH_CHANNEL * 2)
+#define REG_MAP_SIZE        0x68                                                  // 0x00 - 0x67, includes user bytes
+
+#define TACH_K(SR)                            (60UL * 8192UL * (SR))                                     // RPM * count * NP, at most 15728640
+#define CALC_RPM_OR_BIT(X,SR,NP)              ((TACH_K(SR) + ((uint32_t)(X) * (NP)) / 2) / ((uint32_t)(X) * (NP)))   // 32 bit, rounded to nearest
 #define FAN_TO_CHAN(F)                        (((F) > 5) ? (F - 6) : F)
 #define CONSTRAIN(X, LOW, HIGH)               (((X) < (LOW)) ? (LOW) : ((X) > (HIGH) ? (HIGH) : (X)))
-#define MAP(X, I_MIN, I_MAX, O_MIN, O_MAX)    ((((X) - (I_MIN)) * ((O_MAX) - (O_MIN))) / (((I_MAX) - (I_MIN)) + (O_MIN)))
+#define MAP(X, I_MIN, I_MAX, O_MIN, O_MAX)    ((((X) - (I_MIN)) * ((O_MAX) - (O_MIN))) / ((I_MAX) - (I_MIN)) + (O_MIN))
 #define REG_TO_LFTJST(N, MSB, LSB)            (0xFFFF & ((MSB) << ((N) - 8) | (LSB) >> (16 - (N))))
 #define LFTJST_TO_MSB(N, LJ)                  (0xFF & ((N) >> ((LJ) - 8)))
 #define LFTJST_TO_LSB(N, LJ)                  (0xFF & ((N) << (16 - LJ)))
 
+#define REG_IS_VOLATILE(R)                    ((R) == MAX31790_REG_GLOBAL_CONFIG || (R) == MAX31790_REG_FAN_FAULT_STATUS_2 || \
+                                               (R) == MAX31790_REG_FAN_FAULT_STATUS_1 || ((R) >= MAX31790_REG_TACH_COUNT(0) && (R) < MAX31790_REG_TARGET_DUTY(0)))
+#define REG_IS_USER_BYTE(R)                   ((R) == MAX31790_REG_USER_BYTE_0 || (R) == MAX31790_REG_USER_BYTE_1 || \
+                                               ((R) >= MAX31790_REG_USER_BYTE_2 && (R) <= MAX31790_REG_USER_BYTE_4) || ((R) >= MAX31790_REG_USER_BYTE_5 && (R) <= MAX31790_REG_USER_BYTE_8) || \
+                                               ((R) >= MAX31790_REG_USER_BYTE_9 && (R) <= MAX31790_REG_USER_BYTE_12) || ((R) >= MAX31790_REG_USER_BYTE_13 && (R) <= MAX31790_REG_USER_BYTE_14))
+
 #define CHCK_TACH_CHAN(C)                     do {if((C) >= NUM_TACH_CHANNEL) return ESP_ERR_INVALID_ARG;} while(0)   
 #define CHCK_CHAN(C)                          do {if((C) >= NUM_CHANNEL) return ESP_ERR_INVALID_ARG;} while(0)  
 
 typedef struct
 {
    uint8_t adr;                                 // 0x40 >> 1
+   uint8_t port;                                // I2C port the device sits on, I2C_NUM_0 when left zero
+   uint32_t timeout_ms;                         // Transaction deadline, 0 takes the bus default
+   uint8_t retries;                             // Extra attempts after a NACK or timeout
+   uint32_t backoff_ms;                         // Wait before the first retry, doubles per retry
+   int64_t deadline_us;                         // esp_timer time bounding every bus call, lock wait and retries included, 0 none
+   i2cmanager_dev_t *i2c;                       // Registry slot, attached by MAX31790_initiate()
    uint8_t global_cfg;                          // 0x00;
    uint8_t fan_failed_seq_start_cfg;            // 0x45;
    uint8_t fan_cfg[NUM_CHANNEL];                // {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
@@ -163,67 +190,130 @@ typedef struct
    uint8_t fan_hallcount[NUM_TACH_CHANNEL];     // {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3};
    uint8_t fault_mask_1;                        // 0x3f;
    uint8_t fault_mask_2;                        // 0x3f;
-   uint8_t write_buff[2];
-   uint8_t read_buff[2];
+   uint8_t shadow[REG_MAP_SIZE];                // Driver copy of the register map
+   uint8_t shadow_valid[REG_MAP_SIZE / 8];      // Bit set: shadow matches hardware, reads and equal writes are skipped
+   uint8_t shadow_dirty[REG_MAP_SIZE / 8];      // Bit set: shadow holds a value that failed to reach hardware
+   uint8_t shadow_queued[REG_MAP_SIZE];         // Async writes per register not yet settled by the engine, shadow not trusted while set
+   uint32_t tach_k[NUM_TACH_CHANNEL];           // TACH_K of each input's speed range, refreshed when FAN_DYN is written
 } max31790_master_config_t;
 
+typedef max31790_master_config_t *max31790_handle_t;                              // One per chip, every API call takes the device it targets
+
+typedef struct
+{
+   max31790_handle_t dev;
+   uint8_t data[REG_MAP_SIZE];                  // Staged register values
+   uint8_t staged[REG_MAP_SIZE / 8];            // Bit set: register written on commit
+} max31790_batch_t;
+
 /* Utility -------------------------------------------------------------------------------- */
 float MAX31790_bits_to_fduty(uint16_t bits);
 uint16_t MAX31790_fduty_to_bits(float duty);
+uint16_t MAX31790_bits_to_permille(uint16_t bits);                              // Integer only, rounded to nearest
+uint16_t MAX31790_permille_to_bits(uint16_t permille);                          // Integer only, rounded to nearest
+uint32_t MAX31790_count_to_rpm(max31790_handle_t dev, uint8_t fan_number, uint16_t count);
+uint16_t MAX31790_rpm_to_count(max31790_handle_t dev, uint8_t channel, uint32_t rpm);
+void MAX31790_counts_to_rpm(max31790_handle_t dev, const uint16_t counts[NUM_TACH_CHANNEL], uint32_t rpm[NUM_TACH_CHANNEL]);   // Converts a snapshot without touching the bus
+uint8_t MAX31790_crc8(const uint8_t *buff, size_t len);                         // Poly 0x07, init 0xFF, for records kept in user bytes or flash
 
 /* Setup ---------------------------------------------------------------------------------- */
-esp_err_t MAX31790_initiate(max31790_master_config_t *cfg);
+esp_err_t MAX31790_initiate(max31790_handle_t dev);                                               // Attaches to the I2CManager registry on first call, the port needs a backend.
+
+esp_err_t MAX31790_initiate_warm(max31790_handle_t dev, bool *resumed, uint8_t *rewritten);       // Reads 0x00 - 0x14 and the targets, writes only what differs. resumed: the chip was configured
+                                                                                                  // before and its setpoints were kept, false for a chip at power-on values. Both optional.
+
+void MAX31790_set_deadline(max31790_handle_t dev, int64_t deadline_us);                          // Calls fail with I2CMANAGER_ERR_DEADLINE once passed, 0 clears. Owning task only.
+
+/* Cache ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_resync(max31790_handle_t dev);                                                 // Reloads the shadow from hardware (two burst reads) and drops dirty state.
+
+esp_err_t MAX31790_flush(max31790_handle_t dev);                                                  // Retries registers whose last write failed.
+
+void MAX31790_invalidate_cache(max31790_handle_t dev);                                            // Forces the next access of every register to the bus.
+
+/* Batch ---------------------------------------------------------------------------------- */
+void MAX31790_batch_begin(max31790_batch_t *batch, max31790_handle_t dev);
+
+esp_err_t MAX31790_batch_stage(max31790_batch_t *batch, uint8_t reg, const uint8_t *buff, uint8_t len);
+
+esp_err_t MAX31790_batch_stage_dutybits(max31790_batch_t *batch, uint8_t channel, uint16_t dutybits);
+
+esp_err_t MAX31790_batch_stage_target_rpm(max31790_batch_t *batch, uint8_t channel, uint32_t rpm);   // Converted with the speed range staged in the batch, else the one in effect, stage a range change first.
+
+esp_err_t MAX31790_batch_stage_fan_dynamic(max31790_batch_t *batch, uint8_t channel, uint8_t fan_dyn);   // Speed conversions follow once the commit has written it.
+
+esp_err_t MAX31790_batch_commit(max31790_batch_t *batch);                        // Merges staged registers into the fewest auto-increment writes, unchanged ones are dropped.
+
+esp_err_t MAX31790_batch_commit_async(max31790_batch_t *batch, i2cmanager_cb_t cb, void *arg, uint8_t *submitted);   // Same runs queued on the port engine, gaps bridged with staged values only, cb once per submitted run.
 
 /* Set ------------------------------------------------------------------------------------ */
-esp_err_t MAX31790_set_master_config(max31790_master_config_t *cfg);
+esp_err_t MAX31790_set_master_config(max31790_handle_t dev);                     // Three transactions: global, fan config + dynamics, fault masks + sequencer.
+
+esp_err_t MAX31790_set_all_target_dutybits(max31790_handle_t dev, const uint16_t dutybits[NUM_CHANNEL]);   // One transaction across 0x40 - 0x4B.
+
+esp_err_t MAX31790_set_target_dutybits(max31790_handle_t dev, uint8_t channel, uint16_t dutybits);
 
-esp_err_t MAX31790_set_target_dutybits(uint8_t channel, uint16_t dutybits);
+esp_err_t MAX31790_set_target_dutybits_async(max31790_handle_t dev, uint8_t channel, uint16_t dutybits, i2cmanager_token_t *token);   // Queued on the port engine at high priority, always the bus, token is optional.
 
-esp_err_t MAX31790_set_target_rpm(uint8_t channel, uint32_t RPM);               // When changing from PWM mode to RPM mode, best results are obtained by loading this register with the current TACH count before changing to RPM mode.
+esp_err_t MAX31790_set_target_rpm(max31790_handle_t dev, uint8_t channel, uint32_t RPM);               // When changing from PWM mode to RPM mode, use MAX31790_set_mode_bumpless() rather than writing the mode bit.
 
-esp_err_t MAX31790_set_fault_mask(uint8_t fan_number);
+esp_err_t MAX31790_set_fault_mask(max31790_handle_t dev, uint8_t fan_number);
 
-esp_err_t inline MAX31790_set_target_duty(uint8_t channel, float fduty) { return MAX31790_set_target_dutybits(channel, MAX31790_fduty_to_bits(fduty)); };
+esp_err_t MAX31790_clear_fault_status(max31790_handle_t dev, uint16_t fans);                       // One transaction, bit N clears fan N.
 
-esp_err_t MAX31790_set_window(uint8_t cfg, uint8_t channel);
+static inline esp_err_t MAX31790_set_target_duty(max31790_handle_t dev, uint8_t channel, float fduty) { return MAX31790_set_target_dutybits(dev, channel, MAX31790_fduty_to_bits(fduty)); };
 
-esp_err_t MAX31790_set_failed_fan_seq_start(uint8_t ff_ss);
+esp_err_t MAX31790_set_window(max31790_handle_t dev, uint8_t cfg, uint8_t channel);
 
-esp_err_t MAX31790_set_global_config(uint8_t cfg);
+esp_err_t MAX31790_set_failed_fan_seq_start(max31790_handle_t dev, uint8_t ff_ss);
 
-esp_err_t MAX31790_set_pwm_feq(uint8_t bit_freq);
+esp_err_t MAX31790_set_global_config(max31790_handle_t dev, uint8_t cfg);
 
-esp_err_t MAX31790_set_fan_config(uint8_t fan_cfg, uint8_t channel);
+esp_err_t MAX31790_set_pwm_feq(max31790_handle_t dev, uint8_t bit_freq);
 
-esp_err_t MAX31790_set_fan_dynamic(uint8_t fan_dyn, uint8_t channel);
+esp_err_t MAX31790_set_fan_config(max31790_handle_t dev, uint8_t fan_cfg, uint8_t channel);
+
+esp_err_t MAX31790_set_fan_dynamic(max31790_handle_t dev, uint8_t fan_dyn, uint8_t channel);
+
+esp_err_t MAX31790_set_mode_bumpless(max31790_handle_t dev, uint8_t channel, uint8_t mode);        // MAX31790_FAN_CFG_MODE_RPM / _PWM. Seeds the new target from the live TACH count or PWM duty, then flips the mode: read, write, write.
+
+esp_err_t MAX31790_set_regs(max31790_handle_t dev, uint8_t reg, const uint8_t *buff, uint8_t len);            // Raw auto-increment write through the shadow, equal registers skipped. FAN_DYN here refreshes the speed conversions.
 
 /* Get ------------------------------------------------------------------------------------- */
-esp_err_t MAX31790_get_dutybits(uint8_t channel, bool isTarget, uint16_t *dutybits);
+esp_err_t MAX31790_get_dutybits(max31790_handle_t dev, uint8_t channel, bool isTarget, uint16_t *dutybits);
+
+esp_err_t MAX31790_get_rpm(max31790_handle_t dev, uint8_t fan_number, bool isTarget, uint32_t *rpm);
+
+esp_err_t MAX31790_get_all_rpm(max31790_handle_t dev, uint32_t rpm[NUM_TACH_CHANNEL]);                   // Reads all 12 TACH counts (0x18 - 0x2F) in one auto-increment transaction, a coherent snapshot of every fan.
+
+esp_err_t MAX31790_get_regs(max31790_handle_t dev, uint8_t reg, uint8_t *buff, uint8_t len);                  // Raw auto-increment read, configuration registers may come from the shadow.
+
+esp_err_t MAX31790_get_regs_async(max31790_handle_t dev, uint8_t reg, uint8_t *buff, uint8_t len, i2cmanager_cb_t cb, void *arg);   // Queued on the port engine, always the bus. buff must outlive the completion.
 
-esp_err_t MAX31790_get_rpm(uint8_t fan_number, bool isTarget, uint32_t *rpm);
+esp_err_t MAX31790_get_global_config(max31790_handle_t dev, uint8_t *gl_cfg); 
 
-esp_err_t MAX31790_get_global_config(uint8_t *gl_cfg); 
+static inline esp_err_t MAX31790_get_target_dutybits(max31790_handle_t dev, uint8_t channel, uint16_t *tar_dutybits){ return MAX31790_get_dutybits(dev, channel, true, tar_dutybits); };
 
-esp_err_t inline MAX31790_get_target_dutybits(uint8_t channel, uint16_t *tar_dutybits){ return MAX31790_get_dutybits(channel, true, tar_dutybits); };
+esp_err_t MAX31790_get_duty(max31790_handle_t dev, uint8_t channel, bool isTarget, float *fl_duty);
 
-esp_err_t MAX31790_get_duty(uint8_t channel, bool isTarget, float *fl_duty);
+esp_err_t MAX31790_get_target_duty(max31790_handle_t dev, uint8_t channel, float *tar_duty);
 
-esp_err_t MAX31790_get_target_duty(uint8_t channel, float *tar_duty);
+static inline esp_err_t MAX31790_get_target_tach(max31790_handle_t dev, uint8_t fan_number, uint32_t *rpm){ return MAX31790_get_rpm(dev, fan_number, true, rpm); };
 
-esp_err_t inline MAX31790_get_target_tach(uint8_t fan_number, uint32_t *rpm){ return MAX31790_get_rpm(fan_number, true, rpm); };
+esp_err_t MAX31790_get_pwm_freq(max31790_handle_t dev, uint8_t *pwm_freq);
 
-esp_err_t MAX31790_get_pwm_freq(uint8_t *pwm_freq);
+esp_err_t MAX31790_get_failed_fan_seq_opt(max31790_handle_t dev, uint8_t *ff_seq_opt);
 
-esp_err_t MAX31790_get_failed_fan_seq_opt(uint8_t *ff_seq_opt);
+esp_err_t MAX31790_get_fan_config(max31790_handle_t dev, uint8_t channel, uint8_t *fan_cfg);
 
-esp_err_t MAX31790_get_fan_config(uint8_t channel, uint8_t *fan_cfg);
+esp_err_t MAX31790_get_fan_dynamic(max31790_handle_t dev, uint8_t channel, uint8_t *fan_dyn);
 
-esp_err_t MAX31790_get_fan_dynamic(uint8_t channel, uint8_t *fan_dyn);
+esp_err_t MAX31790_get_fault_mask(max31790_handle_t dev, uint8_t num, uint8_t *f_mask);
 
-esp_err_t MAX31790_get_fault_mask(uint8_t num, uint8_t *f_mask);
+esp_err_t MAX31790_get_fault_status(max31790_handle_t dev, uint8_t num, uint8_t *f_status);
 
-esp_err_t MAX31790_get_fault_status(uint8_t num, uint8_t *f_status);
+esp_err_t MAX31790_get_fault_status_all(max31790_handle_t dev, uint16_t *fans);                    // Both status registers in one transaction, bit N is fan N.
 
-esp_err_t MAX31790_get_window(uint8_t cfg, uint8_t channel, uint8_t *window);
+esp_err_t MAX31790_get_window(max31790_handle_t dev, uint8_t cfg, uint8_t channel, uint8_t *window);
 
 #endif
@@ -0,0 +1,292 @@
+/****************************************************** 
+  Description: IDF MAX31790 Typed Register Layer, C++17  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_HPP
+#define MAX31790_HPP
+
+#include <stdint.h>
+#include <array>
+#include <type_traits>
+
+extern "C" {
+#include "MAX31790.h"
+}
+
+namespace max31790
+{
+
+/* Field values ----------------------------------------------------------------------------- */
+enum class standby : uint8_t        { run = 0, standby = 1 };
+enum class oscillator : uint8_t     { internal = 0, external = 1 };
+enum class watchdog : uint8_t       { off = 0, s5 = 1, s10 = 2, s30 = 3 };
+enum class pwm_freq : uint8_t       { hz25 = 0, hz30, hz35, hz100, hz125, hz149_7, khz1_25, khz1_47, khz3_57, khz5, khz12_5, khz25 };
+enum class mode : uint8_t           { pwm = 0, rpm = 1 };
+enum class spin_up : uint8_t        { none = 0, ms500 = 1, s1 = 2, s2 = 3 };
+enum class speed_range : uint8_t    { x1 = 0, x2, x4, x8, x16, x32 };
+enum class rate_of_change : uint8_t { ms0 = 0, ms1_95, ms3_91, ms7_81, ms15_6, ms31_25, ms62_5, ms125 };   // Per duty LSB
+enum class seq_start : uint8_t      { ms0 = 0, ms250, ms500, ms1000, ms2000, ms4000 };
+enum class failed_fan : uint8_t     { zero = 0, keep = 1, full = 2, full_all = 3 };
+enum class fault_queue : uint8_t    { q1 = 0, q2 = 1, q4 = 2, q6 = 3 };
+
+/* Descriptors ------------------------------------------------------------------------------ */
+template<uint8_t Ch>                            // PWM channel, 0 - 5
+struct channel
+{
+   static_assert(Ch < NUM_CHANNEL, "PWM channel out of range");
+   static constexpr uint8_t index = Ch;
+};
+
+template<uint8_t Fan>                           // Tach input, 0 - 11
+struct tach
+{
+   static_assert(Fan < NUM_TACH_CHANNEL, "Tach input out of range");
+   static constexpr uint8_t index = Fan;
+   static constexpr uint8_t chan = FAN_TO_CHAN(Fan);
+};
+
+template<typename Reg, uint8_t Shift, uint8_t Width, typename T>
+struct field
+{
+   static_assert(Width && Shift + Width <= 8, "Field outside its byte");
+
+   using reg = Reg;
+   using type = T;
+   static constexpr uint8_t shift = Shift;
+   static constexpr uint8_t width = Width;
+   static constexpr uint8_t mask = ((0x01u << Width) - 1) << Shift;
+
+   static constexpr uint8_t encode(T val) { return (static_cast<uint8_t>(val) << Shift) & mask; }
+   static constexpr T decode(uint8_t raw) { return static_cast<T>((raw & mask) >> Shift); }
+};
+
+template<uint8_t Bits>                          // Left justified across an MSB, LSB pair
+struct word
+{
+   static_assert(Bits > 8 && Bits <= 16, "Not a register pair");
+
+   static constexpr uint16_t max = (0x01u << Bits) - 1;
+
+   static constexpr std::array<uint8_t, 2> encode(uint16_t val) { return {{static_cast<uint8_t>(LFTJST_TO_MSB(val, Bits)), static_cast<uint8_t>(LFTJST_TO_LSB(val, Bits))}}; }
+   static constexpr uint16_t decode(uint8_t msb, uint8_t lsb) { return REG_TO_LFTJST(Bits, msb, lsb); }
+};
+
+/* Registers, fields are bound to the register they live in --------------------------------- */
+struct global_config
+{
+   static constexpr uint8_t addr = MAX31790_REG_GLOBAL_CONFIG;
+
+   using run_standby     = field<global_config, 7, 1, standby>;
+   using reset           = field<global_config, 6, 1, bool>;
+   using bus_timeout_off = field<global_config, 5, 1, bool>;
+   using osc             = field<global_config, 3, 1, oscillator>;
+   using i2c_watchdog    = field<global_config, 1, 2, watchdog>;
+   using watchdog_status = field<global_config, 0, 1, bool>;
+};
+
+struct pwm_frequency
+{
+   static constexpr uint8_t addr = MAX31790_REG_FREQ_START;
+
+   using channels_1_3 = field<pwm_frequency, 0, 4, pwm_freq>;
+   using channels_4_6 = field<pwm_frequency, 4, 4, pwm_freq>;
+};
+
+struct fan_config
+{
+   template<uint8_t Ch> static constexpr uint8_t addr = MAX31790_REG_FAN_CONFIG(channel<Ch>::index);
+
+   using control_mode     = field<fan_config, 7, 1, mode>;
+   using spin_up_time     = field<fan_config, 5, 2, spin_up>;
+   using monitor_only     = field<fan_config, 4, 1, bool>;
+   using tach_input       = field<fan_config, 3, 1, bool>;
+   using locked_rotor     = field<fan_config, 2, 1, bool>;
+   using locked_high      = field<fan_config, 1, 1, bool>;
+   using pin_is_tach      = field<fan_config, 0, 1, bool>;
+};
+
+struct fan_dynamics
+{
+   template<uint8_t Ch> static constexpr uint8_t addr = MAX31790_REG_FAN_DYNAMIC(channel<Ch>::index);
+
+   using range         = field<fan_dynamics, 5, 3, speed_range>;
+   using roc           = field<fan_dynamics, 2, 3, rate_of_change>;
+   using asymmetric    = field<fan_dynamics, 1, 1, bool>;
+};
+
+struct failed_fan_seq_start
+{
+   static constexpr uint8_t addr = MAX31790_REG_SEQ_START_CONFIG;
+
+   using start_delay   = field<failed_fan_seq_start, 5, 3, seq_start>;
+   using on_failure    = field<failed_fan_seq_start, 2, 2, failed_fan>;
+   using queue         = field<failed_fan_seq_start, 0, 2, fault_queue>;
+};
+
+struct target_duty
+{
+   template<uint8_t Ch> static constexpr uint8_t addr = MAX31790_REG_TARGET_DUTY(channel<Ch>::index);
+
+   using value = word<9>;
+};
+
+struct target_count
+{
+   template<uint8_t Ch> static constexpr uint8_t addr = MAX31790_REG_TARGET_COUNT(channel<Ch>::index);
+
+   using value = word<11>;
+};
+
+struct tach_count
+{
+   template<uint8_t Fan> static constexpr uint8_t addr = MAX31790_REG_TACH_COUNT(tach<Fan>::index);
+
+   using value = word<11>;
+};
+
+struct pwm_duty
+{
+   template<uint8_t Ch> static constexpr uint8_t addr = MAX31790_REG_PWM_DUTY(channel<Ch>::index);
+
+   using value = word<9>;
+};
+
+/* Whole register values -------------------------------------------------------------------- */
+template<typename Reg>
+class value
+{
+public:
+   constexpr value() : raw_(0) {}
+   constexpr explicit value(uint8_t raw) : raw_(raw) {}
+
+   template<typename F>
+   constexpr value set(typename F::type val) const
+   {
+       static_assert(std::is_same<typename F::reg, Reg>::value, "Field of another register");
+       return value(static_cast<uint8_t>((raw_ & ~F::mask) | F::encode(val)));
+   }
+
+   template<typename F>
+   constexpr typename F::type get() const
+   {
+       static_assert(std::is_same<typename F::reg, Reg>::value, "Field of another register");
+       return F::decode(raw_);
+   }
+
+   constexpr uint8_t raw() const { return raw_; }
+   constexpr bool operator==(value other) const { return raw_ == other.raw_; }
+
+private:
+   uint8_t raw_;
+};
+
+/* Device, channels fixed at compile time, no range checks at run time ---------------------- */
+template<uint8_t Ch>
+inline esp_err_t set_fan_config(max31790_handle_t dev, value<fan_config> val)
+{
+    const uint8_t raw = val.raw();
+    return MAX31790_set_regs(dev, fan_config::addr<Ch>, &raw, 1);
+}
+
+template<uint8_t Ch>
+inline esp_err_t set_fan_dynamics(max31790_handle_t dev, value<fan_dynamics> val)                   // The speed range refreshes the driver's conversions
+{
+    const uint8_t raw = val.raw();
+    return MAX31790_set_regs(dev, fan_dynamics::addr<Ch>, &raw, 1);
+}
+
+inline esp_err_t set_global_config(max31790_handle_t dev, value<global_config> val)
+{
+    const uint8_t raw = val.raw();
+    return MAX31790_set_regs(dev, global_config::addr, &raw, 1);
+}
+
+inline esp_err_t set_failed_fan_seq_start(max31790_handle_t dev, value<failed_fan_seq_start> val)
+{
+    const uint8_t raw = val.raw();
+    return MAX31790_set_regs(dev, failed_fan_seq_start::addr, &raw, 1);
+}
+
+template<uint8_t Ch, uint16_t Bits>
+inline esp_err_t set_target_dutybits(max31790_handle_t dev)                                         // Encoded at compile time
+{
+    static_assert(Bits <= DUTYBITS_MAX, "Duty out of range");
+    static constexpr std::array<uint8_t, 2> raw = target_duty::value::encode(Bits);
+    return MAX31790_set_regs(dev, target_duty::addr<Ch>, raw.data(), 2);
+}
+
+template<uint8_t Ch>
+inline esp_err_t set_target_dutybits(max31790_handle_t dev, uint16_t dutybits)                     // Clamped to 511 as the C call does
+{
+    const std::array<uint8_t, 2> raw = target_duty::value::encode(dutybits > DUTYBITS_MAX ? DUTYBITS_MAX : dutybits);
+    return MAX31790_set_regs(dev, target_duty::addr<Ch>, raw.data(), 2);
+}
+
+template<uint8_t Ch>
+inline esp_err_t set_target_rpm(max31790_handle_t dev, uint32_t rpm)
+{
+    const std::array<uint8_t, 2> raw = target_count::value::encode(MAX31790_rpm_to_count(dev, Ch, rpm));
+    return MAX31790_set_regs(dev, target_count::addr<Ch>, raw.data(), 2);
+}
+
+/* Batch, staged inline: constant offsets into the batch, no call ---------------------------- */
+inline void stage_raw(max31790_batch_t *batch, uint8_t reg, uint8_t raw)                           // reg is a constant at every call site below
+{
+    batch->data[reg] = raw;
+    batch->staged[reg >> 3] |= 0x01 << (reg & 0x07);
+}
+
+template<uint8_t Ch>
+inline void stage_dutybits(max31790_batch_t *batch, uint16_t dutybits)
+{
+    const std::array<uint8_t, 2> raw = target_duty::value::encode(dutybits > DUTYBITS_MAX ? DUTYBITS_MAX : dutybits);
+
+    stage_raw(batch, target_duty::addr<Ch>, raw[0]);
+    stage_raw(batch, target_duty::addr<Ch> + 1, raw[1]);
+}
+
+template<uint8_t Ch>
+inline void stage_target_rpm(max31790_batch_t *batch, uint32_t rpm)                                // Range as staged, stage the dynamics first
+{
+    const std::array<uint8_t, 2> raw = target_count::value::encode(MAX31790_rpm_to_count(batch->dev, Ch, rpm));
+
+    stage_raw(batch, target_count::addr<Ch>, raw[0]);
+    stage_raw(batch, target_count::addr<Ch> + 1, raw[1]);
+}
+
+template<uint8_t Ch>
+inline void stage_fan_config(max31790_batch_t *batch, value<fan_config> val)
+{
+    stage_raw(batch, fan_config::addr<Ch>, val.raw());
+}
+
+template<uint8_t Ch>
+inline esp_err_t stage_fan_dynamics(max31790_batch_t *batch, value<fan_dynamics> val)              // Through the C call, the conversions follow the staged range
+{
+    return MAX31790_batch_stage_fan_dynamic(batch, channel<Ch>::index, val.raw());
+}
+
+/* Reads ------------------------------------------------------------------------------------ */
+template<uint8_t Fan>
+inline uint16_t tach_count_of(const uint8_t counts[TACH_COUNT_BURST])                             // From a MAX31790_get_regs() burst at TACH_COUNT(0)
+{
+    return tach_count::value::decode(counts[tach_count::addr<Fan> - MAX31790_REG_TACH_COUNT(0)], counts[tach_count::addr<Fan> - MAX31790_REG_TACH_COUNT(0) + 1]);
+}
+
+/* The C masks describe the same layout ----------------------------------------------------- */
+static_assert(fan_config::control_mode::encode(mode::rpm) == MAX31790_FAN_CFG_MODE_RPM, "");
+static_assert(fan_config::spin_up_time::mask == MAX31790_FAN_CFG_SPIN_UP_MASK, "");
+static_assert(fan_dynamics::range::mask == MAX31790_FAN_DYN_SR_MASK, "");
+static_assert(fan_dynamics::roc::mask == MAX31790_FAN_DYN_PWM_ROC_MASK, "");
+static_assert(failed_fan_seq_start::start_delay::mask == MAX31790_FAN_FAILED_SEQ_SSD_MASK, "");
+static_assert(failed_fan_seq_start::on_failure::mask == MAX31790_FAN_FAILED_SEQ_FFO_MASK, "");
+static_assert(failed_fan_seq_start::queue::mask == MAX31790_FAN_FAILED_SEQ_FFQ_MASK, "");
+static_assert(global_config::i2c_watchdog::mask == MAX31790_GLO_I2C_WD_MASK, "");
+static_assert(pwm_frequency::channels_1_3::mask == MAX31790_PWM_FREQ_MASK, "");
+
+}
+
+#endif
@@ -0,0 +1,544 @@
+/****************************************************** 
+  Description: IDF MAX31790 Fan Calibration  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Cal.h"
+
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "MAX31790 Cal";
+static const uint8_t user_reg[MAX31790_CAL_USER_BYTES] =
+{
+    MAX31790_REG_USER_BYTE_0, MAX31790_REG_USER_BYTE_1, MAX31790_REG_USER_BYTE_2, MAX31790_REG_USER_BYTE_3,
+    MAX31790_REG_USER_BYTE_4, MAX31790_REG_USER_BYTE_5, MAX31790_REG_USER_BYTE_6, MAX31790_REG_USER_BYTE_7,
+    MAX31790_REG_USER_BYTE_8, MAX31790_REG_USER_BYTE_9, MAX31790_REG_USER_BYTE_10, MAX31790_REG_USER_BYTE_11,
+    MAX31790_REG_USER_BYTE_12, MAX31790_REG_USER_BYTE_13, MAX31790_REG_USER_BYTE_14
+};
+
+static void MAX31790_cal_wait(max31790_cal_t *cal, uint32_t ms);
+static esp_err_t MAX31790_cal_measure(max31790_cal_t *cal, const uint16_t duty[NUM_CHANNEL], uint32_t settle_ms, uint32_t rpm[NUM_CHANNEL]);
+static esp_err_t MAX31790_cal_read_user(max31790_cal_t *cal, uint8_t buff[MAX31790_CAL_USER_BYTES]);
+static uint16_t MAX31790_cal_point_bits(const max31790_cal_chan_t *chan, uint8_t point);
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_cal_init(max31790_cal_t *cal, max31790_handle_t dev, const max31790_cal_config_t *cfg)
+{
+    memset(cal, 0, sizeof(*cal));
+
+    if(cfg)
+        cal->cfg = *cfg;
+
+    if(!cal->cfg.settle_ms)
+        cal->cfg.settle_ms = MAX31790_CAL_DEF_SETTLE_MS;
+    if(!cal->cfg.step_bits)
+        cal->cfg.step_bits = MAX31790_CAL_DEF_STEP_BITS;
+    if(!cal->cfg.hop_bits)
+        cal->cfg.hop_bits = MAX31790_CAL_DEF_HOP_BITS;
+    if(!cal->cfg.hop_ms)
+        cal->cfg.hop_ms = MAX31790_CAL_DEF_HOP_MS;
+
+    cal->dev = dev;
+
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_cal_load(max31790_cal_t *cal)
+{
+    uint8_t blob[MAX31790_CAL_BLOB_MAX] = {0};
+    size_t len = 0;
+    esp_err_t err_ret = ESP_OK;
+
+    err_ret = MAX31790_cal_read_user(cal, blob);
+    if(err_ret == ESP_OK && MAX31790_cal_decode(cal, blob, MAX31790_CAL_USER_BYTES) == ESP_OK)
+    {
+        ESP_LOGD(TAG, "Loaded from user bytes. Adr: 0x%02x", cal->dev->adr);
+        return ESP_OK;
+    }
+
+    if(err_ret != ESP_OK)                                                                           // Bus trouble is not an empty page
+        return err_ret;
+
+    if(!cal->cfg.store)
+        return ESP_ERR_NOT_FOUND;
+
+    err_ret = cal->cfg.store->load(cal->cfg.store_ctx, blob, sizeof(blob), &len);
+    if(err_ret == ESP_OK)
+        err_ret = MAX31790_cal_decode(cal, blob, len);
+
+    if(err_ret == ESP_OK && len <= MAX31790_CAL_USER_BYTES)                                        // Chip lost power, put it back for the next reset
+        MAX31790_cal_save(cal);
+
+    ESP_LOGD(TAG, "Load from store: %s", esp_err_to_name(err_ret));
+
+    return (err_ret == ESP_OK) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t MAX31790_cal_save(max31790_cal_t *cal)
+{
+    uint8_t blob[MAX31790_CAL_BLOB_MAX] = {0};
+    size_t len = MAX31790_cal_encode(cal, blob);
+    esp_err_t err_ret = ESP_ERR_INVALID_SIZE;
+    max31790_batch_t batch;
+    uint8_t blank = 0;
+
+    MAX31790_batch_begin(&batch, cal->dev);
+
+    if(len <= MAX31790_CAL_USER_BYTES)
+    {
+        for(uint8_t x = 0; x < len; x++)
+            MAX31790_batch_stage(&batch, user_reg[x], &blob[x], 1);
+
+        err_ret = MAX31790_batch_commit(&batch);                                                    // Five runs at most
+    }
+    else                                                                                            // An older, smaller record must not shadow the store
+    {
+        MAX31790_batch_stage(&batch, user_reg[0], &blank, 1);
+        err_ret = MAX31790_batch_commit(&batch);
+        if(err_ret != ESP_OK)                                                                       // The stale record would still win at load, a store save would be lost
+            return err_ret;
+
+        err_ret = ESP_ERR_INVALID_SIZE;
+    }
+
+    if(cal->cfg.store && (err_ret == ESP_OK || err_ret == ESP_ERR_INVALID_SIZE))
+        err_ret = cal->cfg.store->save(cal->cfg.store_ctx, blob, len);
+
+    return err_ret;
+}
+
+/* Sweep ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_cal_sweep(max31790_cal_t *cal, uint8_t channels)
+{
+    max31790_handle_t dev = cal->dev;
+    max31790_cal_chan_t res[NUM_CHANNEL] = {0};
+    uint8_t fan_cfg[NUM_CHANNEL] = {0};
+    uint8_t fan_dyn[NUM_CHANNEL] = {0};
+    uint16_t restore[NUM_CHANNEL] = {0};
+    uint16_t duty[NUM_CHANNEL] = {0};
+    uint32_t rpm[NUM_CHANNEL] = {0};
+    uint16_t step = cal->cfg.step_bits;
+    esp_err_t err_ret = ESP_OK;
+    uint8_t active = 0;
+    uint8_t swept = 0;
+
+    channels &= (0x01 << NUM_CHANNEL) - 1;
+
+    if(!channels)
+        return ESP_ERR_INVALID_ARG;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL && err_ret == ESP_OK; x++)
+    {
+        err_ret = MAX31790_get_fan_config(dev, x, &fan_cfg[x]);
+        if(err_ret == ESP_OK)
+            err_ret = MAX31790_get_fan_dynamic(dev, x, &fan_dyn[x]);
+        if(err_ret == ESP_OK)
+            err_ret = MAX31790_get_target_dutybits(dev, x, &restore[x]);
+
+        if(err_ret == ESP_OK && (channels & (0x01 << x)) &&
+           ((fan_cfg[x] & MAX31790_FAN_CFG_CON_MON_MON) || !(fan_cfg[x] & MAX31790_FAN_CFG_TACH_INPUT)))   // Nothing to drive or nothing to see
+            err_ret = ESP_ERR_INVALID_ARG;
+    }
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    ESP_LOGI(TAG, "Sweep. Adr: 0x%02x Channels: 0x%02x", dev->adr, channels);
+
+    swept = channels;
+
+    memcpy(duty, restore, sizeof(duty));
+
+    for(uint8_t x = 0; x < NUM_CHANNEL && err_ret == ESP_OK; x++)                                   // PWM mode, no spin-up kick, duty steps at once, finest low speed range
+    {
+        if(!(channels & (0x01 << x)))
+            continue;
+
+        err_ret = MAX31790_set_fan_config(dev, fan_cfg[x] & ~(MAX31790_FAN_CFG_MODE_RPM | MAX31790_FAN_CFG_SPIN_UP_MASK), x);
+        if(err_ret == ESP_OK)
+            err_ret = MAX31790_set_fan_dynamic(dev, fan_dyn[x] & ~(MAX31790_FAN_DYN_SR_MASK | MAX31790_FAN_DYN_PWM_ROC_MASK), x);
+
+        duty[x] = DUTYBITS_MAX;
+    }
+
+    if(err_ret == ESP_OK)                                                                           // Full speed, fans that do not turn are left out
+        err_ret = MAX31790_cal_measure(cal, duty, cal->cfg.settle_ms, rpm);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL && err_ret == ESP_OK; x++)
+    {
+        if(!(channels & (0x01 << x)))
+            continue;
+
+        if(!rpm[x])
+            ESP_LOGW(TAG, "Channel %d not turning at full duty", x);
+
+        channels &= rpm[x] ? 0xFF : ~(0x01 << x);
+        res[x].rpm[MAX31790_CAL_POINTS - 1] = rpm[x];
+        res[x].rpm[0] = rpm[x];
+    }
+
+    active = channels;
+
+    while(err_ret == ESP_OK && active)                                                              // Down until each fan stops, last turning duty is the stall duty
+    {
+        for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+            if(active & (0x01 << x))
+                duty[x] = (duty[x] > step) ? duty[x] - step : 0;
+
+        err_ret = MAX31790_cal_measure(cal, duty, cal->cfg.settle_ms, rpm);
+
+        for(uint8_t x = 0; x < NUM_CHANNEL && err_ret == ESP_OK; x++)
+        {
+            if(!(active & (0x01 << x)))
+                continue;
+
+            if(rpm[x])
+                res[x].rpm[0] = rpm[x];
+
+            if(!rpm[x] || !duty[x])
+            {
+                res[x].stall_bits = rpm[x] ? 0 : CONSTRAIN(duty[x] + step, 0, DUTYBITS_MAX);
+                active &= ~(0x01 << x);
+            }
+        }
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        if(channels & (0x01 << x))
+            duty[x] = DUTYBITS_MAX;
+
+    if(err_ret == ESP_OK)                                                                           // Stopped below stall, back up before the points
+        err_ret = MAX31790_cal_measure(cal, duty, cal->cfg.settle_ms, rpm);
+
+    for(uint8_t p = MAX31790_CAL_POINTS - 2; p > 0 && err_ret == ESP_OK; p--)                       // Points between stall and full, from above so nothing stops
+    {
+        for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+            if(channels & (0x01 << x))
+                duty[x] = MAX31790_cal_point_bits(&res[x], p);
+
+        err_ret = MAX31790_cal_measure(cal, duty, cal->cfg.settle_ms, rpm);
+
+        for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+            if(channels & (0x01 << x))
+                res[x].rpm[p] = CONSTRAIN(rpm[x], res[x].rpm[0], res[x].rpm[p + 1]);              // Monotonic, tach jitter aside
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        if(channels & (0x01 << x))
+            duty[x] = 0;
+
+    if(err_ret == ESP_OK)                                                                           // Fully stopped, a coasting rotor starts more easily
+        err_ret = MAX31790_cal_measure(cal, duty, cal->cfg.settle_ms * 3, rpm);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        if(channels & (0x01 << x))
+            duty[x] = res[x].stall_bits;
+
+    active = channels;
+
+    while(err_ret == ESP_OK && active)                                                              // Up from stall until each fan starts
+    {
+        err_ret = MAX31790_cal_measure(cal, duty, cal->cfg.settle_ms, rpm);
+
+        for(uint8_t x = 0; x < NUM_CHANNEL && err_ret == ESP_OK; x++)
+        {
+            if(!(active & (0x01 << x)))
+                continue;
+
+            if(rpm[x] || duty[x] >= DUTYBITS_MAX)
+            {
+                res[x].start_bits = duty[x];
+                res[x].valid = true;
+                active &= ~(0x01 << x);
+            }
+            else
+                duty[x] = CONSTRAIN(duty[x] + step, 0, DUTYBITS_MAX);
+        }
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)                                                        // Put back what the caller had, whatever happened
+    {
+        if(!(swept & (0x01 << x)))
+            continue;
+
+        MAX31790_set_fan_dynamic(dev, fan_dyn[x], x);
+        MAX31790_set_fan_config(dev, fan_cfg[x], x);
+    }
+
+    MAX31790_set_all_target_dutybits(dev, restore);
+    MAX31790_clear_fault_status(dev, swept | (swept << NUM_CHANNEL));                               // Stopped on purpose
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        if(!(channels & (0x01 << x)))
+            continue;
+
+        cal->chan[x] = res[x];
+
+        ESP_LOGI(TAG, "Channel %d: start %d stall %d rpm %d %d %d %d", x, res[x].start_bits, res[x].stall_bits,
+                 (int)res[x].rpm[0], (int)res[x].rpm[1], (int)res[x].rpm[2], (int)res[x].rpm[3]);
+    }
+
+    return MAX31790_cal_save(cal);
+}
+
+/* Encoding ---------------------------------------------------------------------------------- */
+size_t MAX31790_cal_encode(const max31790_cal_t *cal, uint8_t blob[MAX31790_CAL_BLOB_MAX])
+{
+    size_t len = 1;
+    uint8_t mask = 0;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)                                                        // Full speed in 64 RPM, duties in 2 LSB rounded up, points as a fraction of full
+    {
+        const max31790_cal_chan_t *chan = &cal->chan[x];
+        uint32_t full = chan->rpm[MAX31790_CAL_POINTS - 1];
+
+        if(!chan->valid || !full)
+            continue;
+
+        mask |= 0x01 << x;
+
+        blob[len++] = CONSTRAIN((full + MAX31790_CAL_RPM_LSB / 2) / MAX31790_CAL_RPM_LSB, 1, 0xFF);
+        blob[len++] = chan->start_bits >> 1;
+        blob[len++] = chan->stall_bits >> 1;
+
+        for(uint8_t p = 0; p < MAX31790_CAL_POINTS - 1; p++)
+            blob[len++] = CONSTRAIN((chan->rpm[p] * 0xFF + full / 2) / full, 0, 0xFF);
+    }
+
+    blob[0] = (MAX31790_CAL_VERSION << 6) | mask;
+    blob[len] = MAX31790_crc8(blob, len);
+
+    return len + 1;
+}
+
+esp_err_t MAX31790_cal_decode(max31790_cal_t *cal, const uint8_t *blob, size_t len)
+{
+    max31790_cal_chan_t chan[NUM_CHANNEL] = {0};
+    size_t need = 2;
+    size_t pos = 1;
+
+    if(len < need)
+        return ESP_ERR_INVALID_SIZE;
+
+    if((blob[0] >> 6) != MAX31790_CAL_VERSION)
+        return ESP_ERR_INVALID_VERSION;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        need += (blob[0] & (0x01 << x)) ? MAX31790_CAL_REC_SIZE : 0;
+
+    if(len < need)                                                                                  // User bytes are read whole, the header says how much is ours
+        return ESP_ERR_INVALID_SIZE;
+
+    if(MAX31790_crc8(blob, need - 1) != blob[need - 1])
+        return ESP_ERR_INVALID_CRC;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        uint32_t full = 0;
+
+        if(!(blob[0] & (0x01 << x)))
+            continue;
+
+        full = blob[pos++] * MAX31790_CAL_RPM_LSB;
+
+        chan[x].start_bits = (blob[pos++] << 1) | 0x01;
+        chan[x].stall_bits = (blob[pos++] << 1) | 0x01;
+
+        for(uint8_t p = 0; p < MAX31790_CAL_POINTS - 1; p++)
+            chan[x].rpm[p] = (blob[pos++] * full + 0x7F) / 0xFF;
+
+        chan[x].rpm[MAX31790_CAL_POINTS - 1] = full;
+        chan[x].valid = true;
+    }
+
+    memcpy(cal->chan, chan, sizeof(chan));
+
+    return ESP_OK;
+}
+
+/* Feed-forward ------------------------------------------------------------------------------ */
+uint16_t MAX31790_cal_rpm_to_dutybits(const max31790_cal_t *cal, uint8_t channel, uint32_t rpm)
+{
+    const max31790_cal_chan_t *chan = &cal->chan[(channel < NUM_CHANNEL) ? channel : 0];
+
+    if(channel >= NUM_CHANNEL || !chan->valid || !rpm)
+        return 0;
+
+    if(rpm <= chan->rpm[0])                                                                         // Slowest it turns
+        return chan->stall_bits;
+
+    for(uint8_t p = 0; p < MAX31790_CAL_POINTS - 1; p++)
+    {
+        uint16_t lo = MAX31790_cal_point_bits(chan, p);
+        uint16_t hi = MAX31790_cal_point_bits(chan, p + 1);
+        uint32_t span = chan->rpm[p + 1] - chan->rpm[p];
+
+        if(rpm > chan->rpm[p + 1])
+            continue;
+
+        if(!span)
+            return hi;
+
+        return lo + ((rpm - chan->rpm[p]) * (hi - lo) + span / 2) / span;
+    }
+
+    return DUTYBITS_MAX;
+}
+
+uint32_t MAX31790_cal_dutybits_to_rpm(const max31790_cal_t *cal, uint8_t channel, uint16_t dutybits)
+{
+    const max31790_cal_chan_t *chan = &cal->chan[(channel < NUM_CHANNEL) ? channel : 0];
+
+    if(channel >= NUM_CHANNEL || !chan->valid || dutybits < chan->stall_bits)
+        return 0;
+
+    for(uint8_t p = 0; p < MAX31790_CAL_POINTS - 1; p++)
+    {
+        uint16_t lo = MAX31790_cal_point_bits(chan, p);
+        uint16_t hi = MAX31790_cal_point_bits(chan, p + 1);
+
+        if(dutybits > hi)
+            continue;
+
+        if(hi == lo)
+            return chan->rpm[p + 1];
+
+        return chan->rpm[p] + ((int64_t)(chan->rpm[p + 1] - chan->rpm[p]) * (dutybits - lo)) / (hi - lo);
+    }
+
+    return chan->rpm[MAX31790_CAL_POINTS - 1];
+}
+
+esp_err_t MAX31790_cal_set_dutybits(max31790_cal_t *cal, uint8_t channel, uint16_t dutybits, uint32_t *expect_rpm)
+{
+    CHCK_CHAN(channel);
+
+    dutybits = CONSTRAIN(dutybits, 0, DUTYBITS_MAX);
+
+    if(cal->chan[channel].valid && dutybits && dutybits < cal->chan[channel].stall_bits)            // Would only stop the fan and trip FAN_FAIL
+        dutybits = cal->chan[channel].stall_bits;
+
+    if(expect_rpm)
+        *expect_rpm = MAX31790_cal_dutybits_to_rpm(cal, channel, dutybits);
+
+    return MAX31790_set_target_dutybits(cal->dev, channel, dutybits);
+}
+
+esp_err_t MAX31790_cal_set_rpm(max31790_cal_t *cal, uint8_t channel, uint32_t rpm)
+{
+    max31790_handle_t dev = cal->dev;
+    max31790_batch_t batch;
+    esp_err_t err_ret = ESP_OK;
+    uint16_t ff = 0;
+    uint16_t live = 0;
+    uint8_t fan_cfg = 0;
+    uint8_t fan_dyn = 0;
+
+    CHCK_CHAN(channel);
+
+    err_ret = MAX31790_get_fan_config(dev, channel, &fan_cfg);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    ff = MAX31790_cal_rpm_to_dutybits(cal, channel, rpm);
+
+    if(!(fan_cfg & MAX31790_FAN_CFG_MODE_RPM))                                                      // Open loop on the curve
+        return cal->chan[channel].valid ? MAX31790_set_target_dutybits(dev, channel, ff) : ESP_ERR_INVALID_STATE;
+
+    if(cal->chan[channel].valid && rpm)
+        err_ret = MAX31790_get_dutybits(dev, channel, false, &live);
+
+    if(err_ret != ESP_OK || !cal->chan[channel].valid || !rpm || (ff > live ? ff - live : live - ff) < cal->cfg.hop_bits)
+        return (err_ret == ESP_OK) ? MAX31790_set_target_rpm(dev, channel, rpm) : err_ret;
+
+    err_ret = MAX31790_get_fan_dynamic(dev, channel, &fan_dyn);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    MAX31790_batch_begin(&batch, dev);                                                              // The loop integrates from the duty it finds, hand it the estimate
+    MAX31790_batch_stage_fan_dynamic(&batch, channel, fan_dyn & ~MAX31790_FAN_DYN_PWM_ROC_MASK);
+    MAX31790_batch_stage_dutybits(&batch, channel, ff);
+    MAX31790_batch_stage_target_rpm(&batch, channel, rpm);
+
+    err_ret = MAX31790_batch_commit(&batch);
+    if(err_ret == ESP_OK)
+        err_ret = MAX31790_set_fan_config(dev, fan_cfg & ~MAX31790_FAN_CFG_MODE_RPM, channel);
+
+    if(err_ret == ESP_OK)
+        MAX31790_cal_wait(cal, cal->cfg.hop_ms);
+
+    MAX31790_batch_begin(&batch, dev);                                                              // Back to closed loop and the configured rate, even after a failure
+    MAX31790_batch_stage(&batch, MAX31790_REG_FAN_CONFIG(channel), &fan_cfg, 1);
+    MAX31790_batch_stage_fan_dynamic(&batch, channel, fan_dyn);
+
+    if(MAX31790_batch_commit(&batch) != ESP_OK && err_ret == ESP_OK)
+        err_ret = ESP_FAIL;
+
+    cal->hops += (err_ret == ESP_OK);
+
+    return err_ret;
+}
+
+/* Internal ---------------------------------------------------------------------------------- */
+static void MAX31790_cal_wait(max31790_cal_t *cal, uint32_t ms)
+{
+    if(cal->cfg.wait)
+        cal->cfg.wait(cal->cfg.wait_ctx, ms);
+    else
+        vTaskDelay(pdMS_TO_TICKS(ms) ? pdMS_TO_TICKS(ms) : 1);
+}
+
+static esp_err_t MAX31790_cal_measure(max31790_cal_t *cal, const uint16_t duty[NUM_CHANNEL], uint32_t settle_ms, uint32_t rpm[NUM_CHANNEL])
+{
+    uint8_t burst[NUM_CHANNEL * 2] = {0};
+    esp_err_t err_ret = ESP_OK;
+
+    err_ret = MAX31790_set_all_target_dutybits(cal->dev, duty);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    MAX31790_cal_wait(cal, settle_ms);
+
+    err_ret = MAX31790_get_regs(cal->dev, MAX31790_REG_TACH_COUNT(0), burst, sizeof(burst));       // Each channel's own input
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        uint16_t count = REG_TO_LFTJST(11, burst[x * 2], burst[x * 2 + 1]);
+
+        rpm[x] = (count && count < TACH_COUNT_MAX) ? MAX31790_count_to_rpm(cal->dev, x, count) : 0;   // Saturated count is a stopped fan
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t MAX31790_cal_read_user(max31790_cal_t *cal, uint8_t buff[MAX31790_CAL_USER_BYTES])
+{
+    esp_err_t err_ret = ESP_OK;
+    uint8_t end = 0;
+
+    for(uint8_t x = 0; x < MAX31790_CAL_USER_BYTES && err_ret == ESP_OK; x = end)                   // One read per contiguous run
+    {
+        end = x + 1;
+
+        while(end < MAX31790_CAL_USER_BYTES && user_reg[end] == user_reg[end - 1] + 1)
+            end++;
+
+        err_ret = MAX31790_get_regs(cal->dev, user_reg[x], buff + x, end - x);
+    }
+
+    return err_ret;
+}
+
+static uint16_t MAX31790_cal_point_bits(const max31790_cal_chan_t *chan, uint8_t point)
+{
+    return chan->stall_bits + ((DUTYBITS_MAX - chan->stall_bits) * point) / (MAX31790_CAL_POINTS - 1);
+}
@@ -0,0 +1,82 @@
+/****************************************************** 
+  Description: IDF MAX31790 Fan Calibration  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_CAL_H
+#define MAX31790_CAL_H
+
+#include "MAX31790.h"
+
+#define MAX31790_CAL_DEF_SETTLE_MS          3000                          // Per sweep step, several fan time constants
+#define MAX31790_CAL_DEF_STEP_BITS          8
+#define MAX31790_CAL_DEF_HOP_BITS           32                            // RPM steps needing a duty move this large are pre-positioned
+#define MAX31790_CAL_DEF_HOP_MS             2                             // A few PWM periods at 1 kHz and up
+
+#define MAX31790_CAL_POINTS                 4                             // Stall duty, two between, full duty
+#define MAX31790_CAL_RPM_LSB                64                            // Full speed resolution, up to 16320 RPM
+#define MAX31790_CAL_VERSION                1
+#define MAX31790_CAL_REC_SIZE               6
+#define MAX31790_CAL_BLOB_MAX               (2 + NUM_CHANNEL * MAX31790_CAL_REC_SIZE)   // Header, records, CRC-8
+#define MAX31790_CAL_USER_BYTES             15
+
+typedef struct                                  // Persists the encoded calibration when it does not fit the user bytes, or must survive chip power loss
+{
+   esp_err_t (*save)(void *ctx, const uint8_t *blob, size_t len);
+   esp_err_t (*load)(void *ctx, uint8_t *blob, size_t max, size_t *len);   // ESP_ERR_NOT_FOUND when nothing is stored
+} max31790_cal_store_ops_t;
+
+typedef struct                                  // Zero fields take the defaults above
+{
+   uint32_t settle_ms;
+   uint16_t step_bits;                          // Start and stall resolution
+   uint16_t hop_bits;
+   uint32_t hop_ms;                             // Time in PWM mode while pre-positioning, at least one PWM period
+   const max31790_cal_store_ops_t *store;       // NULL: user bytes only
+   void *store_ctx;
+   void (*wait)(void *ctx, uint32_t ms);        // NULL: vTaskDelay, simulations advance model time instead
+   void *wait_ctx;
+} max31790_cal_config_t;
+
+typedef struct
+{
+   bool valid;
+   uint16_t start_bits;                         // Lowest duty that starts a stopped fan
+   uint16_t stall_bits;                         // Lowest duty that keeps a spinning fan turning
+   uint32_t rpm[MAX31790_CAL_POINTS];           // Speed at duties spread evenly from stall_bits to full
+} max31790_cal_chan_t;
+
+typedef struct
+{
+   max31790_handle_t dev;
+   max31790_cal_config_t cfg;
+   max31790_cal_chan_t chan[NUM_CHANNEL];
+   uint32_t hops;                               // RPM setpoints that were pre-positioned
+} max31790_cal_t;
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_cal_init(max31790_cal_t *cal, max31790_handle_t dev, const max31790_cal_config_t *cfg);   // NULL cfg takes the defaults
+
+esp_err_t MAX31790_cal_load(max31790_cal_t *cal);                              // User bytes, then the store. ESP_ERR_NOT_FOUND when neither holds a valid record.
+
+esp_err_t MAX31790_cal_save(max31790_cal_t *cal);                              // User bytes when it fits, the store when set, ESP_ERR_INVALID_SIZE when neither takes it. The store is not written when blanking the user bytes fails.
+
+esp_err_t MAX31790_cal_sweep(max31790_cal_t *cal, uint8_t channels);           // Blocking, channels swept together, bit per channel. Saves on success.
+
+/* Encoding ------------------------------------------------------------------------------- */
+size_t MAX31790_cal_encode(const max31790_cal_t *cal, uint8_t blob[MAX31790_CAL_BLOB_MAX]);   // Valid channels only, returns the length
+
+esp_err_t MAX31790_cal_decode(max31790_cal_t *cal, const uint8_t *blob, size_t len);   // ESP_ERR_INVALID_CRC / _VERSION, cal untouched on failure
+
+/* Feed-forward --------------------------------------------------------------------------- */
+uint16_t MAX31790_cal_rpm_to_dutybits(const max31790_cal_t *cal, uint8_t channel, uint32_t rpm);   // Inverse of the curve, 0 for 0 RPM, never below stall
+
+uint32_t MAX31790_cal_dutybits_to_rpm(const max31790_cal_t *cal, uint8_t channel, uint16_t dutybits);   // Expected speed, 0 below stall
+
+esp_err_t MAX31790_cal_set_dutybits(max31790_cal_t *cal, uint8_t channel, uint16_t dutybits, uint32_t *expect_rpm);   // Non-zero duties below stall are raised to it, expect_rpm is optional
+
+esp_err_t MAX31790_cal_set_rpm(max31790_cal_t *cal, uint8_t channel, uint32_t rpm);   // PWM mode: open loop duty. RPM mode: large steps start the loop from the estimated duty.
+
+#endif
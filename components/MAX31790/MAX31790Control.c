@@ -0,0 +1,292 @@
+/****************************************************** 
+  Description: IDF MAX31790 Fan Curve and PID Control  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Control.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define CONTROL_STACK 3072
+#define CONTROL_HALF_Q16 0x8000
+
+static const char *TAG = "MAX31790 Control";
+
+static void MAX31790_task_control(void *arg);
+static int32_t MAX31790_control_pid(max31790_control_t *ctl, uint8_t channel, int32_t temp_mc, uint32_t dt_ms, int32_t lo, int32_t hi);
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_control_init(max31790_control_t *ctl, max31790_handle_t dev, const max31790_control_config_t *cfg)
+{
+    memset(ctl, 0, sizeof(*ctl));
+
+    if(!cfg || cfg->n_inputs > MAX31790_CONTROL_MAX_INPUTS)
+        return ESP_ERR_INVALID_ARG;
+
+    ctl->cfg = *cfg;
+
+    if(!ctl->cfg.period_ms)
+        ctl->cfg.period_ms = MAX31790_CONTROL_DEF_PERIOD_MS;
+
+    for(uint8_t x = 0; x < ctl->cfg.n_inputs; x++)
+        if(!ctl->cfg.input[x].read)
+            return ESP_ERR_INVALID_ARG;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        max31790_control_chan_config_t *c = &ctl->cfg.chan[x];
+
+        if(c->mode == MAX31790_CONTROL_OFF)
+            continue;
+
+        if(c->mode > MAX31790_CONTROL_PID || c->space > MAX31790_CONTROL_RPM || c->n_points > MAX31790_CONTROL_CURVE_POINTS ||
+           !c->inputs || (c->inputs >> ctl->cfg.n_inputs) || (c->mode == MAX31790_CONTROL_CURVE && !c->n_points))
+            return ESP_ERR_INVALID_ARG;
+
+        for(uint8_t y = 1; y < c->n_points; y++)
+            if(c->curve[y].temp_mc <= c->curve[y - 1].temp_mc)
+                return ESP_ERR_INVALID_ARG;
+
+        if(!c->out_min && !c->out_max)                                                              // Whole range, RPM has no natural top
+        {
+            if(c->space == MAX31790_CONTROL_RPM)
+                return ESP_ERR_INVALID_ARG;
+
+            c->out_max = DUTYBITS_MAX;
+        }
+
+        if(c->out_min > c->out_max)
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    ctl->dev = dev;
+    ctl->lock = xSemaphoreCreateMutex();
+
+    return ctl->lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t MAX31790_control_start(max31790_control_t *ctl, UBaseType_t priority, BaseType_t core)
+{
+    ESP_LOGD(TAG, "Start. Period: %dms Core: %d", (int)ctl->cfg.period_ms, (int)core);
+
+    if(!ctl->lock || ctl->task)
+        return ESP_ERR_INVALID_STATE;
+
+    if(!ctl->exited)
+        ctl->exited = xSemaphoreCreateBinary();
+
+    if(!ctl->exited)
+        return ESP_ERR_NO_MEM;
+
+    ctl->stop = false;
+
+    if(xTaskCreatePinnedToCore(MAX31790_task_control, "max31790_control", CONTROL_STACK, ctl, priority, &ctl->task, core) != pdPASS)
+        return ESP_ERR_NO_MEM;
+
+    return ESP_OK;
+}
+
+void MAX31790_control_stop(max31790_control_t *ctl)
+{
+    if(!ctl->task)
+        return;
+
+    ctl->stop = true;
+    xSemaphoreTake(ctl->exited, portMAX_DELAY);                                                     // Never while it holds ctl->lock or the bus
+
+    ctl->task = NULL;
+}
+
+/* Run --------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_control_tick(max31790_control_t *ctl, int64_t now_us)
+{
+    int32_t temps[MAX31790_CONTROL_MAX_INPUTS] = {0};
+    max31790_batch_t batch;
+    esp_err_t err_ret = ESP_OK;
+    uint32_t dt_ms = ctl->cfg.period_ms;
+    uint8_t read_ok = 0;
+    bool changed = false;
+
+    for(uint8_t x = 0; x < ctl->cfg.n_inputs; x++)                                                 // Outside the lock, sources may block
+    {
+        if(ctl->cfg.input[x].read(ctl->cfg.input[x].ctx, &temps[x]) == ESP_OK)
+            read_ok |= (0x01 << x);
+    }
+
+    if(ctl->last_us && now_us > ctl->last_us)                                                       // Measured, a late tick integrates what it missed
+        dt_ms = (now_us - ctl->last_us) / 1000;
+    dt_ms = dt_ms ? dt_ms : 1;
+
+    MAX31790_batch_begin(&batch, ctl->dev);
+
+    xSemaphoreTake(ctl->lock, portMAX_DELAY);
+
+    ctl->stats.ticks++;
+    ctl->stats.input_errors += (read_ok != (0x01 << ctl->cfg.n_inputs) - 1);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        const max31790_control_chan_config_t *c = &ctl->cfg.chan[x];
+        max31790_control_chan_t *st = &ctl->chan[x];
+        uint8_t usable = c->inputs & read_ok;
+        int32_t out = c->out_max;                                                                   // Every input failed, full cooling
+        int32_t temp_mc = INT32_MIN;
+
+        if(c->mode == MAX31790_CONTROL_OFF)
+            continue;
+
+        for(uint8_t y = 0; y < ctl->cfg.n_inputs; y++)
+            if((usable & (0x01 << y)) && temps[y] > temp_mc)
+                temp_mc = temps[y];
+
+        if(!usable)
+            st->primed = false;                                                                     // Derivative restarts on the next reading
+        else if(c->mode == MAX31790_CONTROL_CURVE)
+            out = MAX31790_control_curve(c, temp_mc);
+        else
+            out = MAX31790_control_pid(ctl, x, temp_mc, dt_ms, c->out_min, c->out_max);
+
+        out = CONSTRAIN(out, c->out_min, c->out_max);
+
+        if(c->space == MAX31790_CONTROL_DUTY && ctl->cfg.cal && ctl->cfg.cal->chan[x].valid &&      // Would only stop the fan and trip FAN_FAIL
+           out && out < ctl->cfg.cal->chan[x].stall_bits)
+            out = ctl->cfg.cal->chan[x].stall_bits;
+
+        if(c->space == MAX31790_CONTROL_RPM)
+            MAX31790_batch_stage_target_rpm(&batch, x, out);
+        else
+            MAX31790_batch_stage_dutybits(&batch, x, out);
+
+        changed |= (out != st->out) || !ctl->last_us;
+        st->out = out;
+        st->temp_mc = usable ? temp_mc : st->temp_mc;
+    }
+
+    ctl->stats.writes += changed;
+
+    xSemaphoreGive(ctl->lock);
+
+    ctl->last_us = now_us;
+
+    err_ret = MAX31790_batch_commit(&batch);                                                        // Unchanged targets are dropped, one burst per run of a space
+    if(err_ret != ESP_OK)
+    {
+        xSemaphoreTake(ctl->lock, portMAX_DELAY);
+        ctl->stats.write_errors++;
+        xSemaphoreGive(ctl->lock);
+    }
+
+    return err_ret;
+}
+
+esp_err_t MAX31790_control_set_setpoint(max31790_control_t *ctl, uint8_t channel, int32_t setpoint_mc)
+{
+    CHCK_CHAN(channel);
+
+    xSemaphoreTake(ctl->lock, portMAX_DELAY);
+    ctl->cfg.chan[channel].setpoint_mc = setpoint_mc;
+    xSemaphoreGive(ctl->lock);
+
+    return ESP_OK;
+}
+
+void MAX31790_control_get_stats(max31790_control_t *ctl, max31790_control_stats_t *stats)
+{
+    xSemaphoreTake(ctl->lock, portMAX_DELAY);
+    *stats = ctl->stats;
+    xSemaphoreGive(ctl->lock);
+}
+
+int32_t MAX31790_control_curve(const max31790_control_chan_config_t *chan, int32_t temp_mc)
+{
+    const max31790_control_point_t *p = chan->curve;
+    uint8_t x = 1;
+
+    if(!chan->n_points)
+        return 0;
+
+    if(temp_mc <= p[0].temp_mc)
+        return p[0].out;
+
+    if(temp_mc >= p[chan->n_points - 1].temp_mc)
+        return p[chan->n_points - 1].out;
+
+    while(temp_mc > p[x].temp_mc)
+        x++;
+
+    return p[x - 1].out + (int32_t)(((int64_t)(p[x].out - p[x - 1].out) * (temp_mc - p[x - 1].temp_mc)) / (p[x].temp_mc - p[x - 1].temp_mc));
+}
+
+/* Internal ---------------------------------------------------------------------------------- */
+static void MAX31790_task_control(void *arg)
+{
+    max31790_control_t *ctl = (max31790_control_t *)arg;
+    TickType_t wake = xTaskGetTickCount();
+    int64_t release_us = 0;
+
+    vTaskDelayUntil(&wake, 1);                                                                      // Releases fall on tick edges, measure from one
+    release_us = esp_timer_get_time();
+
+    while(!ctl->stop)
+    {
+        int64_t start_us = esp_timer_get_time();
+        int64_t late_us = (start_us > release_us) ? start_us - release_us : 0;
+        int64_t work_us = 0;
+
+        if(MAX31790_control_tick(ctl, start_us) != ESP_OK)
+            ESP_LOGW(TAG, "Control write failed. Adr: 0x%02x", ctl->dev->adr);
+
+        work_us = esp_timer_get_time() - start_us;
+        release_us += (int64_t)ctl->cfg.period_ms * 1000;
+
+        xSemaphoreTake(ctl->lock, portMAX_DELAY);
+        ctl->stats.late_max_us = (late_us > ctl->stats.late_max_us) ? late_us : ctl->stats.late_max_us;
+        ctl->stats.late_sum_us += late_us;
+        ctl->stats.work_max_us = (work_us > ctl->stats.work_max_us) ? work_us : ctl->stats.work_max_us;
+        xSemaphoreGive(ctl->lock);
+
+        if(xTaskDelayUntil(&wake, pdMS_TO_TICKS(ctl->cfg.period_ms)) == pdFALSE)                   // Release already passed, runs again at once to catch up
+        {
+            xSemaphoreTake(ctl->lock, portMAX_DELAY);
+            ctl->stats.overruns++;
+            xSemaphoreGive(ctl->lock);
+        }
+    }
+
+    xSemaphoreGive(ctl->exited);
+    vTaskDelete(NULL);
+}
+
+static int32_t MAX31790_control_pid(max31790_control_t *ctl, uint8_t channel, int32_t temp_mc, uint32_t dt_ms, int32_t lo, int32_t hi)
+{
+    const max31790_control_chan_config_t *c = &ctl->cfg.chan[channel];
+    max31790_control_chan_t *st = &ctl->chan[channel];
+    int64_t span = (int64_t)(hi - lo) << 16;
+    int64_t err = temp_mc - c->setpoint_mc;                                                         // Hot is positive, more air
+    int64_t di = (c->ki * err * dt_ms) / 1000000;                                                   // Milli degrees by milliseconds
+    int64_t u = ((int64_t)MAX31790_control_curve(c, temp_mc) << 16) + (c->kp * err) / 1000;
+    int32_t out = 0;
+
+    if(st->primed)                                                                                  // Milli degrees per millisecond is degrees per second
+        u += (c->kd * (int64_t)(temp_mc - st->prev_mc)) / (int64_t)dt_ms;
+
+    st->integ += di;
+    st->integ = CONSTRAIN(st->integ, -span, span);
+    out = (int32_t)((u + st->integ + CONTROL_HALF_Q16) >> 16);
+
+    st->saturated = out > hi || out < lo;
+    if((out > hi && di > 0) || (out < lo && di < 0))                                                // Anti-windup, the integral stops where the output clamps
+    {
+        st->integ -= di;
+        out = (int32_t)((u + st->integ + CONTROL_HALF_Q16) >> 16);
+    }
+
+    st->prev_mc = temp_mc;
+    st->primed = true;
+
+    return CONSTRAIN(out, lo, hi);
+}
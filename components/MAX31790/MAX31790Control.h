@@ -0,0 +1,122 @@
+/****************************************************** 
+  Description: IDF MAX31790 Fan Curve and PID Control  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_CONTROL_H
+#define MAX31790_CONTROL_H
+
+#include "MAX31790.h"
+#include "MAX31790Cal.h"
+
+#define MAX31790_CONTROL_DEF_PERIOD_MS      100                           // A multiple of the tick period, the release time is quantised to it
+#define MAX31790_CONTROL_MAX_INPUTS         4
+#define MAX31790_CONTROL_CURVE_POINTS       8
+
+#define MAX31790_CONTROL_Q16(X)             ((int32_t)((X) * 65536.0))   // Gains in Q16.16
+
+typedef esp_err_t (*max31790_temp_read_t)(void *ctx, int32_t *temp_mc);   // Milli degrees C, runs on the control task
+
+typedef struct
+{
+   max31790_temp_read_t read;
+   void *ctx;
+} max31790_control_input_t;
+
+typedef enum
+{
+   MAX31790_CONTROL_OFF = 0,                    // Channel left alone
+   MAX31790_CONTROL_CURVE,                      // Output straight from the curve
+   MAX31790_CONTROL_PID                         // Temperature held at setpoint_mc, the curve is feed-forward when it has points
+} max31790_control_mode_t;
+
+typedef enum
+{
+   MAX31790_CONTROL_DUTY = 0,                   // Output in dutybits to TARGET_DUTY
+   MAX31790_CONTROL_RPM                         // Output in RPM to TARGET_COUNT, the channel in RPM mode closes the speed loop
+} max31790_control_space_t;
+
+typedef struct
+{
+   int32_t temp_mc;
+   int32_t out;
+} max31790_control_point_t;
+
+typedef struct
+{
+   max31790_control_mode_t mode;
+   max31790_control_space_t space;
+   uint8_t inputs;                              // Bit per input, the hottest one drives the channel
+   uint8_t n_points;
+   max31790_control_point_t curve[MAX31790_CONTROL_CURVE_POINTS];   // Ascending temperature, held flat beyond both ends
+   int32_t setpoint_mc;
+   int32_t kp;                                  // Q16.16 output per degree C
+   int32_t ki;                                  // Q16.16 output per degree C second
+   int32_t kd;                                  // Q16.16 output per degree C per second, on the measurement so setpoint changes do not kick
+   int32_t out_min;                             // Both 0: the whole range of the space
+   int32_t out_max;                             // Also the output while every input fails
+} max31790_control_chan_config_t;
+
+typedef struct
+{
+   uint32_t period_ms;                          // 0 takes the default
+   max31790_control_input_t input[MAX31790_CONTROL_MAX_INPUTS];
+   uint8_t n_inputs;
+   max31790_control_chan_config_t chan[NUM_CHANNEL];
+   const max31790_cal_t *cal;                   // Optional, non-zero duties are raised to the channel's stall duty
+} max31790_control_config_t;
+
+typedef struct
+{
+   int32_t temp_mc;                             // Input used last tick
+   int32_t prev_mc;
+   int64_t integ;                               // Q16.16 output
+   int32_t out;                                 // Last output staged
+   bool primed;                                 // prev_mc holds a reading
+   bool saturated;
+} max31790_control_chan_t;
+
+typedef struct
+{
+   uint32_t ticks;
+   uint32_t overruns;                           // Ticks that ran past the next release
+   uint32_t late_max_us;                        // Release jitter, wake time after the ideal release
+   uint64_t late_sum_us;
+   uint32_t work_max_us;                        // Inputs, control and the write
+   uint32_t writes;                             // Ticks that wrote, one burst per run of adjacent channels sharing a space
+   uint32_t input_errors;
+   uint32_t write_errors;
+} max31790_control_stats_t;
+
+typedef struct
+{
+   max31790_handle_t dev;
+   max31790_control_config_t cfg;
+   max31790_control_chan_t chan[NUM_CHANNEL];
+   max31790_control_stats_t stats;
+   int64_t last_us;                             // Time of the last tick, 0 before the first
+   SemaphoreHandle_t lock;                      // Setpoints and stats from any task
+   volatile bool stop;                          // Seen at the next release
+   SemaphoreHandle_t exited;
+   TaskHandle_t task;
+} max31790_control_t;
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_control_init(max31790_control_t *ctl, max31790_handle_t dev, const max31790_control_config_t *cfg);   // Curves must ascend, inputs must exist.
+
+esp_err_t MAX31790_control_start(max31790_control_t *ctl, UBaseType_t priority, BaseType_t core);   // Period locked task, core or tskNO_AFFINITY.
+
+void MAX31790_control_stop(max31790_control_t *ctl);                     // Returns once the task has left, within a period. Stats stay readable.
+
+/* Run ------------------------------------------------------------------------------------ */
+esp_err_t MAX31790_control_tick(max31790_control_t *ctl, int64_t now_us);     // Reads the inputs, stages every channel, one batch commit.
+
+esp_err_t MAX31790_control_set_setpoint(max31790_control_t *ctl, uint8_t channel, int32_t setpoint_mc);
+
+void MAX31790_control_get_stats(max31790_control_t *ctl, max31790_control_stats_t *stats);
+
+int32_t MAX31790_control_curve(const max31790_control_chan_config_t *chan, int32_t temp_mc);   // Integer interpolation, no bus access
+
+#endif
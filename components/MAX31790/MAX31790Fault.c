@@ -0,0 +1,218 @@
+/****************************************************** 
+  Description: IDF MAX31790 Fault Monitor  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Fault.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define FAULT_STACK 3072
+
+static const char *TAG = "MAX31790 Fault";
+
+static void MAX31790_task_fault(void *arg);
+static void MAX31790_fault_dispatch(max31790_fault_monitor_t *mon, uint16_t edges, bool failed, int64_t alert_us, int64_t read_us);
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_fault_init(max31790_fault_monitor_t *mon, max31790_handle_t dev, const max31790_fault_config_t *cfg)
+{
+    SemaphoreHandle_t wake = mon->wake;                                                             // Kept across a re-init
+    SemaphoreHandle_t exited = mon->exited;
+
+    if(mon->task)
+        return ESP_ERR_INVALID_STATE;
+
+    memset(mon, 0, sizeof(*mon));
+
+    mon->dev = dev;
+
+    if(cfg)
+        mon->cfg = *cfg;
+
+    if(!mon->cfg.poll_ms)
+        mon->cfg.poll_ms = MAX31790_FAULT_DEF_POLL_MS;
+
+    if(!mon->cfg.recheck_ms)
+        mon->cfg.recheck_ms = MAX31790_FAULT_DEF_RECHECK_MS;
+
+    mon->wake = wake ? wake : xSemaphoreCreateBinary();
+    mon->exited = exited ? exited : xSemaphoreCreateBinary();
+
+    if(!mon->wake || !mon->exited)
+        return ESP_ERR_NO_MEM;
+
+    xSemaphoreTake(mon->wake, 0);                                                                   // A notify left over from the last run
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_fault_add_callback(max31790_fault_monitor_t *mon, max31790_fault_cb_t cb, void *arg)
+{
+    if(!cb)
+        return ESP_ERR_INVALID_ARG;
+
+    if(mon->task || mon->n_cb >= MAX31790_FAULT_MAX_CB)                                              // List is read unlocked by the task
+        return ESP_ERR_INVALID_STATE;
+
+    mon->cb[mon->n_cb] = cb;
+    mon->cb_arg[mon->n_cb] = arg;
+    mon->n_cb++;
+
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_fault_start(max31790_fault_monitor_t *mon, UBaseType_t priority)
+{
+    esp_err_t err_ret = ESP_OK;
+
+    ESP_LOGD(TAG, "Start. Alert: %s Poll: %dms", mon->cfg.alert.ops ? "yes" : "no", (int)mon->cfg.poll_ms);
+
+    if(!mon->wake || mon->task)
+        return ESP_ERR_INVALID_STATE;
+
+    mon->stop = false;
+
+    if(mon->cfg.alert.ops)
+    {
+        err_ret = mon->cfg.alert.ops->arm(mon->cfg.alert.ctx, MAX31790_fault_notify, mon);
+        if(err_ret != ESP_OK)
+            return err_ret;
+    }
+
+    if(xTaskCreate(MAX31790_task_fault, "max31790_fault", FAULT_STACK, mon, priority, &mon->task) != pdPASS)
+    {
+        if(mon->cfg.alert.ops)
+            mon->cfg.alert.ops->disarm(mon->cfg.alert.ctx);
+
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void MAX31790_fault_stop(max31790_fault_monitor_t *mon)
+{
+    if(!mon->task)
+        return;
+
+    if(mon->cfg.alert.ops)
+        mon->cfg.alert.ops->disarm(mon->cfg.alert.ctx);
+
+    mon->stop = true;
+    xSemaphoreGive(mon->wake);                                                                      // Idle with an alert source it waits forever
+    xSemaphoreTake(mon->exited, portMAX_DELAY);
+
+    mon->task = NULL;
+}
+
+void MAX31790_fault_deinit(max31790_fault_monitor_t *mon)
+{
+    MAX31790_fault_stop(mon);
+
+    if(mon->wake)
+        vSemaphoreDelete(mon->wake);
+
+    if(mon->exited)
+        vSemaphoreDelete(mon->exited);
+
+    mon->wake = NULL;
+    mon->exited = NULL;
+}
+
+/* Service ----------------------------------------------------------------------------------- */
+esp_err_t MAX31790_fault_service(max31790_fault_monitor_t *mon, int64_t alert_us)
+{
+    uint16_t fans = 0;
+    uint16_t masked = ((mon->dev->fault_mask_2 & 0x3F) << NUM_CHANNEL) | (mon->dev->fault_mask_1 & 0x3F);
+    esp_err_t err_ret = MAX31790_get_fault_status_all(mon->dev, &fans);
+    int64_t read_us = esp_timer_get_time();
+
+    mon->reads++;
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    if(fans)                                                                                        // Fans still failing latch again after the fault queue
+        err_ret = MAX31790_clear_fault_status(mon->dev, fans);
+
+    fans &= ~masked;
+
+    MAX31790_fault_dispatch(mon, fans & ~mon->state, true, alert_us, read_us);
+    MAX31790_fault_dispatch(mon, mon->state & ~fans, false, 0, read_us);
+
+    mon->state = fans;
+
+    return err_ret;
+}
+
+void IRAM_ATTR MAX31790_fault_notify(void *arg)
+{
+    max31790_fault_monitor_t *mon = (max31790_fault_monitor_t *)arg;
+    BaseType_t woken = pdFALSE;
+    uint32_t none = 0;
+
+    __atomic_compare_exchange_n(&mon->alert_us, &none, (uint32_t)esp_timer_get_time() | 0x01, false,   // Keep the first edge until the task takes it
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+
+    xSemaphoreGiveFromISR(mon->wake, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/* Task -------------------------------------------------------------------------------------- */
+static void MAX31790_task_fault(void *arg)
+{
+    max31790_fault_monitor_t *mon = (max31790_fault_monitor_t *)arg;
+    int64_t alert_us = 0;
+    TickType_t wait = 0;
+
+    if(!mon->cfg.alert.ops || !mon->cfg.alert.ops->asserted || mon->cfg.alert.ops->asserted(mon->cfg.alert.ctx))
+        MAX31790_fault_service(mon, 0);                                                             // Faults latched before the alert was armed
+
+    while(!mon->stop)
+    {
+        if(mon->state)
+            wait = pdMS_TO_TICKS(mon->cfg.recheck_ms);
+        else
+            wait = mon->cfg.alert.ops ? portMAX_DELAY : pdMS_TO_TICKS(mon->cfg.poll_ms);            // Idle with an alert source costs no bus time
+
+        alert_us = 0;
+
+        if(xSemaphoreTake(mon->wake, wait) && !mon->stop)
+        {
+            uint32_t edge = __atomic_exchange_n(&mon->alert_us, 0, __ATOMIC_ACQUIRE);
+            int64_t now = esp_timer_get_time();
+
+            alert_us = edge ? now - (uint32_t)((uint32_t)now - edge) : 0;                          // Widened against now, an edge is never 71 minutes old
+            mon->alerts++;
+        }
+
+        if(mon->stop)
+            break;
+
+        if(MAX31790_fault_service(mon, alert_us) != ESP_OK)
+            ESP_LOGW(TAG, "Status read failed. Adr: 0x%02x", mon->dev->adr);
+    }
+
+    xSemaphoreGive(mon->exited);
+    vTaskDelete(NULL);
+}
+
+static void MAX31790_fault_dispatch(max31790_fault_monitor_t *mon, uint16_t edges, bool failed, int64_t alert_us, int64_t read_us)
+{
+    max31790_fault_event_t event = {.failed = failed, .alert_us = alert_us, .read_us = read_us};
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL && edges; x++)
+    {
+        if(!(edges & (0x01 << x)))
+            continue;
+
+        event.fan_number = x;
+
+        for(uint8_t y = 0; y < mon->n_cb; y++)
+            mon->cb[y](mon->dev, &event, mon->cb_arg[y]);
+    }
+}
@@ -0,0 +1,89 @@
+/****************************************************** 
+  Description: IDF MAX31790 Fault Monitor  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_FAULT_H
+#define MAX31790_FAULT_H
+
+#include "MAX31790.h"
+
+#define MAX31790_FAULT_MAX_CB               4
+#define MAX31790_FAULT_DEF_POLL_MS          1000                          // Status poll period without an alert source
+#define MAX31790_FAULT_DEF_RECHECK_MS       1000                          // Poll while a fan is failed, must exceed the fault queue time (100 ms x FFQ)
+
+typedef void (*max31790_alert_notify_t)(void *arg);                       // ISR safe
+
+typedef struct                                                            // Something that watches the FAN_FAIL pin
+{
+   esp_err_t (*arm)(void *ctx, max31790_alert_notify_t notify, void *arg);   // Call notify when FAN_FAIL asserts
+   void (*disarm)(void *ctx);
+   bool (*asserted)(void *ctx);                                           // Current pin level, true while low, optional
+} max31790_alert_ops_t;
+
+typedef struct
+{
+   const max31790_alert_ops_t *ops;             // NULL: status is polled
+   void *ctx;
+} max31790_alert_t;
+
+typedef struct
+{
+   int gpio;                                    // FAN_FAIL, open drain, active low
+} max31790_alert_gpio_t;
+
+extern const max31790_alert_ops_t max31790_alert_gpio_ops;                // ESP-IDF only, ctx is a max31790_alert_gpio_t
+
+typedef struct
+{
+   uint8_t fan_number;
+   bool failed;                                 // True on the rising edge, false on recovery
+   int64_t alert_us;                            // esp_timer time FAN_FAIL asserted, 0 when found by a poll
+   int64_t read_us;                             // esp_timer time the status read completed
+} max31790_fault_event_t;
+
+typedef void (*max31790_fault_cb_t)(max31790_handle_t dev, const max31790_fault_event_t *event, void *arg);   // Runs on the monitor task
+
+typedef struct
+{
+   max31790_alert_t alert;
+   uint32_t poll_ms;
+   uint32_t recheck_ms;
+} max31790_fault_config_t;
+
+typedef struct
+{
+   max31790_handle_t dev;
+   max31790_fault_config_t cfg;
+   max31790_fault_cb_t cb[MAX31790_FAULT_MAX_CB];
+   void *cb_arg[MAX31790_FAULT_MAX_CB];
+   uint8_t n_cb;
+   uint16_t state;                              // Bit per fan, failed as of the last read
+   uint32_t alert_us;                           // ISR edge time, low 32 bits forced odd, 0 none. Atomic where 64 bits would tear.
+   SemaphoreHandle_t wake;
+   volatile bool stop;                          // Task leaves when next woken
+   SemaphoreHandle_t exited;
+   TaskHandle_t task;
+   uint32_t alerts;
+   uint32_t reads;
+} max31790_fault_monitor_t;
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_fault_init(max31790_fault_monitor_t *mon, max31790_handle_t dev, const max31790_fault_config_t *cfg);   // NULL cfg: polled, default periods. Zeroed storage the first time, a stopped monitor after.
+
+esp_err_t MAX31790_fault_add_callback(max31790_fault_monitor_t *mon, max31790_fault_cb_t cb, void *arg);
+
+esp_err_t MAX31790_fault_start(max31790_fault_monitor_t *mon, UBaseType_t priority);   // Arms the alert source and reads once for faults already latched.
+
+void MAX31790_fault_stop(max31790_fault_monitor_t *mon);                 // Disarms, wakes the task and waits out any status read in flight.
+
+void MAX31790_fault_deinit(max31790_fault_monitor_t *mon);               // Stops the task, deletes its semaphores.
+
+/* Service -------------------------------------------------------------------------------- */
+esp_err_t MAX31790_fault_service(max31790_fault_monitor_t *mon, int64_t alert_us);   // One burst read, re-arms latched bits, dispatches edges. Masked fans are ignored.
+
+void MAX31790_fault_notify(void *arg);                                    // Alert sources call this, ISR safe, arg is the monitor.
+
+#endif
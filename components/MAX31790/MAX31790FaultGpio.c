@@ -0,0 +1,60 @@
+/****************************************************** 
+  Description: IDF MAX31790 FAN_FAIL GPIO Alert  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Fault.h"
+
+#include <driver/gpio.h>
+
+static esp_err_t MAX31790_alert_gpio_arm(void *ctx, max31790_alert_notify_t notify, void *arg);
+static void MAX31790_alert_gpio_disarm(void *ctx);
+static bool MAX31790_alert_gpio_asserted(void *ctx);
+
+const max31790_alert_ops_t max31790_alert_gpio_ops =
+{
+    .arm = MAX31790_alert_gpio_arm,
+    .disarm = MAX31790_alert_gpio_disarm,
+    .asserted = MAX31790_alert_gpio_asserted
+};
+
+static esp_err_t MAX31790_alert_gpio_arm(void *ctx, max31790_alert_notify_t notify, void *arg)
+{
+    max31790_alert_gpio_t *alert = (max31790_alert_gpio_t *)ctx;
+    esp_err_t err_ret = ESP_OK;
+
+    gpio_config_t conf =
+    {
+        .pin_bit_mask = 1ULL << alert->gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,                                                           // Open drain output, weak pull-up if the board has none
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE
+    };
+
+    err_ret = gpio_config(&conf);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    err_ret = gpio_install_isr_service(0);
+    if(err_ret != ESP_OK && err_ret != ESP_ERR_INVALID_STATE)                                       // Already installed by someone else
+        return err_ret;
+
+    return gpio_isr_handler_add(alert->gpio, notify, arg);
+}
+
+static void MAX31790_alert_gpio_disarm(void *ctx)
+{
+    max31790_alert_gpio_t *alert = (max31790_alert_gpio_t *)ctx;
+
+    gpio_isr_handler_remove(alert->gpio);
+}
+
+static bool MAX31790_alert_gpio_asserted(void *ctx)
+{
+    max31790_alert_gpio_t *alert = (max31790_alert_gpio_t *)ctx;
+
+    return !gpio_get_level(alert->gpio);
+}
@@ -0,0 +1,189 @@
+/****************************************************** 
+  Description: IDF MAX31790 Tach Filter and Stall Predictor  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Filter.h"
+
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "MAX31790 Filter";
+
+static uint16_t MAX31790_filter_median(const max31790_filter_t *filter, uint8_t fan_number);
+static inline uint32_t MAX31790_filter_rpm(max31790_handle_t dev, uint8_t fan_number, uint16_t count);
+static void MAX31790_filter_vote(max31790_filter_t *filter, uint8_t fan_number, bool predicted);
+
+#define FILTER_DEF(V, D) do { if(!(V)) (V) = (D); } while(0)
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_filter_init(max31790_filter_t *filter, max31790_handle_t dev, const max31790_filter_config_t *cfg, max31790_filter_cb_t cb, void *arg)
+{
+    memset(filter, 0, sizeof(*filter));
+
+    if(cfg)
+        filter->cfg = *cfg;
+
+    FILTER_DEF(filter->cfg.fans, (0x01 << NUM_TACH_CHANNEL) - 1);
+    FILTER_DEF(filter->cfg.median, MAX31790_FILTER_DEF_MEDIAN);
+    FILTER_DEF(filter->cfg.ema_ms, MAX31790_FILTER_DEF_EMA_MS);
+    FILTER_DEF(filter->cfg.outlier_permille, MAX31790_FILTER_DEF_OUTLIER);
+    FILTER_DEF(filter->cfg.slope_ms, MAX31790_FILTER_DEF_SLOPE_MS);
+    FILTER_DEF(filter->cfg.min_slope_rpm_s, MAX31790_FILTER_DEF_MIN_SLOPE);
+    FILTER_DEF(filter->cfg.horizon_ms, MAX31790_FILTER_DEF_HORIZON_MS);
+    FILTER_DEF(filter->cfg.confirm, MAX31790_FILTER_DEF_CONFIRM);
+    FILTER_DEF(filter->cfg.settle_ms, MAX31790_FILTER_DEF_SETTLE_MS);
+
+    if(filter->cfg.median > MAX31790_FILTER_MEDIAN_MAX || !(filter->cfg.median & 0x01))
+        return ESP_ERR_INVALID_ARG;
+
+    filter->dev = dev;
+    filter->cb = cb;
+    filter->cb_arg = arg;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+        filter->eta_ms[x] = UINT32_MAX;
+
+    return ESP_OK;
+}
+
+/* Update ------------------------------------------------------------------------------------ */
+esp_err_t MAX31790_filter_update(max31790_filter_t *filter, const max31790_frame_t *frame)
+{
+    const max31790_filter_config_t *cfg = &filter->cfg;
+    bool filling = false;
+    float dt_ms = 0;
+
+    if(frame->rslt != ESP_OK)                                                                       // Counts are stale, the trend waits for the next good frame
+        return frame->rslt;
+
+    if(filter->frames && frame->timestamp_us <= filter->last_us)                                    // Already seen
+        return ESP_ERR_INVALID_STATE;
+
+    dt_ms = (frame->timestamp_us - filter->last_us) / 1000.0f;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)                                                   // Every input shares the window position
+        filter->win[filter->win_pos][x] = frame->tach_count[x];
+
+    filter->win_pos = (filter->win_pos + 1) % cfg->median;
+    filling = filter->win_fill < cfg->median;                                                       // Too few samples to reject one, the median seeds the average
+    filter->win_fill += filling;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        uint8_t ch = FAN_TO_CHAN(x);
+        uint32_t raw = 0;
+        uint32_t med = 0;
+        uint32_t stall = cfg->stall_rpm ? cfg->stall_rpm : MAX31790_count_to_rpm(filter->dev, x, TACH_COUNT_MAX);
+        float in = 0;
+        float prev = 0;
+        bool slower = false;
+
+        if(!(cfg->fans & (0x01 << x)))
+            continue;
+
+        raw = MAX31790_filter_rpm(filter->dev, x, frame->tach_count[x]);
+        med = MAX31790_filter_rpm(filter->dev, x, MAX31790_filter_median(filter, x));
+        in = raw;
+
+        if((uint64_t)((raw > med) ? raw - med : med - raw) * PERMILLE_MAX > (uint64_t)med * cfg->outlier_permille)   // A missed or doubled pulse, not the rotor
+        {
+            in = med;
+            filter->rejected[x]++;
+        }
+
+        slower = frame->target_dutybits[ch] < filter->target_dutybits[x] || frame->target_count[ch] > filter->target_count[x];
+        filter->target_dutybits[x] = frame->target_dutybits[ch];
+        filter->target_count[x] = frame->target_count[ch];
+
+        if(filling)
+        {
+            filter->ema[x] = med;
+            filter->slope[x] = 0;
+        }
+        else
+        {
+            prev = filter->ema[x];
+            filter->ema[x] += (in - filter->ema[x]) * dt_ms / (cfg->ema_ms + dt_ms);
+            filter->slope[x] += (((filter->ema[x] - prev) * 1000.0f / dt_ms) - filter->slope[x]) * dt_ms / (cfg->slope_ms + dt_ms);
+        }
+
+        if(slower && filter->frames)                                                                        // Commanded down, a falling speed is expected
+            filter->settle_us[x] = frame->timestamp_us + (int64_t)cfg->settle_ms * 1000;
+
+        if(frame->timestamp_us < filter->settle_us[x])
+            filter->slope[x] = 0;
+
+        filter->rpm[x] = (uint32_t)(filter->ema[x] + 0.5f);
+
+        if(filter->ema[x] <= stall && (filter->decaying & (0x01 << x)))                            // Stays flagged down there until it recovers
+            filter->eta_ms[x] = 0;
+        else if(filter->slope[x] >= -(float)cfg->min_slope_rpm_s)
+            filter->eta_ms[x] = UINT32_MAX;
+        else if(filter->ema[x] <= stall)
+            filter->eta_ms[x] = 0;
+        else
+            filter->eta_ms[x] = (uint32_t)((filter->ema[x] - stall) * 1000.0f / -filter->slope[x]);
+
+        MAX31790_filter_vote(filter, x, filter->eta_ms[x] < ((filter->decaying & (0x01 << x)) ? cfg->horizon_ms * 2 : cfg->horizon_ms));   // Hysteresis, an ETA near the horizon does not flap
+    }
+
+    filter->last_us = frame->timestamp_us;
+    filter->frames++;
+
+    return ESP_OK;
+}
+
+/* Utility ----------------------------------------------------------------------------------- */
+static uint16_t MAX31790_filter_median(const max31790_filter_t *filter, uint8_t fan_number)
+{
+    uint16_t sorted[MAX31790_FILTER_MEDIAN_MAX];
+    uint8_t n = filter->win_fill;
+
+    for(uint8_t x = 0; x < n; x++)                                                                  // Insertion sort, at most 7
+    {
+        uint16_t val = filter->win[x][fan_number];
+        uint8_t y = x;
+
+        for(; y > 0 && sorted[y - 1] > val; y--)
+            sorted[y] = sorted[y - 1];
+
+        sorted[y] = val;
+    }
+
+    return sorted[n / 2];
+}
+
+static inline uint32_t MAX31790_filter_rpm(max31790_handle_t dev, uint8_t fan_number, uint16_t count)
+{
+    return (count >= TACH_COUNT_MAX) ? 0 : MAX31790_count_to_rpm(dev, fan_number, count);          // Saturated: no pulses in the window
+}
+
+static void MAX31790_filter_vote(max31790_filter_t *filter, uint8_t fan_number, bool predicted)
+{
+    uint16_t bit = 0x01 << fan_number;
+
+    if(predicted && filter->hits[fan_number] < filter->cfg.confirm)
+        filter->hits[fan_number]++;
+    else if(!predicted && filter->hits[fan_number])
+        filter->hits[fan_number]--;
+
+    if(filter->hits[fan_number] == filter->cfg.confirm && !(filter->decaying & bit))
+    {
+        filter->decaying |= bit;
+        ESP_LOGW(TAG, "Fan %d decaying. RPM: %d ETA: %dms", fan_number + 1, (int)filter->rpm[fan_number], (int)filter->eta_ms[fan_number]);
+
+        if(filter->cb)
+            filter->cb(filter->dev, fan_number, true, filter->eta_ms[fan_number], filter->cb_arg);
+    }
+    else if(!filter->hits[fan_number] && (filter->decaying & bit))
+    {
+        filter->decaying &= ~bit;
+        ESP_LOGI(TAG, "Fan %d steady. RPM: %d", fan_number + 1, (int)filter->rpm[fan_number]);
+
+        if(filter->cb)
+            filter->cb(filter->dev, fan_number, false, UINT32_MAX, filter->cb_arg);
+    }
+}
@@ -0,0 +1,71 @@
+/****************************************************** 
+  Description: IDF MAX31790 Tach Filter and Stall Predictor  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_FILTER_H
+#define MAX31790_FILTER_H
+
+#include "MAX31790.h"
+#include "MAX31790Sampler.h"
+
+#define MAX31790_FILTER_MEDIAN_MAX          7
+#define MAX31790_FILTER_DEF_MEDIAN          5                             // Frames, odd
+#define MAX31790_FILTER_DEF_EMA_MS          400                           // Time constant of the smoothed speed
+#define MAX31790_FILTER_DEF_OUTLIER         150                           // Permille off the median that replaces a sample with the median
+#define MAX31790_FILTER_DEF_SLOPE_MS        4000                          // Time constant of the trend
+#define MAX31790_FILTER_DEF_MIN_SLOPE       10                            // RPM/s of decline below which a fan is steady, above the noise of the trend
+#define MAX31790_FILTER_DEF_HORIZON_MS      30000                         // Flag a fan predicted to stall within this
+#define MAX31790_FILTER_DEF_CONFIRM         5                             // Frames the prediction must hold, and be absent to clear
+#define MAX31790_FILTER_DEF_SETTLE_MS       4000                          // Trend ignored after the fan's target changes
+
+typedef void (*max31790_filter_cb_t)(max31790_handle_t dev, uint8_t fan_number, bool decaying, uint32_t eta_ms, void *arg);   // On the edges, runs on the updating task
+
+typedef struct                                  // Zero fields take the defaults above
+{
+   uint16_t fans;                               // Bit per tach input to filter, 0 filters all 12
+   uint8_t median;
+   uint32_t ema_ms;
+   uint16_t outlier_permille;
+   uint32_t slope_ms;
+   uint32_t min_slope_rpm_s;
+   uint32_t stall_rpm;                          // Where the prediction ends, 0: slowest speed the input's range counts, where the chip's fault starts
+   uint32_t horizon_ms;
+   uint8_t confirm;
+   uint32_t settle_ms;
+} max31790_filter_config_t;
+
+typedef struct                                  // One array per field, a pass over the 12 inputs walks each linearly
+{
+   max31790_filter_config_t cfg;
+   max31790_handle_t dev;
+   max31790_filter_cb_t cb;
+   void *cb_arg;
+   uint16_t win[MAX31790_FILTER_MEDIAN_MAX][NUM_TACH_CHANNEL];   // Raw counts, the median of counts is the median of speeds
+   uint8_t win_pos;
+   uint8_t win_fill;
+   float ema[NUM_TACH_CHANNEL];                 // RPM
+   float slope[NUM_TACH_CHANNEL];               // RPM/s, negative while slowing
+   uint16_t target_dutybits[NUM_TACH_CHANNEL];  // Of the input's channel, a slower command restarts the trend
+   uint16_t target_count[NUM_TACH_CHANNEL];
+   int64_t settle_us[NUM_TACH_CHANNEL];         // Trend ignored until this frame time
+   uint8_t hits[NUM_TACH_CHANNEL];              // Prediction votes, 0 - confirm
+   uint32_t rpm[NUM_TACH_CHANNEL];              // Filtered, what readers use
+   uint32_t eta_ms[NUM_TACH_CHANNEL];           // Predicted time to stall_rpm, UINT32_MAX when steady or rising
+   uint16_t decaying;                           // Bit per input flagged
+   uint32_t rejected[NUM_TACH_CHANNEL];         // Samples replaced by the median
+   int64_t last_us;                             // Frame time of the last update, 0 before the first
+   uint32_t frames;
+} max31790_filter_t;
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_filter_init(max31790_filter_t *filter, max31790_handle_t dev, const max31790_filter_config_t *cfg, max31790_filter_cb_t cb, void *arg);   // NULL cfg takes the defaults, cb is optional.
+
+/* Update, no bus access ------------------------------------------------------------------ */
+esp_err_t MAX31790_filter_update(max31790_filter_t *filter, const max31790_frame_t *frame);   // One sampler frame. Stale frames are skipped with their bus result.
+
+static inline bool MAX31790_filter_is_decaying(const max31790_filter_t *filter, uint8_t fan_number) { return filter->decaying & (0x01 << fan_number); };
+
+#endif
@@ -0,0 +1,215 @@
+/****************************************************** 
+  Description: IDF MAX31790 Register Map Image  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Image.h"
+
+#include <string.h>
+#include <esp_log.h>
+
+#define IMAGE_GLO_KEEP      (~(MAX31790_GLO_RESET_RESET | MAX31790_GLO_I2C_WD_STATUS) & 0xFF)    // Restoring these would reset the chip or fake a watchdog expiry
+
+static const char *TAG = "MAX31790 Image";
+static const uint8_t sections[MAX31790_IMAGE_SECTIONS][2] =                                         // First register, length | class
+{
+    {MAX31790_REG_GLOBAL_CONFIG,        MAX31790_REG_FAN_FAULT_STATUS_2 - MAX31790_REG_GLOBAL_CONFIG},                              // 0x00 - 0x0F
+    {MAX31790_REG_FAN_FAULT_STATUS_2,   2 | MAX31790_IMAGE_SEC_STATUS},                                                              // 0x10 - 0x11
+    {MAX31790_REG_FAN_FAULT_MASK_2,     MAX31790_REG_TACH_COUNT(0) - MAX31790_REG_FAN_FAULT_MASK_2},                                 // 0x12 - 0x17
+    {MAX31790_REG_TACH_COUNT(0),        (MAX31790_REG_PWM_DUTY(NUM_CHANNEL) - MAX31790_REG_TACH_COUNT(0)) | MAX31790_IMAGE_SEC_STATUS},   // 0x18 - 0x3B
+    {MAX31790_REG_TARGET_DUTY(0),       REG_MAP_SIZE - MAX31790_REG_TARGET_DUTY(0)}                                                  // 0x40 - 0x67
+};
+
+static esp_err_t MAX31790_image_read(max31790_handle_t dev, uint8_t regs[REG_MAP_SIZE]);
+static inline void MAX31790_image_bit_set(uint8_t *map, uint8_t reg, bool val);
+
+esp_err_t MAX31790_image_export(max31790_handle_t dev, uint8_t img[MAX31790_IMAGE_SIZE], size_t *len)
+{
+    uint8_t regs[REG_MAP_SIZE] = {0};
+    esp_err_t err_ret = ESP_OK;
+    size_t pos = 0;
+
+    if(len)
+        *len = 0;
+
+    err_ret = MAX31790_image_read(dev, regs);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    img[pos++] = MAX31790_IMAGE_MAGIC;
+    img[pos++] = MAX31790_IMAGE_VERSION;
+    img[pos++] = MAX31790_IMAGE_SECTIONS;
+
+    for(uint8_t x = 0; x < MAX31790_IMAGE_SECTIONS; x++)
+    {
+        img[pos++] = sections[x][0];
+        img[pos++] = sections[x][1];
+    }
+
+    for(uint8_t x = 0; x < MAX31790_IMAGE_SECTIONS; x++)
+    {
+        uint8_t sec_len = sections[x][1] & MAX31790_IMAGE_SEC_LEN_MASK;
+
+        memcpy(img + pos, regs + sections[x][0], sec_len);
+        pos += sec_len;
+    }
+
+    img[pos] = MAX31790_crc8(img, pos);
+    pos++;
+
+    if(len)
+        *len = pos;
+
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_image_import(max31790_handle_t dev, const uint8_t *img, size_t len, uint8_t flags)
+{
+    max31790_image_t image;
+    max31790_batch_t batch;
+    uint8_t back[REG_MAP_SIZE] = {0};
+    esp_err_t err_ret = ESP_OK;
+
+    err_ret = MAX31790_image_decode(img, len, &image);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    image.regs[MAX31790_REG_GLOBAL_CONFIG] &= IMAGE_GLO_KEEP;
+
+    MAX31790_batch_begin(&batch, dev);
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x++)
+    {
+        if((flags & MAX31790_IMAGE_KEEP_USER) && REG_IS_USER_BYTE(x))
+            MAX31790_image_bit_set(image.restore, x, false);
+
+        if(MAX31790_image_has(image.restore, x))                                                    // Commit merges these into runs
+            MAX31790_batch_stage(&batch, x, &image.regs[x], 1);
+    }
+
+    if(MAX31790_image_has(image.restore, MAX31790_REG_GLOBAL_CONFIG))                               // Device config follows, a later set_master_config() keeps the image
+        dev->global_cfg = image.regs[MAX31790_REG_GLOBAL_CONFIG];
+    if(MAX31790_image_has(image.restore, MAX31790_REG_SEQ_START_CONFIG))
+        dev->fan_failed_seq_start_cfg = image.regs[MAX31790_REG_SEQ_START_CONFIG];
+    if(MAX31790_image_has(image.restore, MAX31790_REG_FAN_FAULT_MASK_1))
+        dev->fault_mask_1 = image.regs[MAX31790_REG_FAN_FAULT_MASK_1];
+    if(MAX31790_image_has(image.restore, MAX31790_REG_FAN_FAULT_MASK_2))
+        dev->fault_mask_2 = image.regs[MAX31790_REG_FAN_FAULT_MASK_2];
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        if(MAX31790_image_has(image.restore, MAX31790_REG_FAN_CONFIG(x)))
+            dev->fan_cfg[x] = image.regs[MAX31790_REG_FAN_CONFIG(x)];
+        if(MAX31790_image_has(image.restore, MAX31790_REG_FAN_DYNAMIC(x)))                          // Speed conversions follow the new range
+            MAX31790_batch_stage_fan_dynamic(&batch, x, image.regs[MAX31790_REG_FAN_DYNAMIC(x)]);
+    }
+
+    err_ret = MAX31790_batch_commit(&batch);
+    if(err_ret != ESP_OK || !(flags & MAX31790_IMAGE_VERIFY))
+        return err_ret;
+
+    MAX31790_invalidate_cache(dev);                                                                 // Read back the chip, not the shadow
+
+    err_ret = MAX31790_image_read(dev, back);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    back[MAX31790_REG_GLOBAL_CONFIG] &= IMAGE_GLO_KEEP;
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x++)
+    {
+        if(MAX31790_image_has(image.restore, x) && back[x] != image.regs[x])
+        {
+            ESP_LOGW(TAG, "Verify failed. Adr: 0x%02X Reg: 0x%02X Wrote: 0x%02X Read: 0x%02X", dev->adr, x, image.regs[x], back[x]);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_image_decode(const uint8_t *img, size_t len, max31790_image_t *out)
+{
+    size_t pos = 0;
+    size_t need = 0;
+    uint8_t count = 0;
+
+    if(len < 3 || img[0] != MAX31790_IMAGE_MAGIC)
+        return ESP_ERR_INVALID_ARG;
+
+    if(img[1] != MAX31790_IMAGE_VERSION)
+        return ESP_ERR_INVALID_VERSION;
+
+    count = img[2];
+    need = 3 + count * 2 + 1;
+    if(len < need)
+        return ESP_ERR_INVALID_SIZE;
+
+    for(uint8_t x = 0; x < count; x++)                                                              // Table first, the data length depends on it
+    {
+        uint8_t first = img[3 + x * 2];
+        uint8_t sec_len = img[4 + x * 2] & MAX31790_IMAGE_SEC_LEN_MASK;
+
+        if(first + sec_len > REG_MAP_SIZE)
+            return ESP_ERR_INVALID_SIZE;
+
+        need += sec_len;
+    }
+
+    if(len != need)
+        return ESP_ERR_INVALID_SIZE;
+
+    if(MAX31790_crc8(img, need - 1) != img[need - 1])
+        return ESP_ERR_INVALID_CRC;
+
+    memset(out, 0, sizeof(*out));
+    pos = 3 + count * 2;
+
+    for(uint8_t x = 0; x < count; x++)
+    {
+        uint8_t first = img[3 + x * 2];
+        uint8_t sec_len = img[4 + x * 2] & MAX31790_IMAGE_SEC_LEN_MASK;
+        bool status = img[4 + x * 2] & MAX31790_IMAGE_SEC_STATUS;
+
+        for(uint8_t r = first; r < first + sec_len; r++)
+        {
+            out->regs[r] = img[pos++];
+            MAX31790_image_bit_set(out->present, r, true);
+            MAX31790_image_bit_set(out->restore, r, !status);
+        }
+    }
+
+    return ESP_OK;
+}
+
+/* Utility ----------------------------------------------------------------------------------- */
+static esp_err_t MAX31790_image_read(max31790_handle_t dev, uint8_t regs[REG_MAP_SIZE])
+{
+    esp_err_t err_ret = ESP_OK;
+    uint8_t end = 0;
+
+    for(uint8_t x = 0; x < MAX31790_IMAGE_SECTIONS; x = end)                                        // One auto-increment read per run of adjacent sections
+    {
+        uint8_t first = sections[x][0];
+        uint8_t last = first + (sections[x][1] & MAX31790_IMAGE_SEC_LEN_MASK);
+
+        for(end = x + 1; end < MAX31790_IMAGE_SECTIONS && sections[end][0] == last; end++)
+            last += sections[end][1] & MAX31790_IMAGE_SEC_LEN_MASK;
+
+        err_ret = MAX31790_get_regs(dev, first, regs + first, last - first);
+        if(err_ret != ESP_OK)
+            return err_ret;
+    }
+
+    return ESP_OK;
+}
+
+static inline void MAX31790_image_bit_set(uint8_t *map, uint8_t reg, bool val)
+{
+    if(val)
+        map[reg >> 3] |= (0x01 << (reg & 0x07));
+    else
+        map[reg >> 3] &= ~(0x01 << (reg & 0x07));
+}
@@ -0,0 +1,44 @@
+/****************************************************** 
+  Description: IDF MAX31790 Register Map Image  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_IMAGE_H
+#define MAX31790_IMAGE_H
+
+#include "MAX31790.h"
+
+#define MAX31790_IMAGE_MAGIC                0x31
+#define MAX31790_IMAGE_VERSION              1
+#define MAX31790_IMAGE_SECTIONS             5                             // Runs of one register class, the reserved 0x3C - 0x3F left out
+#define MAX31790_IMAGE_SEC_STATUS           0x80                          // Section length flag: read-only or status, never restored
+#define MAX31790_IMAGE_SEC_LEN_MASK         0x7F
+#define MAX31790_IMAGE_REGS                 (REG_MAP_SIZE - 4)
+#define MAX31790_IMAGE_SIZE                 (3 + MAX31790_IMAGE_SECTIONS * 2 + MAX31790_IMAGE_REGS + 1)   // Header, section table, registers, CRC-8
+
+#define MAX31790_IMAGE_VERIFY               0x01                          // Import flag: read back and compare what was restored
+#define MAX31790_IMAGE_KEEP_USER            0x02                          // Import flag: leave this chip's user bytes, they may hold its calibration
+
+/*  Layout, version 1
+    [0] magic  [1] version  [2] section count
+    [3 ...] per section: first register, length | MAX31790_IMAGE_SEC_STATUS
+    register bytes of every section in table order, CRC-8 over everything before it */
+
+typedef struct
+{
+   uint8_t regs[REG_MAP_SIZE];                  // Reserved and absent registers read 0
+   uint8_t present[REG_MAP_SIZE / 8];           // Bit set: register carried by the image
+   uint8_t restore[REG_MAP_SIZE / 8];           // Bit set: register written back on import
+} max31790_image_t;
+
+esp_err_t MAX31790_image_export(max31790_handle_t dev, uint8_t img[MAX31790_IMAGE_SIZE], size_t *len);   // Two auto-increment reads. Registers the shadow holds may come from it, MAX31790_resync() first to bypass it.
+
+esp_err_t MAX31790_image_import(max31790_handle_t dev, const uint8_t *img, size_t len, uint8_t flags);   // Coalesced writes of the restorable registers, the device config follows. ESP_ERR_INVALID_RESPONSE when verify finds a difference.
+
+esp_err_t MAX31790_image_decode(const uint8_t *img, size_t len, max31790_image_t *out);   // ESP_ERR_INVALID_ARG not an image, ESP_ERR_INVALID_CRC / _VERSION / _SIZE. No bus access.
+
+static inline bool MAX31790_image_has(const uint8_t *map, uint8_t reg) { return map[reg >> 3] & (0x01 << (reg & 0x07)); };
+
+#endif
@@ -0,0 +1,320 @@
+/****************************************************** 
+  Description: IDF MAX31790 Setpoint Ramp Engine  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Ramp.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define RAMP_STACK 3072
+#define RAMP_SR_MAX 5                                                                               // Speed range code of SR 32
+#define RAMP_ROC_MAX 7                                                                              // PWM_ROC code of 125 ms per LSB
+
+static const char *TAG = "MAX31790 Ramp";
+static const uint8_t sr_map[RAMP_SR_MAX + 1] = {1, 2, 4, 8, 16, 32};
+static const uint32_t roc_us[RAMP_ROC_MAX + 1] = {0, 1953, 3906, 7813, 15625, 31250, 62500, 125000};   // Time per duty LSB step
+
+static void MAX31790_task_ramp(void *arg);
+static esp_err_t MAX31790_ramp_request(max31790_ramp_t *ramp, uint8_t channel, bool rpm, int32_t to, uint32_t duration_ms, max31790_ramp_shape_t shape);
+static int32_t MAX31790_ramp_value(const max31790_ramp_chan_t *chan, uint32_t progress);
+static uint8_t MAX31790_ramp_roc(uint32_t delta_bits, uint32_t tick_ms, uint8_t roc_min, uint8_t roc_max);
+static bool MAX31790_ramp_in_window(max31790_ramp_t *ramp, uint8_t channel, uint32_t rpm);
+static uint32_t MAX31790_ramp_min_ms(const max31790_ramp_t *ramp, uint8_t channel, bool rpm, uint32_t span, uint8_t dyn, max31790_ramp_shape_t shape);
+static uint8_t MAX31790_ramp_sr(max31790_ramp_t *ramp, uint8_t channel, uint32_t rpm, uint8_t sr);
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_ramp_init(max31790_ramp_t *ramp, max31790_handle_t dev, const max31790_ramp_config_t *cfg)
+{
+    memset(ramp, 0, sizeof(*ramp));
+
+    if(cfg)
+        ramp->cfg = *cfg;
+
+    if(!ramp->cfg.tick_ms)
+        ramp->cfg.tick_ms = MAX31790_RAMP_DEF_TICK_MS;
+
+    ramp->dev = dev;
+    ramp->lock = xSemaphoreCreateMutex();
+
+    return ramp->lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t MAX31790_ramp_start(max31790_ramp_t *ramp, UBaseType_t priority)
+{
+    ESP_LOGD(TAG, "Start. Tick: %dms", (int)ramp->cfg.tick_ms);
+
+    if(ramp->task)
+        return ESP_ERR_INVALID_STATE;
+
+    if(!ramp->exited)
+        ramp->exited = xSemaphoreCreateBinary();
+
+    if(!ramp->exited)
+        return ESP_ERR_NO_MEM;
+
+    ramp->stop = false;
+
+    if(xTaskCreate(MAX31790_task_ramp, "max31790_ramp", RAMP_STACK, ramp, priority, &ramp->task) != pdPASS)
+        return ESP_ERR_NO_MEM;
+
+    return ESP_OK;
+}
+
+void MAX31790_ramp_stop(max31790_ramp_t *ramp)
+{
+    if(!ramp->task)
+        return;
+
+    ramp->stop = true;
+    xSemaphoreTake(ramp->exited, portMAX_DELAY);
+
+    ramp->task = NULL;
+}
+
+/* Profiles ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_ramp_duty(max31790_ramp_t *ramp, uint8_t channel, uint16_t dutybits, uint32_t duration_ms, max31790_ramp_shape_t shape)
+{
+    return MAX31790_ramp_request(ramp, channel, false, CONSTRAIN(dutybits, 0, DUTYBITS_MAX), duration_ms, shape);
+}
+
+esp_err_t MAX31790_ramp_rpm(max31790_ramp_t *ramp, uint8_t channel, uint32_t rpm, uint32_t duration_ms, max31790_ramp_shape_t shape)
+{
+    return MAX31790_ramp_request(ramp, channel, true, CONSTRAIN(rpm, RPM_MIN, RPM_MAX), duration_ms, shape);
+}
+
+bool MAX31790_ramp_busy(max31790_ramp_t *ramp, uint8_t channel)
+{
+    return channel < NUM_CHANNEL && ramp->chan[channel].active;
+}
+
+/* Run --------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_ramp_tick(max31790_ramp_t *ramp, int64_t now_ms)
+{
+    max31790_batch_t batch;
+    bool staged = false;
+
+    MAX31790_batch_begin(&batch, ramp->dev);
+
+    xSemaphoreTake(ramp->lock, portMAX_DELAY);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        max31790_ramp_chan_t *chan = &ramp->chan[x];
+        uint8_t dyn = ramp->dev->fan_dyn[x];
+        uint8_t roc_base = (chan->dyn_base & MAX31790_FAN_DYN_PWM_ROC_MASK) >> 2;
+        uint32_t progress = PERMILLE_MAX;
+        uint32_t delta = 0;
+        int32_t value = 0;
+
+        if(!chan->active)
+            continue;
+
+        if(chan->start_ms < 0)
+            chan->start_ms = now_ms;
+
+        if(chan->duration_ms && now_ms - chan->start_ms < chan->duration_ms)
+            progress = ((now_ms - chan->start_ms) * PERMILLE_MAX) / chan->duration_ms;
+
+        value = MAX31790_ramp_value(chan, progress);
+        delta = (value > chan->setpoint) ? value - chan->setpoint : chan->setpoint - value;          // Movement this tick
+
+        if(progress >= PERMILLE_MAX && chan->rpm && roc_base < RAMP_ROC_MAX &&                      // Duty held near where the profile left it while the fan catches up,
+           now_ms - chan->start_ms < 2 * (int64_t)chan->duration_ms && !MAX31790_ramp_in_window(ramp, x, value))   // the loop would wind up on the lag and overshoot
+        {
+            dyn = (dyn & ~MAX31790_FAN_DYN_PWM_ROC_MASK) | (RAMP_ROC_MAX << 2);
+        }
+        else if(progress >= PERMILLE_MAX)                                                           // Done, hand back the configured rate, the range stays with the speed
+        {
+            dyn = (dyn & ~MAX31790_FAN_DYN_PWM_ROC_MASK) | (chan->dyn_base & MAX31790_FAN_DYN_PWM_ROC_MASK);
+            chan->active = false;
+        }
+        else if(!chan->rpm)                                                                         // Chip slews the duty across the whole tick, no staircase
+        {
+            dyn = (dyn & ~MAX31790_FAN_DYN_PWM_ROC_MASK) | (MAX31790_ramp_roc(delta, ramp->cfg.tick_ms, roc_base, RAMP_ROC_MAX) << 2);
+        }
+        else if(ramp->cfg.rpm_full[x])                                                              // Loop may only move the duty as fast as the profile needs, at least half the
+        {                                                                                           // configured rate or the fan's lag piles up for the end
+            delta = ((uint64_t)delta * DUTYBITS_MAX) / ramp->cfg.rpm_full[x];
+            dyn = (dyn & ~MAX31790_FAN_DYN_PWM_ROC_MASK) | (MAX31790_ramp_roc(delta, ramp->cfg.tick_ms, roc_base, roc_base + (roc_base < RAMP_ROC_MAX)) << 2);
+        }
+
+        if(chan->rpm)                                                                               // Count in range with the finest resolution, with hysteresis
+            dyn = (dyn & ~MAX31790_FAN_DYN_SR_MASK) | (MAX31790_ramp_sr(ramp, x, value, (dyn & MAX31790_FAN_DYN_SR_MASK) >> 5) << 5);
+
+        MAX31790_batch_stage_fan_dynamic(&batch, x, dyn);                                           // Dropped on commit when unchanged
+
+        if(chan->rpm)
+            MAX31790_batch_stage_target_rpm(&batch, x, value);
+        else
+            MAX31790_batch_stage_dutybits(&batch, x, value);
+
+        chan->setpoint = value;
+        staged = true;
+    }
+
+    xSemaphoreGive(ramp->lock);
+
+    if(!staged)
+        return ESP_OK;
+
+    ramp->batches++;
+
+    return MAX31790_batch_commit(&batch);                                                           // FAN_DYN sits below the targets, a new range lands first
+}
+
+/* Internal ---------------------------------------------------------------------------------- */
+static void MAX31790_task_ramp(void *arg)
+{
+    max31790_ramp_t *ramp = (max31790_ramp_t *)arg;
+    TickType_t wake = xTaskGetTickCount();
+
+    while(!ramp->stop)
+    {
+        if(MAX31790_ramp_tick(ramp, esp_timer_get_time() / 1000) != ESP_OK)
+            ESP_LOGW(TAG, "Ramp write failed. Adr: 0x%02x", ramp->dev->adr);
+
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(ramp->cfg.tick_ms));
+    }
+
+    xSemaphoreGive(ramp->exited);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t MAX31790_ramp_request(max31790_ramp_t *ramp, uint8_t channel, bool rpm, int32_t to, uint32_t duration_ms, max31790_ramp_shape_t shape)
+{
+    max31790_ramp_chan_t *chan = NULL;
+    esp_err_t err_ret = ESP_OK;
+    int32_t from = 0;
+    uint8_t dyn = 0;
+
+    CHCK_CHAN(channel);
+
+    chan = &ramp->chan[channel];
+
+    if(shape > MAX31790_RAMP_S_CURVE)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(ramp->lock, portMAX_DELAY);
+
+    if(chan->active)                                                                                // Retarget from where the ramp is, the range it changed is not the base
+        dyn = chan->dyn_base;
+    else
+        err_ret = MAX31790_get_fan_dynamic(ramp->dev, channel, &dyn);
+
+    if(chan->active && chan->rpm == rpm)
+        from = chan->setpoint;
+    else if(err_ret == ESP_OK && rpm)
+    {
+        uint32_t target = 0;
+
+        err_ret = MAX31790_get_target_tach(ramp->dev, channel, &target);
+        from = target;
+    }
+    else if(err_ret == ESP_OK)
+    {
+        uint16_t target = 0;
+
+        err_ret = MAX31790_get_target_dutybits(ramp->dev, channel, &target);
+        from = target;
+    }
+
+    if(err_ret == ESP_OK)                                                                           // Never faster than the configured rate, a step would be gentler
+    {
+        uint32_t min_ms = MAX31790_ramp_min_ms(ramp, channel, rpm, (to > from) ? to - from : from - to, dyn, shape);
+
+        duration_ms = (duration_ms < min_ms) ? min_ms : duration_ms;
+    }
+
+    if(err_ret == ESP_OK)
+    {
+        chan->rpm = rpm;
+        chan->shape = shape;
+        chan->from = from;
+        chan->to = to;
+        chan->setpoint = from;
+        chan->duration_ms = duration_ms;
+        chan->start_ms = -1;
+        chan->dyn_base = dyn;
+        chan->active = true;
+    }
+
+    xSemaphoreGive(ramp->lock);
+
+    return err_ret;
+}
+
+static int32_t MAX31790_ramp_value(const max31790_ramp_chan_t *chan, uint32_t progress)
+{
+    uint64_t s = progress;
+
+    if(chan->shape == MAX31790_RAMP_S_CURVE)                                                        // 3p^2 - 2p^3 in permille
+        s = (s * s * (3 * PERMILLE_MAX - 2 * s)) / ((uint64_t)PERMILLE_MAX * PERMILLE_MAX);
+
+    return chan->from + (int32_t)(((int64_t)(chan->to - chan->from) * (int64_t)s) / PERMILLE_MAX);
+}
+
+static uint8_t MAX31790_ramp_roc(uint32_t delta_bits, uint32_t tick_ms, uint8_t roc_min, uint8_t roc_max)
+{
+    for(uint8_t x = roc_max; x > roc_min; x--)                                                      // Slowest rate that still arrives within the tick
+        if((uint64_t)roc_us[x] * delta_bits <= (uint64_t)tick_ms * 1000)
+            return x;
+
+    return roc_min;                                                                                 // Never past the configured rate, 0 jumps
+}
+
+static bool MAX31790_ramp_in_window(max31790_ramp_t *ramp, uint8_t channel, uint32_t rpm)
+{
+    uint8_t live[2] = {0};
+    uint8_t window = 0;
+    int32_t err = 0;
+
+    if(MAX31790_get_window(ramp->dev, 0, channel, &window) != ESP_OK ||                             // Window is served by the shadow
+       MAX31790_get_regs(ramp->dev, MAX31790_REG_TACH_COUNT(channel), live, 2) != ESP_OK)
+        return true;                                                                                // Cannot tell, do not hold the rate down
+
+    err = (int32_t)REG_TO_LFTJST(11, live[0], live[1]) - MAX31790_rpm_to_count(ramp->dev, channel, rpm);
+
+    return err <= window && -err <= window;
+}
+
+static uint32_t MAX31790_ramp_min_ms(const max31790_ramp_t *ramp, uint8_t channel, bool rpm, uint32_t span, uint8_t dyn, max31790_ramp_shape_t shape)
+{
+    uint8_t roc = (dyn & MAX31790_FAN_DYN_PWM_ROC_MASK) >> 2;
+    uint64_t ms = 0;
+
+    if(rpm && !ramp->cfg.rpm_full[channel])                                                         // No duty scale, the loop's rate is all there is
+        return 0;
+
+    if(rpm)
+        span = ((uint64_t)span * DUTYBITS_MAX) / ramp->cfg.rpm_full[channel];
+
+    ms = ((uint64_t)span * roc_us[roc]) / 1000;
+
+    if(shape == MAX31790_RAMP_S_CURVE)                                                              // Smoothstep peaks at 1.5 times the mean slope
+        ms = (ms * 3) / 2;
+
+    return (ms > UINT32_MAX) ? UINT32_MAX : ms;
+}
+
+static uint8_t MAX31790_ramp_sr(max31790_ramp_t *ramp, uint8_t channel, uint32_t rpm, uint8_t sr)
+{
+    uint32_t div = rpm * (ramp->dev->fan_hallcount[channel] ? ramp->dev->fan_hallcount[channel] : 1);
+
+    sr = (sr > RAMP_SR_MAX) ? RAMP_SR_MAX : sr;
+
+    if(!div)
+        return sr;
+
+    while(sr > 0 && TACH_K(sr_map[sr]) / div > TACH_COUNT_MAX)                                      // Count would saturate
+        sr--;
+
+    while(sr < RAMP_SR_MAX && TACH_K(sr_map[sr]) / div < TACH_COUNT_MAX / 4)                        // Coarse, the next range at most halves the headroom
+        sr++;
+
+    return sr;
+}
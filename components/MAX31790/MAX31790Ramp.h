@@ -0,0 +1,69 @@
+/****************************************************** 
+  Description: IDF MAX31790 Setpoint Ramp Engine  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_RAMP_H
+#define MAX31790_RAMP_H
+
+#include "MAX31790.h"
+
+#define MAX31790_RAMP_DEF_TICK_MS           20
+
+typedef enum
+{
+   MAX31790_RAMP_LINEAR = 0,
+   MAX31790_RAMP_S_CURVE                        // Smoothstep, no step in acceleration at either end
+} max31790_ramp_shape_t;
+
+typedef struct                                  // Zero fields take the defaults above
+{
+   uint32_t tick_ms;
+   uint32_t rpm_full[NUM_CHANNEL];              // Speed at 100 % duty, lets RPM ramps pick PWM_ROC, 0 keeps the configured rate
+} max31790_ramp_config_t;
+
+typedef struct
+{
+   bool active;
+   bool rpm;                                    // Setpoint is RPM into TARGET_COUNT, else dutybits into TARGET_DUTY
+   max31790_ramp_shape_t shape;
+   int32_t from;
+   int32_t to;
+   int32_t setpoint;                            // Last value written
+   uint32_t duration_ms;
+   int64_t start_ms;                            // -1 until the first tick, ramps start on the tick clock
+   uint8_t dyn_base;                            // FAN_DYN before the ramp, its PWM_ROC is restored when it ends
+} max31790_ramp_chan_t;
+
+typedef struct
+{
+   max31790_handle_t dev;
+   max31790_ramp_config_t cfg;
+   max31790_ramp_chan_t chan[NUM_CHANNEL];
+   SemaphoreHandle_t lock;                      // Requests may come from any task
+   uint32_t batches;                            // Commits, one per tick with work
+   volatile bool stop;
+   SemaphoreHandle_t exited;                    // Given by the task once it is off the lock and the bus
+   TaskHandle_t task;
+} max31790_ramp_t;
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_ramp_init(max31790_ramp_t *ramp, max31790_handle_t dev, const max31790_ramp_config_t *cfg);   // NULL cfg takes the defaults
+
+esp_err_t MAX31790_ramp_start(max31790_ramp_t *ramp, UBaseType_t priority);     // Ticks on its own task every tick_ms.
+
+void MAX31790_ramp_stop(max31790_ramp_t *ramp);                          // Blocks until the task is out, at most a tick. Outputs hold where they are.
+
+/* Profiles ------------------------------------------------------------------------------- */
+esp_err_t MAX31790_ramp_duty(max31790_ramp_t *ramp, uint8_t channel, uint16_t dutybits, uint32_t duration_ms, max31790_ramp_shape_t shape);   // PWM mode, from the current target or the ramp in progress. Never faster than the configured PWM_ROC, a shorter duration is stretched
+
+esp_err_t MAX31790_ramp_rpm(max31790_ramp_t *ramp, uint8_t channel, uint32_t rpm, uint32_t duration_ms, max31790_ramp_shape_t shape);   // RPM mode, see MAX31790_set_mode_bumpless(). Stretched as above with rpm_full, the duty is held after the profile until the fan is in the window
+
+bool MAX31790_ramp_busy(max31790_ramp_t *ramp, uint8_t channel);
+
+/* Run ------------------------------------------------------------------------------------ */
+esp_err_t MAX31790_ramp_tick(max31790_ramp_t *ramp, int64_t now_ms);       // Every moving channel's FAN_DYN and target in one batch.
+
+#endif
@@ -0,0 +1,209 @@
+/****************************************************** 
+  Description: IDF MAX31790 Telemetry Sampler  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Sampler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define SAMPLER_STACK 3072
+#define SAMPLER_READ_RETRY 4                                                                        // Reader gives up on a slot the producer keeps lapping
+
+static const char *TAG = "MAX31790 Sampler";
+
+static void MAX31790_task_sampler(void *arg);
+static bool MAX31790_slot_read(max31790_slot_t *slot, max31790_frame_t *frame);
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_sampler_init(max31790_sampler_t *sampler, max31790_handle_t dev, const max31790_sampler_config_t *cfg)
+{
+    uint16_t depth = (cfg && cfg->depth) ? cfg->depth : MAX31790_SAMPLER_DEF_DEPTH;
+
+    if(sampler->task)
+        return ESP_ERR_INVALID_STATE;
+
+    sampler->dev = dev;
+    sampler->depth = depth;
+    sampler->period_ms = (cfg && cfg->period_ms) ? cfg->period_ms : MAX31790_SAMPLER_DEF_PERIOD_MS;
+    atomic_init(&sampler->head, 0);
+
+    free(sampler->slots);                                                                           // A re-init drops the last ring, the exit semaphore is kept
+    sampler->slots = calloc(depth, sizeof(max31790_slot_t));                                        // Once, the sample path never allocates
+    if(!sampler->slots)
+        return ESP_ERR_NO_MEM;
+
+    for(uint16_t x = 0; x < depth; x++)
+        atomic_init(&sampler->slots[x].seq, 0);
+
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_sampler_start(max31790_sampler_t *sampler, UBaseType_t priority)
+{
+    ESP_LOGD(TAG, "Start. Period: %dms Depth: %d", (int)sampler->period_ms, sampler->depth);
+
+    if(!sampler->slots || sampler->task)
+        return ESP_ERR_INVALID_STATE;
+
+    if(!sampler->exited)
+        sampler->exited = xSemaphoreCreateBinary();
+
+    if(!sampler->exited)
+        return ESP_ERR_NO_MEM;
+
+    sampler->stop = false;
+
+    if(xTaskCreate(MAX31790_task_sampler, "max31790_sampler", SAMPLER_STACK, sampler, priority, &sampler->task) != pdPASS)
+        return ESP_ERR_NO_MEM;
+
+    return ESP_OK;
+}
+
+void MAX31790_sampler_stop(max31790_sampler_t *sampler)
+{
+    if(!sampler->task)
+        return;
+
+    sampler->stop = true;                                                                           // Deleting it mid read would strand the port token
+    xSemaphoreTake(sampler->exited, portMAX_DELAY);
+
+    sampler->task = NULL;
+}
+
+void MAX31790_sampler_deinit(max31790_sampler_t *sampler)
+{
+    MAX31790_sampler_stop(sampler);
+
+    free(sampler->slots);
+    sampler->slots = NULL;
+
+    if(sampler->exited)
+        vSemaphoreDelete(sampler->exited);
+
+    sampler->exited = NULL;
+}
+
+/* Producer ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_sampler_capture(max31790_sampler_t *sampler)
+{
+    uint8_t status[MAX31790_REG_PWM_DUTY(NUM_CHANNEL) - MAX31790_REG_FAN_FAULT_STATUS_2] = {0};   // 0x10 - 0x3B
+    uint8_t target[MAX31790_REG_TARGET_COUNT(NUM_CHANNEL) - MAX31790_REG_TARGET_DUTY(0)] = {0};     // 0x40 - 0x5B
+    max31790_frame_t frame = {0};
+    esp_err_t rslt = ESP_OK;
+
+    rslt = MAX31790_get_regs(sampler->dev, MAX31790_REG_FAN_FAULT_STATUS_2, status, sizeof(status));
+    if(rslt == ESP_OK)
+        rslt = MAX31790_get_regs(sampler->dev, MAX31790_REG_TARGET_DUTY(0), target, sizeof(target));
+
+    frame.timestamp_us = esp_timer_get_time();
+    frame.rslt = rslt;
+    frame.fault_status_1 = status[MAX31790_REG_FAN_FAULT_STATUS_1 - MAX31790_REG_FAN_FAULT_STATUS_2];
+    frame.fault_status_2 = status[0];
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        uint8_t *reg = status + MAX31790_REG_TACH_COUNT(x) - MAX31790_REG_FAN_FAULT_STATUS_2;
+        frame.tach_count[x] = REG_TO_LFTJST(11, reg[0], reg[1]);
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        uint8_t *reg = status + MAX31790_REG_PWM_DUTY(x) - MAX31790_REG_FAN_FAULT_STATUS_2;
+        frame.pwm_dutybits[x] = REG_TO_LFTJST(9, reg[0], reg[1]);
+
+        reg = target + MAX31790_REG_TARGET_DUTY(x) - MAX31790_REG_TARGET_DUTY(0);
+        frame.target_dutybits[x] = REG_TO_LFTJST(9, reg[0], reg[1]);
+
+        reg = target + MAX31790_REG_TARGET_COUNT(x) - MAX31790_REG_TARGET_DUTY(0);
+        frame.target_count[x] = REG_TO_LFTJST(11, reg[0], reg[1]);
+    }
+
+    MAX31790_sampler_publish(sampler, &frame);
+
+    return rslt;
+}
+
+void MAX31790_sampler_publish(max31790_sampler_t *sampler, const max31790_frame_t *frame)
+{
+    unsigned head = atomic_load_explicit(&sampler->head, memory_order_relaxed);
+    max31790_slot_t *slot = &sampler->slots[head % sampler->depth];
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);                                // Odd, readers back off
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame = *frame;
+    slot->frame.seq = head;
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&sampler->head, head + 1, memory_order_release);
+}
+
+/* Consumers --------------------------------------------------------------------------------- */
+bool MAX31790_sampler_latest(max31790_sampler_t *sampler, max31790_frame_t *frame)
+{
+    unsigned head = atomic_load_explicit(&sampler->head, memory_order_acquire);
+
+    if(!head)
+        return false;
+
+    return MAX31790_slot_read(&sampler->slots[(head - 1) % sampler->depth], frame);
+}
+
+uint16_t MAX31790_sampler_history(max31790_sampler_t *sampler, max31790_frame_t *frames, uint16_t max_frames)
+{
+    unsigned head = atomic_load_explicit(&sampler->head, memory_order_acquire);
+    uint16_t count = 0;
+
+    while(count < max_frames && count < sampler->depth && count < head)
+    {
+        unsigned want = head - 1 - count;
+
+        if(!MAX31790_slot_read(&sampler->slots[want % sampler->depth], &frames[count]) || frames[count].seq != want)
+            break;                                                                                  // Overwritten since head was read, the window ends here
+
+        count++;
+    }
+
+    return count;
+}
+
+static bool MAX31790_slot_read(max31790_slot_t *slot, max31790_frame_t *frame)
+{
+    for(uint8_t x = 0; x < SAMPLER_READ_RETRY; x++)
+    {
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if(seq & 0x01)
+            continue;
+
+        *frame = slot->frame;
+        atomic_thread_fence(memory_order_acquire);
+
+        if(atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq)
+            return true;
+    }
+
+    return false;
+}
+
+static void MAX31790_task_sampler(void *arg)
+{
+    max31790_sampler_t *sampler = (max31790_sampler_t *)arg;
+    TickType_t wake = xTaskGetTickCount();
+
+    while(!sampler->stop)
+    {
+        MAX31790_sampler_capture(sampler);
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(sampler->period_ms));
+    }
+
+    xSemaphoreGive(sampler->exited);
+    vTaskDelete(NULL);
+}
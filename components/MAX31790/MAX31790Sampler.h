@@ -0,0 +1,74 @@
+/****************************************************** 
+  Description: IDF MAX31790 Telemetry Sampler  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_SAMPLER_H
+#define MAX31790_SAMPLER_H
+
+#include <stdatomic.h>
+
+#include "MAX31790.h"
+
+#define MAX31790_SAMPLER_DEF_PERIOD_MS      100
+#define MAX31790_SAMPLER_DEF_DEPTH          32
+
+typedef struct
+{
+   int64_t timestamp_us;                        // esp_timer time the burst completed
+   uint32_t seq;                                // Frame number, increments by one per sample
+   esp_err_t rslt;                              // Bus result, counts are stale when not ESP_OK
+   uint16_t tach_count[NUM_TACH_CHANNEL];       // 11 bit counts
+   uint16_t pwm_dutybits[NUM_CHANNEL];          // 9 bit, current output
+   uint16_t target_dutybits[NUM_CHANNEL];
+   uint16_t target_count[NUM_CHANNEL];
+   uint8_t fault_status_1;                      // Fans 1 - 6
+   uint8_t fault_status_2;                      // Fans 7 - 12
+} max31790_frame_t;
+
+typedef struct
+{
+   atomic_uint seq;                             // Odd while the producer writes the slot
+   max31790_frame_t frame;
+} max31790_slot_t;
+
+typedef struct
+{
+   uint32_t period_ms;
+   uint16_t depth;                              // Frames kept for history readers
+} max31790_sampler_config_t;
+
+typedef struct
+{
+   max31790_handle_t dev;
+   max31790_slot_t *slots;
+   uint16_t depth;
+   uint32_t period_ms;
+   atomic_uint head;                            // Frames published so far
+   volatile bool stop;                          // Task leaves between captures
+   SemaphoreHandle_t exited;
+   TaskHandle_t task;
+} max31790_sampler_t;
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_sampler_init(max31790_sampler_t *sampler, max31790_handle_t dev, const max31790_sampler_config_t *cfg);   // NULL cfg takes the defaults. Zeroed storage the first time, a stopped sampler after.
+
+esp_err_t MAX31790_sampler_start(max31790_sampler_t *sampler, UBaseType_t priority);
+
+void MAX31790_sampler_stop(max31790_sampler_t *sampler);                 // Waits for the task to finish its capture, up to one period.
+
+void MAX31790_sampler_deinit(max31790_sampler_t *sampler);               // Stops the task, frees the ring and the exit semaphore.
+
+/* Producer ------------------------------------------------------------------------------- */
+esp_err_t MAX31790_sampler_capture(max31790_sampler_t *sampler);                 // One frame, two burst reads (target registers usually hit the shadow).
+
+void MAX31790_sampler_publish(max31790_sampler_t *sampler, const max31790_frame_t *frame);   // Single producer only.
+
+/* Consumers, any number, never touch I2C ------------------------------------------------- */
+bool MAX31790_sampler_latest(max31790_sampler_t *sampler, max31790_frame_t *frame);
+
+uint16_t MAX31790_sampler_history(max31790_sampler_t *sampler, max31790_frame_t *frames, uint16_t max_frames);   // Newest first, returns frames copied.
+
+#endif
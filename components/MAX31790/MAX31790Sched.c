@@ -0,0 +1,285 @@
+/****************************************************** 
+  Description: IDF MAX31790 Adaptive Tach Scheduler  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Sched.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define SCHED_STACK 3072
+#define SCHED_BRIDGE_MAX 1                                                                          // Idle inputs read to join two runs, 2 bytes each beat a new transaction
+#define SCHED_CREDIT_WINDOW_MS 1000
+
+typedef struct
+{
+    uint8_t first;
+    uint8_t count;
+    int64_t overdue_ms;                                                                             // Most overdue member, runs are served in this order
+} max31790_sched_run_t;
+
+static const char *TAG = "MAX31790 Sched";
+
+static void MAX31790_task_sched(void *arg);
+static uint8_t MAX31790_sched_runs(const max31790_sched_t *sched, int64_t now_ms, max31790_sched_run_t *runs);
+static uint32_t MAX31790_sched_cost_us(const max31790_sched_t *sched, uint8_t count);
+static void MAX31790_sched_update(max31790_sched_t *sched, uint8_t fan_number, uint32_t rpm, int64_t now_ms);
+
+#define SCHED_DEF(V, D) do { if(!(V)) (V) = (D); } while(0)
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_sched_init(max31790_sched_t *sched, max31790_handle_t dev, const max31790_sched_config_t *cfg, max31790_sched_cb_t cb, void *arg)
+{
+    int64_t now_ms = esp_timer_get_time() / 1000;
+
+    memset(sched, 0, sizeof(*sched));
+
+    if(cfg)
+        sched->cfg = *cfg;
+
+    SCHED_DEF(sched->cfg.fans, (0x01 << NUM_TACH_CHANNEL) - 1);
+    SCHED_DEF(sched->cfg.tick_ms, MAX31790_SCHED_DEF_TICK_MS);
+    SCHED_DEF(sched->cfg.min_ms, MAX31790_SCHED_DEF_MIN_MS);
+    SCHED_DEF(sched->cfg.max_ms, MAX31790_SCHED_DEF_MAX_MS);
+    SCHED_DEF(sched->cfg.change_rpm_s, MAX31790_SCHED_DEF_CHANGE_RPM_S);
+    SCHED_DEF(sched->cfg.near_rpm, MAX31790_SCHED_DEF_NEAR_RPM);
+    SCHED_DEF(sched->cfg.budget_permille, MAX31790_SCHED_DEF_BUDGET);
+    SCHED_DEF(sched->cfg.clk_hz, MAX31790_SCHED_DEF_CLK_HZ);
+
+    if(sched->cfg.min_ms > sched->cfg.max_ms || sched->cfg.budget_permille > PERMILLE_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    sched->dev = dev;
+    sched->cb = cb;
+    sched->cb_arg = arg;
+    sched->start_ms = now_ms;
+    sched->last_tick_ms = now_ms;
+    sched->credit_cap_us = (int64_t)SCHED_CREDIT_WINDOW_MS * sched->cfg.budget_permille;          // One window of budget,
+    if(sched->credit_cap_us < MAX31790_sched_cost_us(sched, NUM_TACH_CHANNEL))                      // never less than a full burst
+        sched->credit_cap_us = MAX31790_sched_cost_us(sched, NUM_TACH_CHANNEL);
+    sched->credit_us = sched->credit_cap_us;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        sched->fan[x].interval_ms = sched->cfg.min_ms;
+        sched->fan[x].due_ms = now_ms;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t MAX31790_sched_start(max31790_sched_t *sched, UBaseType_t priority)
+{
+    ESP_LOGD(TAG, "Start. Tick: %dms Budget: %d", (int)sched->cfg.tick_ms, sched->cfg.budget_permille);
+
+    if(sched->task)
+        return ESP_ERR_INVALID_STATE;
+
+    if(!sched->exited)
+        sched->exited = xSemaphoreCreateBinary();
+
+    if(!sched->exited)
+        return ESP_ERR_NO_MEM;
+
+    sched->stop = false;
+
+    if(xTaskCreate(MAX31790_task_sched, "max31790_sched", SCHED_STACK, sched, priority, &sched->task) != pdPASS)
+        return ESP_ERR_NO_MEM;
+
+    return ESP_OK;
+}
+
+void MAX31790_sched_stop(max31790_sched_t *sched)
+{
+    if(!sched->task)
+        return;
+
+    sched->stop = true;
+    xSemaphoreTake(sched->exited, portMAX_DELAY);                                                   // The task may be inside a burst
+
+    sched->task = NULL;
+}
+
+/* Run --------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_sched_tick(max31790_sched_t *sched, int64_t now_ms)
+{
+    max31790_sched_run_t runs[NUM_TACH_CHANNEL];
+    uint8_t burst[TACH_COUNT_BURST] = {0};
+    esp_err_t err_ret = ESP_OK;
+    uint8_t n_run = 0;
+
+    if(now_ms > sched->last_tick_ms)                                                                // Budget accrues in microseconds per millisecond
+        sched->credit_us += (now_ms - sched->last_tick_ms) * sched->cfg.budget_permille;
+
+    if(sched->credit_us > sched->credit_cap_us)
+        sched->credit_us = sched->credit_cap_us;
+
+    sched->last_tick_ms = now_ms;
+
+    n_run = MAX31790_sched_runs(sched, now_ms, runs);
+
+    for(uint8_t x = 0; x < n_run; x++)
+    {
+        uint32_t cost_us = MAX31790_sched_cost_us(sched, runs[x].count);
+        esp_err_t rslt = ESP_OK;
+
+        if(sched->credit_us < cost_us)                                                              // Stays due, the next tick tries again
+        {
+            sched->deferred++;
+            continue;
+        }
+
+        rslt = MAX31790_get_regs(sched->dev, MAX31790_REG_TACH_COUNT(runs[x].first), burst, runs[x].count * 2);
+
+        sched->credit_us -= cost_us;
+        sched->bus_us += cost_us;
+        sched->bursts++;
+
+        if(rslt != ESP_OK)
+        {
+            err_ret = (err_ret == ESP_OK) ? rslt : err_ret;
+            continue;
+        }
+
+        for(uint8_t y = 0; y < runs[x].count; y++)
+        {
+            uint8_t fan_number = runs[x].first + y;
+
+            if(sched->cfg.fans & (0x01 << fan_number))
+                MAX31790_sched_update(sched, fan_number, MAX31790_count_to_rpm(sched->dev, fan_number, REG_TO_LFTJST(11, burst[y * 2], burst[(y * 2) + 1])), now_ms);
+        }
+    }
+
+    return err_ret;
+}
+
+void MAX31790_sched_report(const max31790_sched_t *sched, int64_t now_ms, max31790_sched_report_t *report)
+{
+    int64_t elapsed_ms = now_ms - sched->start_ms;
+
+    memset(report, 0, sizeof(*report));
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        const max31790_sched_fan_t *fan = &sched->fan[x];
+
+        if(!(sched->cfg.fans & (0x01 << x)))
+            continue;
+
+        report->interval_ms[x] = fan->interval_ms;
+        report->stale_ms[x] = fan->reads ? now_ms - fan->read_ms : elapsed_ms;
+        report->stale_avg_ms[x] = (fan->reads > 1) ? fan->stale_sum_ms / (fan->reads - 1) : 0;
+        report->stale_max_ms[x] = fan->stale_max_ms;
+    }
+
+    report->utilisation_permille = (elapsed_ms > 0) ? sched->bus_us / elapsed_ms : 0;             // us per ms is permille
+    report->bursts = sched->bursts;
+    report->deferred = sched->deferred;
+}
+
+/* Internal ---------------------------------------------------------------------------------- */
+static void MAX31790_task_sched(void *arg)
+{
+    max31790_sched_t *sched = (max31790_sched_t *)arg;
+    TickType_t wake = xTaskGetTickCount();
+
+    while(!sched->stop)
+    {
+        if(MAX31790_sched_tick(sched, esp_timer_get_time() / 1000) != ESP_OK)
+            ESP_LOGW(TAG, "Tach burst failed. Adr: 0x%02x", sched->dev->adr);
+
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(sched->cfg.tick_ms));
+    }
+
+    xSemaphoreGive(sched->exited);
+    vTaskDelete(NULL);
+}
+
+static uint8_t MAX31790_sched_runs(const max31790_sched_t *sched, int64_t now_ms, max31790_sched_run_t *runs)
+{
+    uint8_t n_run = 0;
+    int8_t last_due = -1;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        int64_t overdue_ms = now_ms - sched->fan[x].due_ms;
+
+        if(!(sched->cfg.fans & (0x01 << x)) || overdue_ms < 0)
+            continue;
+
+        if(n_run && x - last_due - 1 <= SCHED_BRIDGE_MAX)                                           // Join the previous run, reading the gap
+        {
+            runs[n_run - 1].count = x - runs[n_run - 1].first + 1;
+            if(overdue_ms > runs[n_run - 1].overdue_ms)
+                runs[n_run - 1].overdue_ms = overdue_ms;
+        }
+        else
+        {
+            runs[n_run].first = x;
+            runs[n_run].count = 1;
+            runs[n_run].overdue_ms = overdue_ms;
+            n_run++;
+        }
+
+        last_due = x;
+    }
+
+    for(uint8_t x = 1; x < n_run; x++)                                                              // Most overdue first, at most 6 runs
+    {
+        max31790_sched_run_t run = runs[x];
+        int8_t y = x - 1;
+
+        for(; y >= 0 && runs[y].overdue_ms < run.overdue_ms; y--)
+            runs[y + 1] = runs[y];
+
+        runs[y + 1] = run;
+    }
+
+    return n_run;
+}
+
+static uint32_t MAX31790_sched_cost_us(const max31790_sched_t *sched, uint8_t count)
+{
+    uint32_t bits = 3 + 9 * (3 + 2 * count);                                                        // START, repeated START, STOP, address, register, address, data
+
+    return (bits * 1000000UL + sched->cfg.clk_hz - 1) / sched->cfg.clk_hz;
+}
+
+static void MAX31790_sched_update(max31790_sched_t *sched, uint8_t fan_number, uint32_t rpm, int64_t now_ms)
+{
+    max31790_sched_fan_t *fan = &sched->fan[fan_number];
+    uint32_t threshold = sched->cfg.threshold_rpm[fan_number];
+    uint32_t delta = (rpm > fan->rpm) ? rpm - fan->rpm : fan->rpm - rpm;
+    uint32_t margin = (rpm > threshold) ? rpm - threshold : threshold - rpm;
+    bool below = threshold && rpm < threshold;
+    bool changing = false;
+
+    if(fan->reads)
+    {
+        uint32_t age_ms = now_ms - fan->read_ms;
+
+        fan->stale_sum_ms += age_ms;
+        if(age_ms > fan->stale_max_ms)
+            fan->stale_max_ms = age_ms;
+
+        changing = age_ms && ((uint64_t)delta * 1000 / age_ms) >= sched->cfg.change_rpm_s;
+    }
+
+    if(!fan->reads || changing || (threshold && margin <= sched->cfg.near_rpm))
+        fan->interval_ms = sched->cfg.min_ms;
+    else
+        fan->interval_ms = (fan->interval_ms * 2 < sched->cfg.max_ms) ? fan->interval_ms * 2 : sched->cfg.max_ms;
+
+    if(sched->cb && (fan->reads ? below != fan->below : below))                                    // First read reports a fan already under threshold
+        sched->cb(sched->dev, fan_number, rpm, below, sched->cb_arg);
+
+    fan->rpm = rpm;
+    fan->below = below;
+    fan->read_ms = now_ms;
+    fan->due_ms = now_ms + fan->interval_ms;
+    fan->reads++;
+}
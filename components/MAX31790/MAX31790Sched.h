@@ -0,0 +1,90 @@
+/****************************************************** 
+  Description: IDF MAX31790 Adaptive Tach Scheduler  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_SCHED_H
+#define MAX31790_SCHED_H
+
+#include "MAX31790.h"
+
+#define MAX31790_SCHED_DEF_TICK_MS          50
+#define MAX31790_SCHED_DEF_MIN_MS           100                           // Fans ramping or near their threshold
+#define MAX31790_SCHED_DEF_MAX_MS           2000                          // Fans that have been stable a while
+#define MAX31790_SCHED_DEF_CHANGE_RPM_S     200
+#define MAX31790_SCHED_DEF_NEAR_RPM         300
+#define MAX31790_SCHED_DEF_BUDGET           100                           // Permille of bus time
+#define MAX31790_SCHED_DEF_CLK_HZ           100000
+
+typedef struct                                  // Zero fields take the defaults above
+{
+   uint16_t fans;                               // Bit per tach input to poll, 0 polls all 12
+   uint32_t tick_ms;
+   uint32_t min_ms;
+   uint32_t max_ms;                             // Interval doubles per stable read up to this
+   uint32_t change_rpm_s;                       // Rate of change that pins a fan to min_ms
+   uint32_t near_rpm;                           // Band around threshold_rpm that pins a fan to min_ms
+   uint16_t budget_permille;                    // Bus occupancy the scheduler may use
+   uint32_t clk_hz;                             // Bus clock, prices each burst
+   uint32_t threshold_rpm[NUM_TACH_CHANNEL];    // Low speed alarm, 0 for none
+} max31790_sched_config_t;
+
+typedef struct
+{
+   uint32_t interval_ms;
+   int64_t due_ms;
+   int64_t read_ms;                             // Last refresh, 0 before the first
+   uint32_t rpm;
+   bool below;                                  // Under threshold_rpm as of the last read
+   uint32_t reads;
+   uint32_t stale_max_ms;                       // Largest age data reached before a refresh
+   uint64_t stale_sum_ms;
+} max31790_sched_fan_t;
+
+typedef void (*max31790_sched_cb_t)(max31790_handle_t dev, uint8_t fan_number, uint32_t rpm, bool below, void *arg);   // Threshold crossings, runs on the caller of tick
+
+typedef struct
+{
+   max31790_handle_t dev;
+   max31790_sched_config_t cfg;
+   max31790_sched_fan_t fan[NUM_TACH_CHANNEL];
+   max31790_sched_cb_t cb;
+   void *cb_arg;
+   int64_t credit_us;                           // Bus time the budget allows right now
+   int64_t credit_cap_us;
+   int64_t start_ms;
+   int64_t last_tick_ms;
+   uint64_t bus_us;                             // Estimated wire time spent
+   uint32_t bursts;
+   uint32_t deferred;                           // Bursts pushed to a later tick by the budget
+   volatile bool stop;                          // Checked between ticks
+   SemaphoreHandle_t exited;
+   TaskHandle_t task;
+} max31790_sched_t;
+
+typedef struct
+{
+   uint32_t interval_ms[NUM_TACH_CHANNEL];
+   uint32_t stale_ms[NUM_TACH_CHANNEL];         // Age of the data right now
+   uint32_t stale_avg_ms[NUM_TACH_CHANNEL];     // Mean age at refresh
+   uint32_t stale_max_ms[NUM_TACH_CHANNEL];
+   uint16_t utilisation_permille;               // Estimated bus occupancy since init
+   uint32_t bursts;
+   uint32_t deferred;
+} max31790_sched_report_t;
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_sched_init(max31790_sched_t *sched, max31790_handle_t dev, const max31790_sched_config_t *cfg, max31790_sched_cb_t cb, void *arg);   // NULL cfg takes the defaults
+
+esp_err_t MAX31790_sched_start(max31790_sched_t *sched, UBaseType_t priority);   // Ticks on its own task every tick_ms.
+
+void MAX31790_sched_stop(max31790_sched_t *sched);                       // Returns after the tick in flight, up to tick_ms.
+
+/* Run ------------------------------------------------------------------------------------ */
+esp_err_t MAX31790_sched_tick(max31790_sched_t *sched, int64_t now_ms);     // Reads what is due as contiguous bursts, within budget.
+
+void MAX31790_sched_report(const max31790_sched_t *sched, int64_t now_ms, max31790_sched_report_t *report);
+
+#endif
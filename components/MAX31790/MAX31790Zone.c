@@ -0,0 +1,282 @@
+/****************************************************** 
+  Description: IDF MAX31790 Multi-Controller Zones  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Zone.h"
+
+#include <string.h>
+#include <esp_log.h>
+
+#define ZONE_BIAS 0x10000                                                                           // Holds pending above zero until every request is queued
+
+static const char *TAG = "MAX31790 Zone";
+
+static void MAX31790_zone_done(esp_err_t rslt, void *arg);
+static esp_err_t MAX31790_zone_begin(max31790_zone_t *zone);
+static void MAX31790_zone_queued(max31790_zone_t *zone, uint32_t submitted);
+static esp_err_t MAX31790_zone_set_async(max31790_zone_t *zone, bool rpm_mode, uint32_t val);
+
+#define ZONE_DEF(V, D) do { if(!(V)) (V) = (D); } while(0)
+
+/* Setup ------------------------------------------------------------------------------------- */
+esp_err_t MAX31790_zone_init(max31790_zone_t *zone, const max31790_zone_fan_t *fans, uint8_t n_fans, const max31790_zone_config_t *cfg)
+{
+    memset(zone, 0, sizeof(*zone));
+
+    if(cfg)
+        zone->cfg = *cfg;
+
+    ZONE_DEF(zone->cfg.timeout_ms, MAX31790_ZONE_DEF_TIMEOUT_MS);
+
+    if(!n_fans || n_fans > MAX31790_ZONE_MAX_FANS)
+        return ESP_ERR_INVALID_ARG;
+
+    for(uint8_t x = 0; x < n_fans; x++)
+    {
+        uint8_t d = 0;
+
+        if(!fans[x].dev || fans[x].channel >= NUM_CHANNEL)
+            return ESP_ERR_INVALID_ARG;
+
+        while(d < zone->n_devs && zone->dev[d].dev != fans[x].dev)                                  // Fans on one chip share its slot
+            d++;
+
+        if(d == zone->n_devs)
+        {
+            if(zone->n_devs == MAX31790_ZONE_MAX_DEVS)
+                return ESP_ERR_INVALID_ARG;
+
+            zone->dev[d].zone = zone;
+            zone->dev[d].dev = fans[x].dev;
+            zone->n_devs++;
+        }
+
+        if(zone->dev[d].channels & (0x01 << fans[x].channel))                                       // Two fans cannot share a PWM output
+            return ESP_ERR_INVALID_ARG;
+
+        zone->dev[d].channels |= (0x01 << fans[x].channel);
+        if(MAX31790_ZONE_BURST_LEN(fans[x].channel) > zone->dev[d].burst_len)                       // Tach inputs 7 - 12 and the PWM registers are never needed
+            zone->dev[d].burst_len = MAX31790_ZONE_BURST_LEN(fans[x].channel);
+
+        zone->fan[x] = fans[x];
+        zone->slot[x] = d;
+    }
+
+    zone->n_fans = n_fans;
+    zone->done = xSemaphoreCreateBinary();
+
+    if(!zone->done)
+        return ESP_ERR_NO_MEM;
+
+    ESP_LOGD(TAG, "Init. Fans: %d Devices: %d", zone->n_fans, zone->n_devs);
+
+    return ESP_OK;
+}
+
+/* Setpoints --------------------------------------------------------------------------------- */
+esp_err_t MAX31790_zone_set_dutybits_async(max31790_zone_t *zone, uint16_t dutybits)
+{
+    return MAX31790_zone_set_async(zone, false, dutybits);
+}
+
+esp_err_t MAX31790_zone_set_rpm_async(max31790_zone_t *zone, uint32_t rpm)
+{
+    return MAX31790_zone_set_async(zone, true, rpm);
+}
+
+esp_err_t MAX31790_zone_wait(max31790_zone_t *zone, TickType_t timeout)
+{
+    if(!zone->busy)
+        return ESP_ERR_INVALID_STATE;
+
+    if(xSemaphoreTake(zone->done, timeout) != pdTRUE)                                               // Still busy, wait again for the late requests
+        return ESP_ERR_TIMEOUT;
+
+    zone->busy = false;
+
+    return atomic_load(&zone->rslt);
+}
+
+esp_err_t MAX31790_zone_set_dutybits(max31790_zone_t *zone, uint16_t dutybits)
+{
+    esp_err_t err_ret = MAX31790_zone_set_dutybits_async(zone, dutybits);
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    return MAX31790_zone_wait(zone, pdMS_TO_TICKS(zone->cfg.timeout_ms));
+}
+
+esp_err_t MAX31790_zone_set_rpm(max31790_zone_t *zone, uint32_t rpm)
+{
+    esp_err_t err_ret = MAX31790_zone_set_rpm_async(zone, rpm);
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    return MAX31790_zone_wait(zone, pdMS_TO_TICKS(zone->cfg.timeout_ms));
+}
+
+/* Telemetry --------------------------------------------------------------------------------- */
+esp_err_t MAX31790_zone_read(max31790_zone_t *zone, max31790_zone_telemetry_t *telem)
+{
+    esp_err_t err_ret = ESP_OK;
+    uint32_t submitted = 0;
+    uint64_t sum = 0;
+    uint8_t with_data = 0;
+
+    err_ret = MAX31790_zone_begin(zone);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    for(uint8_t d = 0; d < zone->n_devs; d++)                                                       // Every port's engine starts on its first burst at once
+    {
+        max31790_zone_dev_t *zd = &zone->dev[d];
+
+        err_ret = MAX31790_get_regs_async(zd->dev, MAX31790_ZONE_BURST_REG, zd->burst, zd->burst_len, MAX31790_zone_done, zd);
+        if(err_ret == ESP_OK)
+            zone->requests++;
+        else
+            MAX31790_zone_done(err_ret, zd);                                                        // Completes as a request that failed at once
+        submitted++;
+    }
+
+    zone->reads++;
+    MAX31790_zone_queued(zone, submitted);
+
+    err_ret = MAX31790_zone_wait(zone, pdMS_TO_TICKS(zone->cfg.timeout_ms));
+    if(err_ret == ESP_ERR_TIMEOUT)
+        return err_ret;                                                                             // Bursts still land in zd->burst, nothing to aggregate yet
+
+    memset(telem, 0, sizeof(*telem));
+    telem->rpm_min = UINT32_MAX;
+
+    for(uint8_t x = 0; x < zone->n_fans; x++)
+    {
+        const max31790_zone_dev_t *zd = &zone->dev[zone->slot[x]];
+        uint8_t ch = zone->fan[x].channel;
+        uint8_t reg = MAX31790_REG_TACH_COUNT(ch) - MAX31790_ZONE_BURST_REG;
+        uint16_t count = REG_TO_LFTJST(11, zd->burst[reg], zd->burst[reg + 1]);
+        max31790_zone_health_t health = MAX31790_ZONE_OK;
+
+        if(zd->rslt != ESP_OK)
+            health = MAX31790_ZONE_NO_DATA;
+        else if(zd->burst[MAX31790_REG_FAN_FAULT_STATUS_1 - MAX31790_ZONE_BURST_REG] & (0x01 << ch))
+            health = MAX31790_ZONE_FAILED;
+        else if(count >= TACH_COUNT_MAX)
+            health = MAX31790_ZONE_STOPPED;
+
+        telem->health[x] = health;
+
+        if(health != MAX31790_ZONE_NO_DATA)
+        {
+            telem->rpm[x] = (count >= TACH_COUNT_MAX) ? 0 : MAX31790_count_to_rpm(zd->dev, ch, count);
+            telem->rpm_min = (telem->rpm[x] < telem->rpm_min) ? telem->rpm[x] : telem->rpm_min;
+            telem->rpm_max = (telem->rpm[x] > telem->rpm_max) ? telem->rpm[x] : telem->rpm_max;
+            sum += telem->rpm[x];
+            with_data++;
+        }
+
+        if(health > telem->worst)
+        {
+            telem->worst = health;
+            telem->worst_fan = x;
+        }
+    }
+
+    if(with_data)
+        telem->rpm_mean = sum / with_data;
+    else
+        telem->rpm_min = 0;
+
+    return err_ret;
+}
+
+/* Utility ----------------------------------------------------------------------------------- */
+static void MAX31790_zone_done(esp_err_t rslt, void *arg)                                          // On the engine task of the device's port
+{
+    max31790_zone_dev_t *zd = arg;
+    max31790_zone_t *zone = zd->zone;
+    int expected = ESP_OK;
+
+    if(rslt != ESP_OK)
+    {
+        if(zd->rslt == ESP_OK)
+            zd->rslt = rslt;
+        atomic_compare_exchange_strong(&zone->rslt, &expected, rslt);                               // First failure of the zone wins
+    }
+
+    if(atomic_fetch_sub(&zone->pending, 1) == 1)
+        xSemaphoreGive(zone->done);
+}
+
+static esp_err_t MAX31790_zone_begin(max31790_zone_t *zone)
+{
+    if(zone->busy)
+        return ESP_ERR_INVALID_STATE;
+
+    zone->busy = true;
+    atomic_store(&zone->rslt, ESP_OK);
+    atomic_store(&zone->pending, ZONE_BIAS);
+
+    for(uint8_t d = 0; d < zone->n_devs; d++)
+        zone->dev[d].rslt = ESP_OK;
+
+    return ESP_OK;
+}
+
+static void MAX31790_zone_queued(max31790_zone_t *zone, uint32_t submitted)                        // Drops the bias, completes at once if every request already has
+{
+    int release = ZONE_BIAS - (int)submitted;
+
+    if(atomic_fetch_sub(&zone->pending, release) == release)
+        xSemaphoreGive(zone->done);
+}
+
+static esp_err_t MAX31790_zone_set_async(max31790_zone_t *zone, bool rpm_mode, uint32_t val)
+{
+    max31790_batch_t batch;
+    esp_err_t err_ret = ESP_OK;
+    uint32_t submitted = 0;
+
+    err_ret = MAX31790_zone_begin(zone);
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    for(uint8_t d = 0; d < zone->n_devs; d++)                                                       // Requests copy their data, one batch serves every device
+    {
+        max31790_zone_dev_t *zd = &zone->dev[d];
+        uint8_t n = 0;
+
+        MAX31790_batch_begin(&batch, zd->dev);
+
+        for(uint8_t ch = 0; ch < NUM_CHANNEL; ch++)
+        {
+            if(!(zd->channels & (0x01 << ch)))
+                continue;
+
+            if(rpm_mode)
+                MAX31790_batch_stage_target_rpm(&batch, ch, val);
+            else
+                MAX31790_batch_stage_dutybits(&batch, ch, val);
+        }
+
+        err_ret = MAX31790_batch_commit_async(&batch, MAX31790_zone_done, zd, &n);
+        zone->requests += n;
+        submitted += n;
+
+        if(err_ret != ESP_OK)                                                                       // Runs after the failed one are not queued
+        {
+            submitted++;
+            MAX31790_zone_done(err_ret, zd);
+        }
+    }
+
+    zone->updates++;
+    MAX31790_zone_queued(zone, submitted);
+
+    return ESP_OK;
+}
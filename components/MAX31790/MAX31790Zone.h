@@ -0,0 +1,98 @@
+/****************************************************** 
+  Description: IDF MAX31790 Multi-Controller Zones  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_ZONE_H
+#define MAX31790_ZONE_H
+
+#include <stdatomic.h>
+
+#include "MAX31790.h"
+
+#define MAX31790_ZONE_MAX_FANS              48
+#define MAX31790_ZONE_MAX_DEVS              8
+#define MAX31790_ZONE_DEF_TIMEOUT_MS        200                           // Whole zone, every port
+
+#define MAX31790_ZONE_BURST_REG             MAX31790_REG_FAN_FAULT_STATUS_2
+#define MAX31790_ZONE_BURST_LEN(C)          (MAX31790_REG_TACH_COUNT(C) + 2 - MAX31790_ZONE_BURST_REG)   // Fault status, bridged to the tach count of channel C
+
+typedef struct                                  // Logical fan, the bus is the port of its device
+{
+   max31790_handle_t dev;
+   uint8_t channel;                             // Written channel, its own tach input is read
+} max31790_zone_fan_t;
+
+typedef enum                                    // Ordered, worst last
+{
+   MAX31790_ZONE_OK = 0,
+   MAX31790_ZONE_STOPPED,                       // No tach pulses, commanded off or stalled
+   MAX31790_ZONE_FAILED,                        // Fault status latched by the chip
+   MAX31790_ZONE_NO_DATA                        // Device read failed
+} max31790_zone_health_t;
+
+typedef struct                                  // Zero fields take the defaults above
+{
+   uint32_t timeout_ms;
+} max31790_zone_config_t;
+
+typedef struct
+{
+   uint32_t rpm_min;                            // Over fans with data
+   uint32_t rpm_max;
+   uint32_t rpm_mean;
+   max31790_zone_health_t worst;
+   uint8_t worst_fan;                           // Zone index of the first fan at worst
+   uint32_t rpm[MAX31790_ZONE_MAX_FANS];
+   max31790_zone_health_t health[MAX31790_ZONE_MAX_FANS];
+} max31790_zone_telemetry_t;
+
+typedef struct max31790_zone max31790_zone_t;
+
+typedef struct                                  // One per device the zone touches, the completion context of its requests
+{
+   max31790_zone_t *zone;
+   max31790_handle_t dev;
+   uint8_t channels;                            // Bit per channel driven by the zone
+   esp_err_t rslt;                              // First failure of the last operation
+   uint8_t burst_len;                           // Up to the highest channel driven, 0x10 - 0x23 with all six
+   uint8_t burst[MAX31790_ZONE_BURST_LEN(NUM_CHANNEL - 1)];
+} max31790_zone_dev_t;
+
+struct max31790_zone
+{
+   max31790_zone_config_t cfg;
+   max31790_zone_fan_t fan[MAX31790_ZONE_MAX_FANS];
+   uint8_t slot[MAX31790_ZONE_MAX_FANS];        // Index of each fan's device in dev
+   uint8_t n_fans;
+   max31790_zone_dev_t dev[MAX31790_ZONE_MAX_DEVS];
+   uint8_t n_devs;
+   atomic_int pending;                          // Biased while submitting, the request that takes it to 0 completes the zone
+   atomic_int rslt;
+   bool busy;
+   SemaphoreHandle_t done;
+   uint32_t updates;
+   uint32_t reads;
+   uint32_t requests;                           // Queued transfers, before the engines merge any
+};
+
+/* Setup ---------------------------------------------------------------------------------- */
+esp_err_t MAX31790_zone_init(max31790_zone_t *zone, const max31790_zone_fan_t *fans, uint8_t n_fans, const max31790_zone_config_t *cfg);   // NULL cfg takes the defaults. Every port needs I2CMANAGER_engine_start().
+
+/* Setpoints, one grouped write per device, all ports at once ----------------------------- */
+esp_err_t MAX31790_zone_set_dutybits_async(max31790_zone_t *zone, uint16_t dutybits);   // Returns once queued, MAX31790_zone_wait() for the result.
+
+esp_err_t MAX31790_zone_set_rpm_async(max31790_zone_t *zone, uint32_t rpm);
+
+esp_err_t MAX31790_zone_wait(max31790_zone_t *zone, TickType_t timeout);    // Single completion of the whole zone, first device failure.
+
+esp_err_t MAX31790_zone_set_dutybits(max31790_zone_t *zone, uint16_t dutybits);   // Queue and wait, timeout_ms bounds the slowest bus.
+
+esp_err_t MAX31790_zone_set_rpm(max31790_zone_t *zone, uint32_t rpm);
+
+/* Telemetry ------------------------------------------------------------------------------ */
+esp_err_t MAX31790_zone_read(max31790_zone_t *zone, max31790_zone_telemetry_t *telem);   // One burst per device, all ports at once. Failed devices report NO_DATA.
+
+#endif
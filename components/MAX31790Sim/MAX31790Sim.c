@@ -0,0 +1,489 @@
+/****************************************************** 
+  Description: MAX31790 Behavioural Simulator  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#include "MAX31790Sim.h"
+
+#include <string.h>
+#include <esp_timer.h>
+
+#define SIM_DEF_CLK_HZ      100000
+#define SIM_RPM_MODE_STEP   1000                                                                    // us per duty LSB in RPM mode when PWM_ROC is 0
+#define SIM_STOPPED_RPM     1.0f
+#define SIM_STEP_MAX_MS     1                                                                       // Model resolution, one loop update per slice
+
+static const uint8_t sr_map[6] = {1, 2, 4, 8, 16, 32};
+static const uint32_t roc_us[8] = {0, 1953, 3906, 7813, 15625, 31250, 62500, 125000};              // Duty LSB step time per PWM_ROC code
+static const uint32_t spin_up_ms[4] = {0, 500, 1000, 2000};
+static const uint8_t ffq_map[4] = {1, 2, 4, 6};
+
+static esp_err_t MAX31790SIM_write(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout);
+static esp_err_t MAX31790SIM_read(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout);
+static esp_err_t MAX31790SIM_recover(void *ctx, uint8_t port);
+static bool MAX31790SIM_sda_low(void *ctx, uint8_t port);
+static esp_err_t MAX31790SIM_begin(max31790sim_bus_t *bus, uint8_t adr, uint32_t bytes, bool repeated_start, TickType_t timeout, max31790sim_dev_t **dev);
+static void MAX31790SIM_write_reg(max31790sim_dev_t *dev, uint8_t reg, uint8_t val);
+static void MAX31790SIM_wire_wait(const max31790sim_bus_t *bus, int64_t start_us, uint64_t wire_ns);
+static void MAX31790SIM_step_slice(max31790sim_dev_t *dev, uint32_t dt_ms);
+static void MAX31790SIM_step_channel(max31790sim_dev_t *dev, uint8_t channel, uint32_t dt_ms, float *output);
+static void MAX31790SIM_step_fan(max31790sim_dev_t *dev, uint8_t fan_number, uint32_t dt_ms, float output);
+static void MAX31790SIM_step_faults(max31790sim_dev_t *dev);
+static inline uint16_t MAX31790SIM_get11(const max31790sim_dev_t *dev, uint8_t reg);
+static inline void MAX31790SIM_put(max31790sim_dev_t *dev, uint8_t reg, uint16_t val, uint8_t bits);
+static inline bool MAX31790SIM_tach_enabled(const max31790sim_dev_t *dev, uint8_t fan_number);
+static void MAX31790SIM_drive_fail(max31790sim_dev_t *dev);
+static esp_err_t MAX31790SIM_alert_arm(void *ctx, max31790_alert_notify_t notify, void *arg);
+static void MAX31790SIM_alert_disarm(void *ctx);
+static bool MAX31790SIM_alert_asserted(void *ctx);
+
+const i2cmanager_backend_t max31790sim_backend =
+{
+    .write = MAX31790SIM_write,
+    .read = MAX31790SIM_read,
+    .recover = MAX31790SIM_recover,
+    .sda_low = MAX31790SIM_sda_low
+};
+
+const max31790_alert_ops_t max31790sim_alert_ops =
+{
+    .arm = MAX31790SIM_alert_arm,
+    .disarm = MAX31790SIM_alert_disarm,
+    .asserted = MAX31790SIM_alert_asserted
+};
+
+/* Device ------------------------------------------------------------------------------------ */
+void MAX31790SIM_init(max31790sim_dev_t *dev, uint8_t adr)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->adr = adr;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        dev->fan[x].rpm_max = 3000;
+        dev->fan[x].start_permille = 200;
+        dev->fan[x].stall_permille = 120;
+        dev->fan[x].tau_ms = 800;
+        dev->fan[x].pulses_per_rev = 2;
+        dev->fan[x].present = true;
+    }
+
+    MAX31790SIM_reset(dev);
+}
+
+void MAX31790SIM_reset(max31790sim_dev_t *dev)
+{
+    memset(dev->regs, 0, sizeof(dev->regs));
+
+    dev->regs[MAX31790_REG_GLOBAL_CONFIG] = MAX31790_GLO_BUS_TIMEOUT_DIS;
+    dev->regs[MAX31790_REG_FREQ_START] = 0x44;
+    dev->regs[MAX31790_REG_FAN_FAULT_MASK_1] = 0x3F;
+    dev->regs[MAX31790_REG_FAN_FAULT_MASK_2] = 0x3F;
+    dev->regs[MAX31790_REG_SEQ_START_CONFIG] = 0x45;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        dev->regs[MAX31790_REG_FAN_DYNAMIC(x)] = 0x4C;
+        dev->regs[MAX31790_REG_WINDOW(x)] = 0x08;
+        MAX31790SIM_put(dev, MAX31790_REG_TARGET_COUNT(x), TACH_COUNT_MAX, 11);
+        dev->duty[x] = 0;
+        dev->spin_up_ms[x] = 0;
+    }
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        MAX31790SIM_put(dev, MAX31790_REG_TACH_COUNT(x), TACH_COUNT_MAX, 11);
+        dev->fault_q[x] = 0;
+    }
+}
+
+void MAX31790SIM_step(max31790sim_dev_t *dev, uint32_t dt_ms)
+{
+    for(; dt_ms > SIM_STEP_MAX_MS; dt_ms -= SIM_STEP_MAX_MS)                                        // Long steps overshoot the RPM loop, take them in slices
+        MAX31790SIM_step_slice(dev, SIM_STEP_MAX_MS);
+
+    MAX31790SIM_step_slice(dev, dt_ms);
+}
+
+bool MAX31790SIM_fan_fail(const max31790sim_dev_t *dev)
+{
+    uint8_t s1 = dev->regs[MAX31790_REG_FAN_FAULT_STATUS_1] & ~dev->regs[MAX31790_REG_FAN_FAULT_MASK_1];
+    uint8_t s2 = dev->regs[MAX31790_REG_FAN_FAULT_STATUS_2] & ~dev->regs[MAX31790_REG_FAN_FAULT_MASK_2];
+
+    return (s1 | s2) & 0x3F;
+}
+
+/* Bus --------------------------------------------------------------------------------------- */
+void MAX31790SIM_bus_init(max31790sim_bus_t *bus, const max31790sim_bus_cfg_t *cfg)
+{
+    memset(bus, 0, sizeof(*bus));
+
+    if(cfg)
+        bus->cfg = *cfg;
+
+    if(!bus->cfg.clk_hz)
+        bus->cfg.clk_hz = SIM_DEF_CLK_HZ;
+
+    bus->last_step_us = esp_timer_get_time();
+}
+
+esp_err_t MAX31790SIM_bus_attach(max31790sim_bus_t *bus, max31790sim_dev_t *dev)
+{
+    if(bus->n_dev >= MAX31790SIM_MAX_DEV)
+        return ESP_ERR_NO_MEM;
+
+    for(uint8_t x = 0; x < bus->n_dev; x++)
+        if(bus->dev[x]->adr == dev->adr)
+            return ESP_ERR_INVALID_STATE;
+
+    bus->dev[bus->n_dev++] = dev;
+
+    return ESP_OK;
+}
+
+void MAX31790SIM_bus_step(max31790sim_bus_t *bus, uint32_t dt_ms)
+{
+    for(uint8_t x = 0; x < bus->n_dev; x++)
+        MAX31790SIM_step(bus->dev[x], dt_ms);
+}
+
+void MAX31790SIM_bus_inject_nak(max31790sim_bus_t *bus, uint32_t count)
+{
+    bus->nak_next += count;
+}
+
+void MAX31790SIM_bus_inject_stuck(max31790sim_bus_t *bus, uint32_t clocks)
+{
+    bus->stuck_clocks = clocks;
+}
+
+uint64_t MAX31790SIM_wire_time_ns(const max31790sim_bus_cfg_t *cfg, uint32_t bytes, bool repeated_start)
+{
+    uint32_t bits = 2 + (bytes * 9) + (repeated_start ? 1 : 0);                                     // START, 8 bits + ACK per byte, STOP
+    uint32_t clk_hz = cfg->clk_hz ? cfg->clk_hz : SIM_DEF_CLK_HZ;
+
+    return ((uint64_t)bits * 1000000000ULL) / clk_hz + (uint64_t)cfg->stretch_us * 1000;
+}
+
+void MAX31790SIM_bus_reset_counters(max31790sim_bus_t *bus)
+{
+    bus->bus_time_ns = 0;
+    bus->transactions = 0;
+    bus->bytes = 0;
+    bus->naks = 0;
+    bus->timeouts = 0;
+    bus->recoveries = 0;
+}
+
+/* Backend ----------------------------------------------------------------------------------- */
+static esp_err_t MAX31790SIM_write(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout)
+{
+    max31790sim_dev_t *dev = NULL;
+    esp_err_t rslt = MAX31790SIM_begin((max31790sim_bus_t *)ctx, adr, 2 + len, false, timeout, &dev);
+
+    if(rslt != ESP_OK)
+        return rslt;
+
+    for(size_t x = 0; x < len; x++)                                                                 // Auto-increment, one register per data byte
+        MAX31790SIM_write_reg(dev, (uint8_t)(reg + x), buff[x]);
+
+    MAX31790SIM_drive_fail(dev);                                                                    // Clearing status or masks moves the pin
+
+    return ESP_OK;
+}
+
+static esp_err_t MAX31790SIM_read(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout)
+{
+    max31790sim_dev_t *dev = NULL;
+    esp_err_t rslt = MAX31790SIM_begin((max31790sim_bus_t *)ctx, adr, 3 + len, true, timeout, &dev);
+
+    if(rslt != ESP_OK)
+        return rslt;
+
+    for(size_t x = 0; x < len; x++)
+    {
+        uint8_t r = (uint8_t)(reg + x);
+        buff[x] = (r < REG_MAP_SIZE) ? dev->regs[r] : 0x00;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t MAX31790SIM_recover(void *ctx, uint8_t port)
+{
+    max31790sim_bus_t *bus = (max31790sim_bus_t *)ctx;
+    uint32_t clocks = (bus->stuck_clocks && bus->stuck_clocks < I2CMANAGER_RECOVER_CLOCKS) ? bus->stuck_clocks : I2CMANAGER_RECOVER_CLOCKS;
+    uint32_t clk_hz = bus->cfg.clk_hz ? bus->cfg.clk_hz : SIM_DEF_CLK_HZ;
+    uint64_t wire_ns = ((uint64_t)(clocks + 1) * 1000000000ULL) / clk_hz;                          // Pulses until SDA rises, then STOP
+    int64_t start_us = esp_timer_get_time();
+
+    bus->recoveries++;
+    bus->stuck_clocks -= (bus->stuck_clocks > clocks) ? clocks : bus->stuck_clocks;
+    bus->bus_time_ns += wire_ns;
+
+    MAX31790SIM_wire_wait(bus, start_us, wire_ns);
+
+    return bus->stuck_clocks ? I2CMANAGER_ERR_BUS_STUCK : ESP_OK;
+}
+
+static bool MAX31790SIM_sda_low(void *ctx, uint8_t port)
+{
+    return ((max31790sim_bus_t *)ctx)->stuck_clocks != 0;                                           // Stretching holds SCL, never SDA
+}
+
+static esp_err_t MAX31790SIM_begin(max31790sim_bus_t *bus, uint8_t adr, uint32_t bytes, bool repeated_start, TickType_t timeout, max31790sim_dev_t **dev)
+{
+    int64_t start_us = esp_timer_get_time();
+    uint64_t wire_ns = 0;
+    uint64_t limit_ns = (uint64_t)pdTICKS_TO_MS(timeout) * 1000000ULL;
+    esp_err_t rslt = ESP_OK;
+
+    if(bus->cfg.auto_step && start_us - bus->last_step_us >= 1000)
+    {
+        uint32_t dt_ms = (start_us - bus->last_step_us) / 1000;
+
+        MAX31790SIM_bus_step(bus, dt_ms);
+        bus->last_step_us += (int64_t)dt_ms * 1000;
+    }
+
+    *dev = NULL;
+    for(uint8_t x = 0; x < bus->n_dev && !*dev; x++)
+        if(bus->dev[x]->adr == adr)
+            *dev = bus->dev[x];
+
+    bus->transactions++;
+
+    if(bus->nak_next || !*dev || (bus->cfg.nak_every && !(bus->transactions % bus->cfg.nak_every)))
+    {
+        if(bus->nak_next)
+            bus->nak_next--;
+
+        bus->naks++;
+        *dev = NULL;
+        bytes = 1;                                                                                  // Address byte only
+        repeated_start = false;
+        rslt = I2CMANAGER_ERR_NACK;
+    }
+
+    wire_ns = MAX31790SIM_wire_time_ns(&bus->cfg, bytes, repeated_start);
+
+    if(bus->stuck_clocks || (timeout != portMAX_DELAY && wire_ns > limit_ns))                      // Held SDA or deadline hit mid transfer, the master gives up
+    {
+        wire_ns = (timeout != portMAX_DELAY) ? limit_ns : wire_ns;
+        *dev = NULL;
+        rslt = ESP_ERR_TIMEOUT;
+        bus->timeouts++;
+    }
+
+    bus->bytes += bytes;
+    bus->bus_time_ns += wire_ns;
+
+    MAX31790SIM_wire_wait(bus, start_us, wire_ns);
+
+    return rslt;
+}
+
+static void MAX31790SIM_wire_wait(const max31790sim_bus_t *bus, int64_t start_us, uint64_t wire_ns)
+{
+    int64_t end_us = start_us + (int64_t)(wire_ns / 1000);
+
+    if(!bus->cfg.real_time)
+        return;
+
+    while(bus->cfg.yield && end_us - esp_timer_get_time() >= portTICK_PERIOD_MS * 1000)            // Other tasks run meanwhile, the tail is spun for accuracy
+        vTaskDelay(1);
+
+    while(esp_timer_get_time() < end_us);
+}
+
+/* Model ------------------------------------------------------------------------------------- */
+static void MAX31790SIM_write_reg(max31790sim_dev_t *dev, uint8_t reg, uint8_t val)
+{
+    if(reg >= REG_MAP_SIZE)
+        return;
+
+    if(reg == MAX31790_REG_GLOBAL_CONFIG && (val & MAX31790_GLO_RESET_RESET))
+    {
+        MAX31790SIM_reset(dev);
+        return;
+    }
+
+    if(reg == MAX31790_REG_FAN_FAULT_STATUS_1 || reg == MAX31790_REG_FAN_FAULT_STATUS_2)           // Write 0 to clear
+    {
+        dev->regs[reg] &= val;
+        return;
+    }
+
+    if(reg >= MAX31790_REG_TACH_COUNT(0) && reg < MAX31790_REG_TARGET_DUTY(0))                     // Tach, PWM duty and reserved are read only
+        return;
+
+    if(reg == MAX31790_REG_GLOBAL_CONFIG)
+        val = (val & ~MAX31790_GLO_I2C_WD_STATUS) | (dev->regs[reg] & MAX31790_GLO_I2C_WD_STATUS);
+
+    dev->regs[reg] = val;
+}
+
+static void MAX31790SIM_step_slice(max31790sim_dev_t *dev, uint32_t dt_ms)
+{
+    float output[NUM_CHANNEL] = {0};
+
+    if(!dt_ms)
+        return;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790SIM_step_channel(dev, x, dt_ms, &output[x]);
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+        MAX31790SIM_step_fan(dev, x, dt_ms, output[FAN_TO_CHAN(x)]);
+
+    for(dev->fault_ms += dt_ms; dev->fault_ms >= MAX31790SIM_FAULT_PERIOD_MS; dev->fault_ms -= MAX31790SIM_FAULT_PERIOD_MS)
+        MAX31790SIM_step_faults(dev);
+
+    MAX31790SIM_drive_fail(dev);
+}
+
+static void MAX31790SIM_step_channel(max31790sim_dev_t *dev, uint8_t channel, uint32_t dt_ms, float *output)
+{
+    uint8_t cfg = dev->regs[MAX31790_REG_FAN_CONFIG(channel)];
+    uint8_t dyn = dev->regs[MAX31790_REG_FAN_DYNAMIC(channel)];
+    uint32_t step_us = roc_us[(dyn & MAX31790_FAN_DYN_PWM_ROC_MASK) >> 2];
+    float was = dev->duty[channel];
+    float target = 0;
+
+    if(dev->regs[MAX31790_REG_GLOBAL_CONFIG] & MAX31790_GLO_RUN_STANDBY_STANDBY)
+    {
+        dev->duty[channel] = 0;
+    }
+    else if(cfg & MAX31790_FAN_CFG_MODE_RPM)                                                        // Closed loop on the channel's own tach input
+    {
+        int32_t err = (int32_t)MAX31790SIM_get11(dev, MAX31790_REG_TACH_COUNT(channel)) - MAX31790SIM_get11(dev, MAX31790_REG_TARGET_COUNT(channel));
+        float steps = (dt_ms * 1000.0f) / (step_us ? step_us : SIM_RPM_MODE_STEP);
+
+        if(err > dev->regs[MAX31790_REG_WINDOW(channel)])                                           // Count too high, fan too slow
+            dev->duty[channel] += steps;
+        else if(-err > dev->regs[MAX31790_REG_WINDOW(channel)])
+            dev->duty[channel] -= steps;
+    }
+    else
+    {
+        target = REG_TO_LFTJST(9, dev->regs[MAX31790_REG_TARGET_DUTY(channel)], dev->regs[MAX31790_REG_TARGET_DUTY(channel) + 1]);
+
+        if(!step_us)
+            dev->duty[channel] = target;
+        else if(dev->duty[channel] < target)
+            dev->duty[channel] = CONSTRAIN(dev->duty[channel] + (dt_ms * 1000.0f) / step_us, 0, target);
+        else
+            dev->duty[channel] = CONSTRAIN(dev->duty[channel] - (dt_ms * 1000.0f) / step_us, target, DUTYBITS_MAX);
+    }
+
+    dev->duty[channel] = CONSTRAIN(dev->duty[channel], 0, DUTYBITS_MAX);
+
+    if(was < 1.0f && dev->duty[channel] >= 1.0f && dev->rpm[channel] < SIM_STOPPED_RPM)             // Spin-up from a stop at full drive
+        dev->spin_up_ms[channel] = spin_up_ms[(cfg >> 5) & 0x03];
+
+    dev->spin_up_ms[channel] -= (dev->spin_up_ms[channel] > dt_ms) ? dt_ms : dev->spin_up_ms[channel];
+
+    *output = dev->spin_up_ms[channel] ? DUTYBITS_MAX : dev->duty[channel];
+
+    if(cfg & MAX31790_FAN_CFG_CON_MON_MON)                                                          // Output disabled, fans run from their own supply
+        *output = -1.0f;
+
+    MAX31790SIM_put(dev, MAX31790_REG_PWM_DUTY(channel), (*output < 0) ? 0 : (uint16_t)(*output + 0.5f), 9);
+}
+
+static void MAX31790SIM_step_fan(max31790sim_dev_t *dev, uint8_t fan_number, uint32_t dt_ms, float output)
+{
+    const max31790sim_fan_t *fan = &dev->fan[fan_number];
+    uint8_t dyn = dev->regs[MAX31790_REG_FAN_DYNAMIC(FAN_TO_CHAN(fan_number))];
+    uint8_t sr = (dyn & MAX31790_FAN_DYN_SR_MASK) >> 5;
+    float permille = (output < 0) ? PERMILLE_MAX : (output * PERMILLE_MAX) / DUTYBITS_MAX;
+    float *rpm = &dev->rpm[fan_number];
+    float target = 0;
+    uint32_t count = TACH_COUNT_MAX;
+
+    dev->wear[fan_number] = CONSTRAIN(dev->wear[fan_number] + (fan->decay_per_s * dt_ms) / 1000.0f, 0.0f, 1.0f);
+
+    if(fan->present && !fan->locked && permille >= ((*rpm < SIM_STOPPED_RPM) ? fan->start_permille : fan->stall_permille))
+        target = fan->rpm_max * (permille / PERMILLE_MAX) * (1.0f - dev->wear[fan_number]);
+
+    *rpm += (target - *rpm) * dt_ms / (float)(fan->tau_ms + dt_ms);
+
+    if(*rpm >= SIM_STOPPED_RPM && fan->pulses_per_rev)
+        count = TACH_K(sr_map[sr < sizeof(sr_map) ? sr : sizeof(sr_map) - 1]) / (uint32_t)(*rpm * fan->pulses_per_rev);
+
+    if(!MAX31790SIM_tach_enabled(dev, fan_number))
+        count = TACH_COUNT_MAX;
+
+    MAX31790SIM_put(dev, MAX31790_REG_TACH_COUNT(fan_number), CONSTRAIN(count, 1, TACH_COUNT_MAX), 11);
+}
+
+static void MAX31790SIM_step_faults(max31790sim_dev_t *dev)
+{
+    uint8_t ffq = ffq_map[dev->regs[MAX31790_REG_SEQ_START_CONFIG] & 0x03];
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        uint8_t ch = FAN_TO_CHAN(x);
+        bool driven = dev->duty[ch] >= 1.0f || (dev->regs[MAX31790_REG_FAN_CONFIG(ch)] & MAX31790_FAN_CFG_CON_MON_MON);
+        bool failing = MAX31790SIM_tach_enabled(dev, x) && driven && !dev->spin_up_ms[ch] && MAX31790SIM_get11(dev, MAX31790_REG_TACH_COUNT(x)) >= TACH_COUNT_MAX;
+
+        dev->fault_q[x] = failing ? dev->fault_q[x] + (dev->fault_q[x] < 0xFF) : 0;
+
+        if(dev->fault_q[x] >= ffq)                                                                  // Sticky until written to 0
+            dev->regs[(x < NUM_CHANNEL) ? MAX31790_REG_FAN_FAULT_STATUS_1 : MAX31790_REG_FAN_FAULT_STATUS_2] |= (0x01 << ch);
+    }
+}
+
+static inline uint16_t MAX31790SIM_get11(const max31790sim_dev_t *dev, uint8_t reg)
+{
+    return REG_TO_LFTJST(11, dev->regs[reg], dev->regs[reg + 1]);
+}
+
+static inline void MAX31790SIM_put(max31790sim_dev_t *dev, uint8_t reg, uint16_t val, uint8_t bits)
+{
+    dev->regs[reg] = LFTJST_TO_MSB(val, bits);
+    dev->regs[reg + 1] = LFTJST_TO_LSB(val, bits);
+}
+
+static inline bool MAX31790SIM_tach_enabled(const max31790sim_dev_t *dev, uint8_t fan_number)
+{
+    uint8_t cfg = dev->regs[MAX31790_REG_FAN_CONFIG(FAN_TO_CHAN(fan_number))];
+
+    if(fan_number < NUM_CHANNEL)
+        return cfg & MAX31790_FAN_CFG_TACH_INPUT;
+
+    return cfg & MAX31790_FAN_CFG_PWM_TACH_TACH;                                                    // PWM pin reused as the second tach input
+}
+
+static void MAX31790SIM_drive_fail(max31790sim_dev_t *dev)
+{
+    bool level = MAX31790SIM_fan_fail(dev);
+
+    if(level && !dev->fail_level && dev->alert_notify)                                              // Falling edge on the real pin
+        dev->alert_notify(dev->alert_arg);
+
+    dev->fail_level = level;
+}
+
+/* Alert ------------------------------------------------------------------------------------- */
+static esp_err_t MAX31790SIM_alert_arm(void *ctx, max31790_alert_notify_t notify, void *arg)
+{
+    max31790sim_dev_t *dev = (max31790sim_dev_t *)ctx;
+
+    dev->alert_arg = arg;
+    dev->alert_notify = notify;
+
+    return ESP_OK;
+}
+
+static void MAX31790SIM_alert_disarm(void *ctx)
+{
+    ((max31790sim_dev_t *)ctx)->alert_notify = NULL;
+}
+
+static bool MAX31790SIM_alert_asserted(void *ctx)
+{
+    return MAX31790SIM_fan_fail((const max31790sim_dev_t *)ctx);
+}
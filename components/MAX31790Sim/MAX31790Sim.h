@@ -0,0 +1,99 @@
+/****************************************************** 
+  Description: MAX31790 Behavioural Simulator  
+       Author: Jonathan Dempsey JDWifWaf@gmail.com  
+      Version: 1.0.0
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790SIM_H
+#define MAX31790SIM_H
+
+#include "MAX31790.h"
+#include "MAX31790Fault.h"
+#include "I2CManager.h"
+
+#define MAX31790SIM_MAX_DEV                 16                            // Chips per simulated bus (address pins allow 16)
+#define MAX31790SIM_FAULT_PERIOD_MS         100                           // Tach fault evaluation interval
+
+typedef struct
+{
+   uint32_t rpm_max;                            // Rotor speed at 100 % duty
+   uint16_t start_permille;                     // Duty needed to start a stopped rotor
+   uint16_t stall_permille;                     // Duty below which a spinning rotor stops
+   uint32_t tau_ms;                             // First order speed response
+   uint8_t pulses_per_rev;                      // Tach pulses per revolution
+   bool present;                                // Nothing on the input when false, count saturates
+   bool locked;                                 // Injected failure, rotor held at 0 RPM
+   float decay_per_s;                           // Injected bearing wear, fraction of rpm_max lost per second
+} max31790sim_fan_t;
+
+typedef struct
+{
+   uint8_t adr;
+   uint8_t regs[REG_MAP_SIZE];
+   max31790sim_fan_t fan[NUM_TACH_CHANNEL];     // Inputs 7 - 12 see the PWM of channel (input - 6)
+   float rpm[NUM_TACH_CHANNEL];
+   float wear[NUM_TACH_CHANNEL];                // Accumulated decay, 0 - 1
+   float duty[NUM_CHANNEL];                     // 9 bit output, fractional while ramping
+   uint32_t spin_up_ms[NUM_CHANNEL];            // Remaining forced 100 % time
+   uint8_t fault_q[NUM_TACH_CHANNEL];           // Consecutive failing evaluations
+   uint32_t fault_ms;                           // Time since the last fault evaluation
+   bool fail_level;                             // FAN_FAIL as last driven
+   max31790_alert_notify_t alert_notify;        // Called when FAN_FAIL asserts
+   void *alert_arg;
+} max31790sim_dev_t;
+
+typedef struct
+{
+   uint32_t clk_hz;                             // 100000 or 400000
+   uint32_t stretch_us;                         // Clock stretch added to every transaction
+   uint32_t nak_every;                          // NAK one transaction in N, 0 never
+   bool real_time;                              // Busy wait the modelled wire time
+   bool yield;                                  // With real_time, sleep whole ticks of it as an interrupt driven controller frees the CPU
+   bool auto_step;                              // Advance the chips by host time on every transaction
+} max31790sim_bus_cfg_t;
+
+typedef struct
+{
+   max31790sim_bus_cfg_t cfg;
+   max31790sim_dev_t *dev[MAX31790SIM_MAX_DEV];
+   uint8_t n_dev;
+   uint32_t nak_next;                           // NAK the next N transactions
+   uint32_t stuck_clocks;                       // SDA held low until this many SCL pulses, 0 free
+   int64_t last_step_us;
+   uint64_t bus_time_ns;                        // Modelled wire time, includes stretching
+   uint32_t transactions;
+   uint32_t bytes;
+   uint32_t naks;
+   uint32_t timeouts;                           // Transfers longer than the caller's deadline
+   uint32_t recoveries;
+} max31790sim_bus_t;
+
+extern const i2cmanager_backend_t max31790sim_backend;                          // ctx is a max31790sim_bus_t
+extern const max31790_alert_ops_t max31790sim_alert_ops;                        // FAN_FAIL pin, ctx is a max31790sim_dev_t
+
+/* Device --------------------------------------------------------------------------------- */
+void MAX31790SIM_init(max31790sim_dev_t *dev, uint8_t adr);                      // Power-on register defaults, fans present at 3000 RPM / 2 PPR.
+
+void MAX31790SIM_reset(max31790sim_dev_t *dev);                                  // Registers only, rotors keep spinning.
+
+void MAX31790SIM_step(max31790sim_dev_t *dev, uint32_t dt_ms);
+
+bool MAX31790SIM_fan_fail(const max31790sim_dev_t *dev);                         // FAN_FAIL pin, asserted while any unmasked fault is set.
+
+/* Bus ------------------------------------------------------------------------------------ */
+void MAX31790SIM_bus_init(max31790sim_bus_t *bus, const max31790sim_bus_cfg_t *cfg);   // NULL cfg: 100 kHz, no stretching, no NAKs.
+
+esp_err_t MAX31790SIM_bus_attach(max31790sim_bus_t *bus, max31790sim_dev_t *dev);
+
+void MAX31790SIM_bus_step(max31790sim_bus_t *bus, uint32_t dt_ms);
+
+void MAX31790SIM_bus_inject_nak(max31790sim_bus_t *bus, uint32_t count);
+
+void MAX31790SIM_bus_inject_stuck(max31790sim_bus_t *bus, uint32_t clocks);      // Slave holds SDA, every transfer times out until clocked free.
+
+uint64_t MAX31790SIM_wire_time_ns(const max31790sim_bus_cfg_t *cfg, uint32_t bytes, bool repeated_start);
+
+void MAX31790SIM_bus_reset_counters(max31790sim_bus_t *bus);
+
+#endif
@@ -0,0 +1,261 @@
+/******************************************************
+  Description: Setpoint latency under tach telemetry on
+               the same port: the blocking write against
+               the engine queued one, caller time and
+               completion timed, then the shadow checked
+               after a good and a NAKed queued write, and
+               a queued write retried past a NAK.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sim.h"
+
+#define ASYNC_ADR           0x20
+#define ASYNC_PORT          0
+#define ASYNC_CH            1
+#define ASYNC_SETPOINTS     200                 // Per mode
+#define ASYNC_GAP_MS        3                   // Between setpoints
+#define ASYNC_JITTER_US     3000                // Random spin after the gap, lands setpoints anywhere in a sweep
+#define ASYNC_PRIO          5
+#define ASYNC_WARM_MS       3000
+#define ASYNC_SUBMIT_US     100                 // Median caller time of a queued setpoint
+#define ASYNC_BLOCK_GAIN    10                  // Median sync caller time over the queued one
+
+enum { MODE_SYNC = 0, MODE_ASYNC, MODE_COUNT };
+
+typedef struct
+{
+    int64_t caller_us[ASYNC_SETPOINTS];         // Until the call returns
+    int64_t done_us[ASYNC_SETPOINTS];           // Until the value is on the chip
+    uint32_t errors;
+} async_result_t;
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static i2cmanager_token_t token;
+static volatile bool telemetry_run;
+static uint32_t sweeps;
+static uint32_t sweep_errors;
+static bool failed;
+
+static const char *names[MODE_COUNT] = {"sync", "async"};
+
+static max31790_master_config_t cfg =
+{
+    .adr = ASYNC_ADR,
+    .port = ASYNC_PORT,
+    .global_cfg = MAX31790_GLO_BUS_TIMEOUT_DIS,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2}
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "async: %s\n", what);
+        failed = true;
+    }
+}
+
+static int async_cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static bool async_on_chip(uint16_t dutybits)
+{
+    uint8_t reg = MAX31790_REG_TARGET_DUTY(ASYNC_CH);
+
+    return sim.regs[reg] == LFTJST_TO_MSB(dutybits, 9) && sim.regs[reg + 1] == LFTJST_TO_LSB(dutybits, 9);
+}
+
+static void telemetry_task(void *arg)                                                               // 12 input sweeps a tick apart, the port mostly busy
+{
+    SemaphoreHandle_t done = arg;
+    uint32_t rpm[NUM_TACH_CHANNEL];
+
+    while(telemetry_run)
+    {
+        sweep_errors += MAX31790_get_all_rpm(&cfg, rpm) != ESP_OK;
+        sweeps++;
+        vTaskDelay(1);                                                                              // The host port has no priorities, back to back sweeps would starve every waiter
+    }
+
+    xSemaphoreGive(done);
+    vTaskDelete(NULL);
+}
+
+static void async_run(uint8_t mode, async_result_t *r)
+{
+    memset(r, 0, sizeof(*r));
+
+    for(uint32_t x = 0; x < ASYNC_SETPOINTS; x++)
+    {
+        uint16_t dutybits = (x & 0x01) ? 200 : 300;                                                 // Alternate, an unchanged value skips the bus
+        int64_t start = 0;
+        esp_err_t rslt = ESP_OK;
+
+        vTaskDelay(pdMS_TO_TICKS(ASYNC_GAP_MS));
+
+        start = esp_timer_get_time() + rand() % ASYNC_JITTER_US;                                    // Sleeps end on tick edges, in phase with the sweeps
+        while(esp_timer_get_time() < start);
+
+        start = esp_timer_get_time();
+        if(mode == MODE_SYNC)
+        {
+            rslt = MAX31790_set_target_dutybits(&cfg, ASYNC_CH, dutybits);
+            r->caller_us[x] = esp_timer_get_time() - start;
+            r->done_us[x] = r->caller_us[x];
+        }
+        else
+        {
+            I2CMANAGER_token_init(&token);
+            rslt = MAX31790_set_target_dutybits_async(&cfg, ASYNC_CH, dutybits, &token);
+            r->caller_us[x] = esp_timer_get_time() - start;
+
+            if(rslt == ESP_OK && I2CMANAGER_token_wait(&token, portMAX_DELAY) == ESP_OK)
+                rslt = token.rslt;
+            r->done_us[x] = esp_timer_get_time() - start;
+        }
+
+        r->errors += rslt != ESP_OK || !async_on_chip(dutybits);
+    }
+
+    qsort(r->caller_us, ASYNC_SETPOINTS, sizeof(int64_t), async_cmp);
+    qsort(r->done_us, ASYNC_SETPOINTS, sizeof(int64_t), async_cmp);
+
+    printf("{\"mode\":\"%s\",\"setpoints\":%d,\"errors\":%u,\"caller_us_p50\":%lld,\"caller_us_p99\":%lld,\"caller_us_max\":%lld,"
+           "\"done_us_p50\":%lld,\"done_us_p99\":%lld,\"done_us_max\":%lld}\n",
+           names[mode], ASYNC_SETPOINTS, r->errors,
+           (long long)r->caller_us[ASYNC_SETPOINTS / 2], (long long)r->caller_us[ASYNC_SETPOINTS * 99 / 100], (long long)r->caller_us[ASYNC_SETPOINTS - 1],
+           (long long)r->done_us[ASYNC_SETPOINTS / 2], (long long)r->done_us[ASYNC_SETPOINTS * 99 / 100], (long long)r->done_us[ASYNC_SETPOINTS - 1]);
+
+    check("setpoint not applied", !r->errors);
+}
+
+static void async_shadow(void)                                                                      // Queued writes settle the shadow as MAX31790_write() does
+{
+    uint8_t reg = MAX31790_REG_TARGET_DUTY(ASYNC_CH);
+    uint8_t buff[2] = {0};
+    uint32_t tx = 0;
+    esp_err_t good = ESP_FAIL;
+    esp_err_t naked = ESP_FAIL;
+    esp_err_t flushed = ESP_FAIL;
+    bool cached = false;
+    bool dirty = false;
+    bool retried = false;
+
+    I2CMANAGER_token_init(&token);
+    if(MAX31790_set_target_dutybits_async(&cfg, ASYNC_CH, 400, &token) == ESP_OK && I2CMANAGER_token_wait(&token, portMAX_DELAY) == ESP_OK)
+        good = token.rslt;
+
+    tx = bus.transactions;
+    cached = MAX31790_get_regs(&cfg, reg, buff, 2) == ESP_OK && bus.transactions == tx &&
+             buff[0] == LFTJST_TO_MSB(400, 9) && buff[1] == LFTJST_TO_LSB(400, 9);
+
+    MAX31790SIM_bus_inject_nak(&bus, 1);                                                            // No retries attached, one NAK fails the write
+    I2CMANAGER_token_init(&token);
+    if(MAX31790_set_target_dutybits_async(&cfg, ASYNC_CH, 100, &token) == ESP_OK && I2CMANAGER_token_wait(&token, portMAX_DELAY) == ESP_OK)
+        naked = token.rslt;
+
+    dirty = (cfg.shadow_dirty[reg >> 3] & (0x01 << (reg & 0x07))) && !(cfg.shadow_valid[reg >> 3] & (0x01 << (reg & 0x07))) && async_on_chip(400);
+    flushed = MAX31790_flush(&cfg);
+    retried = async_on_chip(100) && !(cfg.shadow_dirty[reg >> 3] & (0x01 << (reg & 0x07)));
+
+    printf("{\"part\":\"shadow\",\"good\":\"%s\",\"cached\":%s,\"naked\":\"%s\",\"dirty\":%s,\"flush\":\"%s\",\"retried\":%s}\n",
+           I2CMANAGER_err_to_name(good), cached ? "true" : "false", I2CMANAGER_err_to_name(naked), dirty ? "true" : "false",
+           I2CMANAGER_err_to_name(flushed), retried ? "true" : "false");
+
+    check("queued write failed", good == ESP_OK);
+    check("settled write not served from the shadow", cached);
+    check("NAKed queued write reported success", naked != ESP_OK);
+    check("failed queued write not dirty", dirty);
+    check("flush did not retry the failed queued write", flushed == ESP_OK && retried);
+}
+
+static void async_retry(void)                                                                       // The engine retries as the device was attached, like a blocking write
+{
+    uint32_t naks = bus.naks;
+    esp_err_t rslt = ESP_FAIL;
+
+    cfg.i2c->cfg.retries = 1;
+
+    MAX31790SIM_bus_inject_nak(&bus, 1);
+    I2CMANAGER_token_init(&token);
+    if(MAX31790_set_target_dutybits_async(&cfg, ASYNC_CH, 300, &token) == ESP_OK && I2CMANAGER_token_wait(&token, portMAX_DELAY) == ESP_OK)
+        rslt = token.rslt;
+
+    cfg.i2c->cfg.retries = 0;
+
+    printf("{\"part\":\"retry\",\"rslt\":\"%s\",\"naks\":%u,\"on_chip\":%s}\n",
+           I2CMANAGER_err_to_name(rslt), bus.naks - naks, async_on_chip(300) ? "true" : "false");
+
+    check("queued write not retried past a NAK", rslt == ESP_OK && bus.naks - naks == 1 && async_on_chip(300));
+}
+
+int main(int argc, char **argv)
+{
+    async_result_t r[MODE_COUNT];
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    int64_t bound_us = 0;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, ASYNC_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(!done || I2CMANAGER_set_backend(ASYNC_PORT, &max31790sim_backend, &bus) != ESP_OK ||
+       I2CMANAGER_engine_start(ASYNC_PORT, 16, ASYNC_PRIO) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK)
+    {
+        fprintf(stderr, "async: setup failed\n");
+        return 1;
+    }
+
+    for(uint8_t ch = 0; ch < NUM_CHANNEL; ch++)
+        MAX31790_set_target_dutybits(&cfg, ch, MAX31790_permille_to_bits(500));
+
+    MAX31790SIM_bus_step(&bus, ASYNC_WARM_MS);
+
+    bus.cfg = (max31790sim_bus_cfg_t){.clk_hz = 100000, .real_time = true, .yield = true};
+    bound_us = (MAX31790SIM_wire_time_ns(&bus.cfg, 27, true) + MAX31790SIM_wire_time_ns(&bus.cfg, 4, false)) / 1000 +   // A whole sweep ahead, then its own write
+               portTICK_PERIOD_MS * 1000;                                                           // and the tick the sleeping sweep wakes on
+
+    telemetry_run = true;
+    if(xTaskCreate(telemetry_task, "telemetry", 4096, done, ASYNC_PRIO - 1, NULL) != pdPASS)
+    {
+        fprintf(stderr, "async: telemetry start failed\n");
+        return 1;
+    }
+
+    for(uint8_t x = 0; x < MODE_COUNT; x++)
+        async_run(x, &r[x]);
+
+    telemetry_run = false;
+    xSemaphoreTake(done, portMAX_DELAY);
+    bus.cfg.real_time = false;
+
+    printf("{\"telemetry_sweeps\":%u,\"telemetry_errors\":%u,\"done_bound_us\":%lld}\n", sweeps, sweep_errors, (long long)bound_us);
+
+    check("telemetry sweep failed", !sweep_errors);
+    check("queued setpoint blocks the caller", r[MODE_ASYNC].caller_us[ASYNC_SETPOINTS / 2] <= ASYNC_SUBMIT_US);
+    check("queued setpoint not cheaper than the blocking one",
+          r[MODE_ASYNC].caller_us[ASYNC_SETPOINTS / 2] * ASYNC_BLOCK_GAIN <= r[MODE_SYNC].caller_us[ASYNC_SETPOINTS / 2]);
+    check("queued setpoint completion", r[MODE_ASYNC].done_us[ASYNC_SETPOINTS / 2] <= bound_us);
+    check("blocking setpoint completion", r[MODE_SYNC].done_us[ASYNC_SETPOINTS / 2] <= bound_us);
+
+    async_shadow();
+    async_retry();
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,474 @@
+/****************************************************** 
+  Description: Cost of every MAX31790 driver call on the
+               simulated bus: transactions, bytes, wire
+               time, heap allocations and host CPU time.
+               Fault cases inject NAKs, a stuck bus and
+               clock stretching and check latency bounds.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sampler.h"
+#include "MAX31790Fault.h"
+#include "MAX31790Sim.h"
+
+#define BENCH_DEF_ITERS     1000
+#define BENCH_ADR           0x20
+#define BENCH_PORT          0
+#define BENCH_FAULT_ITERS   20                  // Fault cases busy wait real wire time
+
+typedef void (*bench_fn_t)(uint32_t iter);
+
+typedef struct
+{
+    const char *name;
+    bench_fn_t fn;
+    bool cold;                                  // Drop the register shadow before every iteration
+    bench_fn_t prep;                            // Untimed, before every iteration
+    uint32_t budget_us;                         // Deadline given to fn, checked with slack_us, 0 unchecked
+    esp_err_t expect;                           // Result fn must leave in fault_rslt when budget_us is set
+} bench_case_t;
+
+typedef struct
+{
+    uint32_t transactions;
+    uint64_t bytes;
+    uint64_t wire_ns_100k;
+    uint64_t wire_ns_400k;
+} bench_wire_t;
+
+/* Allocation counting, the executable links with --wrap for each of these */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static unsigned long allocs;
+
+void *__wrap_malloc(size_t size)                { __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED); return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size)      { __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED); return __real_calloc(n, size); }
+void *__wrap_realloc(void *ptr, size_t size)    { __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED); return __real_realloc(ptr, size); }
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_sampler_t sampler;
+static max31790_fault_monitor_t monitor;
+static i2cmanager_token_t token;
+static bench_wire_t wire;
+static esp_err_t fault_rslt;
+static uint32_t slack_us;                       // Over a fault case budget, set from the bus clock in main()
+static const max31790sim_bus_cfg_t clk_100k = {.clk_hz = 100000};
+static const max31790sim_bus_cfg_t clk_400k = {.clk_hz = 400000};
+
+static max31790_master_config_t cfg =
+{
+    .adr = BENCH_ADR,
+    .port = BENCH_PORT,
+    .timeout_ms = 20,
+    .retries = 2,
+    .backoff_ms = 1,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5,
+                MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH,
+                MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x00,
+    .fault_mask_2 = 0x00
+};
+
+/* Counting transport, forwards to the simulator and prices each transfer at both clocks */
+static void bench_account(esp_err_t rslt, uint32_t bytes, bool repeated_start)
+{
+    if(rslt != ESP_OK)
+    {
+        bytes = 1;
+        repeated_start = false;
+    }
+
+    wire.transactions++;
+    wire.bytes += bytes;
+    wire.wire_ns_100k += MAX31790SIM_wire_time_ns(&clk_100k, bytes, repeated_start);
+    wire.wire_ns_400k += MAX31790SIM_wire_time_ns(&clk_400k, bytes, repeated_start);
+}
+
+static esp_err_t bench_write(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, const uint8_t *buff, size_t len, TickType_t timeout)
+{
+    esp_err_t rslt = max31790sim_backend.write(ctx, port, adr, reg, buff, len, timeout);
+
+    bench_account(rslt, 2 + len, false);
+
+    return rslt;
+}
+
+static esp_err_t bench_read(void *ctx, uint8_t port, uint8_t adr, uint8_t reg, uint8_t *buff, size_t len, TickType_t timeout)
+{
+    esp_err_t rslt = max31790sim_backend.read(ctx, port, adr, reg, buff, len, timeout);
+
+    bench_account(rslt, 3 + len, true);
+
+    return rslt;
+}
+
+static esp_err_t bench_recover(void *ctx, uint8_t port)
+{
+    return max31790sim_backend.recover(ctx, port);
+}
+
+static bool bench_sda_low(void *ctx, uint8_t port)
+{
+    return max31790sim_backend.sda_low(ctx, port);
+}
+
+static const i2cmanager_backend_t bench_backend = {.write = bench_write, .read = bench_read, .recover = bench_recover, .sda_low = bench_sda_low};
+
+/* Single API calls --------------------------------------------------------------------------- */
+static void b_initiate(uint32_t i)                  { MAX31790_initiate(&cfg); }
+static void b_resync(uint32_t i)                    { MAX31790_resync(&cfg); }
+static void b_flush(uint32_t i)                     { MAX31790_flush(&cfg); }
+static void b_set_master_config(uint32_t i)         { MAX31790_set_master_config(&cfg); }
+static void b_set_target_dutybits(uint32_t i)       { MAX31790_set_target_dutybits(&cfg, i % NUM_CHANNEL, i % (DUTYBITS_MAX + 1)); }
+static void b_set_target_duty(uint32_t i)           { MAX31790_set_target_duty(&cfg, i % NUM_CHANNEL, (i % 1000) / 10.0f); }
+static void b_set_target_rpm(uint32_t i)            { MAX31790_set_target_rpm(&cfg, i % NUM_CHANNEL, 1000 + (i % 2000)); }
+static void b_set_fault_mask(uint32_t i)            { MAX31790_set_fault_mask(&cfg, i % NUM_TACH_CHANNEL); }
+static void b_set_window(uint32_t i)                { MAX31790_set_window(&cfg, i & 0xFF, i % NUM_CHANNEL); }
+static void b_set_failed_fan_seq_start(uint32_t i)  { MAX31790_set_failed_fan_seq_start(&cfg, (i & 1) ? 0x45 : 0x44); }
+static void b_set_global_config(uint32_t i)         { MAX31790_set_global_config(&cfg, (i & 1) ? 0x20 : 0x00); }
+static void b_set_pwm_freq(uint32_t i)              { MAX31790_set_pwm_feq(&cfg, (i & 1) ? 0x44 : 0x33); }
+static void b_set_fan_config(uint32_t i)            { MAX31790_set_fan_config(&cfg, (i & 1) ? MAX31790_FAN_CFG_TACH_INPUT : MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5, i % NUM_CHANNEL); }
+static void b_set_fan_dynamic(uint32_t i)           { MAX31790_set_fan_dynamic(&cfg, (i & 1) ? 0x4C : 0x2C, i % NUM_CHANNEL); }
+static void b_get_dutybits(uint32_t i)              { uint16_t v; MAX31790_get_dutybits(&cfg, i % NUM_CHANNEL, false, &v); }
+static void b_get_target_dutybits(uint32_t i)       { uint16_t v; MAX31790_get_target_dutybits(&cfg, i % NUM_CHANNEL, &v); }
+static void b_get_duty(uint32_t i)                  { float v; MAX31790_get_duty(&cfg, i % NUM_CHANNEL, false, &v); }
+static void b_get_target_duty(uint32_t i)           { float v; MAX31790_get_target_duty(&cfg, i % NUM_CHANNEL, &v); }
+static void b_get_rpm(uint32_t i)                   { uint32_t v; MAX31790_get_rpm(&cfg, i % NUM_TACH_CHANNEL, false, &v); }
+static void b_get_target_tach(uint32_t i)           { uint32_t v; MAX31790_get_target_tach(&cfg, i % NUM_CHANNEL, &v); }
+static void b_get_all_rpm(uint32_t i)               { uint32_t v[NUM_TACH_CHANNEL]; MAX31790_get_all_rpm(&cfg, v); }
+static void b_get_regs(uint32_t i)                  { uint8_t v[REG_MAP_SIZE]; MAX31790_get_regs(&cfg, 0x00, v, REG_MAP_SIZE); }
+static void b_get_global_config(uint32_t i)         { uint8_t v; MAX31790_get_global_config(&cfg, &v); }
+static void b_get_pwm_freq(uint32_t i)              { uint8_t v; MAX31790_get_pwm_freq(&cfg, &v); }
+static void b_get_failed_fan_seq_opt(uint32_t i)    { uint8_t v; MAX31790_get_failed_fan_seq_opt(&cfg, &v); }
+static void b_get_fan_config(uint32_t i)            { uint8_t v; MAX31790_get_fan_config(&cfg, i % NUM_CHANNEL, &v); }
+static void b_get_fan_dynamic(uint32_t i)           { uint8_t v; MAX31790_get_fan_dynamic(&cfg, i % NUM_CHANNEL, &v); }
+static void b_get_fault_mask(uint32_t i)            { uint8_t v; MAX31790_get_fault_mask(&cfg, 1 + (i & 1), &v); }
+static void b_get_fault_status(uint32_t i)          { uint8_t v; MAX31790_get_fault_status(&cfg, 1 + (i & 1), &v); }
+static void b_get_window(uint32_t i)                { uint8_t v; MAX31790_get_window(&cfg, 0, i % NUM_CHANNEL, &v); }
+static void b_sampler_capture(uint32_t i)           { MAX31790_sampler_capture(&sampler); }
+
+static void b_set_all_target_dutybits(uint32_t i)
+{
+    uint16_t d[NUM_CHANNEL];
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        d[x] = (i + x * 50) % (DUTYBITS_MAX + 1);
+
+    MAX31790_set_all_target_dutybits(&cfg, d);
+}
+
+static void b_set_target_dutybits_async(uint32_t i)
+{
+    I2CMANAGER_token_init(&token);                                                                  // Semaphore created at setup, this only rearms it
+    if(MAX31790_set_target_dutybits_async(&cfg, i % NUM_CHANNEL, i % (DUTYBITS_MAX + 1), &token) == ESP_OK)
+        I2CMANAGER_token_wait(&token, portMAX_DELAY);
+}
+
+/* Composite scenarios ------------------------------------------------------------------------ */
+static void s_rpm_sweep_single(uint32_t i)
+{
+    uint32_t v;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+        MAX31790_get_rpm(&cfg, x, false, &v);
+}
+
+static void s_setpoint_update_single(uint32_t i)
+{
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_set_target_dutybits(&cfg, x, (i + x * 50) % (DUTYBITS_MAX + 1));
+}
+
+static void s_setpoint_update_batch(uint32_t i)
+{
+    max31790_batch_t batch;
+
+    MAX31790_batch_begin(&batch, &cfg);
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_batch_stage_dutybits(&batch, x, (i + x * 50) % (DUTYBITS_MAX + 1));
+    MAX31790_batch_commit(&batch);
+}
+
+static void s_fault_poll(uint32_t i)
+{
+    uint8_t v;
+
+    MAX31790_get_fault_status(&cfg, 1, &v);
+    MAX31790_get_fault_status(&cfg, 2, &v);
+}
+
+static void s_fault_poll_burst(uint32_t i)
+{
+    uint8_t v[2];
+
+    MAX31790_get_regs(&cfg, MAX31790_REG_FAN_FAULT_STATUS_2, v, sizeof(v));
+}
+
+static void s_control_loop(uint32_t i)                                                               // One 1 kHz control tick: measure, decide, actuate
+{
+    uint32_t rpm[NUM_TACH_CHANNEL];
+    uint16_t fans = 0;
+
+    MAX31790_get_all_rpm(&cfg, rpm);
+    MAX31790_get_fault_status_all(&cfg, &fans);
+    b_set_all_target_dutybits(i + rpm[0] % 8);
+}
+
+static void s_fault_service(uint32_t i)
+{
+    MAX31790_fault_service(&monitor, 0);
+}
+
+/* Fault injection, real time wire so the deadline is measured on the host clock ------------ */
+static void f_real_time(uint32_t i)                 { bus.cfg.real_time = true; bus.cfg.yield = true; }
+static void f_nak_once(uint32_t i)                  { f_real_time(i); MAX31790SIM_bus_inject_nak(&bus, 1); }
+static void f_nak_always(uint32_t i)                { f_real_time(i); MAX31790SIM_bus_inject_nak(&bus, 1000); }
+static void f_stuck_short(uint32_t i)               { f_real_time(i); MAX31790SIM_bus_inject_stuck(&bus, 5); }
+static void f_stuck_forever(uint32_t i)             { f_real_time(i); MAX31790SIM_bus_inject_stuck(&bus, UINT32_MAX); }
+static void f_stretch(uint32_t i)                   { f_real_time(i); bus.cfg.stretch_us = 50000; }
+
+static void f_read_by(uint32_t budget_us)
+{
+    uint32_t rpm[NUM_TACH_CHANNEL];
+
+    MAX31790_set_deadline(&cfg, esp_timer_get_time() + budget_us);
+    fault_rslt = MAX31790_get_all_rpm(&cfg, rpm);                                                   // Tach counts are volatile, always on the bus
+    MAX31790_set_deadline(&cfg, 0);
+}
+
+static void f_read_10ms(uint32_t i)                 { f_read_by(10000); }
+static void f_read_30ms(uint32_t i)                 { f_read_by(30000); }
+
+static void f_read_late(uint32_t i)
+{
+    uint32_t rpm[NUM_TACH_CHANNEL];
+
+    MAX31790_set_deadline(&cfg, esp_timer_get_time() - 1);
+    fault_rslt = MAX31790_get_all_rpm(&cfg, rpm);
+    MAX31790_set_deadline(&cfg, 0);
+}
+
+static const bench_case_t cases[] =
+{
+    {"initiate",                    b_initiate,                 true},
+    {"resync",                      b_resync,                   false},
+    {"flush",                       b_flush,                    false},
+    {"set_master_config",           b_set_master_config,        true},
+    {"set_master_config_warm",      b_set_master_config,        false},
+    {"set_target_dutybits",         b_set_target_dutybits,      false},
+    {"set_target_dutybits_async",   b_set_target_dutybits_async, false},
+    {"set_all_target_dutybits",     b_set_all_target_dutybits,  false},
+    {"set_target_duty",             b_set_target_duty,          false},
+    {"set_target_rpm",              b_set_target_rpm,           false},
+    {"set_fault_mask",              b_set_fault_mask,           false},
+    {"set_window",                  b_set_window,               false},
+    {"set_failed_fan_seq_start",    b_set_failed_fan_seq_start, false},
+    {"set_global_config",           b_set_global_config,        false},
+    {"set_pwm_freq",                b_set_pwm_freq,             false},
+    {"set_fan_config",              b_set_fan_config,           false},
+    {"set_fan_dynamic",             b_set_fan_dynamic,          false},
+    {"get_dutybits",                b_get_dutybits,             false},
+    {"get_target_dutybits",         b_get_target_dutybits,      true},
+    {"get_target_dutybits_warm",    b_get_target_dutybits,      false},
+    {"get_duty",                    b_get_duty,                 false},
+    {"get_target_duty",             b_get_target_duty,          true},
+    {"get_rpm",                     b_get_rpm,                  false},
+    {"get_target_tach",             b_get_target_tach,          true},
+    {"get_all_rpm",                 b_get_all_rpm,              false},
+    {"get_regs_all",                b_get_regs,                 true},
+    {"get_global_config",           b_get_global_config,        false},
+    {"get_pwm_freq",                b_get_pwm_freq,             true},
+    {"get_pwm_freq_warm",           b_get_pwm_freq,             false},
+    {"get_failed_fan_seq_opt",      b_get_failed_fan_seq_opt,   true},
+    {"get_fan_config",              b_get_fan_config,           true},
+    {"get_fan_dynamic",             b_get_fan_dynamic,          true},
+    {"get_fault_mask",              b_get_fault_mask,           true},
+    {"get_fault_status",            b_get_fault_status,         false},
+    {"get_window",                  b_get_window,               true},
+    {"sampler_capture",             b_sampler_capture,          false},
+    {"scenario_full_init",          b_initiate,                 true},
+    {"scenario_rpm_sweep_12",       s_rpm_sweep_single,         false},
+    {"scenario_rpm_sweep_12_burst", b_get_all_rpm,              false},
+    {"scenario_setpoint_6",         s_setpoint_update_single,   false},
+    {"scenario_setpoint_6_all",     b_set_all_target_dutybits,  false},
+    {"scenario_setpoint_6_batch",   s_setpoint_update_batch,    false},
+    {"scenario_fault_poll",         s_fault_poll,               false},
+    {"scenario_fault_poll_burst",   s_fault_poll_burst,         false},
+    {"scenario_fault_service",      s_fault_service,            false},
+    {"scenario_control_loop",       s_control_loop,             false},
+    {"fault_nak_retry",             f_read_10ms,    false,  f_nak_once,         10000,  ESP_OK},
+    {"fault_nak_persistent",        f_read_10ms,    false,  f_nak_always,       10000,  I2CMANAGER_ERR_NACK},
+    {"fault_stuck_recover",         f_read_30ms,    false,  f_stuck_short,      30000,  ESP_OK},
+    {"fault_stuck_permanent",       f_read_30ms,    false,  f_stuck_forever,    30000,  I2CMANAGER_ERR_BUS_STUCK},
+    {"fault_stretch_deadline",      f_read_10ms,    false,  f_stretch,          10000,  ESP_ERR_TIMEOUT},
+    {"fault_deadline_passed",       f_read_late,    false,  f_real_time,        1,      I2CMANAGER_ERR_DEADLINE},
+};
+
+static uint64_t bench_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long bench_run(const bench_case_t *c, uint32_t iters, bool *failed)
+{
+    const max31790sim_bus_cfg_t bus_cfg = bus.cfg;
+    uint64_t cpu_ns = 0;
+    unsigned long alloc_base = 0;
+    uint64_t start = 0;
+    int64_t wall_us = 0;
+    int64_t wall_us_max = 0;
+    bool pass = true;
+
+    if(c->budget_us && iters > BENCH_FAULT_ITERS)
+        iters = BENCH_FAULT_ITERS;
+
+    MAX31790_initiate(&cfg);                                                                        // Same known state for every case
+    memset(&wire, 0, sizeof(wire));
+    alloc_base = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+
+    for(uint32_t i = 0; i < iters; i++)
+    {
+        if(c->cold)
+            MAX31790_invalidate_cache(&cfg);
+        if(c->prep)
+            c->prep(i);
+
+        start = bench_cpu_ns();
+        wall_us = esp_timer_get_time();
+        c->fn(i);
+        wall_us = esp_timer_get_time() - wall_us;
+        cpu_ns += bench_cpu_ns() - start;
+
+        if(wall_us > wall_us_max)
+            wall_us_max = wall_us;
+
+        if(c->budget_us && (fault_rslt != c->expect || wall_us > (int64_t)c->budget_us + slack_us))
+            pass = false;
+
+        bus.cfg = bus_cfg;                                                                          // Injections last one iteration
+        bus.nak_next = 0;
+        bus.stuck_clocks = 0;
+    }
+
+    printf("{\"case\":\"%s\",\"iters\":%u,\"cold\":%s,\"tx\":%.3f,\"bytes\":%.3f,\"bus_us_100k\":%.3f,\"bus_us_400k\":%.3f,\"allocs\":%.3f,\"cpu_ns\":%.1f,\"wall_us_max\":%lld",
+           c->name, iters, c->cold ? "true" : "false",
+           (double)wire.transactions / iters,
+           (double)wire.bytes / iters,
+           (double)wire.wire_ns_100k / iters / 1000.0,
+           (double)wire.wire_ns_400k / iters / 1000.0,
+           (double)(__atomic_load_n(&allocs, __ATOMIC_RELAXED) - alloc_base) / iters,
+           (double)cpu_ns / iters,
+           (long long)wall_us_max);
+
+    if(c->budget_us)
+        printf(",\"budget_us\":%u,\"slack_us\":%u,\"last\":\"%s\",\"pass\":%s", c->budget_us, slack_us, I2CMANAGER_err_to_name(fault_rslt), pass ? "true" : "false");
+
+    printf("}\n");
+
+    *failed |= !pass;
+
+    return __atomic_load_n(&allocs, __ATOMIC_RELAXED) - alloc_base;
+}
+
+static void bench_usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n iterations] [-f name-filter] [-l] [-z]\n"
+                    "  Prints one JSON object per case, all figures are per iteration.\n"
+                    "  -z exits 1 if any selected case allocates from the heap.\n"
+                    "  Exits 1 if a fault case misses its result or latency bound.\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iters = BENCH_DEF_ITERS;
+    const char *filter = NULL;
+    bool list = false;
+    bool zero_alloc = false;
+    unsigned long allocated = 0;
+    bool failed = false;
+
+    for(int x = 1; x < argc; x++)
+    {
+        if(!strcmp(argv[x], "-n") && x + 1 < argc)
+            iters = strtoul(argv[++x], NULL, 0);
+        else if(!strcmp(argv[x], "-f") && x + 1 < argc)
+            filter = argv[++x];
+        else if(!strcmp(argv[x], "-l"))
+            list = true;
+        else if(!strcmp(argv[x], "-z"))
+            zero_alloc = true;
+        else
+        {
+            bench_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if(!iters)
+    {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    if(list)
+    {
+        for(size_t x = 0; x < sizeof(cases) / sizeof(cases[0]); x++)
+            printf("%s\n", cases[x].name);
+        return 0;
+    }
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, BENCH_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(BENCH_PORT, &bench_backend, &bus) != ESP_OK ||
+       I2CMANAGER_engine_start(BENCH_PORT, 16, 5) != ESP_OK ||
+       MAX31790_initiate(&cfg) != ESP_OK ||
+       MAX31790_sampler_init(&sampler, &cfg, NULL) != ESP_OK ||
+       MAX31790_fault_init(&monitor, &cfg, NULL) != ESP_OK ||
+       I2CMANAGER_token_init(&token) != ESP_OK)
+    {
+        fprintf(stderr, "bench: setup failed\n");
+        return 1;
+    }
+
+    slack_us = portTICK_PERIOD_MS * 1000 +                                                          // Deadlines reach the backend in whole ticks, rounded up
+               MAX31790SIM_wire_time_ns(&bus.cfg, 3 + 2 * NUM_TACH_CHANNEL, true) / 1000;          // and the tach burst on the wire when one falls finishes its bytes
+
+    MAX31790SIM_bus_step(&bus, 5000);                                                               // Let the simulated fans settle so tach counts are realistic
+
+    for(size_t x = 0; x < sizeof(cases) / sizeof(cases[0]); x++)
+        if(!filter || strstr(cases[x].name, filter))
+            allocated += bench_run(&cases[x], iters, &failed);
+
+    if(zero_alloc && allocated)
+    {
+        fprintf(stderr, "bench: %lu heap allocations on the transaction path\n", allocated);
+        return 1;
+    }
+
+    if(failed)
+    {
+        fprintf(stderr, "bench: fault case outside its bound\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+/******************************************************
+  Description: Cold and warm start against a simulated
+               chip: transactions, registers rewritten,
+               setpoints kept and the speed blip across
+               an MCU-only reset.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sim.h"
+
+#define BOOT_ADR            0x20
+#define BOOT_PORT           0
+#define BOOT_RUN_MS         6000                // Before the reset, fans at their setpoints
+#define BOOT_WATCH_MS       4000                // After the reset
+#define BOOT_BLIP_MAX       10                  // Permille of the speed before the reset
+#define BOOT_DUTY           300
+#define BOOT_RPM            1800
+#define BOOT_APP_DUTY       222                 // What the application writes after a cold start
+
+typedef struct
+{
+    const char *name;
+    bool running;                               // Chip configured and spinning before the reset
+    bool warm;                                  // MAX31790_initiate_warm() rather than MAX31790_initiate()
+    uint8_t dyn_ch2;                            // Requested FAN_DYN of channel 2, changed to force one rewrite
+    uint8_t expect_rewritten;
+    uint32_t expect_tx;                         // 0 unchecked
+    bool expect_kept;                           // Setpoints survive the reset, reported as resumed
+} boot_case_t;
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_master_config_t cfg;
+static bool failed;
+
+static const max31790_master_config_t cfg_init =
+{
+    .adr = BOOT_ADR,
+    .port = BOOT_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+static const boot_case_t cases[] =
+{
+    {"cold_initiate",           false,  false,  0x4C,   0,  0,  false},
+    {"cold_initiate_warm",      false,  true,   0x4C,   7,  0,  false},
+    {"warm_initiate",           true,   false,  0x4C,   0,  0,  false},
+    {"warm_initiate_warm",      true,   true,   0x4C,   0,  2,  true},
+    {"warm_one_changed",        true,   true,   0x6C,   1,  3,  true},
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "boot: %s\n", what);
+        failed = true;
+    }
+}
+
+static void boot_reset_mcu(void)                                                                    // Registry and driver state are gone, the chip is not
+{
+    if(cfg.i2c)
+        I2CMANAGER_detach(cfg.i2c);
+
+    cfg = cfg_init;
+}
+
+static void boot_case(const boot_case_t *c)
+{
+    uint8_t before[REG_MAP_SIZE] = {0};
+    float rpm_before[NUM_CHANNEL] = {0};
+    float blip = 0;
+    uint8_t rewritten = 0;
+    bool resumed = false;
+    uint32_t tx = 0;
+    esp_err_t err_ret = ESP_OK;
+    bool kept = true;
+    bool matches = true;
+
+    MAX31790SIM_init(&sim, BOOT_ADR);
+    boot_reset_mcu();
+
+    if(c->running)                                                                                  // Previous firmware left it running, channel 1 in RPM mode
+    {
+        MAX31790_initiate(&cfg);
+        MAX31790_set_target_dutybits(&cfg, 0, BOOT_DUTY);
+        MAX31790_set_target_dutybits(&cfg, 1, BOOT_DUTY);
+        MAX31790SIM_bus_step(&bus, BOOT_RUN_MS);
+        MAX31790_set_mode_bumpless(&cfg, 1, MAX31790_FAN_CFG_MODE_RPM);
+        MAX31790_set_target_rpm(&cfg, 1, BOOT_RPM);
+        MAX31790SIM_bus_step(&bus, BOOT_RUN_MS);
+
+        boot_reset_mcu();
+        cfg.fan_cfg[1] |= MAX31790_FAN_CFG_MODE_RPM;                                                // The firmware asks for what it ran with
+    }
+
+    cfg.fan_dyn[2] = c->dyn_ch2;
+
+    memcpy(before, sim.regs, sizeof(before));
+    memcpy(rpm_before, sim.rpm, sizeof(rpm_before));
+
+    tx = bus.transactions;
+    err_ret = c->warm ? MAX31790_initiate_warm(&cfg, &resumed, &rewritten) : MAX31790_initiate(&cfg);
+    tx = bus.transactions - tx;
+
+    if(!resumed)                                                                                    // Application boot defaults after a cold start
+        MAX31790_set_target_dutybits(&cfg, 0, BOOT_APP_DUTY);
+
+    for(uint8_t x = MAX31790_REG_TARGET_DUTY(0); x < MAX31790_REG_TARGET_COUNT(NUM_CHANNEL); x++)  // Setpoints as the previous firmware left them
+        kept &= sim.regs[x] == before[x];
+
+    matches &= (sim.regs[MAX31790_REG_GLOBAL_CONFIG] & ~MAX31790_GLO_I2C_WD_STATUS) == cfg.global_cfg;
+    matches &= !memcmp(&sim.regs[MAX31790_REG_FAN_CONFIG(0)], cfg.fan_cfg, NUM_CHANNEL);
+    matches &= !memcmp(&sim.regs[MAX31790_REG_FAN_DYNAMIC(0)], cfg.fan_dyn, NUM_CHANNEL);
+    matches &= sim.regs[MAX31790_REG_FAN_FAULT_MASK_1] == cfg.fault_mask_1 && sim.regs[MAX31790_REG_FAN_FAULT_MASK_2] == cfg.fault_mask_2;
+    matches &= sim.regs[MAX31790_REG_SEQ_START_CONFIG] == cfg.fan_failed_seq_start_cfg;
+
+    for(uint32_t t = 0; t < BOOT_WATCH_MS && c->running; t++)                                       // Largest excursion of either driven fan
+    {
+        MAX31790SIM_bus_step(&bus, 1);
+
+        for(uint8_t x = 0; x < 2; x++)
+        {
+            float dev = (sim.rpm[x] > rpm_before[x]) ? sim.rpm[x] - rpm_before[x] : rpm_before[x] - sim.rpm[x];
+
+            blip = (dev * PERMILLE_MAX / rpm_before[x] > blip) ? dev * PERMILLE_MAX / rpm_before[x] : blip;
+        }
+    }
+
+    printf("{\"case\":\"%s\",\"result\":\"%s\",\"tx\":%u,\"rewritten\":%u,\"resumed\":%s,\"config_matches\":%s,\"setpoints_kept\":%s,\"blip_permille\":%.1f}\n",
+           c->name, esp_err_to_name(err_ret), tx, rewritten, resumed ? "true" : "false", matches ? "true" : "false", kept ? "true" : "false", blip);
+
+    check("initiate failed", err_ret == ESP_OK);
+    check("config differs", matches);
+    check("rewrite count", !c->warm || rewritten == c->expect_rewritten);
+    check("resumed", !c->warm || resumed == c->expect_kept);
+    check("transactions", !c->expect_tx || tx == c->expect_tx);
+    check("setpoints", !c->expect_kept || kept);
+    check("speed blip", !c->expect_kept || blip <= BOOT_BLIP_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = (argc > 1) ? argv[1] : NULL;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, BOOT_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(BOOT_PORT, &max31790sim_backend, &bus) != ESP_OK)
+    {
+        fprintf(stderr, "boot: setup failed\n");
+        return 1;
+    }
+
+    for(size_t x = 0; x < sizeof(cases) / sizeof(cases[0]); x++)
+        if(!filter || strstr(cases[x].name, filter))
+            boot_case(&cases[x]);
+
+    return failed ? 1 : 0;
+}
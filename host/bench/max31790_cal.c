@@ -0,0 +1,275 @@
+/******************************************************
+  Description: Calibration sweep, persistence and
+               feed-forward end to end against simulated
+               fans with known start, stall and curves.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Cal.h"
+#include "MAX31790Sim.h"
+
+#define CAL_ADR             0x20
+#define CAL_PORT            0
+#define CAL_CURVE_TOL       30                  // Permille of full speed
+#define CAL_FF_FROM_RPM     900
+#define CAL_FF_TO_RPM       2400
+#define CAL_FF_WINDOW_MS    10000
+#define CAL_BAND            20                  // Permille of the target
+
+static const uint32_t fan_rpm_max[NUM_CHANNEL] = {3000, 2200, 4500, 1800, 3000, 5000};
+static const uint16_t fan_start[NUM_CHANNEL]   = {200, 250, 150, 300, 180, 220};
+static const uint16_t fan_stall[NUM_CHANNEL]   = {120, 150, 90, 200, 100, 140};
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_cal_t cal;
+static bool failed;
+
+static max31790_master_config_t cfg =
+{
+    .adr = CAL_ADR,
+    .port = CAL_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+/* External store, a flash page on a target -------------------------------------------------- */
+static struct
+{
+    uint8_t blob[MAX31790_CAL_BLOB_MAX];
+    size_t len;
+    uint32_t saves;
+} store;
+
+static esp_err_t store_save(void *ctx, const uint8_t *blob, size_t len)
+{
+    memcpy(store.blob, blob, len);
+    store.len = len;
+    store.saves++;
+
+    return ESP_OK;
+}
+
+static esp_err_t store_load(void *ctx, uint8_t *blob, size_t max, size_t *len)
+{
+    if(!store.len || store.len > max)
+        return ESP_ERR_NOT_FOUND;
+
+    memcpy(blob, store.blob, store.len);
+    *len = store.len;
+
+    return ESP_OK;
+}
+
+static const max31790_cal_store_ops_t store_ops = {store_save, store_load};
+
+/* Model time -------------------------------------------------------------------------------- */
+static uint64_t sim_ms;
+
+static void sim_wait(void *ctx, uint32_t ms)
+{
+    for(uint32_t x = 0; x < ms; x++)
+        MAX31790SIM_bus_step(&bus, 1);
+
+    sim_ms += ms;
+}
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "cal: %s\n", what);
+        failed = true;
+    }
+}
+
+static uint16_t permille_to_bits(uint16_t permille)
+{
+    return (permille * DUTYBITS_MAX + PERMILLE_MAX / 2) / PERMILLE_MAX;
+}
+
+/* Cases ------------------------------------------------------------------------------------- */
+static void cal_sweep(uint8_t channels)
+{
+    uint64_t t0 = sim_ms;
+    uint32_t tx = bus.transactions;
+
+    check("sweep failed", MAX31790_cal_sweep(&cal, channels) == ESP_OK);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        const max31790_cal_chan_t *c = &cal.chan[x];
+        int32_t err_max = 0;
+
+        if(!(channels & (0x01 << x)))
+            continue;
+
+        for(uint16_t d = c->stall_bits; d <= DUTYBITS_MAX; d += 8)                                  // Curve against the model across the turning range
+        {
+            int32_t truth = (int32_t)((fan_rpm_max[x] * (uint64_t)d) / DUTYBITS_MAX);
+            int32_t err = (int32_t)MAX31790_cal_dutybits_to_rpm(&cal, x, d) - truth;
+
+            err = (err < 0) ? -err : err;
+            err_max = (err > err_max) ? err : err_max;
+        }
+
+        printf("{\"case\":\"sweep\",\"channel\":%d,\"start_bits\":%d,\"start_true\":%d,\"stall_bits\":%d,\"stall_true\":%d,\"rpm_full\":%u,\"curve_err_max_rpm\":%d}\n",
+               x, c->start_bits, permille_to_bits(fan_start[x]), c->stall_bits, permille_to_bits(fan_stall[x]), c->rpm[MAX31790_CAL_POINTS - 1], err_max);
+
+        check("start duty off", c->start_bits >= permille_to_bits(fan_start[x]) && c->start_bits <= permille_to_bits(fan_start[x]) + cal.cfg.step_bits + 1);
+        check("stall duty off", c->stall_bits >= permille_to_bits(fan_stall[x]) && c->stall_bits <= permille_to_bits(fan_stall[x]) + cal.cfg.step_bits + 1);
+        check("curve off", err_max * PERMILLE_MAX <= (int32_t)(fan_rpm_max[x] * CAL_CURVE_TOL));
+    }
+
+    printf("{\"case\":\"sweep_cost\",\"channels\":\"0x%02x\",\"model_s\":%llu,\"tx\":%u}\n", channels, (unsigned long long)(sim_ms - t0) / 1000, bus.transactions - tx);
+}
+
+static void cal_reboot(const char *name, bool with_store, esp_err_t expect)
+{
+    max31790_cal_config_t cal_cfg = {.wait = sim_wait, .store = with_store ? &store_ops : NULL};
+    max31790_cal_chan_t before[NUM_CHANNEL];
+    uint32_t tx = 0;
+    esp_err_t err_ret = ESP_OK;
+    bool same = true;
+
+    memcpy(before, cal.chan, sizeof(before));
+
+    MAX31790_invalidate_cache(&cfg);                                                                // The driver forgets everything, the chip does not
+    MAX31790_cal_init(&cal, &cfg, &cal_cfg);
+
+    tx = bus.transactions;
+    err_ret = MAX31790_cal_load(&cal);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL && err_ret == ESP_OK; x++)                                   // Within the encoding's rounding
+    {
+        uint32_t full = before[x].rpm[MAX31790_CAL_POINTS - 1];
+
+        if(before[x].valid != cal.chan[x].valid)
+            same = false;
+        else if(before[x].valid && (cal.chan[x].stall_bits < before[x].stall_bits || cal.chan[x].stall_bits > before[x].stall_bits + 1 ||
+                                    cal.chan[x].start_bits < before[x].start_bits || cal.chan[x].start_bits > before[x].start_bits + 1))
+            same = false;
+
+        for(uint8_t p = 0; p < MAX31790_CAL_POINTS && before[x].valid; p++)
+            if(abs((int32_t)cal.chan[x].rpm[p] - (int32_t)before[x].rpm[p]) > (int32_t)(MAX31790_CAL_RPM_LSB / 2 + full / 0xFF + 1))
+                same = false;
+    }
+
+    printf("{\"case\":\"%s\",\"result\":\"%s\",\"tx\":%u,\"store_len\":%u,\"matches\":%s}\n",
+           name, esp_err_to_name(err_ret), bus.transactions - tx, (unsigned)store.len, same ? "true" : "false");
+
+    check(name, err_ret == expect && same);
+
+    if(err_ret != ESP_OK)                                                                           // Keep the sweep for the next case
+        memcpy(cal.chan, before, sizeof(before));
+}
+
+static void cal_save_blank_nak(void)                                                                 // A failed blanking write must not leave a save behind the stale record
+{
+    uint32_t saves = store.saves;
+    esp_err_t err_ret = ESP_OK;
+
+    cal.cfg.store = &store_ops;                                                                     // The last reboot ran without one
+    sim.regs[MAX31790_REG_USER_BYTE_0] = 0x01;                                                      // An older two channel record's header
+    MAX31790_invalidate_cache(&cfg);
+
+    MAX31790SIM_bus_inject_nak(&bus, 1);
+    err_ret = MAX31790_cal_save(&cal);
+
+    printf("{\"case\":\"save_blank_nak\",\"result\":\"%s\",\"store_saves\":%u}\n", I2CMANAGER_err_to_name(err_ret), store.saves - saves);
+
+    check("blanking write failure not reported", err_ret != ESP_OK && err_ret != ESP_ERR_INVALID_SIZE);
+    check("store saved behind a stale record", store.saves == saves);
+
+    check("save after the bus came back", MAX31790_cal_save(&cal) == ESP_OK && store.saves == saves + 1 && !sim.regs[MAX31790_REG_USER_BYTE_0]);
+}
+
+static uint32_t cal_ff_settle(bool feed_forward)
+{
+    uint16_t from = MAX31790_cal_rpm_to_dutybits(&cal, 0, CAL_FF_FROM_RPM);
+    uint32_t band = (CAL_FF_TO_RPM * CAL_BAND) / PERMILLE_MAX;
+    uint32_t settle_ms = 0;
+
+    MAX31790_set_fan_config(&cfg, MAX31790_FAN_CFG_TACH_INPUT, 0);                                  // Steady at the low speed in RPM mode
+    MAX31790_set_target_dutybits(&cfg, 0, from);
+    sim_wait(NULL, 6000);
+    MAX31790_set_mode_bumpless(&cfg, 0, MAX31790_FAN_CFG_MODE_RPM);
+    sim_wait(NULL, 2000);
+
+    if(feed_forward)
+        check("cal_set_rpm failed", MAX31790_cal_set_rpm(&cal, 0, CAL_FF_TO_RPM) == ESP_OK);
+    else
+        MAX31790_set_target_rpm(&cfg, 0, CAL_FF_TO_RPM);
+
+    for(uint32_t t = 1; t <= CAL_FF_WINDOW_MS; t++)
+    {
+        sim_wait(NULL, 1);
+
+        if(sim.rpm[0] > CAL_FF_TO_RPM + band || sim.rpm[0] < CAL_FF_TO_RPM - band)
+            settle_ms = t;
+    }
+
+    return settle_ms;
+}
+
+int main(int argc, char **argv)
+{
+    max31790_cal_config_t cal_cfg = {.wait = sim_wait, .store = &store_ops};
+    uint32_t settle_plain = 0;
+    uint32_t settle_ff = 0;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, CAL_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        sim.fan[x].rpm_max = fan_rpm_max[x];
+        sim.fan[x].start_permille = fan_start[x];
+        sim.fan[x].stall_permille = fan_stall[x];
+    }
+
+    if(I2CMANAGER_set_backend(CAL_PORT, &max31790sim_backend, &bus) != ESP_OK ||
+       MAX31790_initiate(&cfg) != ESP_OK ||
+       MAX31790_cal_init(&cal, &cfg, &cal_cfg) != ESP_OK)
+    {
+        fprintf(stderr, "cal: setup failed\n");
+        return 1;
+    }
+
+    sim_wait(NULL, 5000);
+
+    cal_reboot("load_blank", true, ESP_ERR_NOT_FOUND);
+
+    cal_sweep(0x03);                                                                                // Two channels fit the user bytes
+    cal_reboot("load_user_bytes", false, ESP_OK);
+
+    sim.regs[MAX31790_REG_USER_BYTE_5] ^= 0x10;                                                     // Corrupt, the store takes over
+    cal_reboot("load_corrupt_user_bytes", true, ESP_OK);
+
+    cal_sweep(0x3C);                                                                                // Six do not, the store holds them
+    cal_reboot("load_store", true, ESP_OK);
+    cal_reboot("load_store_missing", false, ESP_ERR_NOT_FOUND);
+    cal_save_blank_nak();
+
+    settle_plain = cal_ff_settle(false);
+    settle_ff = cal_ff_settle(true);
+
+    printf("{\"case\":\"feed_forward\",\"from_rpm\":%d,\"to_rpm\":%d,\"settle_ms_plain\":%u,\"settle_ms_ff\":%u,\"hops\":%u}\n",
+           CAL_FF_FROM_RPM, CAL_FF_TO_RPM, settle_plain, settle_ff, cal.hops);
+
+    check("feed-forward slower", settle_ff < settle_plain);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,379 @@
+/******************************************************
+  Description: Fan curve and PID control against
+               first order thermal zones cooled by
+               simulated fans in model time, then the
+               control task's release jitter in real
+               time.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "MAX31790.h"
+#include "MAX31790Control.h"
+#include "MAX31790Sim.h"
+
+#define CONTROL_ADR         0x20
+#define CONTROL_PORT        0
+#define CONTROL_PERIOD_MS   100                 // Model time tick
+#define CONTROL_RUN_MS      500000
+#define CONTROL_WARM_MS     5000
+#define CONTROL_AMB_C       25.0f
+#define CONTROL_CAP_J_C     50.0f               // Heat capacity of a zone
+#define CONTROL_H0_W_C      0.5f                // Conduction with the fan stopped
+#define CONTROL_H1_W_C      3.0f                // Added at full speed
+#define CONTROL_SETTLE_C    0.5f                // Held within this of the setpoint
+#define CONTROL_UNDERSHOOT  3.0f                // After the overload, at most this below the setpoint
+#define CONTROL_OVER_ON_MS  200000              // Zone A heater overload, saturates the fan
+#define CONTROL_OVER_OFF_MS 260000
+#define CONTROL_FAIL_ON_MS  50000               // Input 3 reads fail
+#define CONTROL_FAIL_OFF_MS 60000
+#define CONTROL_RT_PERIOD   20                  // Real time part
+#define CONTROL_RT_RUN_MS   1000                // Per window
+#define CONTROL_RT_WINDOWS  3                   // Probe and control alternate, the quietest window of each is compared
+#define CONTROL_RT_PRIO     5
+#define CONTROL_RT_LATE_US  500                 // Mean release lateness over the whole run
+#define CONTROL_RT_OWN_US   250                 // Mean lateness the control task may add over the probe's
+
+enum { IN_SWEEP = 0, IN_ZONE_A, IN_ZONE_B, IN_FLAKY, IN_COUNT };
+
+typedef struct
+{
+    float temp_c;
+    float heat_w;
+    uint8_t fan;                                // Tach input cooling it
+} zone_model_t;
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_control_t ctl;
+static float input_c[IN_COUNT];
+static bool flaky_fail;
+static bool failed;
+
+typedef struct                                  // Empty task on the same release clock, what the host alone costs
+{
+    uint32_t ticks;
+    uint32_t late_max_us;
+    uint64_t late_sum_us;
+    SemaphoreHandle_t done;
+} control_probe_t;
+
+static zone_model_t zone_a = {CONTROL_AMB_C, 30.0f, 1};
+static zone_model_t zone_b = {CONTROL_AMB_C, 25.0f, 2};
+
+static max31790_master_config_t cfg =
+{
+    .adr = CONTROL_ADR,
+    .port = CONTROL_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_MODE_RPM,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "control: %s\n", what);
+        failed = true;
+    }
+}
+
+static esp_err_t read_input(void *ctx, int32_t *temp_mc)
+{
+    float *temp_c = (float *)ctx;
+
+    if(temp_c == &input_c[IN_FLAKY] && flaky_fail)
+        return ESP_ERR_TIMEOUT;
+
+    *temp_mc = (int32_t)lroundf(*temp_c * 1000.0f);
+    return ESP_OK;
+}
+
+static void zone_step(zone_model_t *z, uint32_t dt_ms)                                              // C dT/dt = P - (h0 + h1 rpm / rpm_max)(T - Tamb)
+{
+    float h = CONTROL_H0_W_C + CONTROL_H1_W_C * sim.rpm[z->fan] / sim.fan[z->fan].rpm_max;
+
+    z->temp_c += (z->heat_w - h * (z->temp_c - CONTROL_AMB_C)) * (dt_ms / 1000.0f) / CONTROL_CAP_J_C;
+}
+
+static float curve_ref(const max31790_control_chan_config_t *c, float temp_c)                       // Floating point reference
+{
+    float t = temp_c * 1000.0f;
+
+    if(t <= c->curve[0].temp_mc)
+        return c->curve[0].out;
+
+    for(uint8_t x = 1; x < c->n_points; x++)
+        if(t <= c->curve[x].temp_mc)
+            return c->curve[x - 1].out + (c->curve[x].out - c->curve[x - 1].out) * (t - c->curve[x - 1].temp_mc) / (float)(c->curve[x].temp_mc - c->curve[x - 1].temp_mc);
+
+    return c->curve[c->n_points - 1].out;
+}
+
+static void control_config(max31790_control_config_t *cc, uint32_t period_ms)
+{
+    memset(cc, 0, sizeof(*cc));
+
+    cc->period_ms = period_ms;
+    cc->n_inputs = IN_COUNT;
+    for(uint8_t x = 0; x < IN_COUNT; x++)
+        cc->input[x] = (max31790_control_input_t){read_input, &input_c[x]};
+
+    cc->chan[0] = (max31790_control_chan_config_t)                                                  // Curve on a swept inlet temperature
+    {
+        .mode = MAX31790_CONTROL_CURVE, .space = MAX31790_CONTROL_DUTY, .inputs = 0x01 << IN_SWEEP, .n_points = 4,
+        .curve = {{25000, 80}, {35000, 160}, {50000, 300}, {65000, 511}}
+    };
+
+    cc->chan[1] = (max31790_control_chan_config_t)                                                  // Zone A held at 45 C, no feed-forward
+    {
+        .mode = MAX31790_CONTROL_PID, .space = MAX31790_CONTROL_DUTY, .inputs = 0x01 << IN_ZONE_A,
+        .setpoint_mc = 45000, .kp = MAX31790_CONTROL_Q16(30), .ki = MAX31790_CONTROL_Q16(1.5), .kd = MAX31790_CONTROL_Q16(20),
+        .out_min = 60, .out_max = DUTYBITS_MAX
+    };
+
+    cc->chan[2] = (max31790_control_chan_config_t)                                                  // Zone B held at 40 C through the chip's speed loop, curve feed-forward
+    {
+        .mode = MAX31790_CONTROL_PID, .space = MAX31790_CONTROL_RPM, .inputs = 0x01 << IN_ZONE_B, .n_points = 2,
+        .curve = {{30000, 600}, {50000, 2400}},
+        .setpoint_mc = 40000, .kp = MAX31790_CONTROL_Q16(150), .ki = MAX31790_CONTROL_Q16(10),
+        .out_min = 600, .out_max = 2800
+    };
+
+    cc->chan[3] = (max31790_control_chan_config_t)                                                  // Curve on an input that drops out
+    {
+        .mode = MAX31790_CONTROL_CURVE, .space = MAX31790_CONTROL_DUTY, .inputs = 0x01 << IN_FLAKY, .n_points = 2,
+        .curve = {{20000, 100}, {60000, 400}},
+        .out_min = 0, .out_max = 450
+    };
+}
+
+static void control_model(void)
+{
+    max31790_control_config_t cc;
+    max31790_control_stats_t stats;
+    uint32_t tx_max = 0;
+    uint32_t curve_err = 0;
+    float a_err_pre = 0;
+    float a_err_end = 0;
+    float b_err_end = 0;
+    float a_min_after = 100.0f;
+    uint32_t a_recover_ms = 0;
+    int64_t a_integ_sat = INT64_MIN;            // When the output first clamps in the overload
+    bool a_integ_held = true;
+    bool a_saturated = false;
+    bool flaky_ok = true;
+
+    control_config(&cc, CONTROL_PERIOD_MS);
+    input_c[IN_FLAKY] = 40.0f;
+
+    if(MAX31790_control_init(&ctl, &cfg, &cc) != ESP_OK)
+    {
+        fprintf(stderr, "control: init failed\n");
+        exit(1);
+    }
+
+    for(uint32_t t_ms = 0; t_ms < CONTROL_RUN_MS; t_ms += CONTROL_PERIOD_MS)
+    {
+        uint32_t tx = bus.transactions;
+        float want = 0;
+
+        input_c[IN_SWEEP] = 20.0f + 50.0f * t_ms / CONTROL_RUN_MS;
+        input_c[IN_ZONE_A] = zone_a.temp_c;
+        input_c[IN_ZONE_B] = zone_b.temp_c;
+        flaky_fail = t_ms >= CONTROL_FAIL_ON_MS && t_ms < CONTROL_FAIL_OFF_MS;
+        zone_a.heat_w = (t_ms >= CONTROL_OVER_ON_MS && t_ms < CONTROL_OVER_OFF_MS) ? 120.0f : 30.0f;
+
+        check("tick failed", MAX31790_control_tick(&ctl, (int64_t)(t_ms + CONTROL_PERIOD_MS) * 1000) == ESP_OK);
+        tx = bus.transactions - tx;
+        tx_max = (tx > tx_max) ? tx : tx_max;
+
+        want = curve_ref(&cc.chan[0], input_c[IN_SWEEP]);
+        curve_err = (uint32_t)fmaxf(curve_err, fabsf(want - ctl.chan[0].out));
+        check("curve not on the chip", REG_TO_LFTJST(9, sim.regs[MAX31790_REG_TARGET_DUTY(0)], sim.regs[MAX31790_REG_TARGET_DUTY(0) + 1]) == ctl.chan[0].out);
+
+        want = flaky_fail ? cc.chan[3].out_max : curve_ref(&cc.chan[3], input_c[IN_FLAKY]);
+        flaky_ok &= fabsf(want - ctl.chan[3].out) <= 1.0f;
+
+        for(uint32_t x = 0; x < CONTROL_PERIOD_MS; x += 10)                                         // Chip and zones at 10 ms
+        {
+            MAX31790SIM_bus_step(&bus, 10);
+            zone_step(&zone_a, 10);
+            zone_step(&zone_b, 10);
+        }
+
+        if(t_ms >= CONTROL_OVER_ON_MS - 30000 && t_ms < CONTROL_OVER_ON_MS)
+            a_err_pre = fmaxf(a_err_pre, fabsf(zone_a.temp_c - 45.0f));
+
+        if(t_ms >= CONTROL_OVER_ON_MS && t_ms < CONTROL_OVER_OFF_MS)
+        {
+            if(ctl.chan[1].out == DUTYBITS_MAX && a_integ_sat == INT64_MIN)
+                a_integ_sat = ctl.chan[1].integ;
+
+            a_saturated |= ctl.chan[1].out == DUTYBITS_MAX;
+            a_integ_held &= ctl.chan[1].out < DUTYBITS_MAX || ctl.chan[1].integ <= a_integ_sat;
+        }
+
+        if(t_ms >= CONTROL_OVER_OFF_MS)
+        {
+            a_min_after = fminf(a_min_after, zone_a.temp_c);
+            if(fabsf(zone_a.temp_c - 45.0f) > CONTROL_SETTLE_C)
+                a_recover_ms = t_ms - CONTROL_OVER_OFF_MS;
+        }
+
+        if(t_ms >= CONTROL_RUN_MS - 30000)
+        {
+            a_err_end = fmaxf(a_err_end, fabsf(zone_a.temp_c - 45.0f));
+            b_err_end = fmaxf(b_err_end, fabsf(zone_b.temp_c - 40.0f));
+        }
+    }
+
+    MAX31790_control_get_stats(&ctl, &stats);
+
+    printf("{\"part\":\"model\",\"ticks\":%u,\"writes\":%u,\"tx_per_tick_max\":%u,\"curve_err_bits\":%u,\"a_err_pre_c\":%.2f,\"a_min_after_c\":%.2f,"
+           "\"a_recover_ms\":%u,\"a_err_end_c\":%.2f,\"b_err_end_c\":%.2f,\"b_rpm\":%.0f,\"input_errors\":%u}\n",
+           stats.ticks, stats.writes, tx_max, curve_err, a_err_pre, a_min_after, a_recover_ms, a_err_end, b_err_end, sim.rpm[2], stats.input_errors);
+
+    check("curve off the reference", curve_err <= 1);
+    check("zone A not held before the overload", a_err_pre <= CONTROL_SETTLE_C);
+    check("zone A not saturated in the overload", a_saturated);
+    check("zone A integral wound up while clamped", a_integ_held);
+    check("zone A undershoot", a_min_after >= 45.0f - CONTROL_UNDERSHOOT);
+    check("zone A not held at the end", a_err_end <= CONTROL_SETTLE_C);
+    check("zone B not held in RPM mode", b_err_end <= CONTROL_SETTLE_C);
+    check("failed input not at full cooling", flaky_ok);
+    check("input errors miscounted", stats.input_errors == (CONTROL_FAIL_OFF_MS - CONTROL_FAIL_ON_MS) / CONTROL_PERIOD_MS);
+    check("more than one burst per run of channels", tx_max <= 3);                                 // Duty 1 - 2 and 4, RPM 3
+    check("write errors", !stats.write_errors);
+}
+
+static void control_probe_task(void *arg)                                                            // Same lateness measure as MAX31790_task_control()
+{
+    control_probe_t *probe = arg;
+    TickType_t wake = xTaskGetTickCount();
+    int64_t release_us = 0;
+
+    vTaskDelayUntil(&wake, 1);
+    release_us = esp_timer_get_time();
+
+    for(uint32_t x = 0; x < CONTROL_RT_RUN_MS / CONTROL_RT_PERIOD; x++)
+    {
+        int64_t start_us = esp_timer_get_time();
+        uint32_t late_us = (start_us > release_us) ? start_us - release_us : 0;
+
+        probe->late_max_us = (late_us > probe->late_max_us) ? late_us : probe->late_max_us;
+        probe->late_sum_us += late_us;
+        probe->ticks++;
+
+        release_us += (int64_t)CONTROL_RT_PERIOD * 1000;
+        xTaskDelayUntil(&wake, pdMS_TO_TICKS(CONTROL_RT_PERIOD));
+    }
+
+    xSemaphoreGive(probe->done);
+    vTaskDelete(NULL);
+}
+
+static void control_real_time(void)
+{
+    max31790_control_config_t cc;
+    max31790_control_stats_t stats = {0};
+    max31790_control_stats_t prev = {0};
+    control_probe_t probe = {.done = xSemaphoreCreateBinary()};
+    uint32_t expect = CONTROL_RT_RUN_MS / CONTROL_RT_PERIOD;
+    uint32_t probe_mean_us = UINT32_MAX;
+    uint32_t ctl_mean_us = UINT32_MAX;
+    uint32_t ticks_min = UINT32_MAX;
+    uint32_t ticks_max = 0;
+
+    bus.cfg.real_time = true;
+    bus.cfg.yield = true;
+    bus.cfg.auto_step = true;
+    bus.last_step_us = esp_timer_get_time();
+
+    control_config(&cc, CONTROL_RT_PERIOD);
+    if(!probe.done || MAX31790_control_init(&ctl, &cfg, &cc) != ESP_OK)
+    {
+        fprintf(stderr, "control: real time setup failed\n");
+        exit(1);
+    }
+
+    for(uint32_t w = 0; w < CONTROL_RT_WINDOWS; w++)
+    {
+        uint32_t ticks = 0;
+        uint32_t mean_us = 0;
+
+        probe.ticks = 0;
+        probe.late_sum_us = 0;
+        if(xTaskCreate(control_probe_task, "control_probe", 4096, &probe, CONTROL_RT_PRIO, NULL) != pdPASS)
+        {
+            fprintf(stderr, "control: probe start failed\n");
+            exit(1);
+        }
+        xSemaphoreTake(probe.done, portMAX_DELAY);
+        mean_us = probe.late_sum_us / probe.ticks;
+        probe_mean_us = (mean_us < probe_mean_us) ? mean_us : probe_mean_us;
+
+        if(MAX31790_control_start(&ctl, CONTROL_RT_PRIO, 0) != ESP_OK)
+        {
+            fprintf(stderr, "control: task start failed\n");
+            exit(1);
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(CONTROL_RT_RUN_MS));
+        MAX31790_control_stop(&ctl);
+        MAX31790_control_get_stats(&ctl, &stats);
+
+        ticks = stats.ticks - prev.ticks;
+        mean_us = ticks ? (stats.late_sum_us - prev.late_sum_us) / ticks : UINT32_MAX;
+        ctl_mean_us = (mean_us < ctl_mean_us) ? mean_us : ctl_mean_us;
+        ticks_min = (ticks < ticks_min) ? ticks : ticks_min;
+        ticks_max = (ticks > ticks_max) ? ticks : ticks_max;
+        prev = stats;
+    }
+
+    printf("{\"part\":\"real_time\",\"period_ms\":%d,\"windows\":%d,\"ticks\":%u,\"overruns\":%u,\"late_max_us\":%u,\"late_mean_us\":%llu,"
+           "\"late_mean_quiet_us\":%u,\"probe_late_max_us\":%u,\"probe_late_mean_quiet_us\":%u,\"work_max_us\":%u}\n",
+           CONTROL_RT_PERIOD, CONTROL_RT_WINDOWS, stats.ticks, stats.overruns, stats.late_max_us,
+           (unsigned long long)(stats.ticks ? stats.late_sum_us / stats.ticks : 0), ctl_mean_us,
+           probe.late_max_us, probe_mean_us, stats.work_max_us);
+
+    check("ticks missing", ticks_min + 2 >= expect && ticks_max <= expect + 2);
+    check("overruns", !stats.overruns);
+    check("release jitter over a period", stats.late_max_us < CONTROL_RT_PERIOD * 1000);
+    check("mean release lateness", stats.late_sum_us / (stats.ticks ? stats.ticks : 1) < CONTROL_RT_LATE_US);
+    check("control task later than an empty task", ctl_mean_us <= probe_mean_us + CONTROL_RT_OWN_US);
+    check("tick longer than the period", stats.work_max_us < CONTROL_RT_PERIOD * 1000);
+
+    vSemaphoreDelete(probe.done);
+}
+
+int main(int argc, char **argv)
+{
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, CONTROL_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(CONTROL_PORT, &max31790sim_backend, &bus) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK)
+    {
+        fprintf(stderr, "control: setup failed\n");
+        return 1;
+    }
+
+    MAX31790SIM_bus_step(&bus, CONTROL_WARM_MS);
+    MAX31790_clear_fault_status(&cfg, (0x01 << NUM_TACH_CHANNEL) - 1);
+
+    control_model();
+    control_real_time();
+
+    return failed ? 1 : 0;
+}
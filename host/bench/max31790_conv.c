@@ -0,0 +1,224 @@
+/******************************************************
+  Description: Integer duty and tach conversions swept
+               over every input value, speed range and
+               pulse count against the datasheet formula
+               in double precision, then timed per call.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sim.h"
+
+#define CONV_ADR            0x20
+#define CONV_PORT           0
+#define CONV_TIME_CALLS     1000000             // Per timed conversion
+
+static const uint8_t sr_value[NUM_CHANNEL] = {1, 2, 4, 8, 16, 32};
+static const uint8_t np_value[] = {1, 2, 3, 4, 255};   // Pulses per revolution, common fans and the field's limit
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static bool failed;
+
+static max31790_master_config_t cfg =
+{
+    .adr = CONV_ADR,
+    .port = CONV_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {MAX31790_FAN_DYN_SR_1 | 0x0C, MAX31790_FAN_DYN_SR_2 | 0x0C, MAX31790_FAN_DYN_SR_4 | 0x0C,   // One speed range per channel,
+                MAX31790_FAN_DYN_SR_8 | 0x0C, MAX31790_FAN_DYN_SR_16 | 0x0C, MAX31790_FAN_DYN_SR_32 | 0x0C}, // the sweep covers all six at once
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2}
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "conv: %s\n", what);
+        failed = true;
+    }
+}
+
+static uint32_t conv_ref_rpm(uint8_t fan_number, uint16_t count)                                     // RPM = 60 * SR * 8192 / (NP * count)
+{
+    if(!count)
+        return 0;
+
+    return lround(60.0 * 8192.0 * sr_value[FAN_TO_CHAN(fan_number)] / ((double)count * cfg.fan_hallcount[fan_number]));
+}
+
+static uint16_t conv_ref_count(uint8_t channel, uint32_t rpm)                                       // The same formula solved for the count
+{
+    long count = 0;
+
+    rpm = CONSTRAIN(rpm, RPM_MIN, RPM_MAX);
+    count = lround(60.0 * 8192.0 * sr_value[channel] / ((double)rpm * cfg.fan_hallcount[channel]));
+
+    return CONSTRAIN(count, 1, TACH_COUNT_MAX);
+}
+
+static void conv_set_np(uint8_t np)
+{
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+        cfg.fan_hallcount[x] = np;
+}
+
+static void conv_duty(void)
+{
+    uint32_t miss_bits = 0;
+    uint32_t miss_permille = 0;
+    uint32_t miss_round_trip = 0;
+    uint32_t miss_fduty = 0;
+
+    for(uint16_t bits = 0; bits <= DUTYBITS_MAX + 1; bits++)                                        // One past the top, clamped
+    {
+        uint16_t permille = MAX31790_bits_to_permille(bits);
+
+        miss_bits += permille != lround(CONSTRAIN(bits, 0, DUTYBITS_MAX) * (double)PERMILLE_MAX / DUTYBITS_MAX);
+        miss_round_trip += bits <= DUTYBITS_MAX && MAX31790_permille_to_bits(permille) != bits;   // 0.1 % is finer than a duty step
+        miss_fduty += bits <= DUTYBITS_MAX && MAX31790_fduty_to_bits(MAX31790_bits_to_fduty(bits)) != bits;
+    }
+
+    for(uint16_t permille = 0; permille <= PERMILLE_MAX + 1; permille++)
+        miss_permille += MAX31790_permille_to_bits(permille) != lround(CONSTRAIN(permille, 0, PERMILLE_MAX) * (double)DUTYBITS_MAX / PERMILLE_MAX);
+
+    printf("{\"part\":\"duty\",\"bits\":%d,\"permille\":%d,\"bits_to_permille_miss\":%u,\"permille_to_bits_miss\":%u,\"round_trip_miss\":%u,\"fduty_round_trip_miss\":%u}\n",
+           DUTYBITS_MAX + 2, PERMILLE_MAX + 2, miss_bits, miss_permille, miss_round_trip, miss_fduty);
+
+    check("bits to permille", miss_bits == 0);
+    check("permille to bits", miss_permille == 0);
+    check("duty round trip through permille", miss_round_trip == 0);
+    check("duty round trip through float", miss_fduty == 0);
+}
+
+static void conv_tach(void)
+{
+    uint16_t counts[NUM_TACH_CHANNEL];
+    uint32_t rpm[NUM_TACH_CHANNEL];
+    uint64_t checked_rpm = 0;
+    uint64_t checked_count = 0;
+    uint32_t miss_rpm = 0;
+    uint32_t miss_batch = 0;
+    uint32_t miss_count = 0;
+
+    for(uint8_t n = 0; n < sizeof(np_value); n++)
+    {
+        conv_set_np(np_value[n]);
+
+        for(uint32_t count = 0; count <= TACH_COUNT_MAX; count++)                                   // 0 is an unpopulated input
+        {
+            for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+                counts[x] = count;
+
+            MAX31790_counts_to_rpm(&cfg, counts, rpm);
+
+            for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+            {
+                uint32_t want = conv_ref_rpm(x, count);
+
+                miss_rpm += MAX31790_count_to_rpm(&cfg, x, count) != want;
+                miss_batch += rpm[x] != want;
+                checked_rpm++;
+            }
+        }
+
+        for(uint32_t r = 0; r <= RPM_MAX + 1; r++)                                                  // Both clamps included
+        {
+            for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+                miss_count += MAX31790_rpm_to_count(&cfg, x, r) != conv_ref_count(x, r);
+
+            checked_count += NUM_CHANNEL;
+        }
+    }
+
+    printf("{\"part\":\"tach\",\"speed_ranges\":%d,\"pulse_counts\":%zu,\"count_to_rpm\":%llu,\"rpm_to_count\":%llu,"
+           "\"count_to_rpm_miss\":%u,\"counts_to_rpm_miss\":%u,\"rpm_to_count_miss\":%u}\n",
+           NUM_CHANNEL, sizeof(np_value), (unsigned long long)checked_rpm, (unsigned long long)checked_count, miss_rpm, miss_batch, miss_count);
+
+    check("count to rpm", miss_rpm == 0);
+    check("snapshot counts to rpm", miss_batch == 0);
+    check("rpm to count", miss_count == 0);
+}
+
+static void conv_time(void)
+{
+    uint16_t counts[NUM_TACH_CHANNEL];
+    uint32_t rpm[NUM_TACH_CHANNEL];
+    uint32_t sink = 0;
+    int64_t us[6];
+
+    conv_set_np(2);
+
+    us[0] = esp_timer_get_time();
+    for(uint32_t x = 0; x < CONV_TIME_CALLS; x++)
+        sink += MAX31790_count_to_rpm(&cfg, x % NUM_TACH_CHANNEL, 1 + (x & TACH_COUNT_MAX) % TACH_COUNT_MAX);
+    us[0] = esp_timer_get_time() - us[0];
+
+    us[1] = esp_timer_get_time();
+    for(uint32_t x = 0; x < CONV_TIME_CALLS; x++)
+        sink += conv_ref_rpm(x % NUM_TACH_CHANNEL, 1 + (x & TACH_COUNT_MAX) % TACH_COUNT_MAX);
+    us[1] = esp_timer_get_time() - us[1];
+
+    us[2] = esp_timer_get_time();
+    for(uint32_t x = 0; x < CONV_TIME_CALLS; x++)
+        sink += MAX31790_rpm_to_count(&cfg, x % NUM_CHANNEL, RPM_MIN + x * 7);
+    us[2] = esp_timer_get_time() - us[2];
+
+    us[3] = esp_timer_get_time();
+    for(uint32_t x = 0; x < CONV_TIME_CALLS / NUM_TACH_CHANNEL; x++)
+    {
+        for(uint8_t y = 0; y < NUM_TACH_CHANNEL; y++)
+            counts[y] = 1 + (x + y) % TACH_COUNT_MAX;
+
+        MAX31790_counts_to_rpm(&cfg, counts, rpm);
+        sink += rpm[x % NUM_TACH_CHANNEL];
+    }
+    us[3] = esp_timer_get_time() - us[3];
+
+    us[4] = esp_timer_get_time();
+    for(uint32_t x = 0; x < CONV_TIME_CALLS; x++)
+        sink += MAX31790_bits_to_permille(x & DUTYBITS_MAX);
+    us[4] = esp_timer_get_time() - us[4];
+
+    us[5] = esp_timer_get_time();
+    for(uint32_t x = 0; x < CONV_TIME_CALLS; x++)
+        sink += MAX31790_permille_to_bits(x % (PERMILLE_MAX + 1));
+    us[5] = esp_timer_get_time() - us[5];
+
+    __asm__ volatile("" : : "r"(sink) : "memory");                                                 // Keep the results
+
+    printf("{\"part\":\"time\",\"calls\":%d,\"count_to_rpm_ns\":%.2f,\"libm_rpm_ns\":%.2f,\"rpm_to_count_ns\":%.2f,"
+           "\"counts_to_rpm_ns_per_input\":%.2f,\"bits_to_permille_ns\":%.2f,\"permille_to_bits_ns\":%.2f}\n",
+           CONV_TIME_CALLS, us[0] * 1000.0 / CONV_TIME_CALLS, us[1] * 1000.0 / CONV_TIME_CALLS, us[2] * 1000.0 / CONV_TIME_CALLS,
+           us[3] * 1000.0 / CONV_TIME_CALLS, us[4] * 1000.0 / CONV_TIME_CALLS, us[5] * 1000.0 / CONV_TIME_CALLS);
+}
+
+int main(int argc, char **argv)
+{
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, CONV_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(CONV_PORT, &max31790sim_backend, &bus) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK)
+    {
+        fprintf(stderr, "conv: setup failed\n");
+        return 1;
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        check("speed range not applied", cfg.tach_k[x] == TACH_K(sr_value[x]) && cfg.tach_k[x + NUM_CHANNEL] == TACH_K(sr_value[x]));
+
+    conv_duty();
+    conv_tach();
+    conv_time();
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+/******************************************************
+  Description: Typed C++ register layer. Pins every
+               field against the datasheet layout at
+               compile time, then checks the C and C++
+               paths write the same register map and
+               times their batch staging.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "MAX31790.hpp"
+
+extern "C" {
+#include <esp_timer.h>
+#include "MAX31790Sim.h"
+}
+
+#define CXX_ADR_C           0x20                // Configured through the C calls
+#define CXX_ADR_CXX         0x21                // Through MAX31790.hpp
+#define CXX_PORT            0
+#define CXX_ITER            1000000
+
+using namespace max31790;
+
+/* Datasheet layout, Tables 3 - 7 ----------------------------------------------------------- */
+static_assert(global_config::addr == 0x00 && pwm_frequency::addr == 0x01 && failed_fan_seq_start::addr == 0x14, "");
+static_assert(fan_config::addr<0> == 0x02 && fan_config::addr<5> == 0x07, "");
+static_assert(fan_dynamics::addr<0> == 0x08 && fan_dynamics::addr<5> == 0x0D, "");
+static_assert(tach_count::addr<0> == 0x18 && tach_count::addr<11> == 0x2E, "");
+static_assert(pwm_duty::addr<0> == 0x30 && pwm_duty::addr<5> == 0x3A, "");
+static_assert(target_duty::addr<0> == 0x40 && target_duty::addr<5> == 0x4A, "");
+static_assert(target_count::addr<0> == 0x50 && target_count::addr<5> == 0x5A, "");
+
+static_assert(global_config::run_standby::mask == 0x80 && global_config::reset::mask == 0x40 && global_config::bus_timeout_off::mask == 0x20, "");
+static_assert(global_config::osc::mask == 0x08 && global_config::i2c_watchdog::mask == 0x06 && global_config::watchdog_status::mask == 0x01, "");
+static_assert(pwm_frequency::channels_1_3::mask == 0x0F && pwm_frequency::channels_4_6::mask == 0xF0, "");
+static_assert(fan_config::control_mode::mask == 0x80 && fan_config::spin_up_time::mask == 0x60 && fan_config::monitor_only::mask == 0x10, "");
+static_assert(fan_config::tach_input::mask == 0x08 && fan_config::locked_rotor::mask == 0x04 && fan_config::locked_high::mask == 0x02, "");
+static_assert(fan_config::pin_is_tach::mask == 0x01, "");
+static_assert(fan_dynamics::range::mask == 0xE0 && fan_dynamics::roc::mask == 0x1C && fan_dynamics::asymmetric::mask == 0x02, "");
+static_assert(failed_fan_seq_start::start_delay::mask == 0xE0 && failed_fan_seq_start::on_failure::mask == 0x0C && failed_fan_seq_start::queue::mask == 0x03, "");
+
+static_assert(fan_config::spin_up_time::encode(spin_up::ms500) == 0x20 && fan_config::spin_up_time::encode(spin_up::s1) == 0x40 &&
+              fan_config::spin_up_time::encode(spin_up::s2) == 0x60, "");
+static_assert(fan_dynamics::range::encode(speed_range::x1) == 0x00 && fan_dynamics::range::encode(speed_range::x8) == 0x60 &&
+              fan_dynamics::range::encode(speed_range::x16) == 0x80 && fan_dynamics::range::encode(speed_range::x32) == 0xA0, "");
+static_assert(fan_dynamics::roc::encode(rate_of_change::ms125) == 0x1C, "");
+static_assert(failed_fan_seq_start::start_delay::encode(seq_start::ms1000) == 0x60 && failed_fan_seq_start::start_delay::encode(seq_start::ms4000) == 0xA0, "");
+static_assert(failed_fan_seq_start::on_failure::encode(failed_fan::zero) == 0x00 && failed_fan_seq_start::on_failure::encode(failed_fan::full_all) == 0x0C, "");
+static_assert(failed_fan_seq_start::queue::encode(fault_queue::q6) == 0x03, "");
+static_assert(pwm_frequency::channels_4_6::encode(pwm_freq::khz25) == 0xB0, "");
+
+static_assert(target_duty::value::encode(511)[0] == 0xFF && target_duty::value::encode(511)[1] == 0x80, "9 bit, left justified");
+static_assert(target_count::value::encode(2047)[0] == 0xFF && target_count::value::encode(2047)[1] == 0xE0, "11 bit, left justified");
+static_assert(tach_count::value::decode(0x12, 0x34) == 0x091, "");
+static_assert(word<9>::max == DUTYBITS_MAX && word<11>::max == TACH_COUNT_MAX, "");
+
+/* The C options, as fixed against the same tables ------------------------------------------- */
+static_assert(MAX31790_FAN_CFG_SPIN_UP_0_5 == fan_config::spin_up_time::encode(spin_up::ms500), "");
+static_assert(MAX31790_FAN_CFG_SPIN_UP_1 == fan_config::spin_up_time::encode(spin_up::s1), "");
+static_assert(MAX31790_FAN_CFG_SPIN_UP_2 == fan_config::spin_up_time::encode(spin_up::s2), "");
+static_assert(MAX31790_FAN_DYN_SR_8 == fan_dynamics::range::encode(speed_range::x8), "");
+static_assert(MAX31790_FAN_DYN_SR_16 == fan_dynamics::range::encode(speed_range::x16), "");
+static_assert(MAX31790_FAN_FAILED_SEQ_SSD_1000 == failed_fan_seq_start::start_delay::encode(seq_start::ms1000), "");
+static_assert(MAX31790_FAN_FAILED_SEQ_FFO_0 == failed_fan_seq_start::on_failure::encode(failed_fan::zero), "");
+static_assert(MAX31790_FAN_FAILED_SEQ_FFO_A100 == failed_fan_seq_start::on_failure::encode(failed_fan::full_all), "");
+static_assert(MAX31790_FAN_FAILED_SEQ_FFQ_6 == failed_fan_seq_start::queue::encode(fault_queue::q6), "");
+
+/* Whole values compose at compile time ----------------------------------------------------- */
+constexpr value<fan_dynamics> dyn_por = value<fan_dynamics>().set<fan_dynamics::range>(speed_range::x4).set<fan_dynamics::roc>(rate_of_change::ms7_81);
+constexpr value<failed_fan_seq_start> seq_def = value<failed_fan_seq_start>().set<failed_fan_seq_start::start_delay>(seq_start::ms500)
+                                                                            .set<failed_fan_seq_start::on_failure>(failed_fan::keep)
+                                                                            .set<failed_fan_seq_start::queue>(fault_queue::q2);
+constexpr value<fan_config> cfg_rpm = value<fan_config>().set<fan_config::control_mode>(mode::rpm).set<fan_config::tach_input>(true)
+                                                         .set<fan_config::spin_up_time>(spin_up::s1);
+constexpr value<fan_config> cfg_pwm = value<fan_config>().set<fan_config::tach_input>(true).set<fan_config::spin_up_time>(spin_up::ms500);
+
+static_assert(dyn_por.raw() == MAX31790_POR_FAN_DYNAMIC, "");
+static_assert(seq_def.raw() == 0x45, "");
+static_assert(cfg_rpm.raw() == (MAX31790_FAN_CFG_MODE_RPM | MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_1), "");
+static_assert(cfg_rpm.get<fan_config::control_mode>() == mode::rpm && cfg_rpm.get<fan_config::spin_up_time>() == spin_up::s1, "");
+static_assert(value<fan_config>(0xFF).set<fan_config::spin_up_time>(spin_up::none).raw() == 0x9F, "Other fields kept");
+
+#if defined(MAX31790_CXX_EXPECT_FAIL)                                                              // Each of these must stop the build
+static_assert(fan_config::addr<6>, "");
+static_assert(value<fan_config>().set<fan_dynamics::range>(speed_range::x1).raw(), "");
+static_assert(tach_count::addr<12>, "");
+#endif
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim_c;
+static max31790sim_dev_t sim_cxx;
+static bool failed;
+
+static max31790_master_config_t cfg_c = {};
+static max31790_master_config_t cfg_cxx = {};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "cxx: %s\n", what);
+        failed = true;
+    }
+}
+
+static void cxx_dev(max31790_master_config_t *dev, uint8_t adr)
+{
+    static const uint8_t hall[NUM_TACH_CHANNEL] = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2};
+
+    dev->adr = adr;
+    dev->port = CXX_PORT;
+    dev->fan_failed_seq_start_cfg = 0x45;
+    memset(dev->fan_cfg, MAX31790_FAN_CFG_TACH_INPUT, NUM_CHANNEL);
+    memset(dev->fan_dyn, MAX31790_POR_FAN_DYNAMIC, NUM_CHANNEL);
+    memcpy(dev->fan_hallcount, hall, NUM_TACH_CHANNEL);
+    dev->fault_mask_1 = 0x3F;
+    dev->fault_mask_2 = 0x3F;
+}
+
+extern "C" __attribute__((noinline)) void probe_c_stage(max31790_batch_t *batch, const uint16_t *dutybits)   // Sizes compared by the max31790_cxx_size target
+{
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_batch_stage_dutybits(batch, x, dutybits[x]);
+}
+
+extern "C" __attribute__((noinline)) void probe_cxx_stage(max31790_batch_t *batch, const uint16_t *dutybits)
+{
+    stage_dutybits<0>(batch, dutybits[0]);
+    stage_dutybits<1>(batch, dutybits[1]);
+    stage_dutybits<2>(batch, dutybits[2]);
+    stage_dutybits<3>(batch, dutybits[3]);
+    stage_dutybits<4>(batch, dutybits[4]);
+    stage_dutybits<5>(batch, dutybits[5]);
+}
+
+extern "C" __attribute__((noinline)) uint8_t probe_c_compose(void)                                 // What a caller builds by hand from the C options
+{
+    return MAX31790_FAN_CFG_MODE_RPM | MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_1;
+}
+
+extern "C" __attribute__((noinline)) uint8_t probe_cxx_compose(void)
+{
+    return cfg_rpm.raw();
+}
+
+static int64_t cxx_time(void (*probe)(max31790_batch_t *, const uint16_t *), max31790_batch_t *batch)
+{
+    uint16_t duty[NUM_CHANNEL] = {0};
+    int64_t start = esp_timer_get_time();
+
+    for(uint32_t i = 0; i < CXX_ITER; i++)
+    {
+        for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+            duty[x] = (i + x * 37) & 0x1FF;
+
+        probe(batch, duty);
+        __asm__ volatile("" : : "r"(batch) : "memory");                                            // Keep the stores
+    }
+
+    return esp_timer_get_time() - start;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint16_t duty[NUM_CHANNEL] = {0, 100, 200, 300, 400, 511};
+    max31790_batch_t batch_c;
+    max31790_batch_t batch_cxx;
+    int64_t c_us = 0;
+    int64_t cxx_us = 0;
+
+    cxx_dev(&cfg_c, CXX_ADR_C);
+    cxx_dev(&cfg_cxx, CXX_ADR_CXX);
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim_c, CXX_ADR_C);
+    MAX31790SIM_init(&sim_cxx, CXX_ADR_CXX);
+    MAX31790SIM_bus_attach(&bus, &sim_c);
+    MAX31790SIM_bus_attach(&bus, &sim_cxx);
+
+    if(I2CMANAGER_set_backend(CXX_PORT, &max31790sim_backend, &bus) != ESP_OK || MAX31790_initiate(&cfg_c) != ESP_OK || MAX31790_initiate(&cfg_cxx) != ESP_OK)
+    {
+        fprintf(stderr, "cxx: setup failed\n");
+        return 1;
+    }
+
+    MAX31790_set_fan_config(&cfg_c, probe_c_compose(), 2);                                          // Same settings both ways
+    MAX31790_set_fan_dynamic(&cfg_c, MAX31790_FAN_DYN_SR_8 | MAX31790_FAN_DYN_PWM_ROC_7_8, 2);
+    MAX31790_set_failed_fan_seq_start(&cfg_c, MAX31790_FAN_FAILED_SEQ_SSD_1000 | MAX31790_FAN_FAILED_SEQ_FFO_0 | MAX31790_FAN_FAILED_SEQ_FFQ_6);
+    MAX31790_set_target_rpm(&cfg_c, 2, 1500);
+    MAX31790_batch_begin(&batch_c, &cfg_c);
+    probe_c_stage(&batch_c, duty);
+    check("C commit", MAX31790_batch_commit(&batch_c) == ESP_OK);
+
+    set_fan_config<2>(&cfg_cxx, cfg_rpm);
+    set_fan_dynamics<2>(&cfg_cxx, dyn_por.set<fan_dynamics::range>(speed_range::x8));
+    set_failed_fan_seq_start(&cfg_cxx, value<failed_fan_seq_start>().set<failed_fan_seq_start::start_delay>(seq_start::ms1000)
+                                                                    .set<failed_fan_seq_start::queue>(fault_queue::q6));
+    set_target_rpm<2>(&cfg_cxx, 1500);
+    MAX31790_batch_begin(&batch_cxx, &cfg_cxx);
+    probe_cxx_stage(&batch_cxx, duty);
+    check("C++ commit", MAX31790_batch_commit(&batch_cxx) == ESP_OK);
+
+    check("register maps differ", !memcmp(sim_c.regs, sim_cxx.regs, REG_MAP_SIZE));
+    check("speed conversions differ", cfg_c.tach_k[2] == cfg_cxx.tach_k[2] && cfg_cxx.tach_k[2] == TACH_K(8));
+
+    MAX31790_batch_begin(&batch_c, &cfg_c);
+    MAX31790_batch_begin(&batch_cxx, &cfg_c);
+    c_us = cxx_time(probe_c_stage, &batch_c);
+    cxx_us = cxx_time(probe_cxx_stage, &batch_cxx);
+
+    check("staged batches differ", !memcmp(&batch_c, &batch_cxx, sizeof(batch_c)));
+
+    printf("{\"op\":\"stage_6_dutybits\",\"c_ns\":%.1f,\"cxx_ns\":%.1f}\n", c_us * 1000.0 / CXX_ITER, cxx_us * 1000.0 / CXX_ITER);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+/******************************************************
+  Description: max31790d end to end on simulated chips:
+               reader threads on the telemetry page
+               checked for torn cycles and timed, then
+               setpoints over the socket checked back
+               in the page and a clean shutdown.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "max31790_shm.h"
+
+#ifndef MAX31790D_PATH
+#define MAX31790D_PATH      "./max31790d"
+#endif
+
+#define DMN_DEVS            4
+#define DMN_PERIOD_MS       10
+#define DMN_READERS         4
+#define DMN_READ_MS         1000
+#define DMN_START_MS        2000                // Page must appear within this
+#define DMN_REPLY_MS        1000
+#define DMN_RPM             2400
+#define DMN_RPM_TOL         2                   // Percent, count rounding at the default speed range
+#define DMN_SPIN_UP_MS      2000                // Simulated rotors from rest past the lowest countable speed
+#define DMN_CYCLES_MIN      50                  // Of the DMN_READ_MS / DMN_PERIOD_MS due while the readers run
+
+typedef struct
+{
+    pthread_t thread;
+    const max31790_shm_page_t *page;
+    uint64_t reads;
+    uint64_t torn;                              // Copies mixing two cycles, must stay 0
+    uint64_t misses;                            // MAX31790_shm_read() gave up
+    uint32_t first_cycle;
+    uint32_t last_cycle;
+    int64_t ns;
+} dmn_reader_t;
+
+static char sock_path[64];
+static char shm_name[64];
+static atomic_bool readers_stop;
+static bool failed;
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "daemon: %s\n", what);
+        failed = true;
+    }
+}
+
+static int64_t dmn_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool dmn_consistent(const max31790_shm_data_t *data)                                        // Every chip read inside the cycle the header names
+{
+    if(data->n_dev != DMN_DEVS)
+        return false;
+
+    for(uint8_t x = 0; x < data->n_dev; x++)
+        if(data->dev[x].timestamp_us > data->timestamp_us || data->dev[x].timestamp_us < data->timestamp_us - DMN_PERIOD_MS * 1000)
+            return false;
+
+    return true;
+}
+
+static void *dmn_reader(void *arg)                                                                  // Back to back reads, as hard on the seqlock as a reader gets
+{
+    dmn_reader_t *r = arg;
+    max31790_shm_data_t data;
+    int64_t start = dmn_now_ns();
+
+    while(!atomic_load_explicit(&readers_stop, memory_order_relaxed))
+    {
+        if(!MAX31790_shm_read(r->page, &data))
+        {
+            r->misses++;
+            continue;
+        }
+
+        r->torn += !dmn_consistent(&data) || data.cycle < r->last_cycle;
+        r->first_cycle = r->reads ? r->first_cycle : data.cycle;
+        r->last_cycle = data.cycle;
+        r->reads++;
+    }
+
+    r->ns = dmn_now_ns() - start;
+    return NULL;
+}
+
+static bool dmn_wait_cycles(const max31790_shm_page_t *page, uint32_t cycles, max31790_shm_data_t *data)
+{
+    for(uint32_t x = 0; x <= cycles; x++)
+    {
+        uint32_t seq = MAX31790_shm_seq(page);
+        int64_t limit = dmn_now_ns() + (int64_t)DMN_REPLY_MS * 1000000;
+
+        while(MAX31790_shm_seq(page) == seq && dmn_now_ns() < limit)
+            usleep(1000);
+    }
+
+    return MAX31790_shm_read(page, data);
+}
+
+static bool dmn_send(const char *msg, char *reply, size_t reply_len)
+{
+    struct sockaddr_un to = {.sun_family = AF_UNIX};
+    struct sockaddr_un self = {.sun_family = AF_UNIX};
+    int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    ssize_t got = -1;
+
+    strcpy(to.sun_path, sock_path);
+
+    if(sock >= 0 && bind(sock, (struct sockaddr *)&self, sizeof(sa_family_t)) == 0 &&
+       sendto(sock, msg, strlen(msg), 0, (struct sockaddr *)&to, sizeof(to)) >= 0 && poll(&pfd, 1, DMN_REPLY_MS) > 0)
+        got = recv(sock, reply, reply_len - 1, 0);
+
+    if(sock >= 0)
+        close(sock);
+
+    reply[got > 0 ? got : 0] = '\0';
+    return got > 0;
+}
+
+static void dmn_readers(const max31790_shm_page_t *page)
+{
+    dmn_reader_t readers[DMN_READERS] = {0};
+    uint64_t reads = 0;
+    uint64_t torn = 0;
+    uint64_t misses = 0;
+    int64_t ns = 0;
+    uint32_t cycles = UINT32_MAX;
+
+    atomic_store(&readers_stop, false);
+    for(uint8_t x = 0; x < DMN_READERS; x++)
+    {
+        readers[x].page = page;
+        pthread_create(&readers[x].thread, NULL, dmn_reader, &readers[x]);
+    }
+
+    usleep(DMN_READ_MS * 1000);
+    atomic_store(&readers_stop, true);
+
+    for(uint8_t x = 0; x < DMN_READERS; x++)
+    {
+        pthread_join(readers[x].thread, NULL);
+        reads += readers[x].reads;
+        torn += readers[x].torn;
+        misses += readers[x].misses;
+        ns += readers[x].ns;
+        cycles = (readers[x].last_cycle - readers[x].first_cycle < cycles) ? readers[x].last_cycle - readers[x].first_cycle : cycles;
+    }
+
+    printf("{\"op\":\"readers\",\"readers\":%d,\"reads\":%llu,\"torn\":%llu,\"misses\":%llu,\"ns_per_read\":%lld,\"cycles\":%u,\"bytes\":%zu}\n",
+           DMN_READERS, (unsigned long long)reads, (unsigned long long)torn, (unsigned long long)misses,
+           reads ? (long long)(ns / (int64_t)reads) : 0, cycles, sizeof(max31790_shm_data_t));
+
+    check("torn telemetry read", torn == 0);
+    check("readers saw too few cycles", cycles >= DMN_CYCLES_MIN);
+    check("readers starved", reads > (uint64_t)DMN_READERS * cycles);
+}
+
+static void dmn_commands(const max31790_shm_page_t *page)
+{
+    max31790_shm_data_t before;
+    max31790_shm_data_t after;
+    char reply[128];
+    uint32_t target = 0;
+    bool sent = false;
+
+    check("telemetry read", MAX31790_shm_read(page, &before));
+
+    sent = dmn_send("duty 0 1 256\npermille 1 2 500; rpm 2 3 2400\n\nduty 3 6 511", reply, sizeof(reply));
+    printf("{\"op\":\"batch\",\"reply\":\"%.*s\"}\n", (int)strcspn(reply, "\n"), reply);
+    check("batch reply", sent && !strcmp(reply, "ok 4\n"));
+
+    check("telemetry after batch", dmn_wait_cycles(page, 2, &after));
+    target = after.dev[2].target_rpm[2];
+    printf("{\"op\":\"applied\",\"dev0_ch1\":%u,\"dev1_ch2\":%u,\"dev2_ch3_rpm\":%u,\"dev3_ch6\":%u,\"writes\":%u,\"commands\":%u}\n",
+           after.dev[0].target_dutybits[0], after.dev[1].target_dutybits[1], target, after.dev[3].target_dutybits[5],
+           after.writes - before.writes, after.commands - before.commands);
+    check("duty not applied", after.dev[0].target_dutybits[0] == 256);
+    check("permille not applied", after.dev[1].target_dutybits[1] == MAX31790_permille_to_bits(500));
+    check("rpm not applied", target * 100 >= DMN_RPM * (100 - DMN_RPM_TOL) && target * 100 <= DMN_RPM * (100 + DMN_RPM_TOL));
+    check("full duty not applied", after.dev[3].target_dutybits[5] == DUTYBITS_MAX);
+    check("one commit per chip", after.writes - before.writes == DMN_DEVS);
+    check("command count", after.commands - before.commands == 4);
+
+    sent = dmn_send("duty 0 1 100\nduty 0 9 100", reply, sizeof(reply));                           // Second line bad, the first must not land
+    printf("{\"op\":\"reject\",\"reply\":\"%.*s\"}\n", (int)strcspn(reply, "\n"), reply);
+    check("reject reply", sent && !strncmp(reply, "err line 2:", 11));
+
+    sent = dmn_send("spin 0 1 100", reply, sizeof(reply));
+    check("unknown command reply", sent && !strncmp(reply, "err line 1:", 11));
+
+    check("telemetry after reject", dmn_wait_cycles(page, 2, &after));
+    check("rejected message applied", after.dev[0].target_dutybits[0] == 256);
+    check("rejected count", after.rejected - before.rejected == 2);
+
+    check("telemetry after spin up", dmn_wait_cycles(page, DMN_SPIN_UP_MS / DMN_PERIOD_MS, &after));
+    printf("{\"op\":\"spin_up\",\"dev0_fan1_rpm\":%u,\"dev3_fan6_rpm\":%u}\n", after.dev[0].rpm[0], after.dev[3].rpm[5]);
+    check("fans not reported", after.dev[0].rpm[0] > 0 && after.dev[3].rpm[5] > 0 && after.dev[0].rslt == 0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *daemon = (argc > 1) ? argv[1] : MAX31790D_PATH;
+    const max31790_shm_page_t *page = NULL;
+    max31790_shm_data_t data;
+    char devs[8];
+    char period[8];
+    int status = 0;
+    pid_t pid = 0;
+
+    snprintf(sock_path, sizeof(sock_path), "/tmp/max31790d_bench_%d.sock", (int)getpid());
+    snprintf(shm_name, sizeof(shm_name), "/max31790d_bench_%d", (int)getpid());
+    snprintf(devs, sizeof(devs), "%d", DMN_DEVS);
+    snprintf(period, sizeof(period), "%d", DMN_PERIOD_MS);
+
+    pid = fork();
+    if(pid == 0)
+    {
+        execl(daemon, daemon, "--fake", devs, "-p", period, "-s", sock_path, "-m", shm_name, (char *)NULL);
+        perror(daemon);
+        _exit(127);
+    }
+
+    for(int64_t limit = dmn_now_ns() + (int64_t)DMN_START_MS * 1000000; !page && dmn_now_ns() < limit; usleep(10000))
+        page = MAX31790_shm_attach(shm_name);
+
+    if(!page || !dmn_wait_cycles(page, 1, &data))
+    {
+        fprintf(stderr, "daemon: %s did not publish\n", daemon);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return 1;
+    }
+
+    printf("{\"op\":\"start\",\"pid\":%d,\"devices\":%d,\"period_ms\":%u}\n", page->pid, data.n_dev, data.period_ms);
+    check("page pid", page->pid == pid);
+
+    dmn_readers(page);
+    dmn_commands(page);
+
+    check("telemetry at stop", MAX31790_shm_read(page, &data));
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    MAX31790_shm_detach(page);
+
+    printf("{\"op\":\"stop\",\"cycles\":%u,\"overruns\":%u,\"exit\":%d}\n", data.cycle, data.overruns, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    check("daemon exit", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    check("page left behind", MAX31790_shm_attach(shm_name) == NULL);
+    check("socket left behind", access(sock_path, F_OK) != 0);
+
+    return failed ? 1 : 0;
+}
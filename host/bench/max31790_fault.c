@@ -0,0 +1,196 @@
+/******************************************************
+  Description: Fault monitor woken by the simulated
+               FAN_FAIL pin: a rotor locked and freed
+               repeatedly, each edge checked at the
+               callback and the alert to status read
+               latency timed.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Fault.h"
+#include "MAX31790Sim.h"
+
+#define FAULT_ADR           0x20
+#define FAULT_PORT          0
+#define FAULT_FAN           2
+#define FAULT_EVENTS        9                   // Lock / free cycles
+#define FAULT_STEP_MS       20                  // Model time per step, the chip runs ahead of the host clock
+#define FAULT_WAIT_MS       10000               // Model time for an edge to arrive
+#define FAULT_RECHECK_MS    300
+#define FAULT_WARM_MS       5000
+#define FAULT_PRIO          5
+
+typedef struct
+{
+    uint8_t fan_number;
+    bool failed;
+    int64_t alert_us;
+    int64_t read_us;
+} fault_edge_t;
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_fault_monitor_t mon;
+static fault_edge_t edges[4 * FAULT_EVENTS];
+static atomic_uint n_edge;
+static bool failed;
+
+static max31790_master_config_t cfg =
+{
+    .adr = FAULT_ADR,
+    .port = FAULT_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x00,
+    .fault_mask_2 = 0x3F                        // Inputs 7 - 12 unused
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "fault: %s\n", what);
+        failed = true;
+    }
+}
+
+static void on_edge(max31790_handle_t dev, const max31790_fault_event_t *event, void *arg)          // Monitor task
+{
+    unsigned n = atomic_load(&n_edge);
+
+    if(n >= sizeof(edges) / sizeof(edges[0]))
+        return;
+
+    edges[n].fan_number = event->fan_number;
+    edges[n].failed = event->failed;
+    edges[n].alert_us = event->alert_us;
+    edges[n].read_us = event->read_us;
+    atomic_store(&n_edge, n + 1);
+}
+
+static bool fault_step_until(unsigned want)                                                         // The chip only moves here, under the port token like a transfer
+{
+    for(uint32_t ms = 0; ms < FAULT_WAIT_MS; ms += FAULT_STEP_MS)
+    {
+        if(atomic_load(&n_edge) >= want)
+            return true;
+
+        if(I2CMANAGER_take(FAULT_PORT, portMAX_DELAY) != ESP_OK)
+            return false;
+
+        MAX31790SIM_bus_step(&bus, FAULT_STEP_MS);                                                  // FAN_FAIL edges call the monitor's notify in here
+        I2CMUTEX_GIVE_PORT(FAULT_PORT);
+
+        vTaskDelay(1);
+    }
+
+    return atomic_load(&n_edge) >= want;
+}
+
+static int fault_cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    max31790_fault_config_t fc = {.alert = {.ops = &max31790sim_alert_ops, .ctx = &sim}, .recheck_ms = FAULT_RECHECK_MS};
+    int64_t latency[FAULT_EVENTS] = {0};
+    int64_t bound_us = 0;
+    uint32_t n_lat = 0;
+    uint32_t wrong = 0;                                                                             // Edges on the wrong fan or out of order
+    uint32_t polled = 0;                                                                            // Failure edges without an alert time
+    uint32_t reads = 0;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, FAULT_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(FAULT_PORT, &max31790sim_backend, &bus) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK)
+    {
+        fprintf(stderr, "fault: setup failed\n");
+        return 1;
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_set_target_dutybits(&cfg, x, MAX31790_permille_to_bits(500));
+
+    MAX31790SIM_bus_step(&bus, FAULT_WARM_MS);
+    MAX31790_clear_fault_status(&cfg, (0x01 << NUM_TACH_CHANNEL) - 1);                              // Latched while the rotors started
+    bus.cfg.real_time = true;                                                                       // The status read costs its wire time
+
+    bound_us = portTICK_PERIOD_MS * 1000 + MAX31790SIM_wire_time_ns(&bus.cfg, 5, true) / 1000;     // Wake within a tick, then the 0x10 - 0x11 read
+
+    if(MAX31790_fault_init(&mon, &cfg, &fc) != ESP_OK || MAX31790_fault_add_callback(&mon, on_edge, NULL) != ESP_OK ||
+       MAX31790_fault_start(&mon, FAULT_PRIO) != ESP_OK)
+    {
+        fprintf(stderr, "fault: monitor start failed\n");
+        return 1;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(10));
+    reads = mon.reads;                                                                              // The start up read
+    check("edge with every fan running", atomic_load(&n_edge) == 0);
+
+    for(uint32_t x = 0; x < FAULT_EVENTS; x++)
+    {
+        sim.fan[FAULT_FAN].locked = true;
+        check("lock not reported", fault_step_until(2 * x + 1));
+
+        sim.fan[FAULT_FAN].locked = false;
+        check("recovery not reported", fault_step_until(2 * x + 2));
+    }
+
+    MAX31790_fault_stop(&mon);
+
+    for(unsigned x = 0; x < atomic_load(&n_edge); x++)
+    {
+        const fault_edge_t *e = &edges[x];
+
+        wrong += e->fan_number != FAULT_FAN || e->failed != !(x & 0x01);
+
+        if(!e->failed)
+            continue;
+
+        if(!e->alert_us)
+            polled++;
+        else if(n_lat < FAULT_EVENTS)
+            latency[n_lat++] = e->read_us - e->alert_us;
+    }
+
+    qsort(latency, n_lat, sizeof(latency[0]), fault_cmp);
+
+    printf("{\"events\":%d,\"edges\":%u,\"wrong\":%u,\"polled\":%u,\"alerts\":%u,\"reads\":%u,\"latency_us_min\":%lld,\"latency_us_median\":%lld,\"latency_us_max\":%lld,\"bound_us\":%lld}\n",
+           FAULT_EVENTS, atomic_load(&n_edge), wrong, polled, mon.alerts, mon.reads - reads,
+           n_lat ? (long long)latency[0] : -1, n_lat ? (long long)latency[n_lat / 2] : -1, n_lat ? (long long)latency[n_lat - 1] : -1, (long long)bound_us);
+
+    check("edge count", atomic_load(&n_edge) == 2 * FAULT_EVENTS);
+    check("edge on the wrong fan or out of order", wrong == 0);
+    check("failure found by a poll, not the alert", polled == 0);
+    check("alert time after the read", n_lat && latency[0] >= 0);
+    check("alert to read latency", n_lat && latency[n_lat / 2] <= bound_us);                       // Median, a single event can take a host preemption
+
+    SemaphoreHandle_t wake = mon.wake;
+    SemaphoreHandle_t exited = mon.exited;
+
+    check("re-init failed", MAX31790_fault_init(&mon, &cfg, &fc) == ESP_OK);
+    check("re-init made new semaphores", mon.wake == wake && mon.exited == exited);
+
+    MAX31790_fault_deinit(&mon);
+    check("deinit left semaphores", !mon.wake && !mon.exited && !mon.task);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+/******************************************************
+  Description: Tach filter and stall prediction over
+               simulated sampler frames with injected
+               count jitter, missed pulses, bearing wear
+               and a seized rotor, against the chip's
+               own fault flag.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "MAX31790.h"
+#include "MAX31790Filter.h"
+#include "MAX31790Sampler.h"
+#include "MAX31790Sim.h"
+
+#define FILTER_ADR          0x20
+#define FILTER_PORT         0
+#define FILTER_PERIOD_MS    100                 // Sampler frame period
+#define FILTER_RUN_MS       120000
+#define FILTER_WARM_MS      5000                // Up to speed before the trace starts
+#define FILTER_JITTER       30                  // Permille of count, uniform
+#define FILTER_GLITCH_EVERY 23                  // Frames between missed or doubled pulses on the glitch fan
+#define FILTER_MIN_LEAD_MS  5000                // Wear must be flagged this long before the chip's fault
+#define FILTER_NOISE_GAIN   2                   // Raw RMS error over filtered at least this
+
+typedef struct
+{
+    const char *name;
+    uint16_t dutybits;
+    uint16_t jitter_permille;
+    bool glitch;
+    uint32_t event_ms;                          // 0 none
+    float decay_per_s;                          // From event_ms
+    uint16_t step_dutybits;                     // Commanded at event_ms, 0 none
+    bool seize;                                 // Rotor locks at event_ms
+    bool expect_flag;
+    bool expect_lead;                           // Flag before the chip's fault by FILTER_MIN_LEAD_MS
+} filter_case_t;
+
+static const filter_case_t cases[NUM_CHANNEL] =                                                     // One per channel, all filtered in one pass
+{
+    {"steady",          260,    FILTER_JITTER,  false,  0,      0,      0,      false,  false,  false},
+    {"glitches",        260,    FILTER_JITTER,  true,   0,      0,      0,      false,  false,  false},
+    {"bearing_wear",    300,    FILTER_JITTER,  false,  10000,  0.02f,  0,      false,  true,   true},
+    {"step_down",       400,    FILTER_JITTER,  false,  20000,  0,      200,    false,  false,  false},
+    {"slow_wear",       300,    FILTER_JITTER,  false,  5000,   0.008f, 0,      false,  true,   true},
+    {"seized",          300,    FILTER_JITTER,  false,  30000,  0,      0,      true,   true,   false},
+};
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_sampler_t sampler;
+static max31790_filter_t filter;
+static uint64_t sim_ms;
+static uint32_t flag_ms[NUM_CHANNEL];
+static uint32_t edges[NUM_CHANNEL];
+static bool failed;
+
+static max31790_master_config_t cfg =
+{
+    .adr = FILTER_ADR,
+    .port = FILTER_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "filter: %s\n", what);
+        failed = true;
+    }
+}
+
+static uint32_t noise_next(void)                                                                    // Fixed sequence, runs repeat exactly
+{
+    static uint32_t state = 0x31790u;
+
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+static void on_edge(max31790_handle_t dev, uint8_t fan_number, bool decaying, uint32_t eta_ms, void *arg)
+{
+    if(fan_number >= NUM_CHANNEL)
+        return;
+
+    edges[fan_number]++;
+    if(decaying && !flag_ms[fan_number])
+        flag_ms[fan_number] = (uint32_t)sim_ms;
+}
+
+static uint16_t corrupt(const filter_case_t *c, uint16_t count, uint32_t frame)                    // What a noisy tach line and a marginal Hall sensor add
+{
+    int32_t jitter = 0;
+
+    if(count >= TACH_COUNT_MAX)
+        return count;
+
+    if(c->glitch && frame % FILTER_GLITCH_EVERY == FILTER_GLITCH_EVERY - 1)                         // Not while the median window fills
+        return (frame / FILTER_GLITCH_EVERY) & 0x01 ? TACH_COUNT_MAX : count / 2;
+
+    jitter = (int32_t)(noise_next() % (2 * c->jitter_permille + 1)) - c->jitter_permille;
+
+    return CONSTRAIN(count + (count * jitter) / PERMILLE_MAX, 1, TACH_COUNT_MAX);
+}
+
+int main(int argc, char **argv)
+{
+    max31790_frame_t frame;
+    uint32_t hw_ms[NUM_CHANNEL] = {0};
+    double raw_sq[NUM_CHANNEL] = {0};
+    double filt_sq[NUM_CHANNEL] = {0};
+    uint32_t n_sq = 0;
+    uint32_t frame_no = 0;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, FILTER_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(FILTER_PORT, &max31790sim_backend, &bus) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK ||
+       MAX31790_sampler_init(&sampler, &cfg, NULL) != ESP_OK || MAX31790_filter_init(&filter, &cfg, NULL, on_edge, NULL) != ESP_OK)
+    {
+        fprintf(stderr, "filter: setup failed\n");
+        return 1;
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_set_target_dutybits(&cfg, x, cases[x].dutybits);
+
+    MAX31790SIM_bus_step(&bus, FILTER_WARM_MS);
+    MAX31790_clear_fault_status(&cfg, (0x01 << NUM_TACH_CHANNEL) - 1);                              // Latched while the rotors started
+
+    for(sim_ms = 0; sim_ms < FILTER_RUN_MS; sim_ms += FILTER_PERIOD_MS, frame_no++)
+    {
+        for(uint8_t x = 0; x < NUM_CHANNEL; x++)                                                    // Injections
+        {
+            const filter_case_t *c = &cases[x];
+
+            if(!c->event_ms || sim_ms != c->event_ms)
+                continue;
+
+            sim.fan[x].decay_per_s = c->decay_per_s;
+            sim.fan[x].locked = c->seize;
+            if(c->step_dutybits)
+                MAX31790_set_target_dutybits(&cfg, x, c->step_dutybits);
+        }
+
+        MAX31790SIM_bus_step(&bus, FILTER_PERIOD_MS);
+
+        if(MAX31790_sampler_capture(&sampler) != ESP_OK || !MAX31790_sampler_latest(&sampler, &frame))
+        {
+            fprintf(stderr, "filter: capture failed\n");
+            return 1;
+        }
+
+        frame.timestamp_us = (int64_t)(sim_ms + FILTER_PERIOD_MS) * 1000;                           // Model time, a recorded trace replays the same way
+        for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+            frame.tach_count[x] = corrupt(&cases[x], frame.tach_count[x], frame_no);
+
+        check("update failed", MAX31790_filter_update(&filter, &frame) == ESP_OK);
+
+        for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        {
+            uint8_t bit = 0x01 << x;
+            uint16_t count = frame.tach_count[x];
+            double raw = (count >= TACH_COUNT_MAX) ? 0 : MAX31790_count_to_rpm(&cfg, x, count);
+
+            if((frame.fault_status_1 & bit) && !hw_ms[x])
+                hw_ms[x] = (uint32_t)sim_ms;
+
+            if(!cases[x].event_ms)                                                                  // Error against the modelled rotor
+            {
+                raw_sq[x] += (raw - sim.rpm[x]) * (raw - sim.rpm[x]);
+                filt_sq[x] += ((double)filter.rpm[x] - sim.rpm[x]) * ((double)filter.rpm[x] - sim.rpm[x]);
+            }
+        }
+
+        n_sq++;
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        const filter_case_t *c = &cases[x];
+        double raw_rms = sqrt(raw_sq[x] / n_sq);
+        double filt_rms = sqrt(filt_sq[x] / n_sq);
+        int32_t lead_ms = (flag_ms[x] && hw_ms[x]) ? (int32_t)hw_ms[x] - (int32_t)flag_ms[x] : 0;
+
+        printf("{\"case\":\"%s\",\"flag_ms\":%u,\"hw_fault_ms\":%u,\"lead_ms\":%d,\"edges\":%u,\"rejected\":%u,\"raw_rms\":%.1f,\"filtered_rms\":%.1f}\n",
+               c->name, flag_ms[x], hw_ms[x], lead_ms, edges[x], filter.rejected[x], c->event_ms ? 0 : raw_rms, c->event_ms ? 0 : filt_rms);
+
+        if(!c->expect_flag)
+            check("healthy fan flagged", !flag_ms[x]);
+        else
+            check("failing fan missed", flag_ms[x] != 0);
+
+        if(c->expect_lead)
+            check("flagged too late", flag_ms[x] && (!hw_ms[x] || lead_ms >= FILTER_MIN_LEAD_MS));
+
+        if(!c->event_ms)
+            check("noise not reduced", filt_rms * FILTER_NOISE_GAIN <= raw_rms);
+    }
+
+    check("glitches not rejected", filter.rejected[1] >= FILTER_RUN_MS / FILTER_PERIOD_MS / FILTER_GLITCH_EVERY - 1);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+/****************************************************** 
+  Description: Register map image round trip between
+               two simulated chips: export, provision,
+               verify, user byte keeping and rejection
+               of damaged images. Transactions per step.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Image.h"
+#include "MAX31790Sim.h"
+
+#define IMAGE_PORT          0
+#define IMAGE_SRC_ADR       0x20
+#define IMAGE_DST_ADR       0x21
+#define IMAGE_RUN_MS        3000
+#define IMAGE_EXPORT_TX     2
+#define IMAGE_IMPORT_TX     3                   // 0x00 - 0x0F, 0x12 - 0x17, 0x40 - 0x67
+#define IMAGE_VERIFY_TX     2
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim_src;
+static max31790sim_dev_t sim_dst;
+static bool failed;
+
+static max31790_master_config_t src =            // The known-good controller
+{
+    .adr = IMAGE_SRC_ADR,
+    .port = IMAGE_PORT,
+    .global_cfg = MAX31790_GLO_BUS_TIMEOUT_DIS,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_SPIN_UP_0_5, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_MODE_RPM,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, 0x00, 0x00},
+    .fan_dyn = {0x4C, MAX31790_FAN_DYN_SR_2 | MAX31790_FAN_DYN_PWM_ROC_7_8, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x30,
+    .fault_mask_2 = 0x3F
+};
+
+static max31790_master_config_t dst =            // A fresh controller, power-on configuration
+{
+    .adr = IMAGE_DST_ADR,
+    .port = IMAGE_PORT,
+    .global_cfg = MAX31790_GLO_BUS_TIMEOUT_DIS,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "image: %s\n", what);
+        failed = true;
+    }
+}
+
+static uint8_t image_differs(bool with_user)                                                        // Restorable registers the two chips disagree on
+{
+    uint8_t count = 0;
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x++)
+    {
+        uint8_t a = sim_src.regs[x];
+        uint8_t b = sim_dst.regs[x];
+
+        if(REG_IS_VOLATILE(x) && x != MAX31790_REG_GLOBAL_CONFIG)
+            continue;
+        if(x >= MAX31790_REG_PWM_DUTY(NUM_CHANNEL) && x < MAX31790_REG_TARGET_DUTY(0))
+            continue;
+        if(REG_IS_USER_BYTE(x) && !with_user)
+            continue;
+        if(x == MAX31790_REG_GLOBAL_CONFIG)
+        {
+            a &= ~MAX31790_GLO_I2C_WD_STATUS;
+            b &= ~MAX31790_GLO_I2C_WD_STATUS;
+        }
+
+        count += a != b;
+    }
+
+    return count;
+}
+
+static void image_report(const char *name, esp_err_t err_ret, uint32_t tx, size_t len)
+{
+    printf("{\"case\":\"%s\",\"result\":\"%s\",\"tx\":%u,\"bytes\":%u,\"differs\":%u}\n",
+           name, esp_err_to_name(err_ret), tx, (unsigned)len, image_differs(true));
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t img[MAX31790_IMAGE_SIZE] = {0};
+    uint8_t bad[MAX31790_IMAGE_SIZE] = {0};
+    uint8_t user[4] = {0xCA, 0x1B, 0x7E, 0x55};
+    uint8_t user_dst[4] = {0x35, 0xE4, 0x81, 0xAA};
+    max31790_image_t decoded;
+    size_t len = 0;
+    uint32_t tx = 0;
+    esp_err_t err_ret = ESP_OK;
+    bool decode_ok = true;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim_src, IMAGE_SRC_ADR);
+    MAX31790SIM_init(&sim_dst, IMAGE_DST_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim_src);
+    MAX31790SIM_bus_attach(&bus, &sim_dst);
+
+    if(I2CMANAGER_set_backend(IMAGE_PORT, &max31790sim_backend, &bus) != ESP_OK ||
+       MAX31790_initiate(&src) != ESP_OK || MAX31790_initiate(&dst) != ESP_OK)
+    {
+        fprintf(stderr, "image: setup failed\n");
+        return 1;
+    }
+
+    MAX31790_set_pwm_feq(&src, (MAX31790_PWM_FREQ_25K << 4) | MAX31790_PWM_FREQ_1_25K);
+    MAX31790_set_target_dutybits(&src, 0, 300);
+    MAX31790_set_target_rpm(&src, 1, 2000);
+    MAX31790_set_window(&src, 0x40, 1);
+    for(uint8_t x = 0; x < sizeof(user); x++)                                                       // Calibration of this board
+        sim_src.regs[MAX31790_REG_USER_BYTE_5 + x] = user[x];
+    MAX31790SIM_bus_step(&bus, IMAGE_RUN_MS);
+
+    /* Snapshot ------------------------------------------------------------------------------ */
+    tx = bus.transactions;
+    err_ret = MAX31790_image_export(&src, img, &len);
+    tx = bus.transactions - tx;
+    image_report("export", err_ret, tx, len);
+
+    check("export failed", err_ret == ESP_OK && len == MAX31790_IMAGE_SIZE);
+    check("export transactions", tx == IMAGE_EXPORT_TX);
+
+    check("decode failed", MAX31790_image_decode(img, len, &decoded) == ESP_OK);
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x++)
+    {
+        bool hole = x >= MAX31790_REG_PWM_DUTY(NUM_CHANNEL) && x < MAX31790_REG_TARGET_DUTY(0);
+
+        decode_ok &= MAX31790_image_has(decoded.present, x) == !hole;
+        decode_ok &= MAX31790_image_has(decoded.restore, x) == (!hole && (!REG_IS_VOLATILE(x) || x == MAX31790_REG_GLOBAL_CONFIG));
+        decode_ok &= hole || REG_IS_VOLATILE(x) || decoded.regs[x] == sim_src.regs[x];
+    }
+    check("decode differs", decode_ok);
+
+    if(argc > 1)                                                                                    // For max31790_imgdump
+    {
+        FILE *f = fopen(argv[1], "wb");
+
+        check("image file", f && fwrite(img, 1, len, f) == len);
+        if(f)
+            fclose(f);
+    }
+
+    /* Provisioning -------------------------------------------------------------------------- */
+    MAX31790_invalidate_cache(&dst);                                                                // Driver knows nothing of the chip, every run goes out whole
+    tx = bus.transactions;
+    err_ret = MAX31790_image_import(&dst, img, len, MAX31790_IMAGE_VERIFY);
+    tx = bus.transactions - tx;
+    image_report("import_verify", err_ret, tx, len);
+
+    check("import failed", err_ret == ESP_OK);
+    check("import transactions", tx == IMAGE_IMPORT_TX + IMAGE_VERIFY_TX);
+    check("chips differ", !image_differs(true));
+    check("device config", !memcmp(dst.fan_cfg, src.fan_cfg, NUM_CHANNEL) && !memcmp(dst.fan_dyn, src.fan_dyn, NUM_CHANNEL) &&
+                           dst.fault_mask_1 == src.fault_mask_1 && dst.global_cfg == src.global_cfg);
+    check("speed range", MAX31790_rpm_to_count(&dst, 1, 2000) == MAX31790_rpm_to_count(&src, 1, 2000));
+
+    tx = bus.transactions;                                                                          // Same image again, only the volatile global config goes out
+    err_ret = MAX31790_image_import(&dst, img, len, 0);
+    tx = bus.transactions - tx;
+    image_report("import_unchanged", err_ret, tx, len);
+
+    check("reimport failed", err_ret == ESP_OK);
+    check("reimport transactions", tx == 1);
+
+    /* User bytes ---------------------------------------------------------------------------- */
+    for(uint8_t x = 0; x < sizeof(user); x++)                                                       // The destination has its own calibration
+        sim_dst.regs[MAX31790_REG_USER_BYTE_5 + x] = user_dst[x];
+    MAX31790_invalidate_cache(&dst);
+
+    tx = bus.transactions;
+    err_ret = MAX31790_image_import(&dst, img, len, MAX31790_IMAGE_KEEP_USER | MAX31790_IMAGE_VERIFY);
+    tx = bus.transactions - tx;
+    image_report("import_keep_user", err_ret, tx, len);
+
+    check("keep user failed", err_ret == ESP_OK && !image_differs(false));
+    for(uint8_t x = 0; x < sizeof(user); x++)
+        check("user byte overwritten", sim_dst.regs[MAX31790_REG_USER_BYTE_5 + x] == user_dst[x]);
+
+    /* Damaged images ------------------------------------------------------------------------ */
+    memcpy(bad, img, len);
+    bad[len / 2] ^= 0x01;
+    tx = bus.transactions;
+    err_ret = MAX31790_image_import(&dst, bad, len, MAX31790_IMAGE_VERIFY);
+    image_report("reject_crc", err_ret, bus.transactions - tx, len);
+    check("crc accepted", err_ret == ESP_ERR_INVALID_CRC && bus.transactions == tx);
+
+    memcpy(bad, img, len);
+    bad[1]++;
+    err_ret = MAX31790_image_import(&dst, bad, len, 0);
+    image_report("reject_version", err_ret, 0, len);
+    check("version accepted", err_ret == ESP_ERR_INVALID_VERSION);
+
+    err_ret = MAX31790_image_import(&dst, img, len - 1, 0);
+    image_report("reject_short", err_ret, 0, len - 1);
+    check("short accepted", err_ret == ESP_ERR_INVALID_SIZE);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/******************************************************
+  Description: Tach sweep throughput of N simulated
+               chips on M ports, each chip swept by its
+               own task on real time wire, as chips and
+               ports are added and at standard and fast
+               mode clocks.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sim.h"
+
+#define PORTS_NUM           2
+#define PORTS_DEVS          4                   // Per port
+#define PORTS_ADR           0x20
+#define PORTS_SWEEPS        300                 // Per case, split over its chips
+#define PORTS_PRIO          5
+#define PORTS_WARM_MS       3000
+#define PORTS_FAST_GAIN     30                  // Tenths, one port at 400 kHz over 100 kHz, 4x on the wire
+#define PORTS_SPLIT_GAIN    17                  // Tenths, two ports over one at 100 kHz, 2x on the wire
+#define PORTS_ADD_LOSS      90                  // Percent, one port's sweeps/s with PORTS_DEVS chips over one chip
+
+typedef struct
+{
+    uint8_t ports;
+    uint8_t devs_per_port;
+    uint32_t clk_hz;
+} ports_case_t;
+
+typedef struct
+{
+    max31790_handle_t dev;
+    SemaphoreHandle_t done;
+    uint32_t sweeps;
+    uint32_t errors;
+} ports_worker_t;
+
+static max31790sim_bus_t bus[PORTS_NUM];
+static max31790sim_dev_t sim[PORTS_NUM][PORTS_DEVS];
+static max31790_master_config_t cfg[PORTS_NUM][PORTS_DEVS];
+static bool failed;
+
+static const ports_case_t cases[] =
+{
+    {1, 1, 100000}, {1, 2, 100000}, {1, 4, 100000},                                                 // Chips added to one port
+    {2, 1, 100000}, {2, 2, 100000}, {2, 4, 100000},                                                 // Same per port, split over two
+    {1, 2, 400000}, {2, 1, 400000}                                                                  // Two chips in fast mode
+};
+
+enum { CASE_1X1, CASE_1X2, CASE_1X4, CASE_2X1, CASE_2X2, CASE_2X4, CASE_1X2_FAST, CASE_2X1_FAST, CASE_COUNT };
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "ports: %s\n", what);
+        failed = true;
+    }
+}
+
+static void ports_task(void *arg)
+{
+    ports_worker_t *w = arg;
+    uint32_t rpm[NUM_TACH_CHANNEL];
+
+    for(uint32_t x = w->sweeps; x; x--)
+    {
+        w->errors += MAX31790_get_all_rpm(w->dev, rpm) != ESP_OK || !rpm[0];
+    }
+
+    xSemaphoreGive(w->done);
+    vTaskDelete(NULL);
+}
+
+static double ports_run(const ports_case_t *c)                                                      // Aggregate sweeps per second
+{
+    ports_worker_t w[PORTS_NUM * PORTS_DEVS] = {0};
+    const max31790sim_bus_cfg_t bus_cfg = {.clk_hz = c->clk_hz, .real_time = true, .yield = true};
+    uint8_t n_dev = c->ports * c->devs_per_port;
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(n_dev, 0);
+    uint32_t sweeps = 0;
+    uint32_t errors = 0;
+    uint32_t tx = 0;
+    uint64_t wire_ns = 0;
+    uint64_t wire_max_ns = 0;
+    int64_t wall_us = 0;
+    double rate = 0;
+
+    for(uint8_t p = 0; p < PORTS_NUM; p++)
+    {
+        bus[p].cfg = bus_cfg;
+        MAX31790SIM_bus_reset_counters(&bus[p]);
+    }
+
+    wall_us = esp_timer_get_time();
+    for(uint8_t x = 0; x < n_dev; x++)
+    {
+        w[x].dev = &cfg[x % c->ports][x / c->ports];
+        w[x].done = done;
+        w[x].sweeps = PORTS_SWEEPS / n_dev;
+
+        if(!done || xTaskCreate(ports_task, "ports", 4096, &w[x], PORTS_PRIO, NULL) != pdPASS)
+        {
+            fprintf(stderr, "ports: task start failed\n");
+            exit(1);
+        }
+    }
+
+    for(uint8_t x = 0; x < n_dev; x++)
+        xSemaphoreTake(done, portMAX_DELAY);
+    wall_us = esp_timer_get_time() - wall_us;
+    vSemaphoreDelete(done);
+
+    for(uint8_t p = 0; p < PORTS_NUM; p++)
+    {
+        tx += bus[p].transactions;
+        wire_ns += bus[p].bus_time_ns;
+        wire_max_ns = (bus[p].bus_time_ns > wire_max_ns) ? bus[p].bus_time_ns : wire_max_ns;
+        bus[p].cfg.real_time = false;
+    }
+
+    for(uint8_t x = 0; x < n_dev; x++)
+    {
+        sweeps += w[x].sweeps;
+        errors += w[x].errors;
+    }
+
+    rate = sweeps * 1000000.0 / wall_us;
+
+    printf("{\"ports\":%d,\"devices\":%d,\"clk_hz\":%u,\"sweeps\":%u,\"tx\":%u,\"errors\":%u,\"wall_us\":%lld,\"sweeps_per_s\":%.0f,"
+           "\"wire_us\":%llu,\"busiest_port_permille\":%lld}\n",
+           c->ports, n_dev, c->clk_hz, sweeps, tx, errors, (long long)wall_us, rate,
+           (unsigned long long)(wire_ns / 1000), (long long)(wire_max_ns / wall_us));
+
+    check("sweep failed", !errors);
+    check("more than one transaction per sweep", tx == sweeps);
+
+    return rate;
+}
+
+int main(int argc, char **argv)
+{
+    double rate[CASE_COUNT];
+
+    for(uint8_t p = 0; p < PORTS_NUM; p++)
+    {
+        MAX31790SIM_bus_init(&bus[p], NULL);
+
+        for(uint8_t d = 0; d < PORTS_DEVS; d++)
+        {
+            MAX31790SIM_init(&sim[p][d], PORTS_ADR + d);
+            MAX31790SIM_bus_attach(&bus[p], &sim[p][d]);
+
+            cfg[p][d] = (max31790_master_config_t)
+            {
+                .adr = PORTS_ADR + d,
+                .port = p,
+                .global_cfg = MAX31790_GLO_BUS_TIMEOUT_DIS,
+                .fan_failed_seq_start_cfg = 0x45,
+                .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                            MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+                .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+                .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2}
+            };
+        }
+
+        if(I2CMANAGER_set_backend(p, &max31790sim_backend, &bus[p]) != ESP_OK)
+        {
+            fprintf(stderr, "ports: setup failed\n");
+            return 1;
+        }
+
+        for(uint8_t d = 0; d < PORTS_DEVS; d++)
+        {
+            if(MAX31790_initiate(&cfg[p][d]) != ESP_OK)
+            {
+                fprintf(stderr, "ports: initiate failed\n");
+                return 1;
+            }
+
+            for(uint8_t ch = 0; ch < NUM_CHANNEL; ch++)
+                MAX31790_set_target_dutybits(&cfg[p][d], ch, MAX31790_permille_to_bits(500));
+        }
+
+        MAX31790SIM_bus_step(&bus[p], PORTS_WARM_MS);                                               // Counts on every input before timing
+    }
+
+    for(uint8_t x = 0; x < CASE_COUNT; x++)
+        rate[x] = ports_run(&cases[x]);
+
+    printf("{\"fast_gain\":%.2f,\"add_gain\":[%.2f,%.2f],\"split_gain\":[%.2f,%.2f,%.2f],\"split_gain_fast\":%.2f}\n",
+           rate[CASE_1X2_FAST] / rate[CASE_1X2], rate[CASE_1X2] / rate[CASE_1X1], rate[CASE_1X4] / rate[CASE_1X1],
+           rate[CASE_2X1] / rate[CASE_1X1], rate[CASE_2X2] / rate[CASE_1X2], rate[CASE_2X4] / rate[CASE_1X4], rate[CASE_2X1_FAST] / rate[CASE_1X2_FAST]);
+
+    check("fast mode gain on one port", rate[CASE_1X2_FAST] * 10 >= rate[CASE_1X2] * PORTS_FAST_GAIN);
+    check("chips added to a port lose throughput", rate[CASE_1X2] * 100 >= rate[CASE_1X1] * PORTS_ADD_LOSS &&
+                                                  rate[CASE_1X4] * 100 >= rate[CASE_1X1] * PORTS_ADD_LOSS);
+    check("two ports gain at 100 kHz", rate[CASE_2X1] * 10 >= rate[CASE_1X1] * PORTS_SPLIT_GAIN && rate[CASE_2X2] * 10 >= rate[CASE_1X2] * PORTS_SPLIT_GAIN &&
+                                       rate[CASE_2X4] * 10 >= rate[CASE_1X4] * PORTS_SPLIT_GAIN);
+    check("two ports slower than one at 400 kHz", rate[CASE_2X1_FAST] >= rate[CASE_1X2_FAST] * 0.9);   // Sub-tick transfers are spun, one host CPU serialises them
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,285 @@
+/******************************************************
+  Description: Sampler ring under concurrent history
+               readers, first against a producer
+               publishing flat out, then against the
+               sampler task on a simulated chip started
+               and stopped while the readers run.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sampler.h"
+#include "MAX31790Sim.h"
+
+#define SMP_ADR             0x20
+#define SMP_PORT            0
+#define SMP_READERS         4
+#define SMP_DEPTH           8                   // Small, the producer laps readers often
+#define SMP_RING_MS         1000
+#define SMP_TASK_PERIOD_MS  2
+#define SMP_TASK_CYCLES     50                  // Start / stop pairs
+#define SMP_TASK_RUN_MS     7                   // Per cycle, not a multiple of the period so stops land mid capture
+#define SMP_STOP_MAX_MS     (SMP_TASK_PERIOD_MS + 10)   // A period and a capture, plus slices shared with the spinning readers
+
+typedef struct
+{
+    pthread_t thread;
+    uint64_t calls;
+    uint64_t frames;
+    uint64_t empty;                             // History returned nothing
+    uint64_t full;                              // History returned the whole ring
+    uint64_t torn;                              // Frame fields from two publishes, must stay 0
+    uint64_t gaps;                              // Window not consecutive newest first, must stay 0
+    uint64_t back;                              // Newest frame older than one seen before, must stay 0
+} smp_reader_t;
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_sampler_t ring_sampler;
+static max31790_sampler_t task_sampler;
+static max31790_sampler_t *sampler;             // The one the readers watch
+static atomic_bool readers_stop;
+static atomic_bool producer_stop;
+static bool synthetic;                          // Frames carry a pattern derived from seq
+static bool failed;
+
+static max31790_master_config_t cfg =
+{
+    .adr = SMP_ADR,
+    .port = SMP_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2}
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "sampler: %s\n", what);
+        failed = true;
+    }
+}
+
+static void smp_pattern(max31790_frame_t *frame, uint32_t seq)
+{
+    memset(frame, 0, sizeof(*frame));
+    frame->timestamp_us = (int64_t)seq * 1000 + 7;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+        frame->tach_count[x] = (seq + x) & 0x7FF;
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+    {
+        frame->pwm_dutybits[x] = (seq ^ x) & 0x1FF;
+        frame->target_dutybits[x] = (seq + 3 * x) & 0x1FF;
+        frame->target_count[x] = (seq * 5 + x) & 0x7FF;
+    }
+
+    frame->fault_status_1 = seq & 0x3F;
+    frame->fault_status_2 = (seq >> 6) & 0x3F;
+}
+
+static bool smp_intact(const max31790_frame_t *frame)
+{
+    max31790_frame_t want;
+
+    if(!synthetic)
+        return frame->rslt == ESP_OK && frame->timestamp_us > 0;
+
+    smp_pattern(&want, frame->seq);
+    want.seq = frame->seq;
+    return !memcmp(&want, frame, sizeof(want));
+}
+
+static void *smp_reader(void *arg)
+{
+    smp_reader_t *r = arg;
+    max31790_frame_t frames[SMP_DEPTH];
+    uint32_t newest = 0;
+
+    while(!atomic_load_explicit(&readers_stop, memory_order_relaxed))
+    {
+        uint16_t n = MAX31790_sampler_history(sampler, frames, SMP_DEPTH);
+
+        r->calls++;
+        r->frames += n;
+        r->empty += !n;
+        r->full += (n == SMP_DEPTH);
+
+        if(!n)
+            continue;
+
+        r->back += frames[0].seq < newest;
+        newest = frames[0].seq;
+
+        for(uint16_t x = 0; x < n; x++)
+        {
+            r->torn += !smp_intact(&frames[x]);
+            r->gaps += x && frames[x].seq != frames[x - 1].seq - 1;
+        }
+    }
+
+    return NULL;
+}
+
+static void smp_readers_start(smp_reader_t *readers)
+{
+    memset(readers, 0, sizeof(smp_reader_t) * SMP_READERS);
+    atomic_store(&readers_stop, false);
+
+    for(uint8_t x = 0; x < SMP_READERS; x++)
+        pthread_create(&readers[x].thread, NULL, smp_reader, &readers[x]);
+}
+
+static void smp_readers_join(const char *part, smp_reader_t *readers, uint32_t published)
+{
+    smp_reader_t sum = {0};
+
+    atomic_store(&readers_stop, true);
+
+    for(uint8_t x = 0; x < SMP_READERS; x++)
+    {
+        pthread_join(readers[x].thread, NULL);
+        sum.calls += readers[x].calls;
+        sum.frames += readers[x].frames;
+        sum.empty += readers[x].empty;
+        sum.full += readers[x].full;
+        sum.torn += readers[x].torn;
+        sum.gaps += readers[x].gaps;
+        sum.back += readers[x].back;
+    }
+
+    printf("{\"part\":\"%s\",\"readers\":%d,\"depth\":%d,\"published\":%u,\"calls\":%llu,\"frames_per_call\":%.2f,"
+           "\"empty\":%llu,\"full\":%llu,\"torn\":%llu,\"gaps\":%llu,\"back\":%llu}\n",
+           part, SMP_READERS, SMP_DEPTH, published, (unsigned long long)sum.calls, sum.calls ? (double)sum.frames / sum.calls : 0.0,
+           (unsigned long long)sum.empty, (unsigned long long)sum.full, (unsigned long long)sum.torn,
+           (unsigned long long)sum.gaps, (unsigned long long)sum.back);
+
+    check("torn frame", sum.torn == 0);
+    check("history window not consecutive", sum.gaps == 0);
+    check("newest frame went back", sum.back == 0);
+    check("readers got no frames", sum.frames > 0);
+    check("no full window", sum.full > 0);
+}
+
+static void *smp_producer(void *arg)
+{
+    max31790_frame_t frame;
+    uint32_t *published = arg;
+
+    for(uint32_t seq = 0; !atomic_load_explicit(&producer_stop, memory_order_relaxed); seq++)
+    {
+        smp_pattern(&frame, seq);                                                                   // seq is the head publish will stamp, single producer
+        MAX31790_sampler_publish(sampler, &frame);
+        *published = seq + 1;
+    }
+
+    return NULL;
+}
+
+static void smp_ring(void)
+{
+    smp_reader_t readers[SMP_READERS];
+    pthread_t producer;
+    uint32_t published = 0;
+
+    sampler = &ring_sampler;
+    synthetic = true;
+    atomic_store(&producer_stop, false);
+    smp_readers_start(readers);
+    pthread_create(&producer, NULL, smp_producer, &published);
+
+    vTaskDelay(pdMS_TO_TICKS(SMP_RING_MS));
+
+    atomic_store(&producer_stop, true);
+    pthread_join(producer, NULL);
+    smp_readers_join("ring", readers, published);
+
+    check("producer stalled", published > SMP_DEPTH);
+}
+
+static void smp_task(void)
+{
+    smp_reader_t readers[SMP_READERS];
+    int64_t stop_max_us = 0;
+    uint32_t lost = 0;                                                                              // Port token not free after a stop
+    uint32_t moved = 0;                                                                             // Frames published after a stop
+
+    sampler = &task_sampler;
+    synthetic = false;
+    smp_readers_start(readers);
+
+    for(uint32_t x = 0; x < SMP_TASK_CYCLES; x++)
+    {
+        int64_t start_us = 0;
+        unsigned head = 0;
+
+        if(MAX31790_sampler_start(sampler, 1) != ESP_OK)
+        {
+            check("task start", false);
+            break;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(SMP_TASK_RUN_MS + x % SMP_TASK_PERIOD_MS));
+
+        start_us = esp_timer_get_time();
+        MAX31790_sampler_stop(sampler);
+        start_us = esp_timer_get_time() - start_us;
+        stop_max_us = (start_us > stop_max_us) ? start_us : stop_max_us;
+
+        if(I2CMANAGER_take(SMP_PORT, 0) == ESP_OK)
+            I2CMUTEX_GIVE_PORT(SMP_PORT);
+        else
+            lost++;
+
+        head = atomic_load(&sampler->head);
+        vTaskDelay(pdMS_TO_TICKS(2 * SMP_TASK_PERIOD_MS));
+        moved += atomic_load(&sampler->head) != head;
+    }
+
+    smp_readers_join("task", readers, atomic_load(&sampler->head));
+
+    printf("{\"part\":\"task_stop\",\"cycles\":%d,\"period_ms\":%d,\"stop_max_us\":%lld,\"token_lost\":%u,\"published_after_stop\":%u}\n",
+           SMP_TASK_CYCLES, SMP_TASK_PERIOD_MS, (long long)stop_max_us, lost, moved);
+
+    check("port token held after stop", lost == 0);
+    check("task still publishing after stop", moved == 0);
+    check("stop slower than a period and a capture", stop_max_us < SMP_STOP_MAX_MS * 1000);
+}
+
+int main(int argc, char **argv)
+{
+    max31790_sampler_config_t sc = {.period_ms = SMP_TASK_PERIOD_MS, .depth = SMP_DEPTH};
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, SMP_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(SMP_PORT, &max31790sim_backend, &bus) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK ||
+       MAX31790_sampler_init(&ring_sampler, &cfg, &sc) != ESP_OK || MAX31790_sampler_init(&task_sampler, &cfg, &sc) != ESP_OK)
+    {
+        fprintf(stderr, "sampler: setup failed\n");
+        return 1;
+    }
+
+    smp_ring();
+    smp_task();
+
+    check("re-init of a stopped sampler", MAX31790_sampler_init(&task_sampler, &cfg, &sc) == ESP_OK && task_sampler.exited);
+
+    MAX31790_sampler_deinit(&ring_sampler);
+    MAX31790_sampler_deinit(&task_sampler);
+    check("deinit left the ring", !ring_sampler.slots && !task_sampler.slots && !task_sampler.exited);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+/******************************************************
+  Description: Adaptive tach scheduler against a fixed
+               period burst of all 12 inputs and the
+               old one channel per second round robin,
+               on simulated fans with ramps and a rotor
+               locked part way, in model time.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sched.h"
+#include "MAX31790Sim.h"
+
+#define SCHED_ADR           0x20
+#define SCHED_PORT          0
+#define SCHED_TICK_MS       50
+#define SCHED_RUN_MS        60000
+#define SCHED_WARM_MS       5000
+#define SCHED_LOCK_MS       30000               // Rotor of SCHED_LOCK_FAN seizes
+#define SCHED_LOCK_FAN      4
+#define SCHED_RAMP_EVERY_MS 10000               // Ramping fans swap between the two duties
+#define SCHED_DUTY_LO       400                 // Permille, well above the threshold at rpm_max
+#define SCHED_DUTY_HI       800
+#define SCHED_THRESHOLD_RPM 600
+#define SCHED_FIXED_MS      100                 // Fixed burst baseline period
+#define SCHED_RR_MS         1000                // Round robin baseline, one input per period
+
+enum { STRAT_SCHED = 0, STRAT_FIXED, STRAT_RR, STRAT_COUNT };
+
+typedef struct
+{
+    const char *name;
+    double permille;                            // Measured wire time over the run, ramp writes included
+    int64_t detect_ms;                          // Lock to first read under threshold, -1 never
+    uint32_t false_alarms;                      // Other fans reported under threshold
+    uint32_t transactions;
+    uint32_t deferred;
+    uint32_t stale_max_ms;
+} sched_result_t;
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_sched_t sched;
+static sched_result_t *result;
+static int64_t sim_ms;
+static bool failed;
+
+static const uint8_t ramping[] = {1, 2};        // Channels 2 and 3, tach inputs 2, 3, 8 and 9
+static const char *names[STRAT_COUNT] = {"adaptive", "fixed_burst", "round_robin"};
+
+static max31790_master_config_t cfg =
+{
+    .adr = SCHED_ADR,
+    .port = SCHED_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH,
+                MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH,
+                MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH, MAX31790_FAN_CFG_TACH_INPUT | MAX31790_FAN_CFG_PWM_TACH_TACH},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "sched: %s\n", what);
+        failed = true;
+    }
+}
+
+static void sched_seen(uint8_t fan_number, uint32_t rpm)
+{
+    bool below = rpm < SCHED_THRESHOLD_RPM;
+
+    if(below && fan_number == SCHED_LOCK_FAN && sim_ms >= SCHED_LOCK_MS && result->detect_ms < 0)
+        result->detect_ms = sim_ms - SCHED_LOCK_MS;
+    else if(below && fan_number != SCHED_LOCK_FAN)
+        result->false_alarms++;
+}
+
+static void on_cross(max31790_handle_t dev, uint8_t fan_number, uint32_t rpm, bool below, void *arg)
+{
+    if(below)
+        sched_seen(fan_number, rpm);
+}
+
+static void sched_read(uint8_t first, uint8_t count)                                                // Baselines, the same burst read the scheduler issues
+{
+    uint8_t burst[NUM_TACH_CHANNEL * 2];
+
+    if(MAX31790_get_regs(&cfg, MAX31790_REG_TACH_COUNT(first), burst, count * 2) != ESP_OK)
+    {
+        check("baseline read", false);
+        return;
+    }
+
+    for(uint8_t x = 0; x < count; x++)
+        sched_seen(first + x, MAX31790_count_to_rpm(&cfg, first + x, REG_TO_LFTJST(11, burst[x * 2], burst[x * 2 + 1])));
+}
+
+static void sched_run(uint8_t strat, sched_result_t *r)
+{
+    max31790_sched_config_t sc = {.tick_ms = SCHED_TICK_MS};
+    max31790_sched_report_t report;
+    uint64_t bus_ns = 0;
+    int64_t base_ms = 0;                                                                            // Scheduler time of model time 0
+
+    memset(r, 0, sizeof(*r));
+    r->name = names[strat];
+    r->detect_ms = -1;
+    result = r;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+        sc.threshold_rpm[x] = SCHED_THRESHOLD_RPM;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, SCHED_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(SCHED_PORT, &max31790sim_backend, &bus) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK)
+    {
+        fprintf(stderr, "sched: setup failed\n");
+        exit(1);
+    }
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        MAX31790_set_target_dutybits(&cfg, x, MAX31790_permille_to_bits(SCHED_DUTY_HI));
+
+    MAX31790SIM_bus_step(&bus, SCHED_WARM_MS);
+    MAX31790SIM_bus_reset_counters(&bus);
+
+    base_ms = esp_timer_get_time() / 1000;
+    if(strat == STRAT_SCHED && MAX31790_sched_init(&sched, &cfg, &sc, on_cross, NULL) != ESP_OK)
+    {
+        fprintf(stderr, "sched: init failed\n");
+        exit(1);
+    }
+
+    for(sim_ms = 0; sim_ms < SCHED_RUN_MS; sim_ms += SCHED_TICK_MS)
+    {
+        if(sim_ms && !(sim_ms % SCHED_RAMP_EVERY_MS))
+        {
+            uint16_t permille = ((sim_ms / SCHED_RAMP_EVERY_MS) & 0x01) ? SCHED_DUTY_LO : SCHED_DUTY_HI;
+
+            for(uint8_t x = 0; x < sizeof(ramping); x++)
+                MAX31790_set_target_dutybits(&cfg, ramping[x], MAX31790_permille_to_bits(permille));
+        }
+
+        sim.fan[SCHED_LOCK_FAN].locked = sim_ms >= SCHED_LOCK_MS;
+
+        if(strat == STRAT_SCHED)
+            MAX31790_sched_tick(&sched, base_ms + sim_ms);
+        else if(strat == STRAT_FIXED && !(sim_ms % SCHED_FIXED_MS))
+            sched_read(0, NUM_TACH_CHANNEL);
+        else if(strat == STRAT_RR && !(sim_ms % SCHED_RR_MS))
+            sched_read((sim_ms / SCHED_RR_MS) % NUM_TACH_CHANNEL, 1);
+
+        MAX31790SIM_bus_step(&bus, SCHED_TICK_MS);
+    }
+
+    bus_ns = bus.bus_time_ns;
+    r->permille = (double)bus_ns * PERMILLE_MAX / ((double)SCHED_RUN_MS * 1000000);
+    r->transactions = bus.transactions;
+
+    if(strat == STRAT_SCHED)
+    {
+        MAX31790_sched_report(&sched, base_ms + sim_ms, &report);
+        r->deferred = report.deferred;
+
+        for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+            r->stale_max_ms = (report.stale_max_ms[x] > r->stale_max_ms) ? report.stale_max_ms[x] : r->stale_max_ms;
+    }
+    else
+    {
+        r->stale_max_ms = (strat == STRAT_FIXED) ? SCHED_FIXED_MS : SCHED_RR_MS * NUM_TACH_CHANNEL;
+    }
+
+    printf("{\"strategy\":\"%s\",\"run_ms\":%d,\"bus_permille\":%.2f,\"transactions\":%u,\"detect_ms\":%lld,\"false_alarms\":%u,\"stale_max_ms\":%u,\"deferred\":%u}\n",
+           r->name, SCHED_RUN_MS, r->permille, r->transactions, (long long)r->detect_ms, r->false_alarms, r->stale_max_ms, r->deferred);
+}
+
+int main(int argc, char **argv)
+{
+    sched_result_t r[STRAT_COUNT];
+
+    for(uint8_t x = 0; x < STRAT_COUNT; x++)
+        sched_run(x, &r[x]);
+
+    check("adaptive never saw the lock", r[STRAT_SCHED].detect_ms >= 0);
+    check("fixed burst never saw the lock", r[STRAT_FIXED].detect_ms >= 0);
+    check("adaptive over its budget", r[STRAT_SCHED].permille <= MAX31790_SCHED_DEF_BUDGET);
+    check("adaptive bus load not below the fixed burst", r[STRAT_SCHED].permille < r[STRAT_FIXED].permille);
+    check("adaptive detection slower than the fixed burst", r[STRAT_SCHED].detect_ms <= r[STRAT_FIXED].detect_ms + SCHED_TICK_MS);   // Ticks are the scheduler's resolution
+    check("adaptive detection not faster than round robin", r[STRAT_RR].detect_ms < 0 || r[STRAT_SCHED].detect_ms < r[STRAT_RR].detect_ms);
+    check("false alarms on running fans", !r[STRAT_SCHED].false_alarms && !r[STRAT_FIXED].false_alarms && !r[STRAT_RR].false_alarms);
+
+    return failed ? 1 : 0;
+}
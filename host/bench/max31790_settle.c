@@ -0,0 +1,294 @@
+/******************************************************
+  Description: Settling of setpoint profiles and mode
+               switches against the simulated fan: time
+               to band, overshoot, slew and acceleration,
+               final speed and the switch bump checked,
+               ramps never harsher than their step.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Ramp.h"
+#include "MAX31790Sim.h"
+
+#define SETTLE_ADR          0x20
+#define SETTLE_PORT         0
+#define SETTLE_CH           0
+#define SETTLE_WINDOW_MS    8000                // Observed after the command, the fan is settled by the end
+#define SETTLE_PRE_MS       6000                // Steady state before the command
+#define SETTLE_BAND         20                  // Permille of the final speed
+#define SETTLE_DIFF_MS      10                  // Slew and acceleration are taken over this span
+#define SETTLE_RAMP_MS      2000
+#define SETTLE_DUTY_LOW     154                 // 30 %, above the simulated start duty
+#define SETTLE_DUTY_HIGH    460                 // 90 %
+#define SETTLE_RPM_LOW      600
+#define SETTLE_RPM_HIGH     2700                // Also SETTLE_DUTY_HIGH on the 3000 rpm fan
+
+typedef void (*settle_fn_t)(void);
+
+typedef struct
+{
+    const char *name;
+    settle_fn_t setup;                          // Before SETTLE_PRE_MS of steady running
+    settle_fn_t cmd;                            // At t = 0
+    uint32_t target_rpm;                        // Expected final speed, 0: the speed before the command
+} settle_case_t;
+
+typedef struct
+{
+    bool ran;
+    float final;
+    float tol;                                  // Final speed tolerance
+    float dev_max;
+    float overshoot;
+    float slew_max;                             // rpm/s
+    float accel_max;                            // rpm/s^2, what is heard as a spike
+    uint32_t settle_ms;
+} settle_result_t;
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static max31790_ramp_t ramp;
+static int64_t now_ms;
+static max31790_master_config_t cfg;
+static bool failed;
+
+static const max31790_master_config_t cfg_init =
+{
+    .adr = SETTLE_ADR,
+    .port = SETTLE_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+static const max31790_ramp_config_t ramp_cfg = {.rpm_full = {3000, 3000, 3000, 3000, 3000, 3000}};
+
+/* Time advances one simulated millisecond at a time, the ramp ticks on its own period */
+static void settle_step(void)
+{
+    MAX31790SIM_bus_step(&bus, 1);
+    now_ms++;
+
+    if(!(now_ms % ramp.cfg.tick_ms))
+        MAX31790_ramp_tick(&ramp, now_ms);
+}
+
+static void settle_run(uint32_t ms)
+{
+    for(uint32_t x = 0; x < ms; x++)
+        settle_step();
+}
+
+/* Cases ------------------------------------------------------------------------------------- */
+static void pwm_low(void)          { MAX31790_set_target_dutybits(&cfg, SETTLE_CH, SETTLE_DUTY_LOW); }
+static void pwm_mid(void)          { MAX31790_set_target_dutybits(&cfg, SETTLE_CH, DUTYBITS_MAX / 2); }
+static void pwm_step(void)         { MAX31790_set_target_dutybits(&cfg, SETTLE_CH, SETTLE_DUTY_HIGH); }
+static void pwm_linear(void)       { MAX31790_ramp_duty(&ramp, SETTLE_CH, SETTLE_DUTY_HIGH, SETTLE_RAMP_MS, MAX31790_RAMP_LINEAR); }
+static void pwm_s_curve(void)      { MAX31790_ramp_duty(&ramp, SETTLE_CH, SETTLE_DUTY_HIGH, SETTLE_RAMP_MS, MAX31790_RAMP_S_CURVE); }
+
+static void rpm_low(void)
+{
+    MAX31790_set_target_dutybits(&cfg, SETTLE_CH, SETTLE_DUTY_LOW);
+    settle_run(SETTLE_PRE_MS);
+    MAX31790_set_mode_bumpless(&cfg, SETTLE_CH, MAX31790_FAN_CFG_MODE_RPM);
+    MAX31790_set_target_rpm(&cfg, SETTLE_CH, SETTLE_RPM_LOW);
+}
+
+static void rpm_step(void)         { MAX31790_set_target_rpm(&cfg, SETTLE_CH, SETTLE_RPM_HIGH); }
+static void rpm_linear(void)       { MAX31790_ramp_rpm(&ramp, SETTLE_CH, SETTLE_RPM_HIGH, SETTLE_RAMP_MS, MAX31790_RAMP_LINEAR); }
+static void rpm_s_curve(void)      { MAX31790_ramp_rpm(&ramp, SETTLE_CH, SETTLE_RPM_HIGH, SETTLE_RAMP_MS, MAX31790_RAMP_S_CURVE); }
+
+static void switch_naive(void)                                                                      // TARGET_COUNT still holds whatever was there
+{
+    uint8_t fan_cfg = 0;
+
+    MAX31790_get_fan_config(&cfg, SETTLE_CH, &fan_cfg);
+    MAX31790_set_fan_config(&cfg, fan_cfg | MAX31790_FAN_CFG_MODE_RPM, SETTLE_CH);
+}
+
+static void switch_bumpless(void)  { MAX31790_set_mode_bumpless(&cfg, SETTLE_CH, MAX31790_FAN_CFG_MODE_RPM); }
+
+static const settle_case_t cases[] =
+{
+    {"pwm_step",                    pwm_low,        pwm_step,           SETTLE_RPM_HIGH},
+    {"pwm_ramp_linear",             pwm_low,        pwm_linear,         SETTLE_RPM_HIGH},
+    {"pwm_ramp_s_curve",            pwm_low,        pwm_s_curve,        SETTLE_RPM_HIGH},
+    {"rpm_step",                    rpm_low,        rpm_step,           SETTLE_RPM_HIGH},
+    {"rpm_ramp_linear",             rpm_low,        rpm_linear,         SETTLE_RPM_HIGH},
+    {"rpm_ramp_s_curve",            rpm_low,        rpm_s_curve,        SETTLE_RPM_HIGH},
+    {"mode_switch_naive",           pwm_mid,        switch_naive,       0},
+    {"mode_switch_bumpless",        pwm_mid,        switch_bumpless,    0},
+};
+
+enum { CASE_PWM_STEP, CASE_PWM_LINEAR, CASE_PWM_S_CURVE, CASE_RPM_STEP, CASE_RPM_LINEAR, CASE_RPM_S_CURVE,
+       CASE_SWITCH_NAIVE, CASE_SWITCH_BUMPLESS, CASE_COUNT };
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "settle: %s\n", what);
+        failed = true;
+    }
+}
+
+/* The chip's loop rests anywhere within WINDOW counts of TARGET_COUNT, in the speed range it ended on */
+static float settle_window_rpm(float rpm)
+{
+    uint8_t window = 0;
+    uint16_t count = MAX31790_rpm_to_count(&cfg, SETTLE_CH, rpm);
+
+    MAX31790_get_window(&cfg, 0, SETTLE_CH, &window);
+
+    return count ? rpm * window / count : rpm;
+}
+
+/* Measurement ------------------------------------------------------------------------------- */
+static void settle_case(const settle_case_t *c, settle_result_t *r)
+{
+    static float trace[SETTLE_WINDOW_MS + 1];
+    float final = 0;
+    float before = 0;
+    float band = 0;
+    float overshoot = 0;
+    float dev_max = 0;
+    float slew_max = 0;
+    float accel_max = 0;
+    uint32_t settle_ms = 0;
+    uint32_t tx = 0;
+    uint8_t fan_cfg = 0;
+    bool rising = false;
+
+    i2cmanager_dev_t *i2c = cfg.i2c;                                                                // Every case starts from the same chip and config
+
+    cfg = cfg_init;
+    cfg.i2c = i2c;
+    memset(ramp.chan, 0, sizeof(ramp.chan));
+
+    MAX31790SIM_init(&sim, SETTLE_ADR);
+    MAX31790_initiate(&cfg);
+
+    c->setup();
+    settle_run(SETTLE_PRE_MS);
+
+    before = sim.rpm[SETTLE_CH];
+    tx = bus.transactions;
+    c->cmd();
+
+    trace[0] = before;
+    for(uint32_t t = 1; t <= SETTLE_WINDOW_MS; t++)
+    {
+        settle_step();
+        trace[t] = sim.rpm[SETTLE_CH];
+    }
+
+    tx = bus.transactions - tx;                                                                     // The checks below read the chip too
+
+    final = trace[SETTLE_WINDOW_MS];
+    band = final * SETTLE_BAND / PERMILLE_MAX;
+    rising = final > before;
+
+    for(uint32_t t = 0; t <= SETTLE_WINDOW_MS; t++)
+    {
+        float over = rising ? trace[t] - final : final - trace[t];
+        float dev = (trace[t] > before) ? trace[t] - before : before - trace[t];
+
+        if(trace[t] > final + band || trace[t] < final - band)
+            settle_ms = t + 1;
+        if(over > overshoot)
+            overshoot = over;
+        if(dev > dev_max)
+            dev_max = dev;
+
+        if(t >= 2 * SETTLE_DIFF_MS)
+        {
+            float slew = (trace[t] - trace[t - SETTLE_DIFF_MS]) * 1000.0f / SETTLE_DIFF_MS;        // rpm/s
+            float slew_prev = (trace[t - SETTLE_DIFF_MS] - trace[t - 2 * SETTLE_DIFF_MS]) * 1000.0f / SETTLE_DIFF_MS;
+            float accel = (slew - slew_prev) * 1000.0f / SETTLE_DIFF_MS;                               // rpm/s^2
+
+            slew = (slew < 0) ? -slew : slew;
+            accel = (accel < 0) ? -accel : accel;
+
+            if(slew > slew_max)
+                slew_max = slew;
+            if(accel > accel_max)
+                accel_max = accel;
+        }
+    }
+
+    r->ran = true;
+    r->final = final;
+    r->dev_max = dev_max;
+    r->overshoot = overshoot;
+    r->slew_max = slew_max;
+    r->accel_max = accel_max;
+    r->settle_ms = settle_ms;
+    r->tol = (c->target_rpm ? c->target_rpm : before) * SETTLE_BAND / PERMILLE_MAX;
+
+    MAX31790_get_fan_config(&cfg, SETTLE_CH, &fan_cfg);
+    if(fan_cfg & MAX31790_FAN_CFG_MODE_RPM)                                                         // Closed loop, the chip's window rather than the settle band
+        r->tol = settle_window_rpm(c->target_rpm ? c->target_rpm : before);
+
+    printf("{\"case\":\"%s\",\"rpm_before\":%.0f,\"rpm_final\":%.0f,\"rpm_tolerance\":%.1f,\"settle_ms\":%u,\"overshoot_rpm\":%.1f,\"deviation_max_rpm\":%.1f,"
+           "\"slew_max_rpm_s\":%.0f,\"accel_max_rpm_s2\":%.0f,\"tx\":%u}\n",
+           c->name, before, final, r->tol, settle_ms, overshoot, dev_max, slew_max, accel_max, tx);
+
+    if(c->target_rpm)
+        check("final speed off target", final >= c->target_rpm - r->tol && final <= c->target_rpm + r->tol);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = (argc > 1) ? argv[1] : NULL;
+    settle_result_t r[CASE_COUNT] = {0};
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, SETTLE_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    cfg = cfg_init;
+
+    if(I2CMANAGER_set_backend(SETTLE_PORT, &max31790sim_backend, &bus) != ESP_OK ||
+       MAX31790_initiate(&cfg) != ESP_OK ||
+       MAX31790_ramp_init(&ramp, &cfg, &ramp_cfg) != ESP_OK)
+    {
+        fprintf(stderr, "settle: setup failed\n");
+        return 1;
+    }
+
+    for(size_t x = 0; x < CASE_COUNT; x++)
+        if(!filter || strstr(cases[x].name, filter))
+            settle_case(&cases[x], &r[x]);
+
+    for(uint8_t x = CASE_PWM_LINEAR; x <= CASE_RPM_S_CURVE; x++)                                   // Ramps against the step of their own mode
+    {
+        uint8_t step = (x < CASE_RPM_STEP) ? CASE_PWM_STEP : CASE_RPM_STEP;
+
+        if(x == CASE_RPM_STEP || !r[x].ran || !r[step].ran)
+            continue;
+
+        check("ramp slews faster than the step", r[x].slew_max <= r[step].slew_max);
+        check("ramp accelerates harder than the step", r[x].accel_max <= r[step].accel_max);
+        check("ramp overshoots more than the step", r[x].overshoot <= r[step].overshoot);
+
+        if(step == CASE_RPM_STEP)                                                                   // Open loop ramps keep to the step's rate and cannot beat it, closed loop ones
+            check("ramp settles slower than the step", r[x].settle_ms <= r[step].settle_ms);        // spare the loop winding up on the fan's lag
+    }
+
+    if(r[CASE_SWITCH_BUMPLESS].ran)                                                                 // Speed stays inside the loop's window of where it was
+        check("bumpless switch moved the fan", r[CASE_SWITCH_BUMPLESS].dev_max <= r[CASE_SWITCH_BUMPLESS].tol);
+    if(r[CASE_SWITCH_NAIVE].ran)                                                                    // Else the bench would not see a bump at all
+        check("naive switch showed no bump", r[CASE_SWITCH_NAIVE].dev_max > r[CASE_SWITCH_NAIVE].tol);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,307 @@
+/******************************************************
+  Description: I2CManager statistics on the simulated
+               bus: clean transfers, injected NAKs,
+               clock stretch and timeouts, then the
+               counters, histograms and packed dump
+               checked against what was driven.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Sim.h"
+
+#define STATS_ADR           0x20
+#define STATS_PORT          0
+#define STATS_TIMEOUT_MS    20
+#define STATS_RETRIES       2                   // Three attempts per call
+#define STATS_CLEAN_READS   100
+#define STATS_CLEAN_WRITES  50
+#define STATS_NAK_ONCE      20                  // Reads recovered by the first retry
+#define STATS_NAK_ALWAYS    5                   // Reads that NAK every attempt
+#define STATS_STRETCH       10                  // Reads with the clock held STATS_STRETCH_US
+#define STATS_STRETCH_US    3000
+#define STATS_TIMED_OUT     2                   // Reads stretched past STATS_TIMEOUT_MS on every attempt
+#define STATS_LOCK_MISSES   3                   // Takes refused while the token is held
+#define STATS_READ_LEN      2                   // One tach count
+#define STATS_MAGIC         "I2CS"
+#define STATS_VERSION       1
+
+static max31790sim_bus_t bus;
+static max31790sim_dev_t sim;
+static i2cmanager_dev_t *dev;
+static uint32_t takes;                          // Successful takes the bench made since the reset
+static bool failed;
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "stats: %s\n", what);
+        failed = true;
+    }
+}
+
+static uint8_t stats_bucket(int64_t us)                                                             // [0] < 1 us, [n] < 2^n us, last open ended
+{
+    uint8_t bucket = 0;
+
+    for(; us > 0 && bucket < I2CMANAGER_STATS_BUCKETS - 1; us >>= 1)
+        bucket++;
+
+    return bucket;
+}
+
+static uint32_t stats_hist_sum(const uint32_t *hist, uint8_t from)
+{
+    uint32_t sum = 0;
+
+    for(uint8_t x = from; x < I2CMANAGER_STATS_BUCKETS; x++)
+        sum += hist[x];
+
+    return sum;
+}
+
+static esp_err_t stats_read(void)
+{
+    uint8_t buff[STATS_READ_LEN];
+    esp_err_t rslt = I2CMANAGER_take(STATS_PORT, pdMS_TO_TICKS(I2CMANAGER_LOCK_MS));
+
+    if(rslt != ESP_OK)
+        return rslt;
+
+    takes++;
+    rslt = I2CMANAGER_dev_read(dev, MAX31790_REG_TACH_COUNT(0), buff, sizeof(buff));
+    I2CMUTEX_GIVE_PORT(STATS_PORT);
+
+    return rslt;
+}
+
+static esp_err_t stats_write(uint8_t val)
+{
+    esp_err_t rslt = I2CMANAGER_take(STATS_PORT, pdMS_TO_TICKS(I2CMANAGER_LOCK_MS));
+
+    if(rslt != ESP_OK)
+        return rslt;
+
+    takes++;
+    rslt = I2CMANAGER_dev_write(dev, MAX31790_REG_USER_BYTE_0, &val, 1);
+    I2CMUTEX_GIVE_PORT(STATS_PORT);
+
+    return rslt;
+}
+
+static const uint8_t *stats_get32(const uint8_t *buff, uint32_t *val)
+{
+    *val = 0;
+    for(uint8_t x = 0; x < 4; x++)
+        *val |= (uint32_t)*buff++ << (8 * x);
+
+    return buff;
+}
+
+static const uint8_t *stats_get64(const uint8_t *buff, uint64_t *val)
+{
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+
+    buff = stats_get32(buff, &lo);
+    buff = stats_get32(buff, &hi);
+    *val = ((uint64_t)hi << 32) | lo;
+
+    return buff;
+}
+
+static const uint8_t *stats_get_hist(const uint8_t *buff, uint32_t *hist)
+{
+    for(uint8_t x = 0; x < I2CMANAGER_STATS_BUCKETS; x++)
+        buff = stats_get32(buff, &hist[x]);
+
+    return buff;
+}
+
+static size_t stats_parse(const uint8_t *buff, i2cmanager_stats_t *s)                              // Mirror of the dump layout, returns the bytes consumed
+{
+    const uint8_t *p = buff + 8;
+
+    memset(s, 0, sizeof(*s));
+
+    for(uint8_t op = I2CMANAGER_OP_WRITE; op <= I2CMANAGER_OP_READ; op++)
+    {
+        uint32_t max = 0;
+
+        p = stats_get32(p, &s->op[op].calls);
+        for(uint8_t x = 0; x < I2CMANAGER_ERR_CLASSES; x++)
+            p = stats_get32(p, &s->op[op].errors[x]);
+        p = stats_get64(p, &s->op[op].bytes);
+        p = stats_get64(p, &s->op[op].bus_us_total);
+        p = stats_get32(p, &max);
+        s->op[op].bus_us_max = max;
+        p = stats_get_hist(p, s->op[op].bus_hist);
+    }
+
+    p = stats_get32(p, &s->lock_takes);
+    p = stats_get32(p, &s->lock_timeouts);
+    p = stats_get64(p, &s->lock_us_total);
+    p = stats_get32(p, &s->lock_us_max);
+    p = stats_get_hist(p, s->lock_hist);
+
+    return p - buff;
+}
+
+static bool stats_op_equal(const i2cmanager_op_stats_t *a, const i2cmanager_op_stats_t *b)
+{
+    return a->calls == b->calls && !memcmp(a->errors, b->errors, sizeof(a->errors)) && a->bytes == b->bytes &&
+           a->bus_us_total == b->bus_us_total && a->bus_us_max == b->bus_us_max && !memcmp(a->bus_hist, b->bus_hist, sizeof(a->bus_hist));
+}
+
+static void stats_drive(void)
+{
+    uint32_t wrong = 0;                                                                             // Calls that did not end as injected
+
+    for(uint32_t x = 0; x < STATS_CLEAN_READS; x++)
+        wrong += stats_read() != ESP_OK;
+
+    for(uint32_t x = 0; x < STATS_CLEAN_WRITES; x++)
+        wrong += stats_write(x) != ESP_OK;
+
+    for(uint32_t x = 0; x < STATS_NAK_ONCE; x++)
+    {
+        MAX31790SIM_bus_inject_nak(&bus, 1);
+        wrong += stats_read() != ESP_OK;
+    }
+
+    for(uint32_t x = 0; x < STATS_NAK_ALWAYS; x++)
+    {
+        MAX31790SIM_bus_inject_nak(&bus, STATS_RETRIES + 1);
+        wrong += stats_read() != I2CMANAGER_ERR_NACK;
+    }
+
+    bus.cfg.real_time = true;                                                                       // Stretch is waited out, the histogram sees it
+    bus.cfg.stretch_us = STATS_STRETCH_US;
+
+    for(uint32_t x = 0; x < STATS_STRETCH; x++)
+        wrong += stats_read() != ESP_OK;
+
+    bus.cfg.stretch_us = STATS_TIMEOUT_MS * 1000 * 3 / 2;
+
+    for(uint32_t x = 0; x < STATS_TIMED_OUT; x++)
+        wrong += stats_read() != ESP_ERR_TIMEOUT;
+
+    bus.cfg.stretch_us = 0;
+    bus.cfg.real_time = false;
+
+    if(I2CMANAGER_take(STATS_PORT, 0) == ESP_OK)
+    {
+        takes++;
+
+        for(uint32_t x = 0; x < STATS_LOCK_MISSES; x++)
+            wrong += I2CMANAGER_take(STATS_PORT, 0) != I2CMANAGER_ERR_LOCK;                         // Binary token, a second take fails
+
+        I2CMUTEX_GIVE_PORT(STATS_PORT);
+    }
+
+    check("call did not end as injected", wrong == 0);
+}
+
+static void stats_check(const i2cmanager_stats_t *s)
+{
+    const i2cmanager_op_stats_t *r = &s->op[I2CMANAGER_OP_READ];
+    const i2cmanager_op_stats_t *w = &s->op[I2CMANAGER_OP_WRITE];
+    uint32_t read_ok = STATS_CLEAN_READS + STATS_NAK_ONCE + STATS_STRETCH;
+    uint32_t read_nak = STATS_NAK_ONCE + (STATS_RETRIES + 1) * STATS_NAK_ALWAYS;
+    uint32_t read_timeout = (STATS_RETRIES + 1) * STATS_TIMED_OUT;
+    uint8_t stretch_bucket = stats_bucket(STATS_STRETCH_US);
+    uint8_t timeout_bucket = stats_bucket(STATS_TIMEOUT_MS * 1000);
+
+    printf("{\"part\":\"counters\",\"read_calls\":%u,\"read_ok\":%u,\"read_fail\":%u,\"read_timeout\":%u,\"read_bytes\":%llu,\"read_us_max\":%u,"
+           "\"write_calls\":%u,\"write_bytes\":%llu,\"lock_takes\":%u,\"lock_timeouts\":%u}\n",
+           r->calls, r->errors[I2CMANAGER_ERR_OK], r->errors[I2CMANAGER_ERR_FAIL], r->errors[I2CMANAGER_ERR_TIMEOUT], (unsigned long long)r->bytes,
+           r->bus_us_max, w->calls, (unsigned long long)w->bytes, s->lock_takes, s->lock_timeouts);
+
+    printf("{\"part\":\"histogram\",\"stretch_bucket\":%u,\"at_or_above_stretch\":%u,\"timeout_bucket\":%u,\"at_or_above_timeout\":%u,\"read_hist_sum\":%u,\"lock_hist_sum\":%u}\n",
+           stretch_bucket, stats_hist_sum(r->bus_hist, stretch_bucket), timeout_bucket, stats_hist_sum(r->bus_hist, timeout_bucket),
+           stats_hist_sum(r->bus_hist, 0), stats_hist_sum(s->lock_hist, 0));
+
+    check("read calls", r->calls == read_ok + read_nak + read_timeout);
+    check("read successes", r->errors[I2CMANAGER_ERR_OK] == read_ok);
+    check("NAKs not counted as failures", r->errors[I2CMANAGER_ERR_FAIL] == read_nak);
+    check("timeouts", r->errors[I2CMANAGER_ERR_TIMEOUT] == read_timeout);
+    check("other error classes", !r->errors[I2CMANAGER_ERR_INVALID_STATE] && !r->errors[I2CMANAGER_ERR_INVALID_ARG] && !r->errors[I2CMANAGER_ERR_OTHER]);
+    check("read bytes, successful transfers only", r->bytes == (uint64_t)read_ok * STATS_READ_LEN);
+    check("write calls", w->calls == STATS_CLEAN_WRITES && w->errors[I2CMANAGER_ERR_OK] == STATS_CLEAN_WRITES && w->bytes == STATS_CLEAN_WRITES);
+    check("read histogram does not sum to the calls", stats_hist_sum(r->bus_hist, 0) == r->calls);
+    check("write histogram does not sum to the calls", stats_hist_sum(w->bus_hist, 0) == w->calls);
+    check("stretched reads below the stretch bucket", stats_hist_sum(r->bus_hist, stretch_bucket) >= STATS_STRETCH + read_timeout);
+    check("timed out reads below the timeout bucket", stats_hist_sum(r->bus_hist, timeout_bucket) >= read_timeout);
+    check("read max under the timeout", r->bus_us_max >= STATS_TIMEOUT_MS * 1000);
+    check("lock takes", s->lock_takes == takes + 1);                                                // The get's own take is counted before the copy
+    check("lock timeouts", s->lock_timeouts == STATS_LOCK_MISSES);
+    check("lock histogram does not sum to the takes", stats_hist_sum(s->lock_hist, 0) == s->lock_takes);
+}
+
+static void stats_dump(const i2cmanager_stats_t *s)
+{
+    uint8_t buff[I2CMANAGER_STATS_DUMP_SIZE + 16];
+    i2cmanager_stats_t d;
+    esp_err_t short_rslt = ESP_OK;
+    esp_err_t rslt = ESP_OK;
+    size_t parsed = 0;
+    bool tail_kept = true;
+
+    memset(buff, 0xA5, sizeof(buff));
+    short_rslt = I2CMANAGER_stats_dump(STATS_PORT, buff, I2CMANAGER_STATS_DUMP_SIZE - 1);
+    check("short buffer accepted", short_rslt == ESP_ERR_INVALID_SIZE);
+
+    rslt = I2CMANAGER_stats_dump(STATS_PORT, buff, sizeof(buff));
+    parsed = stats_parse(buff, &d);
+
+    for(size_t x = I2CMANAGER_STATS_DUMP_SIZE; x < sizeof(buff); x++)
+        tail_kept &= buff[x] == 0xA5;
+
+    printf("{\"part\":\"dump\",\"size\":%d,\"parsed\":%zu,\"magic\":\"%.4s\",\"version\":%u,\"port\":%u,\"buckets\":%u,\"classes\":%u,\"short\":\"%s\"}\n",
+           I2CMANAGER_STATS_DUMP_SIZE, parsed, (const char *)buff, buff[4], buff[5], buff[6], buff[7], I2CMANAGER_err_to_name(short_rslt));
+
+    check("dump", rslt == ESP_OK);
+    check("dump magic", !memcmp(buff, STATS_MAGIC, 4));
+    check("dump header", buff[4] == STATS_VERSION && buff[5] == STATS_PORT && buff[6] == I2CMANAGER_STATS_BUCKETS && buff[7] == I2CMANAGER_ERR_CLASSES);
+    check("dump layout not I2CMANAGER_STATS_DUMP_SIZE", parsed == I2CMANAGER_STATS_DUMP_SIZE);
+    check("dump wrote past I2CMANAGER_STATS_DUMP_SIZE", tail_kept);
+    check("dumped transfer counters differ from get", stats_op_equal(&d.op[I2CMANAGER_OP_WRITE], &s->op[I2CMANAGER_OP_WRITE]) &&
+                                                      stats_op_equal(&d.op[I2CMANAGER_OP_READ], &s->op[I2CMANAGER_OP_READ]));
+    check("dumped lock counters differ from get", d.lock_takes == s->lock_takes + 1 && d.lock_timeouts == s->lock_timeouts);   // Plus the dump's own take
+}
+
+int main(int argc, char **argv)
+{
+    i2cmanager_dev_config_t dc = {.port = STATS_PORT, .adr = STATS_ADR, .timeout_ms = STATS_TIMEOUT_MS, .retries = STATS_RETRIES};
+    i2cmanager_stats_t s;
+
+    MAX31790SIM_bus_init(&bus, NULL);
+    MAX31790SIM_init(&sim, STATS_ADR);
+    MAX31790SIM_bus_attach(&bus, &sim);
+
+    if(I2CMANAGER_set_backend(STATS_PORT, &max31790sim_backend, &bus) != ESP_OK || I2CMANAGER_attach(&dc, &dev) != ESP_OK ||
+       I2CMANAGER_stats_reset(STATS_PORT) != ESP_OK)
+    {
+        fprintf(stderr, "stats: setup failed\n");
+        return 1;
+    }
+
+    check("bad port accepted", I2CMANAGER_stats_get(I2CMANAGER_NUM_PORTS, &s) == ESP_ERR_INVALID_ARG &&
+                               I2CMANAGER_stats_reset(I2CMANAGER_NUM_PORTS) == ESP_ERR_INVALID_ARG);
+
+    stats_drive();
+
+    check("get", I2CMANAGER_stats_get(STATS_PORT, &s) == ESP_OK);
+    stats_check(&s);
+    stats_dump(&s);
+
+    check("reset", I2CMANAGER_stats_reset(STATS_PORT) == ESP_OK && I2CMANAGER_stats_get(STATS_PORT, &s) == ESP_OK);
+    check("counters left after reset", !s.op[I2CMANAGER_OP_READ].calls && !s.op[I2CMANAGER_OP_WRITE].calls && !s.lock_timeouts && s.lock_takes == 1);
+
+    return failed ? 1 : 0;
+}
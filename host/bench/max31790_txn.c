@@ -0,0 +1,231 @@
+/******************************************************
+  Description: Transaction and byte counts of the driver
+               calls on the in-memory fake bus, checked
+               against what each call is specified to
+               put on the wire.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "I2CManagerFake.h"
+
+#define TXN_ADR             0x20
+#define TXN_PORT            0
+#define TXN_COUNT           0x0200              // Tach count preset on every input, left justified 11 bits
+
+#define TXN_READ(N, D)      ((D) + 3 * (N))     // Wire bytes of N reads carrying D data bytes: address, register, repeated start address
+#define TXN_WRITE(N, D)     ((D) + 2 * (N))     // Address and register
+#define TXN_CH              2
+
+static i2cmanager_fake_t fake;
+static uint8_t *regs;                           // The fake chip's register file
+static bool failed;
+
+static max31790_master_config_t cfg =
+{
+    .adr = TXN_ADR,
+    .port = TXN_PORT,
+    .global_cfg = 0x00,
+    .fan_failed_seq_start_cfg = 0x45,
+    .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+    .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+    .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+    .fault_mask_1 = 0x3F,
+    .fault_mask_2 = 0x3F
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "txn: %s\n", what);
+        failed = true;
+    }
+}
+
+/* Prints what the calls put on the wire since the last reset, checks it, resets */
+static void txn_expect(const char *name, esp_err_t rslt, uint32_t tx, uint32_t bytes)
+{
+    printf("{\"case\":\"%s\",\"result\":\"%s\",\"tx\":%u,\"bytes\":%u,\"want_tx\":%u,\"want_bytes\":%u}\n",
+           name, I2CMANAGER_err_to_name(rslt), fake.transactions, fake.bytes, tx, bytes);
+
+    check(name, rslt == ESP_OK && fake.transactions == tx && fake.bytes == bytes);
+
+    I2CMANAGER_fake_reset_counters(&fake);
+}
+
+static void txn_burst(void)
+{
+    uint32_t rpm[NUM_TACH_CHANNEL] = {0};
+    uint32_t one[NUM_TACH_CHANNEL] = {0};
+    esp_err_t rslt = ESP_OK;
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL; x++)
+    {
+        regs[MAX31790_REG_TACH_COUNT(x)] = LFTJST_TO_MSB(TXN_COUNT, 11);
+        regs[MAX31790_REG_TACH_COUNT(x) + 1] = LFTJST_TO_LSB(TXN_COUNT, 11);
+    }
+
+    I2CMANAGER_fake_reset_counters(&fake);
+
+    for(uint8_t x = 0; x < NUM_TACH_CHANNEL && rslt == ESP_OK; x++)
+        rslt = MAX31790_get_rpm(&cfg, x, false, &one[x]);
+    txn_expect("get_rpm_x12", rslt, NUM_TACH_CHANNEL, TXN_READ(NUM_TACH_CHANNEL, NUM_TACH_CHANNEL * 2));
+
+    rslt = MAX31790_get_all_rpm(&cfg, rpm);
+    txn_expect("get_all_rpm", rslt, 1, TXN_READ(1, NUM_TACH_CHANNEL * 2));                          // 0x18 - 0x2F, 24 bytes in one auto-increment read
+
+    check("burst and single reads disagree", !memcmp(rpm, one, sizeof(rpm)) && rpm[0] == MAX31790_count_to_rpm(&cfg, 0, TXN_COUNT));
+}
+
+static void txn_shadow(void)
+{
+    uint8_t reg = MAX31790_REG_TARGET_DUTY(TXN_CH);
+    uint8_t fan_cfg = 0;
+    uint8_t fan_dyn = 0;
+    esp_err_t rslt = ESP_OK;
+
+    I2CMANAGER_fake_reset_counters(&fake);
+
+    rslt = MAX31790_set_target_dutybits(&cfg, TXN_CH, 300);
+    txn_expect("setpoint", rslt, 1, TXN_WRITE(1, 2));
+
+    rslt = MAX31790_set_target_dutybits(&cfg, TXN_CH, 300);                                          // Unchanged, the shadow answers
+    txn_expect("setpoint_again", rslt, 0, 0);
+
+    rslt = MAX31790_get_fan_config(&cfg, TXN_CH, &fan_cfg);
+    if(rslt == ESP_OK)
+        rslt = MAX31790_get_fan_dynamic(&cfg, TXN_CH, &fan_dyn);
+    txn_expect("cached_getters", rslt, 0, 0);
+
+    rslt = MAX31790_flush(&cfg);                                                                    // Nothing dirty
+    txn_expect("flush_clean", rslt, 0, 0);
+
+    rslt = MAX31790_resync(&cfg);                                                                   // 0x00 - 0x3B and 0x40 - 0x67
+    txn_expect("resync", rslt, 2, TXN_READ(2, MAX31790_REG_PWM_DUTY(NUM_CHANNEL) + REG_MAP_SIZE - MAX31790_REG_TARGET_DUTY(0)));
+
+    rslt = MAX31790_get_fan_config(&cfg, TXN_CH, &fan_cfg);
+    if(rslt == ESP_OK)
+        rslt = MAX31790_get_fan_dynamic(&cfg, TXN_CH, &fan_dyn);
+    txn_expect("getters_after_resync", rslt, 0, 0);
+
+    check("getters disagree with the chip", fan_cfg == regs[MAX31790_REG_FAN_CONFIG(TXN_CH)] && fan_dyn == regs[MAX31790_REG_FAN_DYNAMIC(TXN_CH)]);
+
+    fake.nak_next = 1;                                                                              // No retries configured, one NACK fails the write
+    rslt = MAX31790_set_target_dutybits(&cfg, TXN_CH, 400);
+    check("NACKed setpoint reported success", rslt != ESP_OK);
+    check("failed setpoint not dirty", (cfg.shadow_dirty[reg >> 3] & (0x01 << (reg & 0x07))) != 0);
+    I2CMANAGER_fake_reset_counters(&fake);
+
+    rslt = MAX31790_flush(&cfg);                                                                    // The one dirty run, rewritten once
+    txn_expect("flush_dirty", rslt, 1, TXN_WRITE(1, 2));
+
+    check("flush did not land the failed setpoint", regs[reg] == LFTJST_TO_MSB(400, 9) && regs[reg + 1] == LFTJST_TO_LSB(400, 9));
+
+    rslt = MAX31790_flush(&cfg);
+    txn_expect("flush_after_flush", rslt, 0, 0);
+}
+
+static void txn_dirty_read(void)                                                                    // A read over a dirty register must not take back the failed write
+{
+    uint8_t reg = MAX31790_REG_TARGET_DUTY(TXN_CH);
+    uint8_t buff[NUM_CHANNEL * 2] = {0};
+    esp_err_t rslt = ESP_OK;
+
+    fake.nak_next = 1;
+    rslt = MAX31790_set_target_dutybits(&cfg, TXN_CH, 150);
+    check("NACKed setpoint reported success", rslt != ESP_OK);
+
+    rslt = MAX31790_get_regs(&cfg, MAX31790_REG_TARGET_DUTY(0), buff, sizeof(buff));               // Every target duty, the dirty pair in the middle
+    check("covering read failed", rslt == ESP_OK);
+    check("covering read did not return the chip", !memcmp(buff, regs + MAX31790_REG_TARGET_DUTY(0), sizeof(buff)));
+    I2CMANAGER_fake_reset_counters(&fake);
+
+    rslt = MAX31790_flush(&cfg);
+    txn_expect("flush_after_read", rslt, 1, TXN_WRITE(1, 2));
+
+    check("flush wrote back the chip's old value", regs[reg] == LFTJST_TO_MSB(150, 9) && regs[reg + 1] == LFTJST_TO_LSB(150, 9));
+}
+
+static void txn_batch(void)
+{
+    uint16_t duty[NUM_CHANNEL] = {100, 150, 200, 250, 300, 350};
+    esp_err_t rslt = ESP_OK;
+
+    MAX31790_invalidate_cache(&cfg);                                                                // Cold, as after power up
+    I2CMANAGER_fake_reset_counters(&fake);
+
+    rslt = MAX31790_set_master_config(&cfg);                                                        // 0x00, 0x02 - 0x0D and 0x12 - 0x14, FREQ_START unknown so not bridged
+    txn_expect("set_master_config", rslt, 3, TXN_WRITE(3, 1 + NUM_CHANNEL * 2 + 3));
+
+    rslt = MAX31790_set_all_target_dutybits(&cfg, duty);                                            // 0x40 - 0x4B in one auto-increment write
+    txn_expect("set_all_target_dutybits", rslt, 1, TXN_WRITE(1, NUM_CHANNEL * 2));
+
+    duty[0] = 121;                                                                                  // Both bytes change, channel 1 between is bridged from the shadow
+    duty[2] = 221;
+    rslt = MAX31790_set_all_target_dutybits(&cfg, duty);
+    txn_expect("set_all_target_dutybits_bridged", rslt, 1, TXN_WRITE(1, 6));
+
+    rslt = MAX31790_set_all_target_dutybits(&cfg, duty);
+    txn_expect("set_all_target_dutybits_again", rslt, 0, 0);
+
+    for(uint8_t x = 0; x < NUM_CHANNEL; x++)
+        check("batched setpoint not on the chip", regs[MAX31790_REG_TARGET_DUTY(x)] == LFTJST_TO_MSB(duty[x], 9) &&
+                                                   regs[MAX31790_REG_TARGET_DUTY(x) + 1] == LFTJST_TO_LSB(duty[x], 9));
+}
+
+static void txn_range(void)                                                                         // A staged speed range reaches the conversions only with the chip
+{
+    uint8_t reg = MAX31790_REG_TARGET_COUNT(TXN_CH);
+    uint8_t dyn = (cfg.fan_dyn[TXN_CH] & ~MAX31790_FAN_DYN_SR_MASK) | MAX31790_FAN_DYN_SR_8;
+    uint8_t dyn_was = cfg.fan_dyn[TXN_CH];
+    uint32_t k_was = cfg.tach_k[TXN_CH];
+    uint16_t count = 0;
+    max31790_batch_t batch;
+    esp_err_t rslt = ESP_OK;
+
+    MAX31790_batch_begin(&batch, &cfg);
+    MAX31790_batch_stage_fan_dynamic(&batch, TXN_CH, dyn);
+    MAX31790_batch_stage_target_rpm(&batch, TXN_CH, 3000);
+    check("staging changed the speed range", cfg.fan_dyn[TXN_CH] == dyn_was && cfg.tach_k[TXN_CH] == k_was);
+
+    fake.nak_next = 1;                                                                              // FAN_DYN is the lower run, it fails
+    rslt = MAX31790_batch_commit(&batch);
+    check("NACKed range reported success", rslt != ESP_OK);
+    check("failed write changed the speed range", cfg.fan_dyn[TXN_CH] == dyn_was && cfg.tach_k[TXN_CH] == k_was);
+
+    rslt = MAX31790_flush(&cfg);
+    check("range flush failed", rslt == ESP_OK);
+    check("written range not followed", cfg.fan_dyn[TXN_CH] == dyn && cfg.tach_k[TXN_CH] == TACH_K(8) && cfg.tach_k[TXN_CH + NUM_CHANNEL] == TACH_K(8));
+
+    count = MAX31790_rpm_to_count(&cfg, TXN_CH, 3000);
+    check("target staged with the old range", regs[reg] == LFTJST_TO_MSB(count, 11) && regs[reg + 1] == LFTJST_TO_LSB(count, 11));
+
+    MAX31790_set_fan_dynamic(&cfg, dyn_was, TXN_CH);
+    check("range not restored", cfg.tach_k[TXN_CH] == k_was);
+    I2CMANAGER_fake_reset_counters(&fake);
+}
+
+int main(int argc, char **argv)
+{
+    regs = I2CMANAGER_fake_attach(&fake, TXN_ADR);
+
+    if(!regs || I2CMANAGER_set_backend(TXN_PORT, &i2cmanager_fake_backend, &fake) != ESP_OK || MAX31790_initiate(&cfg) != ESP_OK)
+    {
+        fprintf(stderr, "txn: setup failed\n");
+        return 1;
+    }
+
+    txn_burst();
+    txn_shadow();
+    txn_dirty_read();
+    txn_batch();
+    txn_range();
+
+    return failed ? 1 : 0;
+}
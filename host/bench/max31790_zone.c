@@ -0,0 +1,214 @@
+/******************************************************
+  Description: Zone update and telemetry scaling over
+               simulated buses, one or two ports: wall
+               time against per-fan sequential calls and
+               against the summed wire time of the buses.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Zone.h"
+#include "MAX31790Sim.h"
+
+#define ZONE_PORTS          2
+#define ZONE_DEVS_PER_PORT  8
+#define ZONE_FIRST_ADR      0x20
+#define ZONE_RUN_MS         3000                // Fans up to speed before timing
+#define ZONE_ITER           20
+#define ZONE_DUTY_A         300
+#define ZONE_DUTY_B         320                 // Alternated so no write is dropped as unchanged
+#define ZONE_PARALLEL_MAX   750                 // Two ports: permille of the summed wire time the zone may take
+
+typedef struct
+{
+    uint8_t ports;
+    uint8_t devs_per_port;
+} zone_case_t;
+
+static max31790sim_bus_t bus[ZONE_PORTS];
+static max31790sim_dev_t sim[ZONE_PORTS][ZONE_DEVS_PER_PORT];
+static max31790_master_config_t cfg[ZONE_PORTS][ZONE_DEVS_PER_PORT];
+static max31790_zone_t zone;
+static bool failed;
+
+static const zone_case_t cases[] =                                                                  // The zone holds 8 devices, 48 fans
+{
+    {1, 1}, {1, 2}, {1, 4}, {1, 8},
+    {2, 1}, {2, 2}, {2, 4}
+};
+
+static void check(const char *what, bool ok)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "zone: %s\n", what);
+        failed = true;
+    }
+}
+
+static void zone_bus_mark(uint32_t *tx, uint64_t *wire_ns)                                          // Totals over every bus
+{
+    *tx = 0;
+    *wire_ns = 0;
+
+    for(uint8_t p = 0; p < ZONE_PORTS; p++)
+    {
+        *tx += bus[p].transactions;
+        *wire_ns += bus[p].bus_time_ns;
+    }
+}
+
+static void zone_report(const zone_case_t *c, const char *what, int64_t wall_us, uint32_t tx, uint64_t wire_ns)
+{
+    printf("{\"ports\":%d,\"devices\":%d,\"fans\":%d,\"op\":\"%s\",\"wall_us\":%lld,\"tx\":%u,\"wire_us\":%llu}\n",
+           c->ports, c->ports * c->devs_per_port, zone.n_fans, what, (long long)(wall_us / ZONE_ITER),
+           tx / ZONE_ITER, (unsigned long long)(wire_ns / 1000 / ZONE_ITER));
+}
+
+static void zone_run(const zone_case_t *c)
+{
+    max31790_zone_fan_t fans[MAX31790_ZONE_MAX_FANS];
+    max31790_zone_telemetry_t telem;
+    uint8_t n_fans = 0;
+    uint8_t n_devs = c->ports * c->devs_per_port;
+    int64_t wall_us = 0;
+    int64_t zone_us = 0;
+    uint64_t wire_ns = 0;
+    uint64_t wire_end = 0;
+    uint64_t wire_seq = 0;
+    uint32_t tx = 0;
+    uint32_t tx_end = 0;
+    uint32_t rpm = 0;
+    esp_err_t err_ret = ESP_OK;
+
+    for(uint8_t p = 0; p < c->ports; p++)
+        for(uint8_t d = 0; d < c->devs_per_port; d++)
+            for(uint8_t ch = 0; ch < NUM_CHANNEL; ch++)
+                fans[n_fans++] = (max31790_zone_fan_t){.dev = &cfg[p][d], .channel = ch};
+
+    check("init", MAX31790_zone_init(&zone, fans, n_fans, NULL) == ESP_OK && zone.n_devs == n_devs);
+
+    /* Setpoints ----------------------------------------------------------------------------- */
+    zone_bus_mark(&tx, &wire_ns);
+    wall_us = esp_timer_get_time();
+    for(uint32_t i = 0; i < ZONE_ITER; i++)                                                         // What the single-chip API leaves the caller
+        for(uint8_t x = 0; x < n_fans; x++)
+            err_ret |= MAX31790_set_target_dutybits(fans[x].dev, fans[x].channel, (i & 0x01) ? ZONE_DUTY_A : ZONE_DUTY_B);
+    wall_us = esp_timer_get_time() - wall_us;
+    zone_bus_mark(&tx_end, &wire_end);
+    zone_report(c, "set_sequential", wall_us, tx_end - tx, wire_end - wire_ns);
+    check("sequential set failed", err_ret == ESP_OK);
+
+    zone_bus_mark(&tx, &wire_ns);
+    wall_us = esp_timer_get_time();
+    for(uint32_t i = 0; i < ZONE_ITER; i++)
+        err_ret |= MAX31790_zone_set_dutybits(&zone, (i & 0x01) ? ZONE_DUTY_A : ZONE_DUTY_B);
+    zone_us = esp_timer_get_time() - wall_us;
+    zone_bus_mark(&tx_end, &wire_end);
+    zone_report(c, "set_zone", zone_us, tx_end - tx, wire_end - wire_ns);
+
+    check("zone set failed", err_ret == ESP_OK);
+    check("zone set transactions", tx_end - tx == (uint32_t)n_devs * ZONE_ITER);
+    if(c->ports > 1 && c->devs_per_port > 1)
+        check("zone set not parallel", zone_us * 1000 * 1000 < (int64_t)(wire_end - wire_ns) * ZONE_PARALLEL_MAX);
+
+    for(uint8_t x = 0; x < n_fans; x++)                                                             // Every output took the last value
+    {
+        uint16_t dutybits = 0;
+
+        MAX31790_get_target_dutybits(fans[x].dev, fans[x].channel, &dutybits);
+        check("zone setpoint", dutybits == ZONE_DUTY_A);
+    }
+
+    /* Telemetry ----------------------------------------------------------------------------- */
+    zone_bus_mark(&tx, &wire_ns);
+    wall_us = esp_timer_get_time();
+    for(uint32_t i = 0; i < ZONE_ITER; i++)
+        for(uint8_t x = 0; x < n_fans; x++)
+            err_ret |= MAX31790_get_rpm(fans[x].dev, fans[x].channel, false, &rpm);
+    wall_us = esp_timer_get_time() - wall_us;
+    zone_bus_mark(&tx_end, &wire_end);
+    zone_report(c, "read_sequential", wall_us, tx_end - tx, wire_end - wire_ns);
+    check("sequential read failed", err_ret == ESP_OK);
+    wire_seq = wire_end - wire_ns;
+
+    zone_bus_mark(&tx, &wire_ns);
+    wall_us = esp_timer_get_time();
+    for(uint32_t i = 0; i < ZONE_ITER; i++)
+        err_ret |= MAX31790_zone_read(&zone, &telem);
+    zone_us = esp_timer_get_time() - wall_us;
+    zone_bus_mark(&tx_end, &wire_end);
+    zone_report(c, "read_zone", zone_us, tx_end - tx, wire_end - wire_ns);
+
+    check("zone read failed", err_ret == ESP_OK);
+    check("zone read transactions", tx_end - tx == (uint32_t)n_devs * ZONE_ITER);
+    check("zone read costs more wire time than per-fan reads", wire_end - wire_ns <= wire_seq);      // Fault status comes along, and still fits
+    check("zone telemetry", telem.worst == MAX31790_ZONE_OK && telem.rpm_min > 0 &&
+                            telem.rpm_min <= telem.rpm_mean && telem.rpm_mean <= telem.rpm_max);
+    if(c->ports > 1 && c->devs_per_port > 1)
+        check("zone read not parallel", zone_us * 1000 * 1000 < (int64_t)(wire_end - wire_ns) * ZONE_PARALLEL_MAX);
+
+    vSemaphoreDelete(zone.done);
+}
+
+int main(int argc, char **argv)
+{
+    const max31790sim_bus_cfg_t bus_cfg = {.clk_hz = 100000, .real_time = true, .yield = true};
+
+    for(uint8_t p = 0; p < ZONE_PORTS; p++)
+    {
+        MAX31790SIM_bus_init(&bus[p], NULL);
+
+        for(uint8_t d = 0; d < ZONE_DEVS_PER_PORT; d++)
+        {
+            MAX31790SIM_init(&sim[p][d], ZONE_FIRST_ADR + d);
+            MAX31790SIM_bus_attach(&bus[p], &sim[p][d]);
+
+            cfg[p][d] = (max31790_master_config_t)
+            {
+                .adr = ZONE_FIRST_ADR + d,
+                .port = p,
+                .global_cfg = MAX31790_GLO_BUS_TIMEOUT_DIS,
+                .fan_failed_seq_start_cfg = 0x45,
+                .fan_cfg = {MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT,
+                            MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT, MAX31790_FAN_CFG_TACH_INPUT},
+                .fan_dyn = {0x4C, 0x4C, 0x4C, 0x4C, 0x4C, 0x4C},
+                .fan_hallcount = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+                .fault_mask_1 = 0x3F,
+                .fault_mask_2 = 0x3F
+            };
+        }
+
+        if(I2CMANAGER_set_backend(p, &max31790sim_backend, &bus[p]) != ESP_OK || I2CMANAGER_engine_start(p, 16, 5) != ESP_OK)
+        {
+            fprintf(stderr, "zone: setup failed\n");
+            return 1;
+        }
+
+        for(uint8_t d = 0; d < ZONE_DEVS_PER_PORT; d++)
+        {
+            if(MAX31790_initiate(&cfg[p][d]) != ESP_OK)
+            {
+                fprintf(stderr, "zone: initiate failed\n");
+                return 1;
+            }
+
+            for(uint8_t ch = 0; ch < NUM_CHANNEL; ch++)
+                MAX31790_set_target_dutybits(&cfg[p][d], ch, ZONE_DUTY_A);
+        }
+
+        MAX31790SIM_bus_step(&bus[p], ZONE_RUN_MS);
+        for(uint8_t d = 0; d < ZONE_DEVS_PER_PORT; d++)                                             // Latched while the rotors started
+            MAX31790_clear_fault_status(&cfg[p][d], (0x01 << NUM_TACH_CHANNEL) - 1);
+        bus[p].cfg = bus_cfg;                                                                       // Wire time only from here on
+    }
+
+    for(uint8_t x = 0; x < sizeof(cases) / sizeof(cases[0]); x++)
+        zone_run(&cases[x]);
+
+    return failed ? 1 : 0;
+}
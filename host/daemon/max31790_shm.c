@@ -0,0 +1,129 @@
+/******************************************************
+  Description: max31790d telemetry page, create,
+               publish and attach.
+      License: Apache 2.0
+ *******************************************************/
+
+#include "max31790_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Daemon ----------------------------------------------------------------------------------- */
+max31790_shm_page_t *MAX31790_shm_create(const char *name, uint32_t period_ms)
+{
+    max31790_shm_page_t *page = NULL;
+    int fd = -1;
+
+    shm_unlink(name);                                                                               // A page left by a crashed run, readers still holding it keep the old one
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return NULL;
+
+    if(ftruncate(fd, sizeof(*page)) == 0)
+        page = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if(page == MAP_FAILED || !page)
+    {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    memset(page, 0, sizeof(*page));
+    atomic_init(&page->seq, 0);
+    page->version = MAX31790_SHM_VERSION;
+    page->size = sizeof(*page);
+    page->pid = getpid();
+    page->data.period_ms = period_ms;
+    atomic_thread_fence(memory_order_release);
+    page->magic = MAX31790_SHM_MAGIC;                                                               // Last, a reader seeing it sees the rest
+
+    return page;
+}
+
+void MAX31790_shm_publish(max31790_shm_page_t *page, const max31790_shm_data_t *data)
+{
+    unsigned seq = atomic_load_explicit(&page->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&page->seq, seq + 1, memory_order_relaxed);                               // Odd, readers back off
+    atomic_thread_fence(memory_order_release);
+
+    page->data = *data;
+
+    atomic_store_explicit(&page->seq, seq + 2, memory_order_release);
+}
+
+void MAX31790_shm_destroy(max31790_shm_page_t *page, const char *name)
+{
+    if(page)
+        munmap(page, sizeof(*page));
+
+    shm_unlink(name);
+}
+
+/* Readers ---------------------------------------------------------------------------------- */
+const max31790_shm_page_t *MAX31790_shm_attach(const char *name)
+{
+    max31790_shm_page_t *page = NULL;
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+
+    if(fd < 0)
+        return NULL;
+
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*page))
+        page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if(page == MAP_FAILED || !page)
+        return NULL;
+
+    if(page->magic != MAX31790_SHM_MAGIC || page->version != MAX31790_SHM_VERSION || page->size != sizeof(*page))
+    {
+        munmap(page, sizeof(*page));
+        errno = EPROTO;
+        return NULL;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+
+    return page;
+}
+
+void MAX31790_shm_detach(const max31790_shm_page_t *page)
+{
+    if(page)
+        munmap((void *)page, sizeof(*page));
+}
+
+bool MAX31790_shm_read(const max31790_shm_page_t *page, max31790_shm_data_t *data)
+{
+    atomic_uint *seqp = (atomic_uint *)&page->seq;                                                  // Loads only, the mapping is read only
+
+    for(uint8_t x = 0; x < MAX31790_SHM_READ_RETRY; x++)
+    {
+        unsigned seq = atomic_load_explicit(seqp, memory_order_acquire);
+
+        for(uint32_t spin = 0; (seq & 0x01) && spin < MAX31790_SHM_READ_SPIN; spin++)               // Mid publish, no syscall to wait on it
+            seq = atomic_load_explicit(seqp, memory_order_acquire);
+
+        if(seq & 0x01)
+            continue;
+
+        *data = page->data;
+        atomic_thread_fence(memory_order_acquire);
+
+        if(atomic_load_explicit(seqp, memory_order_relaxed) == seq)
+            return true;
+    }
+
+    return false;
+}
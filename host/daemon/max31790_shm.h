@@ -0,0 +1,79 @@
+/******************************************************
+  Description: max31790d telemetry page. One shared
+               memory page written by the daemon once
+               per sampling cycle, read in place by any
+               number of local processes.
+      License: Apache 2.0
+ *******************************************************/
+
+#ifndef MAX31790_SHM_H
+#define MAX31790_SHM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "MAX31790.h"
+
+#define MAX31790_SHM_MAGIC                  0x30393731                    // "1790" in memory, little endian
+#define MAX31790_SHM_VERSION                1
+#define MAX31790_SHM_MAX_DEV                16                            // I2CMANAGER_MAX_DEVICES
+#define MAX31790_SHM_DEF_NAME               "/max31790d"                  // shm_open() name, /dev/shm/max31790d
+#define MAX31790_SHM_READ_RETRY             8                             // Reader gives up after the writer laps it this often
+#define MAX31790_SHM_READ_SPIN              4096                          // Loads of seq while a publish is under way, one is a 1 kB copy
+
+typedef struct
+{
+   uint8_t adr;
+   uint8_t port;
+   uint16_t fault_status;                       // Bit N: fan N + 1, latched by the chip
+   int32_t rslt;                                // esp_err_t of the cycle's reads, the values are stale when not 0
+   int64_t timestamp_us;                        // CLOCK_MONOTONIC when the reads completed
+   uint16_t tach_count[NUM_TACH_CHANNEL];
+   uint32_t rpm[NUM_TACH_CHANNEL];              // 0 when the input counts no pulses
+   uint16_t pwm_dutybits[NUM_CHANNEL];          // Output now
+   uint16_t target_dutybits[NUM_CHANNEL];
+   uint32_t target_rpm[NUM_CHANNEL];            // From TARGET_COUNT, followed in RPM mode only
+} max31790_shm_dev_t;
+
+typedef struct
+{
+   uint32_t cycle;                              // Sampling cycles published
+   uint32_t period_ms;
+   uint32_t overruns;                           // Cycles that started a period or more late
+   uint32_t commands;                           // Setpoint lines applied
+   uint32_t rejected;                           // Command messages refused whole
+   uint32_t writes;                             // Batch commits
+   int64_t timestamp_us;                        // CLOCK_MONOTONIC at publish
+   int64_t realtime_us;                         // CLOCK_REALTIME at publish
+   uint8_t n_dev;
+   max31790_shm_dev_t dev[MAX31790_SHM_MAX_DEV];
+} max31790_shm_data_t;
+
+typedef struct
+{
+   uint32_t magic;                              // Constant once the page is mapped, checked by readers
+   uint32_t version;
+   uint32_t size;                               // sizeof(max31790_shm_page_t) of the writer
+   int32_t pid;                                 // Daemon process
+   atomic_uint seq;                             // Odd while the daemon writes data
+   max31790_shm_data_t data;
+} max31790_shm_page_t;
+
+/* Daemon ---------------------------------------------------------------------------------- */
+max31790_shm_page_t *MAX31790_shm_create(const char *name, uint32_t period_ms);   // O_CREAT, mode 0644, replaces a stale page. NULL on failure, errno set.
+
+void MAX31790_shm_publish(max31790_shm_page_t *page, const max31790_shm_data_t *data);   // Single writer.
+
+void MAX31790_shm_destroy(max31790_shm_page_t *page, const char *name);
+
+/* Readers, no syscalls after attach -------------------------------------------------------- */
+const max31790_shm_page_t *MAX31790_shm_attach(const char *name);           // Read only mapping. NULL when absent or of another version.
+
+void MAX31790_shm_detach(const max31790_shm_page_t *page);
+
+bool MAX31790_shm_read(const max31790_shm_page_t *page, max31790_shm_data_t *data);   // Consistent copy of one cycle, false while the daemon keeps lapping the reader.
+
+static inline uint32_t MAX31790_shm_seq(const max31790_shm_page_t *page) { return atomic_load_explicit((atomic_uint *)&page->seq, memory_order_acquire); };   // Changes once per publish, poll it before reading
+
+#endif
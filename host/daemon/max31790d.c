@@ -0,0 +1,515 @@
+/******************************************************
+  Description: max31790d, drives MAX31790s on Linux
+               I2C adapters. Publishes every sampling
+               cycle to a shared memory page and takes
+               setpoints on a Unix datagram socket,
+               applied as one batch per chip.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "I2CManagerLinux.h"
+#include "MAX31790.h"
+#include "MAX31790Sampler.h"
+#include "MAX31790Sim.h"
+#include "max31790_shm.h"
+
+#define D_DEF_PERIOD_MS     100
+#define D_DEF_SOCKET        "/run/max31790d.sock"
+#define D_DEF_PULSES        2                   // Tach pulses per revolution, not held by the chip
+#define D_MSG_MAX           2048                // One command message, several lines
+#define D_LINE_MAX          64                  // Setpoints per message
+#define D_FAKE_FIRST_ADR    0x20
+#define D_ADOPT_TIMEOUT     pdMS_TO_TICKS(100)
+
+typedef struct
+{
+    uint8_t dev;
+    uint8_t channel;
+    char what;                                  // 'd' dutybits, 'p' permille, 'r' rpm
+    uint32_t value;
+} d_cmd_t;
+
+static const char *TAG = "max31790d";
+
+static const char *port_path[I2CMANAGER_NUM_PORTS];
+static i2cmanager_linux_t port_bus[I2CMANAGER_NUM_PORTS];
+static max31790sim_bus_t fake_bus;
+static max31790sim_dev_t fake_dev[MAX31790_SHM_MAX_DEV];
+
+static max31790_master_config_t devs[MAX31790_SHM_MAX_DEV];
+static max31790_sampler_t samplers[MAX31790_SHM_MAX_DEV];
+static uint8_t n_dev;
+
+static max31790_shm_page_t *page;
+static max31790_shm_data_t data;
+static volatile sig_atomic_t stop;
+
+static void d_usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [options] BUS:ADR ...\n"
+                    "       %s [options] --fake N\n"
+                    "  BUS:ADR     /dev/i2c-N:0x20, at most %d adapters and %d chips\n"
+                    "  --fake N    N simulated chips in process instead of hardware\n"
+                    "  -p MS       sampling period, default %d\n"
+                    "  -s PATH     command socket, default %s\n"
+                    "  -m NAME     telemetry page, default %s\n"
+                    "  -n PULSES   tach pulses per revolution, default %d\n"
+                    "  -v          debug log\n"
+                    "  Commands, one per line: duty|permille|rpm DEV CHANNEL VALUE, DEV from 0, CHANNEL 1 - 6.\n",
+            argv0, argv0, I2CMANAGER_NUM_PORTS, MAX31790_SHM_MAX_DEV, D_DEF_PERIOD_MS, D_DEF_SOCKET, MAX31790_SHM_DEF_NAME, D_DEF_PULSES);
+}
+
+static void d_signal(int sig)
+{
+    stop = 1;
+}
+
+/* Devices ---------------------------------------------------------------------------------- */
+static int d_port(const char *path)                                                                 // One I2CManager port per adapter
+{
+    for(uint8_t p = 0; p < I2CMANAGER_NUM_PORTS; p++)
+    {
+        if(port_path[p] && !strcmp(port_path[p], path))
+            return p;
+
+        if(port_path[p])
+            continue;
+
+        if(I2CMANAGER_linux_open(&port_bus[p], path) != ESP_OK || I2CMANAGER_set_backend(p, &i2cmanager_linux_backend, &port_bus[p]) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Cannot open %s", path);
+            return -1;
+        }
+
+        port_path[p] = path;
+        return p;
+    }
+
+    ESP_LOGE(TAG, "More than %d adapters", I2CMANAGER_NUM_PORTS);
+    return -1;
+}
+
+static esp_err_t d_adopt(max31790_handle_t dev, uint8_t pulses)                                    // Keep whatever the chip runs with, nothing is rewritten
+{
+    uint8_t live[MAX31790_REG_SEQ_START_CONFIG + 1] = {0};
+    esp_err_t err_ret = I2CMANAGER_take(dev->port, D_ADOPT_TIMEOUT);
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    err_ret = I2CMANAGER_read(dev->port, dev->adr, MAX31790_REG_GLOBAL_CONFIG, live, sizeof(live), D_ADOPT_TIMEOUT);
+    I2CMUTEX_GIVE_PORT(dev->port);
+
+    if(err_ret != ESP_OK)
+        return err_ret;
+
+    dev->global_cfg = live[MAX31790_REG_GLOBAL_CONFIG] & ~(MAX31790_GLO_I2C_WD_STATUS | MAX31790_GLO_RESET_RESET);
+    dev->fan_failed_seq_start_cfg = live[MAX31790_REG_SEQ_START_CONFIG];
+    dev->fault_mask_1 = live[MAX31790_REG_FAN_FAULT_MASK_1];
+    dev->fault_mask_2 = live[MAX31790_REG_FAN_FAULT_MASK_2];
+    memcpy(dev->fan_cfg, live + MAX31790_REG_FAN_CONFIG(0), NUM_CHANNEL);
+    memcpy(dev->fan_dyn, live + MAX31790_REG_FAN_DYNAMIC(0), NUM_CHANNEL);
+    memset(dev->fan_hallcount, pulses, NUM_TACH_CHANNEL);
+
+    return MAX31790_initiate_warm(dev, NULL, NULL);
+}
+
+static esp_err_t d_add(const char *arg, uint8_t pulses)
+{
+    char path[64];
+    const char *colon = strrchr(arg, ':');
+    char *end = NULL;
+    unsigned long adr = 0;
+    int port = 0;
+    max31790_handle_t dev = &devs[n_dev];
+
+    if(!colon || colon == arg || (size_t)(colon - arg) >= sizeof(path) || n_dev >= MAX31790_SHM_MAX_DEV)
+        return ESP_ERR_INVALID_ARG;
+
+    adr = strtoul(colon + 1, &end, 0);
+    if(*end || adr < 0x08 || adr > 0x77)
+        return ESP_ERR_INVALID_ARG;
+
+    memcpy(path, arg, colon - arg);
+    path[colon - arg] = '\0';
+
+    port = d_port(strdup(path));
+    if(port < 0)
+        return ESP_ERR_NOT_FOUND;
+
+    dev->adr = adr;
+    dev->port = port;
+
+    return d_adopt(dev, pulses);
+}
+
+static esp_err_t d_add_fake(uint8_t count, uint8_t pulses)                                         // Chips at power-on values, tach inputs enabled as a board would
+{
+    max31790sim_bus_cfg_t bus_cfg = {.clk_hz = 400000, .auto_step = true};
+    esp_err_t err_ret = ESP_OK;
+
+    if(!count || count > MAX31790_SHM_MAX_DEV)
+        return ESP_ERR_INVALID_ARG;
+
+    MAX31790SIM_bus_init(&fake_bus, &bus_cfg);
+    err_ret = I2CMANAGER_set_backend(0, &max31790sim_backend, &fake_bus);
+
+    for(uint8_t x = 0; x < count && err_ret == ESP_OK; x++, n_dev++)
+    {
+        max31790_handle_t dev = &devs[x];
+
+        MAX31790SIM_init(&fake_dev[x], D_FAKE_FIRST_ADR + x);
+        MAX31790SIM_bus_attach(&fake_bus, &fake_dev[x]);
+
+        dev->adr = D_FAKE_FIRST_ADR + x;
+        dev->fan_failed_seq_start_cfg = 0x45;
+        dev->fault_mask_1 = 0x3F;
+        dev->fault_mask_2 = 0x3F;
+        memset(dev->fan_cfg, MAX31790_FAN_CFG_TACH_INPUT, NUM_CHANNEL);
+        memset(dev->fan_dyn, MAX31790_POR_FAN_DYNAMIC, NUM_CHANNEL);
+        memset(dev->fan_hallcount, pulses, NUM_TACH_CHANNEL);
+
+        err_ret = MAX31790_initiate(dev);
+    }
+
+    port_path[0] = "fake";
+
+    return err_ret;
+}
+
+/* Telemetry -------------------------------------------------------------------------------- */
+static void d_sample(void)
+{
+    struct timespec rt;
+
+    for(uint8_t x = 0; x < n_dev; x++)
+    {
+        max31790_handle_t dev = &devs[x];
+        max31790_shm_dev_t *out = &data.dev[x];
+        max31790_frame_t frame;
+
+        MAX31790_sampler_capture(&samplers[x]);
+        if(!MAX31790_sampler_latest(&samplers[x], &frame))
+            continue;
+
+        out->adr = dev->adr;
+        out->port = dev->port;
+        out->rslt = frame.rslt;
+        out->timestamp_us = frame.timestamp_us;
+
+        if(frame.rslt != ESP_OK)                                                                    // Last good values stay, rslt marks them stale
+            continue;
+
+        out->fault_status = frame.fault_status_1 | (frame.fault_status_2 << NUM_CHANNEL);
+        memcpy(out->tach_count, frame.tach_count, sizeof(out->tach_count));
+        memcpy(out->pwm_dutybits, frame.pwm_dutybits, sizeof(out->pwm_dutybits));
+        memcpy(out->target_dutybits, frame.target_dutybits, sizeof(out->target_dutybits));
+
+        MAX31790_counts_to_rpm(dev, frame.tach_count, out->rpm);
+        for(uint8_t y = 0; y < NUM_TACH_CHANNEL; y++)
+            out->rpm[y] = (frame.tach_count[y] >= TACH_COUNT_MAX) ? 0 : out->rpm[y];                // Saturated, no pulses in the window
+
+        for(uint8_t y = 0; y < NUM_CHANNEL; y++)
+            out->target_rpm[y] = (frame.target_count[y] >= TACH_COUNT_MAX) ? 0 : MAX31790_count_to_rpm(dev, y, frame.target_count[y]);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &rt);
+
+    data.cycle++;
+    data.n_dev = n_dev;
+    data.timestamp_us = esp_timer_get_time();
+    data.realtime_us = (int64_t)rt.tv_sec * 1000000 + rt.tv_nsec / 1000;
+
+    MAX31790_shm_publish(page, &data);
+}
+
+/* Commands --------------------------------------------------------------------------------- */
+static const char *d_parse(char *msg, d_cmd_t *cmds, uint8_t *n_cmds, uint8_t *bad_line)           // Whole message or nothing, NULL when every line is good
+{
+    char *save = NULL;
+    uint8_t line = 0;
+
+    *n_cmds = 0;
+
+    for(char *text = strtok_r(msg, "\n;", &save); text; text = strtok_r(NULL, "\n;", &save))
+    {
+        char word[16];
+        unsigned dev = 0;
+        unsigned channel = 0;
+        unsigned long value = 0;
+        int used = 0;
+        d_cmd_t *cmd = &cmds[*n_cmds];
+
+        *bad_line = ++line;
+
+        if(sscanf(text, " %15s%n", word, &used) != 1)                                               // Blank
+            continue;
+
+        if(*n_cmds >= D_LINE_MAX)
+            return "too many lines";
+
+        if(sscanf(text + used, "%u %u %lu %n", &dev, &channel, &value, &used) != 3)
+            return "expected: duty|permille|rpm DEV CHANNEL VALUE";
+
+        if(dev >= n_dev)
+            return "no such device";
+
+        if(channel < 1 || channel > NUM_CHANNEL)
+            return "channel is 1 - 6";
+
+        if(!strcmp(word, "duty") && value <= DUTYBITS_MAX)
+            cmd->what = 'd';
+        else if(!strcmp(word, "permille") && value <= PERMILLE_MAX)
+            cmd->what = 'p';
+        else if(!strcmp(word, "rpm") && value >= RPM_MIN && value <= RPM_MAX)
+            cmd->what = 'r';
+        else
+            return "unknown command or value out of range";
+
+        cmd->dev = dev;
+        cmd->channel = channel - 1;
+        cmd->value = value;
+        (*n_cmds)++;
+    }
+
+    return NULL;
+}
+
+static esp_err_t d_apply(const d_cmd_t *cmds, uint8_t n_cmds)                                      // One batch per chip touched, one commit each
+{
+    static max31790_batch_t batch[MAX31790_SHM_MAX_DEV];
+    uint32_t touched = 0;
+    esp_err_t err_ret = ESP_OK;
+
+    for(uint8_t x = 0; x < n_cmds; x++)
+    {
+        const d_cmd_t *cmd = &cmds[x];
+        max31790_batch_t *b = &batch[cmd->dev];
+
+        if(!(touched & (0x01u << cmd->dev)))
+            MAX31790_batch_begin(b, &devs[cmd->dev]);
+        touched |= 0x01u << cmd->dev;
+
+        if(cmd->what == 'r')
+            MAX31790_batch_stage_target_rpm(b, cmd->channel, cmd->value);
+        else
+            MAX31790_batch_stage_dutybits(b, cmd->channel, cmd->what == 'p' ? MAX31790_permille_to_bits(cmd->value) : cmd->value);
+    }
+
+    for(uint8_t x = 0; x < n_dev; x++)
+    {
+        esp_err_t rslt = ESP_OK;
+
+        if(!(touched & (0x01u << x)))
+            continue;
+
+        rslt = MAX31790_batch_commit(&batch[x]);
+        data.writes++;
+        err_ret = (err_ret == ESP_OK) ? rslt : err_ret;
+    }
+
+    return err_ret;
+}
+
+static void d_commands(int sock)                                                                    // Drains every queued message
+{
+    for(;;)
+    {
+        char msg[D_MSG_MAX + 1];
+        char reply[128];
+        d_cmd_t cmds[D_LINE_MAX];
+        struct sockaddr_un from;
+        socklen_t from_len = sizeof(from);
+        uint8_t n_cmds = 0;
+        uint8_t line = 0;
+        const char *why = NULL;
+        esp_err_t rslt = ESP_OK;
+        ssize_t len = recvfrom(sock, msg, D_MSG_MAX, MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+
+        if(len < 0)
+            return;
+
+        msg[len] = '\0';
+        why = d_parse(msg, cmds, &n_cmds, &line);
+
+        if(why)
+        {
+            data.rejected++;
+            snprintf(reply, sizeof(reply), "err line %d: %s\n", line, why);
+        }
+        else
+        {
+            rslt = d_apply(cmds, n_cmds);
+            data.commands += n_cmds;
+            if(rslt == ESP_OK)
+                snprintf(reply, sizeof(reply), "ok %d\n", n_cmds);
+            else
+                snprintf(reply, sizeof(reply), "err bus: %s\n", esp_err_to_name(rslt));
+        }
+
+        if(from_len > sizeof(sa_family_t))                                                          // Anonymous senders get no reply
+            sendto(sock, reply, strlen(reply), MSG_DONTWAIT, (struct sockaddr *)&from, from_len);
+    }
+}
+
+static int d_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int sock = -1;
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        if(sock >= 0)
+            close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/* Main ------------------------------------------------------------------------------------- */
+int main(int argc, char **argv)
+{
+    struct sigaction sa = {.sa_handler = d_signal};
+    max31790_sampler_config_t sampler_cfg = {.depth = 2};
+    const char *sock_path = D_DEF_SOCKET;
+    const char *shm_name = MAX31790_SHM_DEF_NAME;
+    uint32_t period_ms = D_DEF_PERIOD_MS;
+    uint8_t pulses = D_DEF_PULSES;
+    uint8_t fake = 0;
+    int64_t next_us = 0;
+    int sock = -1;
+    int first = 0;
+
+    for(int x = 1; x < argc; x++)
+    {
+        if(!strcmp(argv[x], "-p") && x + 1 < argc)
+            period_ms = strtoul(argv[++x], NULL, 0);
+        else if(!strcmp(argv[x], "-s") && x + 1 < argc)
+            sock_path = argv[++x];
+        else if(!strcmp(argv[x], "-m") && x + 1 < argc)
+            shm_name = argv[++x];
+        else if(!strcmp(argv[x], "-n") && x + 1 < argc)
+            pulses = strtoul(argv[++x], NULL, 0);
+        else if(!strcmp(argv[x], "--fake") && x + 1 < argc)
+            fake = strtoul(argv[++x], NULL, 0);
+        else if(!strcmp(argv[x], "-v"))
+            esp_log_host_level = ESP_LOG_DEBUG;
+        else if(argv[x][0] == '-')
+        {
+            d_usage(argv[0]);
+            return 2;
+        }
+        else if(!first)
+            first = x;
+    }
+
+    if(!period_ms || !pulses || (!fake) == (!first))
+    {
+        d_usage(argv[0]);
+        return 2;
+    }
+
+    if(fake && d_add_fake(fake, pulses) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Fake bus setup failed");
+        return 1;
+    }
+
+    for(int x = first; first && x < argc; x++)
+    {
+        esp_err_t rslt = ESP_OK;
+
+        if(argv[x][0] == '-')                                                                       // Options and their values
+        {
+            x += strcmp(argv[x], "-v") != 0;
+            continue;
+        }
+
+        rslt = d_add(argv[x], pulses);
+        if(rslt != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Cannot start %s: %s", argv[x], esp_err_to_name(rslt));
+            return 1;
+        }
+
+        n_dev++;
+    }
+
+    sampler_cfg.period_ms = period_ms;
+    for(uint8_t x = 0; x < n_dev; x++)
+        if(MAX31790_sampler_init(&samplers[x], &devs[x], &sampler_cfg) != ESP_OK)
+            return 1;
+
+    page = MAX31790_shm_create(shm_name, period_ms);
+    sock = d_socket(sock_path);
+    if(!page || sock < 0)
+    {
+        ESP_LOGE(TAG, "Cannot create %s: %s", !page ? shm_name : sock_path, strerror(errno));
+        MAX31790_shm_destroy(page, shm_name);
+        return 1;
+    }
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    data.period_ms = period_ms;
+    ESP_LOGI(TAG, "%d chips, %dms, page %s, socket %s", n_dev, (int)period_ms, shm_name, sock_path);
+
+    next_us = esp_timer_get_time();
+
+    while(!stop)
+    {
+        struct pollfd pfd = {.fd = sock, .events = POLLIN};
+        int64_t now_us = esp_timer_get_time();
+
+        if(now_us >= next_us)                                                                       // Period locked, a late cycle does not shift the ones after it
+        {
+            d_sample();
+
+            next_us += (int64_t)period_ms * 1000;
+            if(now_us >= next_us)
+            {
+                data.overruns++;
+                next_us = now_us + (int64_t)period_ms * 1000;
+            }
+            continue;
+        }
+
+        if(poll(&pfd, 1, (int)((next_us - now_us + 999) / 1000)) > 0 && (pfd.revents & POLLIN))     // Commands go out as they arrive, between cycles
+            d_commands(sock);
+    }
+
+    ESP_LOGI(TAG, "Stopping after %u cycles", data.cycle);
+
+    close(sock);
+    unlink(sock_path);
+    MAX31790_shm_destroy(page, shm_name);
+
+    for(uint8_t x = 0; x < n_dev; x++)
+        MAX31790_sampler_deinit(&samplers[x]);
+
+    return 0;
+}
@@ -0,0 +1,391 @@
+/****************************************************** 
+  Description: Host port of the FreeRTOS/ESP-IDF calls the
+               components use, built on POSIX threads.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+struct host_task_s
+{
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t prio;
+};
+
+struct host_sem_s
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct host_queue_s
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t depth;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+};
+
+esp_log_level_t esp_log_host_level = ESP_LOG_WARN;
+
+static __thread struct host_task_s *self;
+
+static void host_cond_init(pthread_cond_t *cond);
+static int host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline);
+static struct timespec host_deadline(TickType_t ticks);
+static void *host_task_entry(void *arg);
+
+/* ESP-IDF ----------------------------------------------------------------------------------- */
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    (void)level;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch(code)
+    {
+        case ESP_OK:                    return "ESP_OK";
+        case ESP_FAIL:                  return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION:   return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NOT_FINISHED:      return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NOT_ALLOWED:       return "ESP_ERR_NOT_ALLOWED";
+        default:                        return "UNKNOWN ERROR";
+    }
+}
+
+/* Tasks ------------------------------------------------------------------------------------- */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, tskNO_AFFINITY);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    struct host_task_s *task = calloc(1, sizeof(*task));
+    (void)name; (void)stack; (void)core;
+
+    if(!task)
+        return pdFAIL;
+
+    task->fn = fn;
+    task->arg = arg;
+    task->prio = prio;
+
+    if(pthread_create(&task->thread, NULL, host_task_entry, task))
+    {
+        free(task);
+        return pdFAIL;
+    }
+
+    pthread_detach(task->thread);
+
+    if(handle)
+        *handle = task;
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if(!handle || handle == self)
+        pthread_exit(NULL);
+
+    pthread_cancel(handle->thread);                                                                 // Task memory is left to the process, as tasks are rarely deleted
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { .tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000 };
+
+    while(nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t period)
+{
+    xTaskDelayUntil(prev_wake, period);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *prev_wake, TickType_t period)
+{
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    TickType_t wake = *prev_wake + period;
+    int64_t wake_ms = now_ms + (int32_t)(wake - (TickType_t)now_ms);                                // Ticks are CLOCK_MONOTONIC milliseconds, wrapped at 32 bits
+    struct timespec ts = { .tv_sec = wake_ms / 1000, .tv_nsec = (long)(wake_ms % 1000) * 1000000 };
+
+    *prev_wake = wake;
+
+    if(wake_ms <= now_ms)                                                                           // Overrun, FreeRTOS returns without sleeping
+        return pdFALSE;
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);                    // On the tick edge as the tick interrupt would, not a tick count from now
+
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle)
+{
+    handle = handle ? handle : self;
+    return handle ? handle->prio : 0;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+/* Semaphores -------------------------------------------------------------------------------- */
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    struct host_sem_s *sem = calloc(1, sizeof(*sem));
+
+    if(!sem)
+        return NULL;
+
+    pthread_mutex_init(&sem->lock, NULL);
+    host_cond_init(&sem->cond);
+    sem->count = initial;
+    sem->max = max;
+
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t rslt = pdTRUE;
+
+    pthread_mutex_lock(&sem->lock);
+
+    while(!sem->count && rslt)
+        rslt = !host_wait(&sem->cond, &sem->lock, (ticks == portMAX_DELAY) ? NULL : &deadline) || sem->count;
+
+    if(rslt)
+        sem->count--;
+
+    pthread_mutex_unlock(&sem->lock);
+
+    return rslt;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t rslt = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+
+    if(sem->count < sem->max)
+    {
+        sem->count++;
+        rslt = pdTRUE;
+        pthread_cond_signal(&sem->cond);
+    }
+
+    pthread_mutex_unlock(&sem->lock);
+
+    return rslt;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+    if(woken)
+        *woken = pdFALSE;
+
+    return xSemaphoreGive(sem);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+/* Queues ------------------------------------------------------------------------------------ */
+QueueHandle_t xQueueCreate(UBaseType_t depth, UBaseType_t item_size)
+{
+    struct host_queue_s *queue = calloc(1, sizeof(*queue));
+
+    if(!queue)
+        return NULL;
+
+    queue->items = calloc(depth, item_size);
+    if(!queue->items)
+    {
+        free(queue);
+        return NULL;
+    }
+
+    pthread_mutex_init(&queue->lock, NULL);
+    host_cond_init(&queue->not_empty);
+    host_cond_init(&queue->not_full);
+    queue->depth = depth;
+    queue->item_size = item_size;
+
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t rslt = pdTRUE;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while(queue->count == queue->depth && rslt)
+        rslt = !host_wait(&queue->not_full, &queue->lock, (ticks == portMAX_DELAY) ? NULL : &deadline) || queue->count < queue->depth;
+
+    if(rslt)
+    {
+        memcpy(queue->items + ((queue->head + queue->count) % queue->depth) * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return rslt;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t rslt = pdTRUE;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while(!queue->count && rslt)
+        rslt = !host_wait(&queue->not_empty, &queue->lock, (ticks == portMAX_DELAY) ? NULL : &deadline) || queue->count;
+
+    if(rslt)
+    {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->depth;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return rslt;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
+
+/* Internal ---------------------------------------------------------------------------------- */
+static void host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static int host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+    if(!deadline)
+        return pthread_cond_wait(cond, lock);
+
+    return pthread_cond_timedwait(cond, lock, deadline) == ETIMEDOUT;
+}
+
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    if(ticks == portMAX_DELAY)
+        return ts;
+
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+
+    if(ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    return ts;
+}
+
+static void *host_task_entry(void *arg)
+{
+    self = (struct host_task_s *)arg;
+    self->fn(self->arg);
+
+    return NULL;
+}
@@ -0,0 +1,29 @@
+/* Host port: ESP_LOGx to stderr, filtered by one global level. */
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+extern esp_log_level_t esp_log_host_level;                          // Default ESP_LOG_WARN, set directly by host programs
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);    // Ignored, components raise their own tags to DEBUG
+
+#define ESP_HOST_LOG(L, C, tag, fmt, ...) do { if(esp_log_host_level >= (L)) fprintf(stderr, C " (%s) " fmt "\n", tag, ##__VA_ARGS__); } while(0)
+
+#define ESP_LOGE(tag, fmt, ...) ESP_HOST_LOG(ESP_LOG_ERROR, "E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) ESP_HOST_LOG(ESP_LOG_WARN, "W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ESP_HOST_LOG(ESP_LOG_INFO, "I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ESP_HOST_LOG(ESP_LOG_DEBUG, "D", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) ESP_HOST_LOG(ESP_LOG_VERBOSE, "V", tag, fmt, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,9 @@
+/* Host port: CLOCK_MONOTONIC in microseconds. */
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif
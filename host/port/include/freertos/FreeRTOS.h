@@ -0,0 +1,27 @@
+/* Host port: FreeRTOS types on POSIX threads, one tick per millisecond. */
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ          1000
+#define portTICK_PERIOD_MS          (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY               ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(MS)           ((TickType_t)(MS))
+#define pdTICKS_TO_MS(T)            ((uint32_t)(T))
+
+#define pdFALSE                     0
+#define pdTRUE                      1
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+
+#define tskNO_AFFINITY              0x7FFFFFFF
+#define portYIELD_FROM_ISR(X)       ((void)(X))
+#define IRAM_ATTR
+
+#endif
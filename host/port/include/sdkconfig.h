@@ -0,0 +1,5 @@
+/* Host port: Kconfig options come from the host CMakeLists as compile definitions. */
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+#endif
@@ -0,0 +1,124 @@
+/****************************************************** 
+  Description: Pretty-prints a MAX31790 register map
+               image, one register per line with its
+               fields decoded. Reads a file or stdin.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MAX31790.h"
+#include "MAX31790Image.h"
+
+#define DUMP_ASSUMED_NP     2                   // Pulses per revolution for the RPM column, the image does not hold it
+
+static const char *pwm_freq[16] = {"25 Hz", "30 Hz", "35 Hz", "100 Hz", "125 Hz", "149.7 Hz", "1.25 kHz", "1.47 kHz",
+                                   "3.57 kHz", "5 kHz", "12.5 kHz", "25 kHz", "25 kHz", "25 kHz", "25 kHz", "25 kHz"};
+static const char *watchdog[4] = {"off", "5 s", "10 s", "30 s"};
+static const char *spin_up[4] = {"none", "0.5 s", "1 s", "2 s"};
+static const uint8_t sr_map[8] = {1, 2, 4, 8, 16, 32, 32, 32};
+static const char *roc_ms[8] = {"0", "1.95", "3.91", "7.81", "15.6", "31.25", "62.5", "125"};
+static const char *ssd_ms[8] = {"0", "250", "500", "1000", "2000", "4000", "4000", "4000"};
+static const char *ffo[4] = {"0 %", "continue", "100 %", "100 % all"};
+static const uint8_t ffq[4] = {1, 2, 4, 6};
+
+static void dump_fans(const char *what, uint8_t val, uint8_t first)                                 // One bit per fan from first
+{
+    printf("%s:", what);
+    for(uint8_t b = 0; b < 6; b++)
+        if(val & (0x01 << b))
+            printf(" %d", first + b);
+    printf("\n");
+}
+
+static void dump_reg(const max31790_image_t *img, uint8_t reg)
+{
+    uint8_t v = img->regs[reg];
+    uint8_t ch = 0;
+
+    printf("0x%02X  0x%02X  %c  ", reg, v, MAX31790_image_has(img->restore, reg) ? 'W' : 'R');
+
+    if(reg == MAX31790_REG_GLOBAL_CONFIG)
+        printf("global: %s%s%s, osc %s, watchdog %s%s\n", (v & MAX31790_GLO_RUN_STANDBY_STANDBY) ? "standby" : "run", (v & MAX31790_GLO_RESET_RESET) ? ", reset" : "",
+               (v & MAX31790_GLO_BUS_TIMEOUT_DIS) ? ", bus timeout off" : "", (v & MAX31790_GLO_OSC_EXT) ? "ext" : "int",
+               watchdog[(v & MAX31790_GLO_I2C_WD_MASK) >> 1], (v & MAX31790_GLO_I2C_WD_STATUS) ? " (expired)" : "");
+    else if(reg == MAX31790_REG_FREQ_START)
+        printf("pwm freq: 1-3 %s, 4-6 %s\n", pwm_freq[v & MAX31790_PWM_FREQ_MASK], pwm_freq[v >> 4]);
+    else if(reg >= MAX31790_REG_FAN_CONFIG(0) && reg < MAX31790_REG_FAN_CONFIG(NUM_CHANNEL))
+    {
+        ch = reg - MAX31790_REG_FAN_CONFIG(0);
+        printf("fan config %d: %s mode, spin-up %s, %s, tach %s, %s, %s\n", ch + 1, (v & MAX31790_FAN_CFG_MODE_RPM) ? "rpm" : "pwm",
+               spin_up[(v & MAX31790_FAN_CFG_SPIN_UP_MASK) >> 5], (v & MAX31790_FAN_CFG_CON_MON_MON) ? "monitor only" : "control",
+               (v & MAX31790_FAN_CFG_TACH_INPUT) ? "on" : "off", (v & MAX31790_FAN_CFG_TACH_LOCK_LOCK) ? "locked rotor" : "tach",
+               (v & MAX31790_FAN_CFG_PWM_TACH_TACH) ? "pin as tach" : "pin as pwm");
+    }
+    else if(reg >= MAX31790_REG_FAN_DYNAMIC(0) && reg < MAX31790_REG_FAN_DYNAMIC(NUM_CHANNEL))
+        printf("fan dynamics %d: speed range %d, pwm rate of change %s ms/LSB%s\n", reg - MAX31790_REG_FAN_DYNAMIC(0) + 1,
+               sr_map[(v & MAX31790_FAN_DYN_SR_MASK) >> 5], roc_ms[(v & MAX31790_FAN_DYN_PWM_ROC_MASK) >> 2],
+               (v & MAX31790_FAN_DYN_ASYM_ROC) ? ", asymmetric" : "");
+    else if(reg == MAX31790_REG_FAN_FAULT_STATUS_2 || reg == MAX31790_REG_FAN_FAULT_MASK_2)
+        dump_fans(reg == MAX31790_REG_FAN_FAULT_STATUS_2 ? "fault status, fans" : "fault mask, fans", v, 7);
+    else if(reg == MAX31790_REG_FAN_FAULT_STATUS_1 || reg == MAX31790_REG_FAN_FAULT_MASK_1)
+        dump_fans(reg == MAX31790_REG_FAN_FAULT_STATUS_1 ? "fault status, fans" : "fault mask, fans", v, 1);
+    else if(reg == MAX31790_REG_SEQ_START_CONFIG)
+        printf("sequential start %s ms, failed fan %s after %d faults\n", ssd_ms[(v & MAX31790_FAN_FAILED_SEQ_SSD_MASK) >> 5],
+               ffo[(v & MAX31790_FAN_FAILED_SEQ_FFO_MASK) >> 2], ffq[v & MAX31790_FAN_FAILED_SEQ_FFQ_MASK]);
+    else if(REG_IS_USER_BYTE(reg))
+        printf("user byte\n");
+    else if(reg >= MAX31790_REG_TACH_COUNT(0) && reg < MAX31790_REG_PWM_DUTY(0) && !(reg & 0x01))
+    {
+        uint16_t count = REG_TO_LFTJST(11, v, img->regs[reg + 1]);
+        uint8_t fan = (reg - MAX31790_REG_TACH_COUNT(0)) / 2;
+        uint8_t sr = sr_map[(img->regs[MAX31790_REG_FAN_DYNAMIC(FAN_TO_CHAN(fan))] & MAX31790_FAN_DYN_SR_MASK) >> 5];
+
+        printf("tach count %d: %d, %lu rpm at %d ppr\n", fan + 1, count,
+               (count >= TACH_COUNT_MAX || !count) ? 0UL : (unsigned long)CALC_RPM_OR_BIT(count, sr, DUMP_ASSUMED_NP), DUMP_ASSUMED_NP);
+    }
+    else if(reg >= MAX31790_REG_PWM_DUTY(0) && reg < MAX31790_REG_PWM_DUTY(NUM_CHANNEL) && !(reg & 0x01))
+        printf("pwm duty %d: %.1f %%\n", (reg - MAX31790_REG_PWM_DUTY(0)) / 2 + 1, MAX31790_bits_to_fduty(REG_TO_LFTJST(9, v, img->regs[reg + 1])));
+    else if(reg >= MAX31790_REG_TARGET_DUTY(0) && reg < MAX31790_REG_TARGET_DUTY(NUM_CHANNEL) && !(reg & 0x01))
+        printf("target duty %d: %.1f %%\n", (reg - MAX31790_REG_TARGET_DUTY(0)) / 2 + 1, MAX31790_bits_to_fduty(REG_TO_LFTJST(9, v, img->regs[reg + 1])));
+    else if(reg >= MAX31790_REG_TARGET_COUNT(0) && reg < MAX31790_REG_TARGET_COUNT(NUM_CHANNEL) && !(reg & 0x01))
+        printf("target count %d: %d\n", (reg - MAX31790_REG_TARGET_COUNT(0)) / 2 + 1, REG_TO_LFTJST(11, v, img->regs[reg + 1]));
+    else if(reg >= MAX31790_REG_WINDOW(0) && reg < MAX31790_REG_WINDOW(NUM_CHANNEL))
+        printf("window %d: %d\n", reg - MAX31790_REG_WINDOW(0) + 1, v);
+    else
+        printf("\n");                                                                               // Low byte of the pair above
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t buff[MAX31790_IMAGE_SIZE * 2] = {0};
+    max31790_image_t img;
+    FILE *f = (argc > 1) ? fopen(argv[1], "rb") : stdin;
+    size_t len = 0;
+    esp_err_t err_ret = ESP_OK;
+
+    if(!f)
+    {
+        fprintf(stderr, "imgdump: cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    len = fread(buff, 1, sizeof(buff), f);
+    if(f != stdin)
+        fclose(f);
+
+    err_ret = MAX31790_image_decode(buff, len, &img);
+    if(err_ret != ESP_OK)
+    {
+        fprintf(stderr, "imgdump: %s\n", esp_err_to_name(err_ret));
+        return 1;
+    }
+
+    printf("MAX31790 image v%d, %d sections, %u bytes, CRC ok\n", buff[1], buff[2], (unsigned)len);
+    printf("reg   val   W/R  (R: status or read-only, not restored)\n");
+
+    for(uint8_t x = 0; x < REG_MAP_SIZE; x++)
+        if(MAX31790_image_has(img.present, x))
+            dump_reg(&img, x);
+
+    return 0;
+}
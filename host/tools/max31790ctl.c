@@ -0,0 +1,147 @@
+/******************************************************
+  Description: max31790d client. Prints the telemetry
+               page once or per cycle, and sends
+               setpoint lines to the command socket.
+      License: Apache 2.0
+ *******************************************************/
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "max31790_shm.h"
+
+#define CTL_DEF_SOCKET      "/run/max31790d.sock"
+#define CTL_REPLY_MS        1000
+
+static void ctl_usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-s socket] [-m name] status | watch | send LINE ...\n"
+                    "  status      one cycle of the telemetry page\n"
+                    "  watch       every cycle until interrupted\n"
+                    "  send        e.g. send 'duty 0 1 256' 'rpm 0 3 2400', applied as one batch per chip\n", argv0);
+}
+
+static void ctl_print(const max31790_shm_data_t *data)
+{
+    printf("cycle %u  period %ums  overruns %u  commands %u  rejected %u  writes %u\n",
+           data->cycle, data->period_ms, data->overruns, data->commands, data->rejected, data->writes);
+
+    for(uint8_t x = 0; x < data->n_dev && x < MAX31790_SHM_MAX_DEV; x++)
+    {
+        const max31790_shm_dev_t *dev = &data->dev[x];
+
+        printf("dev %d  port %d adr 0x%02X  %s  faults 0x%03X\n", x, dev->port, dev->adr,
+               dev->rslt ? "stale" : "ok", dev->fault_status);
+        for(uint8_t y = 0; y < NUM_CHANNEL; y++)
+            printf("  ch %d  duty %5.1f%% -> %5.1f%%  rpm %6u  target %6u  fan %2d %6u rpm\n", y + 1,
+                   MAX31790_bits_to_permille(dev->pwm_dutybits[y]) / 10.0, MAX31790_bits_to_permille(dev->target_dutybits[y]) / 10.0,
+                   dev->rpm[y], dev->target_rpm[y], y + 7, dev->rpm[y + NUM_CHANNEL]);
+    }
+}
+
+static int ctl_read(const char *name, bool watch)
+{
+    const max31790_shm_page_t *page = MAX31790_shm_attach(name);
+    max31790_shm_data_t data;
+    uint32_t seq = 0;
+
+    if(!page)
+    {
+        perror(name);
+        return 1;
+    }
+
+    do
+    {
+        while(watch && MAX31790_shm_seq(page) == seq)                                               // A tool may sleep, daemon readers spin or poll
+            usleep(page->data.period_ms * 250);
+
+        seq = MAX31790_shm_seq(page);
+        if(!MAX31790_shm_read(page, &data))
+            continue;
+
+        ctl_print(&data);
+        fflush(stdout);
+    } while(watch);
+
+    MAX31790_shm_detach(page);
+    return 0;
+}
+
+static int ctl_send(const char *path, int argc, char **argv)
+{
+    struct sockaddr_un to = {.sun_family = AF_UNIX};
+    struct sockaddr_un self = {.sun_family = AF_UNIX};
+    char msg[2048] = "";
+    char reply[128];
+    size_t len = 0;
+    ssize_t got = 0;
+    int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+
+    if(sock < 0 || strlen(path) >= sizeof(to.sun_path))
+        return 1;
+
+    for(int x = 0; x < argc; x++)
+        len += snprintf(msg + len, len < sizeof(msg) ? sizeof(msg) - len : 0, "%s\n", argv[x]);
+
+    if(len >= sizeof(msg))
+    {
+        fprintf(stderr, "message too long\n");
+        return 1;
+    }
+
+    strcpy(to.sun_path, path);
+    if(bind(sock, (struct sockaddr *)&self, sizeof(sa_family_t)) != 0 ||                             // Autobind, the daemon needs an address to reply to
+       sendto(sock, msg, len, 0, (struct sockaddr *)&to, sizeof(to)) < 0)
+    {
+        perror(path);
+        close(sock);
+        return 1;
+    }
+
+    if(poll(&pfd, 1, CTL_REPLY_MS) <= 0 || (got = recv(sock, reply, sizeof(reply) - 1, 0)) <= 0)
+    {
+        fprintf(stderr, "no reply from %s\n", path);
+        close(sock);
+        return 1;
+    }
+
+    reply[got] = '\0';
+    fputs(reply, stdout);
+    close(sock);
+
+    return strncmp(reply, "ok", 2) != 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *sock_path = CTL_DEF_SOCKET;
+    const char *shm_name = MAX31790_SHM_DEF_NAME;
+    int x = 1;
+
+    for(; x < argc && argv[x][0] == '-'; x++)
+    {
+        if(!strcmp(argv[x], "-s") && x + 1 < argc)
+            sock_path = argv[++x];
+        else if(!strcmp(argv[x], "-m") && x + 1 < argc)
+            shm_name = argv[++x];
+        else
+            break;
+    }
+
+    if(x < argc && !strcmp(argv[x], "status"))
+        return ctl_read(shm_name, false);
+    if(x < argc && !strcmp(argv[x], "watch"))
+        return ctl_read(shm_name, true);
+    if(x + 1 < argc && !strcmp(argv[x], "send"))
+        return ctl_send(sock_path, argc - x - 1, argv + x + 1);
+
+    ctl_usage(argv[0]);
+    return 2;
+}
@@ -7,9 +7,31 @@ static const char *TAG = "MAIN";
 void test();
 void x_call_fan_con(void *arg);
 
+static const i2cmanager_bus_config_t buses[] =
+{
+   {
+      .port = 0,
+      .sda_io = 25,
+      .scl_io = 26,
+      .clk_hz = 400000,
+      .glitch_cycles = 7,
+      .timeout_ms = 50
+   }
+};
+
+static const i2cmanager_config_t i2c_cfg =
+{
+   .buses = buses,
+   .num_buses = sizeof(buses) / sizeof(buses[0])
+};
+
 max31790_master_config_t cfg =
 {
    .adr = 0x20,
+   .port = 0,
+   .timeout_ms = 20,
+   .retries = 2,
+   .backoff_ms = 1,
    .global_cfg = 0x00,
    .fan_failed_seq_start_cfg = 0x45,
    .fan_cfg[0] = (0xFF & (MAX31790_FAN_CFG_SPIN_UP_0_5 |  MAX31790_FAN_CFG_TACH_INPUT)),
@@ -26,11 +48,16 @@ max31790_master_config_t cfg =
 
 void app_main()
 {
-    I2CMANAGER_initiate();
-    MAX31790_initiate(&cfg);    
+    bool resumed = false;
+
+    I2CMANAGER_initiate(&i2c_cfg);
+    MAX31790_initiate_warm(&cfg, &resumed, NULL);
     
-    MAX31790_set_target_dutybits(0, 222);
-    MAX31790_set_target_duty(1, 22.2f);
+    if(!resumed)                                    // Chip came up from power-on, it has no setpoints worth keeping
+    {
+        MAX31790_set_target_dutybits(&cfg, 0, 222);
+        MAX31790_set_target_duty(&cfg, 1, 22.2f);
+    }
     xTaskCreate(x_call_fan_con, "x_call_fan_con", 2048, NULL, 2, NULL);
 }
 
@@ -47,9 +74,9 @@ void x_call_fan_con(void *arg)
         if(x > 5)
             x = 0;
 
-        MAX31790_get_duty(x, false, &fb);
-        MAX31790_get_dutybits(x, false, &u16b);
-        MAX31790_get_rpm(x, false, &u32b);
+        MAX31790_get_duty(&cfg, x, false, &fb);
+        MAX31790_get_dutybits(&cfg, x, false, &u16b);
+        MAX31790_get_rpm(&cfg, x, false, &u32b);
 
         ESP_LOGD(TAG,"Channel: %d    Duty: %.1f%%    Dutyb: %d    RPM: %d", x, fb, u16b,u32b);
 